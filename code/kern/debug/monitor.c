@@ -4,6 +4,11 @@
 #include <trap.h>
 #include <monitor.h>
 #include <kdebug.h>
+#include <swap.h>
+#include <zswap.h>
+#include <memgroup.h>
+#include <proc.h>
+#include <sched.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -39,6 +44,13 @@ static struct command commands[] = {
         "    'x': the specified debug register(0~3)\n"
         "    @example: delbp 3", mon_delete_dr},
     {"listdr", "List all breakpoints or watchpoints.", mon_list_dr},
+    {"swapinfo", "Display swap usage and readahead statistics.", mon_swapinfo},
+    {"zswap", "Set the size cap of the compressed swap pool.\n"
+        "    'x': the cap in pages, 0 stops compressing swapped out pages\n"
+        "    @example: zswap 256", mon_zswap},
+    {"memgroup", "Display the usage and limits of the memory groups.", mon_memgroup},
+    {"rusage", "Display the memory and page fault counters of the processes.", mon_rusage},
+    {"cpus", "Display the run queues and the load balancing counters of the cpus.", mon_cpus},
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -308,3 +320,50 @@ mon_list_dr(int argc, char **argv, struct trapframe *tf) {
     return 0;
 }
 
+
+/* mon_swapinfo - print the swap usage and readahead statistics */
+int
+mon_swapinfo(int argc, char **argv, struct trapframe *tf) {
+    print_swapinfo();
+    return 0;
+}
+
+/* mon_zswap - set the size cap of the compressed swap pool */
+int
+mon_zswap(int argc, char **argv, struct trapframe *tf) {
+    if (argc != 1) {
+        cprintf("zswap: need the cap in pages.\n");
+        return 0;
+    }
+    char *endptr;
+    long max_pages = strtol(argv[0], &endptr, 10);
+    if (*endptr != '\0' || max_pages < 0) {
+        cprintf("unknow parameter(s): [%d] %s\n", 0, argv[0]);
+        return 0;
+    }
+    zswap_set_max_pages(max_pages);
+    print_zswapinfo();
+    return 0;
+}
+
+/* mon_memgroup - print the usage and limits of the memory groups */
+int
+mon_memgroup(int argc, char **argv, struct trapframe *tf) {
+    print_memgroupinfo();
+    return 0;
+}
+
+/* mon_rusage - print the memory and page fault counters of the processes */
+int
+mon_rusage(int argc, char **argv, struct trapframe *tf) {
+    print_rusage();
+    return 0;
+}
+
+/* mon_cpus - print the run queues and the load balancing counters of the cpus */
+int
+mon_cpus(int argc, char **argv, struct trapframe *tf) {
+    print_schedinfo();
+    return 0;
+}
+
@@ -14,6 +14,11 @@ int mon_breakpoint(int argc, char **argv, struct trapframe *tf);
 int mon_watchpoint(int argc, char **argv, struct trapframe *tf);
 int mon_delete_dr(int argc, char **argv, struct trapframe *tf);
 int mon_list_dr(int argc, char **argv, struct trapframe *tf);
+int mon_swapinfo(int argc, char **argv, struct trapframe *tf);
+int mon_zswap(int argc, char **argv, struct trapframe *tf);
+int mon_memgroup(int argc, char **argv, struct trapframe *tf);
+int mon_rusage(int argc, char **argv, struct trapframe *tf);
+int mon_cpus(int argc, char **argv, struct trapframe *tf);
 
 #endif /* !__KERN_DEBUG_MONITOR_H__ */
 
@@ -0,0 +1,183 @@
+#include <types.h>
+#include <stdio.h>
+#include <assert.h>
+#include <pmm.h>
+#include <proc.h>
+#include <picirq.h>
+#include <mp.h>
+#include <apic.h>
+#include <sync.h>
+#include <x86.h>
+#include <trap.h>
+#include <clock.h>
+
+/* *
+ * The local APIC of each cpu and the I/O APIC which routes the device interrupts
+ * to them. The interrupts are still delivered by the 8259A, through LINT0 of the
+ * BSP in the virtual wire mode the BIOS sets up: lapic_init only maps the local
+ * APIC to identify the cpus, and ioapic_init masks all the inputs of the I/O APIC
+ * so no interrupt comes twice. The local APIC timer is a clock event device of
+ * clock.c, one-shot on the vector of IRQ_TIMER. The APs get no device interrupt,
+ * only their timers and the IPIs.
+ * */
+
+#define CMOS_PORT               0x70            // the CMOS RAM, the shutdown code is at 0x0F
+#define CMOS_SHUTDOWN_JMP       0x0A            // jump to the warm reset vector on reset
+#define WARM_RESET_VECTOR       0x467           // the far pointer the BIOS jumps to
+
+// the registers of the I/O APIC
+#define IOAPIC_REGSEL           0x00            // index of the register, in bytes
+#define IOAPIC_WIN              0x10            // data of the register, in bytes
+
+#define IOAPIC_ID               0x00            // ID
+#define IOAPIC_VER              0x01            // Version, the max redirection entry
+#define IOAPIC_REDTBL           0x10            // Redirection table, two per entry
+
+#define IOAPIC_INT_DISABLED     0x00010000      // Interrupt masked
+
+// the local APIC registers, NULL if there is no local APIC
+volatile uint32_t *lapic = NULL;
+
+static volatile uint8_t *ioapic = NULL;
+
+void
+lapic_init(void) {
+    if (lapic_pa == 0) {
+        return ;
+    }
+    lapic = mmio_map(lapic_pa, PGSIZE);
+    if (lapic_id() != cpus[0].apicid) {
+        warn("lapic: bsp apic id %d, %d in the MP table.\n", lapic_id(), cpus[0].apicid);
+        cpus[0].apicid = lapic_id();
+    }
+    cprintf("lapic: id %d, version 0x%x, %s.\n", lapic_id(), lapic[LAPIC_VER] & 0xFF,
+            (lapic[LAPIC_SVR] & LAPIC_SVR_ENABLE) ? "enabled" : "disabled");
+}
+
+// lapic_timer_start - interrupt once after count bus cycles / 16, 0 stops the timer
+void
+lapic_timer_start(uint32_t count) {
+    lapic[LAPIC_TDCR] = LAPIC_X16;
+    lapic[LAPIC_TIMER] = ((count == 0) ? LAPIC_MASKED : 0) | (IRQ_OFFSET + IRQ_TIMER);
+    lapic[LAPIC_TICR] = count;
+}
+
+uint32_t
+lapic_timer_count(void) {
+    return lapic[LAPIC_TCCR];
+}
+
+void
+lapic_eoi(void) {
+    lapic[LAPIC_EOI] = 0;
+}
+
+// lapic_wait_icr - wait until the local APIC has sent the last interrupt command
+static void
+lapic_wait_icr(void) {
+    while (lapic[LAPIC_ICRLO] & LAPIC_DELIVS) {
+        asm volatile ("pause");
+    }
+}
+
+// lapic_ipi - send the interrupt vector to the cpu of the local APIC apicid
+void
+lapic_ipi(int apicid, int vector) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        lapic_wait_icr();
+        lapic[LAPIC_ICRHI] = apicid << 24;
+        lapic[LAPIC_ICRLO] = LAPIC_FIXED | vector;
+        lapic_wait_icr();
+    }
+    local_intr_restore(intr_flag);
+}
+
+// lapic_init_ap - enable the local APIC of the running AP: LINT0 and LINT1 are
+//               - masked, the virtual wire of the 8259A goes to the BSP only
+void
+lapic_init_ap(void) {
+    lapic[LAPIC_SVR] = LAPIC_SVR_ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS);
+    lapic[LAPIC_LINT0] = LAPIC_MASKED;
+    lapic[LAPIC_LINT1] = LAPIC_MASKED;
+    lapic_timer_start(0);
+    // clear the errors, the register is written before it's read
+    lapic[LAPIC_ESR] = 0;
+    lapic[LAPIC_ESR] = 0;
+    lapic[LAPIC_EOI] = 0;
+    lapic[LAPIC_TPR] = 0;
+}
+
+// lapic_udelay - spin for usec microseconds
+static void
+lapic_udelay(uint32_t usec) {
+    uint64_t deadline = clock_read() + (uint64_t)usec * 1000;
+    while (clock_read() < deadline) {
+        asm volatile ("pause");
+    }
+}
+
+/* *
+ * lapic_startap - start the AP of apicid at the physical address addr (page
+ * aligned, below 1M) in real mode, by the INIT-SIPI-SIPI sequence of the MP
+ * specification. The warm reset vector is set as well, for the old cpus which
+ * take INIT as a reset and go through the BIOS.
+ * */
+void
+lapic_startap(int apicid, uintptr_t addr) {
+    assert(addr % PGSIZE == 0 && addr < 0x100000);
+    outb(CMOS_PORT, 0x0F);
+    outb(CMOS_PORT + 1, CMOS_SHUTDOWN_JMP);
+    uint16_t *wrv = KADDR(WARM_RESET_VECTOR);
+    wrv[0] = 0;
+    wrv[1] = addr >> 4;
+
+    lapic_wait_icr();
+    lapic[LAPIC_ICRHI] = apicid << 24;
+    lapic[LAPIC_ICRLO] = LAPIC_INIT | LAPIC_LEVEL | LAPIC_ASSERT;
+    lapic_udelay(200);
+    lapic[LAPIC_ICRLO] = LAPIC_INIT | LAPIC_LEVEL;
+    lapic_udelay(10000);
+
+    // twice, the first one may be lost
+    int i;
+    for (i = 0; i < 2; i ++) {
+        lapic_wait_icr();
+        lapic[LAPIC_ICRHI] = apicid << 24;
+        lapic[LAPIC_ICRLO] = LAPIC_STARTUP | (addr >> 12);
+        lapic_udelay(200);
+    }
+}
+
+static uint32_t
+ioapic_read(int reg) {
+    *(volatile uint32_t *)(ioapic + IOAPIC_REGSEL) = reg;
+    return *(volatile uint32_t *)(ioapic + IOAPIC_WIN);
+}
+
+static void
+ioapic_write(int reg, uint32_t data) {
+    *(volatile uint32_t *)(ioapic + IOAPIC_REGSEL) = reg;
+    *(volatile uint32_t *)(ioapic + IOAPIC_WIN) = data;
+}
+
+void
+ioapic_init(void) {
+    if (ioapic_pa == 0) {
+        return ;
+    }
+    ioapic = mmio_map(ioapic_pa, PGSIZE);
+    int id = (ioapic_read(IOAPIC_ID) >> 24) & 0x0F;
+    int i, maxintr = (ioapic_read(IOAPIC_VER) >> 16) & 0xFF;
+    if (id != ioapic_id) {
+        warn("ioapic: id %d, %d in the MP table.\n", id, ioapic_id);
+    }
+    // mask all, edge-triggered, active high, to the vector of the same irq
+    for (i = 0; i <= maxintr; i ++) {
+        ioapic_write(IOAPIC_REDTBL + 2 * i, IOAPIC_INT_DISABLED | (IRQ_OFFSET + i));
+        ioapic_write(IOAPIC_REDTBL + 2 * i + 1, 0);
+    }
+    cprintf("ioapic: id %d, %d inputs masked.\n", id, maxintr + 1);
+}
+
@@ -0,0 +1,49 @@
+#ifndef __KERN_DRIVER_APIC_H__
+#define __KERN_DRIVER_APIC_H__
+
+#include <types.h>
+
+extern volatile uint32_t *lapic;
+
+void lapic_init(void);
+void lapic_init_ap(void);
+void lapic_startap(int apicid, uintptr_t addr);
+void lapic_timer_start(uint32_t count);
+uint32_t lapic_timer_count(void);
+void lapic_eoi(void);
+void lapic_ipi(int apicid, int vector);
+void ioapic_init(void);
+
+// the registers of the local APIC, indexed in 32-bit words
+#define LAPIC_ID                (0x0020 / 4)    // ID
+#define LAPIC_VER               (0x0030 / 4)    // Version
+#define LAPIC_TPR               (0x0080 / 4)    // Task Priority
+#define LAPIC_SVR               (0x00F0 / 4)    // Spurious Interrupt Vector
+#define LAPIC_SVR_ENABLE        0x00000100      // APIC software enabled
+#define LAPIC_EOI               (0x00B0 / 4)    // EOI
+#define LAPIC_ESR               (0x0280 / 4)    // Error Status
+#define LAPIC_ICRLO             (0x0300 / 4)    // Interrupt Command
+#define LAPIC_FIXED             0x00000000      // deliver the vector
+#define LAPIC_INIT              0x00000500      // INIT/RESET
+#define LAPIC_STARTUP           0x00000600      // Startup IPI
+#define LAPIC_ASSERT            0x00004000      // Assert interrupt (vs deassert)
+#define LAPIC_LEVEL             0x00008000      // Level triggered
+#define LAPIC_DELIVS            0x00001000      // Delivery status
+#define LAPIC_ICRHI             (0x0310 / 4)    // Interrupt Command [63:32], the destination
+#define LAPIC_TIMER             (0x0320 / 4)    // Local Vector Table 0 (TIMER)
+#define LAPIC_MASKED            0x00010000      // Interrupt masked
+#define LAPIC_LINT0             (0x0350 / 4)    // Local Vector Table 1 (LINT0)
+#define LAPIC_LINT1             (0x0360 / 4)    // Local Vector Table 2 (LINT1)
+#define LAPIC_TICR              (0x0380 / 4)    // Timer Initial Count
+#define LAPIC_TCCR              (0x0390 / 4)    // Timer Current Count
+#define LAPIC_TDCR              (0x03E0 / 4)    // Timer Divide Configuration
+#define LAPIC_X16               0x00000003      // divide counts by 16
+
+/* lapic_id - the local APIC id of the running cpu, 0 if there is no local APIC */
+static inline int
+lapic_id(void) {
+    return (lapic == NULL) ? 0 : (lapic[LAPIC_ID] >> 24);
+}
+
+#endif /* !__KERN_DRIVER_APIC_H__ */
+
@@ -2,44 +2,220 @@
 #include <trap.h>
 #include <stdio.h>
 #include <picirq.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <assert.h>
+#include <apic.h>
+#include <clock.h>
 
 /* *
  * Support for time-related hardware gadgets - the 8253 timer,
- * which generates interruptes on IRQ-0.
+ * which generates interruptes on IRQ-0, and the local APIC timer.
+ *
+ * The time is read from the TSC, calibrated against counter 2 of the 8253 at
+ * boot. There is no periodic interrupt: the clock event device is set to the
+ * next time the scheduler asks for, the next timer or the next tick if a proc
+ * is running, so the ticks stop when the cpu is idle. 'ticks' is brought up
+ * to date by clock_read. Each cpu sets its own local APIC timer; the APs are
+ * started only if the clock event device is the local APIC timer.
  * */
 
 #define IO_TIMER1           0x040               // 8253 Timer #1
+#define IO_PPI              0x061               // 8255 port B
 
 /* *
- * Frequency of all three count-down timers; (TIMER_FREQ/freq)
- * is the appropriate count to generate a frequency of freq Hz.
+ * Frequency of all three count-down timers is TIMER_FREQ (clock.h);
+ * (TIMER_FREQ/freq) is the appropriate count to generate a frequency of freq Hz.
  * */
 
-#define TIMER_FREQ      1193182
-#define TIMER_DIV(x)    ((TIMER_FREQ + (x) / 2) / (x))
-
+#define TIMER_CNTR0     (IO_TIMER1 + 0)         // timer counter 0 port
+#define TIMER_CNTR2     (IO_TIMER1 + 2)         // timer counter 2 port
 #define TIMER_MODE      (IO_TIMER1 + 3)         // timer mode port
 #define TIMER_SEL0      0x00                    // select counter 0
-#define TIMER_RATEGEN   0x04                    // mode 2, rate generator
+#define TIMER_SEL2      0x80                    // select counter 2
+#define TIMER_INTTC     0x00                    // mode 0, intr on terminal cnt
 #define TIMER_16BIT     0x30                    // r/w counter 16 bits, LSB first
 
+#define PPI_GATE2       0x01                    // the gate of counter 2
+#define PPI_SPKR        0x02                    // the speaker data
+#define PPI_OUT2        0x20                    // the output of counter 2
+
+#define CALIBRATE_MSEC  10                      // the time the tsc is counted at boot
+#define TSC_SHIFT       22                      // the fraction bits of tsc_mult
+#define CLOCK_MIN_DELTA 10000                   // the earliest event, in ns
+#define LAPIC_MAX_DELTA NSEC_PER_SEC            // the latest event of the local APIC timer
+
+// ns * xxx_mult >> 32 is the count of a clock event device for ns
+#define PIT_MULT        ((uint32_t)(((uint64_t)TIMER_FREQ << 32) / NSEC_PER_SEC))
+
 volatile size_t ticks;
 
+static uint32_t tsc_mult;                       // ns per tsc cycle << TSC_SHIFT
+static uint64_t tsc_base, nsec_base;            // the tsc and the time of the last rebase
+static spinlock_t clock_lock;                   // protects the rebase
+static uint32_t lapic_mult;
+
+static struct clock_event *clock_event;
+static uint64_t event_deadline[NCPU];           // the time the device of each cpu is set to
+
+static void
+pit_set_next(uint64_t delta) {
+    uint32_t count = (delta * PIT_MULT) >> 32;
+    if (count == 0) {
+        count = 1;
+    }
+    outb(TIMER_MODE, TIMER_SEL0 | TIMER_INTTC | TIMER_16BIT);
+    outb(TIMER_CNTR0, count % 256);
+    outb(TIMER_CNTR0, count / 256);
+}
+
+static struct clock_event pit_clock_event = {
+    .name = "8253",
+    .max_delta = (uint64_t)0xFFFF * NSEC_PER_SEC / TIMER_FREQ,
+    .set_next = pit_set_next,
+    .ack = NULL,
+};
+
+static void
+lapic_set_next(uint64_t delta) {
+    uint32_t count = (delta * lapic_mult) >> 32;
+    lapic_timer_start((count == 0) ? 1 : count);
+}
+
+static struct clock_event lapic_clock_event = {
+    .name = "lapic",
+    .max_delta = LAPIC_MAX_DELTA,
+    .set_next = lapic_set_next,
+    .ack = lapic_eoi,
+};
+
+/* *
+ * clock_calibrate - count the cycles of the tsc, and of the local APIC timer if
+ * lapic_timer is set, in CALIBRATE_MSEC ms timed by counter 2 of the 8253
+ * */
+static void
+clock_calibrate(uint64_t *tsc_store, uint32_t *lapic_store, bool lapic_timer) {
+    uint32_t latch = TIMER_FREQ / (1000 / CALIBRATE_MSEC);
+    outb(IO_PPI, (inb(IO_PPI) & ~PPI_SPKR) | PPI_GATE2);
+    outb(TIMER_MODE, TIMER_SEL2 | TIMER_INTTC | TIMER_16BIT);
+    outb(TIMER_CNTR2, latch % 256);
+    outb(TIMER_CNTR2, latch / 256);
+    if (lapic_timer) {
+        lapic_timer_start(~0);
+    }
+    uint64_t tsc = read_tsc();
+    while (!(inb(IO_PPI) & PPI_OUT2)) {
+        /* do nothing */;
+    }
+    *tsc_store = read_tsc() - tsc;
+    *lapic_store = 0;
+    if (lapic_timer) {
+        *lapic_store = ~0 - lapic_timer_count();
+        lapic_timer_start(0);
+    }
+}
+
 /* *
- * clock_init - initialize 8253 clock to interrupt 100 times per second,
- * and then enable IRQ_TIMER.
+ * clock_init - calibrate the tsc, pick the clock event device, the local APIC
+ * timer if the local APIC is enabled, otherwise the 8253, and enable IRQ_TIMER.
  * */
 void
 clock_init(void) {
-    // set 8253 timer-chip
-    outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
-    outb(IO_TIMER1, TIMER_DIV(100) % 256);
-    outb(IO_TIMER1, TIMER_DIV(100) / 256);
+    bool lapic_timer = (lapic != NULL && (lapic[LAPIC_SVR] & LAPIC_SVR_ENABLE));
+    uint64_t tsc_cycles, khz;
+    uint32_t lapic_cycles;
+    clock_calibrate(&tsc_cycles, &lapic_cycles, lapic_timer);
+
+    khz = tsc_cycles;
+    do_div(khz, CALIBRATE_MSEC);
+    if (khz == 0 || (khz >> 32) != 0) {
+        panic("clock: tsc counted %d cycles in %d ms.\n", (uint32_t)tsc_cycles, CALIBRATE_MSEC);
+    }
+    uint64_t mult = (uint64_t)1000000 << TSC_SHIFT;
+    do_div(mult, (uint32_t)khz);
+    tsc_mult = mult;
+    tsc_base = read_tsc(), nsec_base = 0;
+
+    spinlock_init(&clock_lock);
 
     // initialize time counter 'ticks' to zero
     ticks = 0;
 
-    cprintf("++ setup timer interrupts\n");
-    pic_enable(IRQ_TIMER);
+    clock_event = &pit_clock_event;
+    if (lapic_timer && lapic_cycles != 0) {
+        mult = (uint64_t)lapic_cycles * (1000 / CALIBRATE_MSEC) << 32;
+        do_div(mult, NSEC_PER_SEC);
+        if (mult != 0 && (mult >> 32) == 0) {
+            lapic_mult = mult;
+            clock_event = &lapic_clock_event;
+        }
+    }
+    cprintf("++ setup timer interrupts: tsc %d kHz, %s clock event\n", (uint32_t)khz, clock_event->name);
+
+    clock_set_event(TICK_NSEC);
+    if (clock_event == &pit_clock_event) {
+        pic_enable(IRQ_TIMER);
+    }
+}
+
+/* *
+ * clock_read - the ns since clock_init, and brings 'ticks' up to date. The tsc
+ * cycles are converted from the last rebase, which is done every 2^32 cycles,
+ * so the product never overflows and no fraction of a ns is lost often.
+ * */
+uint64_t
+clock_read(void) {
+    uint64_t now;
+    bool intr_flag;
+    spin_lock_irqsave(&clock_lock, intr_flag);
+    {
+        uint64_t delta = read_tsc() - tsc_base;
+        now = nsec_base + ((delta * tsc_mult) >> TSC_SHIFT);
+        if ((delta >> 32) != 0) {
+            tsc_base += delta, nsec_base = now;
+        }
+        uint64_t nticks = now;
+        do_div(nticks, TICK_NSEC);
+        ticks = nticks;
+    }
+    spin_unlock_irqrestore(&clock_lock, intr_flag);
+    return now;
+}
+
+// clock_set_event - interrupt at the time deadline, or as close as the device can
+void
+clock_set_event(uint64_t deadline) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    if (clock_event != NULL) {
+        uint64_t now = clock_read(), *cpu_deadline = &event_deadline[mycpu()->id];
+        if (deadline != *cpu_deadline || *cpu_deadline <= now) {
+            uint64_t delta = (deadline > now) ? deadline - now : 0;
+            if (delta < CLOCK_MIN_DELTA) {
+                delta = CLOCK_MIN_DELTA;
+            }
+            if (delta > clock_event->max_delta) {
+                delta = clock_event->max_delta;
+            }
+            clock_event->set_next(delta);
+            *cpu_deadline = now + delta;
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+// clock_per_cpu - the clock event device is the local APIC timer of each cpu
+bool
+clock_per_cpu(void) {
+    return clock_event == &lapic_clock_event;
+}
+
+// clock_ack - acknowledge the interrupt of the clock event device
+void
+clock_ack(void) {
+    if (clock_event != NULL && clock_event->ack != NULL) {
+        clock_event->ack();
+    }
 }
 
@@ -3,9 +3,30 @@
 
 #include <types.h>
 
+// the 8253 counts at TIMER_FREQ Hz, ticks counts TICK_HZ times per second
+#define TIMER_FREQ                  1193182
+#define TICK_HZ                     100
+#define NSEC_PER_SEC                1000000000
+#define TICK_NSEC                   (NSEC_PER_SEC / TICK_HZ)
+
+/* *
+ * A clock event device interrupts on IRQ_TIMER once, at the time it is set to:
+ * the 8253 counter 0, or the local APIC timer.
+ * */
+struct clock_event {
+    const char *name;
+    uint64_t max_delta;                 // the longest time it can be set to, in ns
+    void (*set_next)(uint64_t delta);   // interrupt once after delta ns
+    void (*ack)(void);                  // acknowledge the interrupt, NULL if not needed
+};
+
 extern volatile size_t ticks;
 
 void clock_init(void);
+uint64_t clock_read(void);
+void clock_set_event(uint64_t deadline);
+void clock_ack(void);
+bool clock_per_cpu(void);
 
 #endif /* !__KERN_DRIVER_CLOCK_H__ */
 
@@ -7,6 +7,7 @@
 #include <trap.h>
 #include <memlayout.h>
 #include <sync.h>
+#include <spinlock.h>
 
 /* stupid I/O delay routine necessitated by historical PC design flaws */
 static void
@@ -213,6 +214,9 @@ static struct {
     uint32_t wpos;
 } cons;
 
+// the cpus print and poll the devices one at a time
+static spinlock_t cons_lock;
+
 /* *
  * cons_intr - called by device interrupt routines to feed input
  * characters into the circular console input buffer.
@@ -414,6 +418,7 @@ kbd_init(void) {
 /* cons_init - initializes the console devices */
 void
 cons_init(void) {
+    spinlock_init(&cons_lock);
     cga_init();
     serial_init();
     kbd_init();
@@ -426,13 +431,13 @@ cons_init(void) {
 void
 cons_putc(int c) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&cons_lock, intr_flag);
     {
         lpt_putc(c);
         cga_putc(c);
         serial_putc(c);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&cons_lock, intr_flag);
 }
 
 /* *
@@ -443,7 +448,7 @@ int
 cons_getc(void) {
     int c = 0;
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&cons_lock, intr_flag);
     {
         // poll for any pending input characters,
         // so that this function works even when interrupts are disabled
@@ -459,7 +464,7 @@ cons_getc(void) {
             }
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&cons_lock, intr_flag);
     return c;
 }
 
@@ -6,6 +6,8 @@
 #include <ide.h>
 #include <x86.h>
 #include <sem.h>
+#include <sync.h>
+#include <spinlock.h>
 #include <assert.h>
 
 #define ISA_DATA                0x00
@@ -43,19 +45,33 @@
 #define IO_CTRL1                0x374
 
 #define MAX_IDE                 4
-#define MAX_NSECS               128
 #define MAX_DISK_NSECS          0x10000000U
 #define VALID_IDE(ideno)        (((ideno) >= 0) && ((ideno) < MAX_IDE) && (ide_devices[ideno].valid))
 
+/* *
+ * A channel is held by one command at a time. The synchronous reads and writes
+ * take it with down() and poll the drive until they are done. The asynchronous
+ * reads and writes wait in the queue of the channel, the first one takes the
+ * channel as soon as it's free, and the interrupt handler moves the data sector
+ * by sector, calls the completion and passes the channel on. The waiters of the semaphore
+ * go before the queue, a fault reading swap shouldn't wait for the writeback.
+ * The queue and the request holding the channel are under the lock of the
+ * channel, the interrupt may come on another cpu than the one queueing.
+ * */
 static struct {
     const unsigned short base;  // I/O Base
     const unsigned short ctrl;  // Control Base
     semaphore_t sem;
+    spinlock_t lock;            // protects queue and cur
+    list_entry_t queue;         // the asynchronous requests waiting for the channel
+    struct ide_request *cur;    // the asynchronous request holding the channel
 } channels[2] = {
     {IO_BASE0, IO_CTRL0},
     {IO_BASE1, IO_CTRL1},
 };
 
+static void ide_kick(int chan);
+
 static void
 lock_channel(unsigned short ideno) {
     down(&(channels[ideno >> 1].sem));
@@ -63,7 +79,14 @@ lock_channel(unsigned short ideno) {
 
 static void
 unlock_channel(unsigned short ideno) {
-    up(&(channels[ideno >> 1].sem));
+    int chan = ideno >> 1;
+    bool intr_flag;
+    spin_lock_irqsave(&(channels[chan].lock), intr_flag);
+    {
+        up(&(channels[chan].sem));
+        ide_kick(chan);
+    }
+    spin_unlock_irqrestore(&(channels[chan].lock), intr_flag);
 }
 
 #define IO_BASE(ideno)          (channels[(ideno) >> 1].base)
@@ -152,8 +175,13 @@ ide_init(void) {
     pic_enable(IRQ_IDE1);
     pic_enable(IRQ_IDE2);
 
-    sem_init(&(channels[0].sem), 1);
-    sem_init(&(channels[1].sem), 1);
+    int chan;
+    for (chan = 0; chan < 2; chan ++) {
+        sem_init(&(channels[chan].sem), 1);
+        spinlock_init(&(channels[chan].lock));
+        list_init(&(channels[chan].queue));
+        channels[chan].cur = NULL;
+    }
 }
 
 bool
@@ -169,14 +197,12 @@ ide_device_size(unsigned short ideno) {
     return 0;
 }
 
-int
-ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
-    assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-    assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
+// ide_command - send a read/write command of nsecs sectors from secno to the
+//             - drive, the channel is held by the caller
+static void
+ide_command(unsigned short ideno, uint32_t secno, size_t nsecs, int cmd) {
     unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
 
-    lock_channel(ideno);
-
     ide_wait_ready(iobase, 0);
 
     // generate interrupt
@@ -186,14 +212,32 @@ ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
     outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
     outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
     outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_READ);
+    outb(iobase + ISA_COMMAND, cmd);
+}
+
+// ide_read_secsv - read nbufs * buf_nsecs sectors from secno in one command,
+//                - the i-th buf_nsecs sectors go to bufs[i]
+int
+ide_read_secsv(unsigned short ideno, uint32_t secno, void *bufs[], size_t nbufs, size_t buf_nsecs) {
+    size_t nsecs = nbufs * buf_nsecs;
+    assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
+    assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
+    unsigned short iobase = IO_BASE(ideno);
+
+    lock_channel(ideno);
+
+    ide_command(ideno, secno, nsecs, IDE_CMD_READ);
 
     int ret = 0;
-    for (; nsecs > 0; nsecs --, dst += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+    size_t i, j;
+    for (i = 0; i < nbufs; i ++) {
+        void *dst = bufs[i];
+        for (j = 0; j < buf_nsecs; j ++, dst += SECTSIZE) {
+            if ((ret = ide_wait_ready(iobase, 1)) != 0) {
+                goto out;
+            }
+            insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
         }
-        insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
     }
 
 out:
@@ -201,31 +245,29 @@ out:
     return ret;
 }
 
+// ide_write_secsv - write nbufs * buf_nsecs sectors to secno in one command,
+//                 - the i-th buf_nsecs sectors come from bufs[i]
 int
-ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
+ide_write_secsv(unsigned short ideno, uint32_t secno, const void *bufs[], size_t nbufs, size_t buf_nsecs) {
+    size_t nsecs = nbufs * buf_nsecs;
     assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
     assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+    unsigned short iobase = IO_BASE(ideno);
 
     lock_channel(ideno);
 
-    ide_wait_ready(iobase, 0);
-
-    // generate interrupt
-    outb(ioctrl + ISA_CTRL, 0);
-    outb(iobase + ISA_SECCNT, nsecs);
-    outb(iobase + ISA_SECTOR, secno & 0xFF);
-    outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-    outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-    outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_WRITE);
+    ide_command(ideno, secno, nsecs, IDE_CMD_WRITE);
 
     int ret = 0;
-    for (; nsecs > 0; nsecs --, src += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+    size_t i, j;
+    for (i = 0; i < nbufs; i ++) {
+        const void *src = bufs[i];
+        for (j = 0; j < buf_nsecs; j ++, src += SECTSIZE) {
+            if ((ret = ide_wait_ready(iobase, 1)) != 0) {
+                goto out;
+            }
+            outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
         }
-        outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
     }
 
 out:
@@ -233,3 +275,139 @@ out:
     return ret;
 }
 
+// ide_request_sector - the address of the i-th sector of req
+static inline void *
+ide_request_sector(struct ide_request *req, size_t i) {
+    return req->bufs[i / req->buf_nsecs] + (i % req->buf_nsecs) * SECTSIZE;
+}
+
+// ide_end_request - the request holding channel chan is over, pass the channel
+//                 - on. called with the lock of the channel held.
+static void
+ide_end_request(int chan, int error) {
+    struct ide_request *req = channels[chan].cur;
+    channels[chan].cur = NULL;
+    req->complete(req, error);
+    up(&(channels[chan].sem));
+    ide_kick(chan);
+}
+
+// ide_kick - start the first queued request if channel chan is free. the drive
+//          - asks for the first sector of a write at once, the others by
+//          - interrupts; each sector read comes by an interrupt.
+//          - called with the lock of the channel held.
+static void
+ide_kick(int chan) {
+    if (channels[chan].cur != NULL || list_empty(&(channels[chan].queue))) {
+        return ;
+    }
+    if (!try_down(&(channels[chan].sem))) {
+        return ;
+    }
+    struct ide_request *req = le2ireq(list_next(&(channels[chan].queue)), link);
+    list_del(&(req->link));
+    channels[chan].cur = req;
+
+    unsigned short iobase = IO_BASE(req->ideno);
+    req->done = 0;
+    if (!req->write) {
+        ide_command(req->ideno, req->secno, req->nbufs * req->buf_nsecs, IDE_CMD_READ);
+        return ;
+    }
+    ide_command(req->ideno, req->secno, req->nbufs * req->buf_nsecs, IDE_CMD_WRITE);
+    if (ide_wait_ready(iobase, 1) != 0) {
+        ide_end_request(chan, -1);
+        return ;
+    }
+    outsl(iobase, ide_request_sector(req, 0), SECTSIZE / sizeof(uint32_t));
+    req->done = 1;
+}
+
+// ide_queue_request - queue req and return at once, see struct ide_request
+static int
+ide_queue_request(struct ide_request *req) {
+    size_t nsecs = req->nbufs * req->buf_nsecs;
+    assert(nsecs > 0 && nsecs <= MAX_NSECS && VALID_IDE(req->ideno));
+    assert(req->secno < MAX_DISK_NSECS && req->secno + nsecs <= MAX_DISK_NSECS);
+    assert(req->complete != NULL);
+
+    int chan = req->ideno >> 1;
+    bool intr_flag;
+    spin_lock_irqsave(&(channels[chan].lock), intr_flag);
+    {
+        list_add_before(&(channels[chan].queue), &(req->link));
+        ide_kick(chan);
+    }
+    spin_unlock_irqrestore(&(channels[chan].lock), intr_flag);
+    return 0;
+}
+
+// ide_read_secsv_async - queue the read of req and return at once
+int
+ide_read_secsv_async(struct ide_request *req) {
+    req->write = 0;
+    return ide_queue_request(req);
+}
+
+// ide_write_secsv_async - queue the write of req and return at once
+int
+ide_write_secsv_async(struct ide_request *req) {
+    req->write = 1;
+    return ide_queue_request(req);
+}
+
+// ide_intr - the interrupt of an IDE channel. if an asynchronous request holds
+//   it, move the next sector when the drive is ready for it (DRQ), or complete
+//   the request when all sectors are moved. the status decides, not the count
+//   of interrupts: the last one of a synchronous command may come late.
+void
+ide_intr(int irq) {
+    int chan = (irq == IRQ_IDE1) ? 0 : 1;
+    spin_lock(&(channels[chan].lock));
+    struct ide_request *req = channels[chan].cur;
+    if (req == NULL) {
+        // a synchronous command polls the drive itself
+        goto out;
+    }
+    unsigned short iobase = IO_BASE(req->ideno);
+    int r = inb(iobase + ISA_STATUS);
+    if (r & IDE_BSY) {
+        goto out;
+    }
+    if (r & (IDE_DF | IDE_ERR)) {
+        ide_end_request(chan, -1);
+        goto out;
+    }
+    if (!req->write) {
+        if (r & IDE_DRQ) {
+            insl(iobase, ide_request_sector(req, req->done), SECTSIZE / sizeof(uint32_t));
+            if (++ req->done == req->nbufs * req->buf_nsecs) {
+                ide_end_request(chan, 0);
+            }
+        }
+        goto out;
+    }
+    if (req->done < req->nbufs * req->buf_nsecs) {
+        if (r & IDE_DRQ) {
+            outsl(iobase, ide_request_sector(req, req->done), SECTSIZE / sizeof(uint32_t));
+            req->done ++;
+        }
+        goto out;
+    }
+    if (!(r & IDE_DRQ)) {
+        ide_end_request(chan, 0);
+    }
+out:
+    spin_unlock(&(channels[chan].lock));
+}
+
+int
+ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
+    return ide_read_secsv(ideno, secno, &dst, 1, nsecs);
+}
+
+int
+ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
+    return ide_write_secsv(ideno, secno, &src, 1, nsecs);
+}
+
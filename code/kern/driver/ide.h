@@ -2,6 +2,27 @@
 #define __KERN_DRIVER_IDE_H__
 
 #include <types.h>
+#include <list.h>
+
+#define MAX_NSECS               128     // max sectors per read/write command
+
+// an asynchronous read or write of nbufs * buf_nsecs sectors, the i-th
+// buf_nsecs sectors go to or come from bufs[i]. the buffers must stay until
+// complete is called.
+struct ide_request {
+    unsigned short ideno;
+    uint32_t secno;
+    void **bufs;
+    size_t nbufs, buf_nsecs;
+    bool write;
+    size_t done;                // the number of sectors sent to or read from the drive
+    // called by the interrupt handler, error is 0 on success or -1
+    void (*complete)(struct ide_request *req, int error);
+    list_entry_t link;          // link in the queue of the channel
+};
+
+#define le2ireq(le, member)                 \
+    to_struct((le), struct ide_request, member)
 
 void ide_init(void);
 bool ide_device_valid(unsigned short ideno);
@@ -9,6 +30,11 @@ size_t ide_device_size(unsigned short ideno);
 
 int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs);
 int ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs);
+int ide_read_secsv(unsigned short ideno, uint32_t secno, void *bufs[], size_t nbufs, size_t buf_nsecs);
+int ide_write_secsv(unsigned short ideno, uint32_t secno, const void *bufs[], size_t nbufs, size_t buf_nsecs);
+int ide_read_secsv_async(struct ide_request *req);
+int ide_write_secsv_async(struct ide_request *req);
+void ide_intr(int irq);
 
 #endif /* !__KERN_DRIVER_IDE_H__ */
 
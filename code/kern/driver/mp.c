@@ -0,0 +1,251 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <proc.h>
+#include <clock.h>
+#include <apic.h>
+#include <x86.h>
+#include <mp.h>
+
+/* *
+ * The MultiProcessor Specification 1.4: the BIOS leaves a floating pointer
+ * structure in the first KB of the EBDA, the last KB of the base memory or
+ * the BIOS ROM, which points to the configuration table listing the processors,
+ * the buses and the I/O APICs of the machine.
+ * */
+
+// the floating pointer structure
+struct mp {
+    uint8_t signature[4];           // "_MP_"
+    uint32_t physaddr;              // the physical address of the configuration table
+    uint8_t length;                 // in 16 bytes, 1
+    uint8_t specrev;                // 1 or 4
+    uint8_t checksum;               // all bytes must add up to 0
+    uint8_t type;                   // the default configuration type, 0 if there is a table
+    uint8_t imcrp;                  // the IMCR is present, the PIC mode is implemented
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+// the header of the configuration table
+struct mpconf {
+    uint8_t signature[4];           // "PCMP"
+    uint16_t length;                // the size of the base table
+    uint8_t version;                // 1 or 4
+    uint8_t checksum;               // all bytes must add up to 0
+    uint8_t product[20];            // the product id
+    uint32_t oemtable;              // the OEM table pointer
+    uint16_t oemlength;             // the OEM table length
+    uint16_t entry;                 // the number of entries
+    uint32_t lapicaddr;             // the address of the local APIC
+    uint16_t xlength;               // the extended table length
+    uint8_t xchecksum;              // the extended table checksum
+    uint8_t reserved;
+} __attribute__((packed));
+
+// the processor entry
+struct mpproc {
+    uint8_t type;                   // MPPROC
+    uint8_t apicid;                 // the id of its local APIC
+    uint8_t version;                // the version of its local APIC
+    uint8_t flags;                  // MPPROC_ENABLED | MPPROC_BSP
+    uint8_t signature[4];           // the CPU signature
+    uint32_t feature;               // the feature flags from CPUID
+    uint8_t reserved[8];
+} __attribute__((packed));
+
+// the I/O APIC entry
+struct mpioapic {
+    uint8_t type;                   // MPIOAPIC
+    uint8_t apicno;                 // the I/O APIC id
+    uint8_t version;                // the I/O APIC version
+    uint8_t flags;                  // MPIOAPIC_ENABLED
+    uint32_t addr;                  // the address of its registers
+} __attribute__((packed));
+
+// the types of the entries, the others are 8 bytes long
+#define MPPROC                  0x00
+#define MPBUS                   0x01
+#define MPIOAPIC                0x02
+#define MPIOINTR                0x03
+#define MPLINTR                 0x04
+
+#define MPPROC_ENABLED          0x01
+#define MPPROC_BSP              0x02
+#define MPIOAPIC_ENABLED        0x01
+
+// the physical address of the local APIC registers, 0 if there is no MP table
+uintptr_t lapic_pa = 0;
+// the physical address and the id of the (first) I/O APIC
+uintptr_t ioapic_pa = 0;
+uint8_t ioapic_id;
+
+// set when all the APs are up, they wait for it in mp_main
+volatile bool mp_commenced = 0;
+// the kernel stack of the AP being started, for mpentry.S
+uintptr_t mpentry_kstack;
+
+#define MPSTART_TIMEOUT         NSEC_PER_SEC    // the time an AP has to start
+
+static uint8_t
+mp_sum(void *addr, size_t len) {
+    uint8_t sum = 0, *p = addr;
+    while (len -- > 0) {
+        sum += *p ++;
+    }
+    return sum;
+}
+
+// mp_search1 - look for the floating pointer in [pa, pa + len) of the physical memory
+static struct mp *
+mp_search1(uintptr_t pa, size_t len) {
+    struct mp *mp = KADDR(pa), *end = KADDR(pa + len);
+    for (; mp < end; mp ++) {
+        if (memcmp(mp->signature, "_MP_", 4) == 0 && mp_sum(mp, sizeof(struct mp)) == 0) {
+            return mp;
+        }
+    }
+    return NULL;
+}
+
+// mp_search - look for the floating pointer where the specification says
+static struct mp *
+mp_search(void) {
+    uint8_t *bda = KADDR(0x400);
+    uintptr_t pa;
+    struct mp *mp;
+    if ((pa = ((bda[0x0F] << 8) | bda[0x0E]) << 4) != 0) {
+        if ((mp = mp_search1(pa, 1024)) != NULL) {
+            return mp;
+        }
+    }
+    else {
+        pa = ((bda[0x14] << 8) | bda[0x13]) * 1024;
+        if ((mp = mp_search1(pa - 1024, 1024)) != NULL) {
+            return mp;
+        }
+    }
+    return mp_search1(0xF0000, 0x10000);
+}
+
+// mp_config - find and check the configuration table
+static struct mpconf *
+mp_config(void) {
+    struct mp *mp;
+    if ((mp = mp_search()) == NULL || mp->physaddr == 0 || PPN(mp->physaddr) >= npage) {
+        return NULL;
+    }
+    struct mpconf *conf = KADDR(mp->physaddr);
+    if (memcmp(conf->signature, "PCMP", 4) != 0 || (conf->version != 1 && conf->version != 4)) {
+        return NULL;
+    }
+    if (mp_sum(conf, conf->length) != 0) {
+        return NULL;
+    }
+    return conf;
+}
+
+// mp_init - detect the processors and the I/O APIC from the MP table, fill cpus[].
+//         - the BSP is always cpus[0].
+void
+mp_init(void) {
+    int i;
+    for (i = 0; i < NCPU; i ++) {
+        cpus[i].id = i;
+    }
+    cpus[0].started = 1;
+
+    struct mpconf *conf;
+    if ((conf = mp_config()) == NULL) {
+        cprintf("mp: no MP table, uniprocessor.\n");
+        return ;
+    }
+
+    lapic_pa = conf->lapicaddr;
+    uint8_t *p = (uint8_t *)(conf + 1), *end = (uint8_t *)conf + conf->length;
+    int nap = 0;
+    while (p < end) {
+        switch (*p) {
+        case MPPROC: {
+                struct mpproc *proc = (struct mpproc *)p;
+                p += sizeof(struct mpproc);
+                if (!(proc->flags & MPPROC_ENABLED)) {
+                    break;
+                }
+                if (proc->flags & MPPROC_BSP) {
+                    cpus[0].apicid = proc->apicid;
+                }
+                else if (nap + 1 < NCPU) {
+                    nap ++;
+                    cpus[nap].apicid = proc->apicid;
+                }
+                else {
+                    warn("mp: too many cpus, cpu %d ignored.\n", proc->apicid);
+                }
+            }
+            break;
+        case MPIOAPIC: {
+                struct mpioapic *ioapic = (struct mpioapic *)p;
+                p += sizeof(struct mpioapic);
+                if ((ioapic->flags & MPIOAPIC_ENABLED) && ioapic_pa == 0) {
+                    ioapic_id = ioapic->apicno;
+                    ioapic_pa = ioapic->addr;
+                }
+            }
+            break;
+        case MPBUS:
+        case MPIOINTR:
+        case MPLINTR:
+            p += 8;
+            break;
+        default:
+            warn("mp: unknown entry type %d.\n", *p);
+            lapic_pa = ioapic_pa = 0;
+            return ;
+        }
+    }
+    ncpu = nap + 1;
+    cprintf("mp: %d cpus, bsp apic %d, local apic at 0x%08x, io apic %d at 0x%08x.\n",
+            ncpu, cpus[0].apicid, lapic_pa, ioapic_id, ioapic_pa);
+}
+
+/* *
+ * mp_start - boot the APs one after another: copy the code of mpentry.S to
+ * MPENTRY_PADDR, and start each AP there with the INIT-SIPI-SIPI sequence on
+ * the kernel stack of its idle proc. The low 4M are mapped in boot_pgdir while
+ * they turn on paging. The APs need the local APIC timer as their clock event
+ * device, they stay halted without it.
+ * */
+void
+mp_start(void) {
+    if (ncpu == 1) {
+        return ;
+    }
+    if (!clock_per_cpu()) {
+        warn("mp: no local APIC timer, %d APs not started.\n", ncpu - 1);
+        return ;
+    }
+    extern char mpentry_start[], mpentry_end[];
+    memcpy(KADDR(MPENTRY_PADDR), mpentry_start, mpentry_end - mpentry_start);
+    boot_pgdir[0] = boot_pgdir[PDX(KERNBASE)];
+
+    int i;
+    for (i = 1; i < ncpu; i ++) {
+        struct cpu *cpu = cpus + i;
+        mpentry_kstack = cpu->idle->kstack + KSTACKSIZE;
+        lapic_startap(cpu->apicid, MPENTRY_PADDR);
+        uint64_t deadline = clock_read() + MPSTART_TIMEOUT;
+        while (!cpu->started && clock_read() < deadline) {
+            asm volatile ("pause");
+        }
+        if (!cpu->started) {
+            warn("mp: cpu %d (apic %d) did not start.\n", i, cpu->apicid);
+        }
+    }
+
+    boot_pgdir[0] = 0;
+    cpu_load_cr3(boot_cr3);
+    mp_commenced = 1;
+    cprintf("mp: %d of %d cpus online.\n", ncpu_online, ncpu);
+}
@@ -0,0 +1,17 @@
+#ifndef __KERN_DRIVER_MP_H__
+#define __KERN_DRIVER_MP_H__
+
+#include <types.h>
+
+extern uintptr_t lapic_pa;
+extern uintptr_t ioapic_pa;
+extern uint8_t ioapic_id;
+
+extern volatile bool mp_commenced;
+extern uintptr_t mpentry_kstack;
+
+void mp_init(void);
+void mp_start(void);
+
+#endif /* !__KERN_DRIVER_MP_H__ */
+
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <wait.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <proc.h>
 #include <sched.h>
 #include <dev.h>
@@ -17,12 +18,14 @@
 static char stdin_buffer[STDIN_BUFSIZE];
 static off_t p_rpos, p_wpos;
 static wait_queue_t __wait_queue, *wait_queue = &__wait_queue;
+// the keyboard interrupt may come on another cpu than the reader
+static spinlock_t stdin_lock;
 
 void
 dev_stdin_write(char c) {
     bool intr_flag;
     if (c != '\0') {
-        local_intr_save(intr_flag);
+        spin_lock_irqsave(&stdin_lock, intr_flag);
         {
             stdin_buffer[p_wpos % STDIN_BUFSIZE] = c;
             if (p_wpos - p_rpos < STDIN_BUFSIZE) {
@@ -32,7 +35,7 @@ dev_stdin_write(char c) {
                 wakeup_queue(wait_queue, WT_KBD, 1);
             }
         }
-        local_intr_restore(intr_flag);
+        spin_unlock_irqrestore(&stdin_lock, intr_flag);
     }
 }
 
@@ -40,7 +43,7 @@ static int
 dev_stdin_read(char *buf, size_t len) {
     int ret = 0;
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&stdin_lock, intr_flag);
     {
         for (; ret < len; ret ++, p_rpos ++) {
         try_again:
@@ -50,11 +53,11 @@ dev_stdin_read(char *buf, size_t len) {
             else {
                 wait_t __wait, *wait = &__wait;
                 wait_current_set(wait_queue, wait, WT_KBD);
-                local_intr_restore(intr_flag);
+                spin_unlock_irqrestore(&stdin_lock, intr_flag);
 
                 schedule();
 
-                local_intr_save(intr_flag);
+                spin_lock_irqsave(&stdin_lock, intr_flag);
                 wait_current_del(wait_queue, wait);
                 if (wait->wakeup_flags == WT_KBD) {
                     goto try_again;
@@ -63,7 +66,7 @@ dev_stdin_read(char *buf, size_t len) {
             }
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&stdin_lock, intr_flag);
     return ret;
 }
 
@@ -108,6 +111,7 @@ stdin_device_init(struct device *dev) {
 
     p_rpos = p_wpos = 0;
     wait_queue_init(wait_queue);
+    spinlock_init(&stdin_lock);
 }
 
 void
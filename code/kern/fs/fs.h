@@ -9,8 +9,10 @@
 #define SECTSIZE            512
 #define PAGE_NSECT          (PGSIZE / SECTSIZE)
 
+#define KERN_DEV_NO         0
 #define SWAP_DEV_NO         1
 #define DISK0_DEV_NO        2
+#define SWAP1_DEV_NO        3
 
 void fs_init(void);
 void fs_cleanup(void);
@@ -3,6 +3,7 @@
 #include <slab.h>
 #include <mmu.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <proc.h>
 #include <sched.h>
 #include <sem.h>
@@ -19,6 +20,7 @@ struct pipe_state {
     bool isclosed;
     int ref_count;
     semaphore_t sem;
+    spinlock_t lock;            // protects the wait queues
     wait_queue_t reader_queue;
     wait_queue_t writer_queue;
 };
@@ -35,6 +37,7 @@ pipe_state_create(void) {
         state->isclosed = 0;
         state->ref_count = 1;
         sem_init(&(state->sem), 1);
+        spinlock_init(&(state->lock));
         wait_queue_init(&(state->reader_queue));
         wait_queue_init(&(state->writer_queue));
     }
@@ -61,38 +64,44 @@ is_full(struct pipe_state *state) {
     return state->p_wpos - state->p_rpos >= PIPE_BUFSIZE;
 }
 
+// pipe_state_wait - sleep on queue until woken up, unless the pipe has become
+//   ready (not full for a writer, not empty for a reader) since the caller
+//   dropped the semaphore: the check is under the lock the waker takes, so the
+//   wakeup can't slip in between. return false if interrupted.
 static bool
-pipe_state_wait(wait_queue_t *queue) {
+pipe_state_wait(struct pipe_state *state, wait_queue_t *queue, bool write) {
     bool intr_flag;
     wait_t __wait, *wait = &__wait;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(state->lock), intr_flag);
+    if (state->isclosed || (write ? !is_full(state) : !is_empty(state))) {
+        spin_unlock_irqrestore(&(state->lock), intr_flag);
+        return 1;
+    }
     wait_current_set(queue, wait, WT_PIPE);
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(state->lock), intr_flag);
 
     schedule();
 
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(state->lock), intr_flag);
     wait_current_del(queue, wait);
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(state->lock), intr_flag);
     return wait->wakeup_flags == WT_PIPE;
 }
 
 static void
-pipe_state_wakeup(wait_queue_t *queue) {
-    if (!wait_queue_empty(queue)) {
-        bool intr_flag;
-        local_intr_save(intr_flag);
-        {
-            wakeup_queue(queue, WT_PIPE, 1);
-        }
-        local_intr_restore(intr_flag);
+pipe_state_wakeup(struct pipe_state *state, wait_queue_t *queue) {
+    bool intr_flag;
+    spin_lock_irqsave(&(state->lock), intr_flag);
+    {
+        wakeup_queue(queue, WT_PIPE, 1);
     }
+    spin_unlock_irqrestore(&(state->lock), intr_flag);
 }
 
-#define wait_reader(state)                          pipe_state_wait(&((state)->writer_queue))
-#define wait_writer(state)                          pipe_state_wait(&((state)->reader_queue))
-#define wakeup_reader(state)                        pipe_state_wakeup(&((state)->reader_queue))
-#define wakeup_writer(state)                        pipe_state_wakeup(&((state)->writer_queue))
+#define wait_reader(state)                          pipe_state_wait(state, &((state)->writer_queue), 1)
+#define wait_writer(state)                          pipe_state_wait(state, &((state)->reader_queue), 0)
+#define wakeup_reader(state)                        pipe_state_wakeup(state, &((state)->reader_queue))
+#define wakeup_writer(state)                        pipe_state_wakeup(state, &((state)->writer_queue))
 
 void
 pipe_state_acquire(struct pipe_state *state) {
@@ -4,24 +4,136 @@
 #include <fs.h>
 #include <ide.h>
 #include <pmm.h>
+#include <error.h>
 #include <assert.h>
 
+// the IDE device of each swap device (the type in swap_entry_t), KERN_DEV_NO if
+// detached: a writeback finishing after its device is removed must fail, not
+// go to the kernel disk
+static unsigned short swap_ideno[MAX_SWAP_DEVS];
+
+#define swapfs_attached(entry)          (swap_ideno[swap_type(entry)] != KERN_DEV_NO)
+
 void
 swapfs_init(void) {
     static_assert((PGSIZE % SECTSIZE) == 0);
+    static_assert(SWAPFS_MAX_PAGES * PAGE_NSECT <= MAX_NSECS);
     if (!ide_device_valid(SWAP_DEV_NO)) {
         panic("swap fs isn't available.\n");
     }
-    max_swap_offset = ide_device_size(SWAP_DEV_NO) / (PGSIZE / SECTSIZE);
+}
+
+// swapfs_attach - use IDE device ideno as swap device type, store its size in pages
+int
+swapfs_attach(int type, unsigned short ideno, size_t *nr_pages_store) {
+    assert(type >= 0 && type < MAX_SWAP_DEVS);
+    if (ideno == KERN_DEV_NO || ideno == DISK0_DEV_NO) {
+        return -E_BUSY;
+    }
+    if (!ide_device_valid(ideno)) {
+        return -E_NO_DEV;
+    }
+    size_t nr_pages = ide_device_size(ideno) / PAGE_NSECT;
+    if (nr_pages > MAX_SWAP_OFFSET_LIMIT) {
+        nr_pages = MAX_SWAP_OFFSET_LIMIT;
+    }
+    swap_ideno[type] = ideno;
+    *nr_pages_store = nr_pages;
+    return 0;
+}
+
+void
+swapfs_detach(int type) {
+    assert(type >= 0 && type < MAX_SWAP_DEVS);
+    swap_ideno[type] = KERN_DEV_NO;
 }
 
 int
 swapfs_read(swap_entry_t entry, struct Page *page) {
-    return ide_read_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
+    if (!swapfs_attached(entry)) {
+        return -E_NO_DEV;
+    }
+    return ide_read_secs(swap_ideno[swap_type(entry)], swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
 }
 
 int
 swapfs_write(swap_entry_t entry, struct Page *page) {
-    return ide_write_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
+    if (!swapfs_attached(entry)) {
+        return -E_NO_DEV;
+    }
+    return ide_write_secs(swap_ideno[swap_type(entry)], swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
+}
+
+
+// swapfs_read_pages - read n pages from the slots starting at entry in one I/O
+int
+swapfs_read_pages(swap_entry_t entry, struct Page *pages[], size_t n) {
+    if (!swapfs_attached(entry)) {
+        return -E_NO_DEV;
+    }
+    assert(n > 0 && n <= SWAPFS_MAX_PAGES);
+    void *bufs[SWAPFS_MAX_PAGES];
+    size_t i;
+    for (i = 0; i < n; i ++) {
+        bufs[i] = page2kva(pages[i]);
+    }
+    return ide_read_secsv(swap_ideno[swap_type(entry)], swap_offset(entry) * PAGE_NSECT, bufs, n, PAGE_NSECT);
+}
+
+// swapfs_write_pages - write n pages to the slots starting at entry in one I/O
+int
+swapfs_write_pages(swap_entry_t entry, struct Page *pages[], size_t n) {
+    if (!swapfs_attached(entry)) {
+        return -E_NO_DEV;
+    }
+    assert(n > 0 && n <= SWAPFS_MAX_PAGES);
+    const void *bufs[SWAPFS_MAX_PAGES];
+    size_t i;
+    for (i = 0; i < n; i ++) {
+        bufs[i] = page2kva(pages[i]);
+    }
+    return ide_write_secsv(swap_ideno[swap_type(entry)], swap_offset(entry) * PAGE_NSECT, bufs, n, PAGE_NSECT);
+}
+
+static void
+swapfs_request_done(struct ide_request *ireq, int error) {
+    struct swapfs_request *req = to_struct(ireq, struct swapfs_request, ide);
+    req->complete(req, (error == 0) ? 0 : -E_SWAP_FAULT);
+}
+
+// swapfs_request_init - set up the IDE request of req for its pages
+static struct ide_request *
+swapfs_request_init(struct swapfs_request *req) {
+    assert(req->n > 0 && req->n <= SWAPFS_MAX_PAGES && req->complete != NULL);
+    size_t i;
+    for (i = 0; i < req->n; i ++) {
+        req->bufs[i] = page2kva(req->pages[i]);
+    }
+    struct ide_request *ireq = &(req->ide);
+    ireq->ideno = swap_ideno[swap_type(req->entry)];
+    ireq->secno = swap_offset(req->entry) * PAGE_NSECT;
+    ireq->bufs = req->bufs, ireq->nbufs = req->n, ireq->buf_nsecs = PAGE_NSECT;
+    ireq->complete = swapfs_request_done;
+    return ireq;
 }
 
+// swapfs_read_pages_async - start reading req->n pages from the slots starting
+//   at req->entry and return at once, req->complete is called when it's done.
+//   if it fails to start, the error is returned and req->complete isn't called.
+int
+swapfs_read_pages_async(struct swapfs_request *req) {
+    if (!swapfs_attached(req->entry)) {
+        return -E_NO_DEV;
+    }
+    return ide_read_secsv_async(swapfs_request_init(req));
+}
+
+// swapfs_write_pages_async - start writing req->n pages to the slots starting at
+//   req->entry, as swapfs_read_pages_async
+int
+swapfs_write_pages_async(struct swapfs_request *req) {
+    if (!swapfs_attached(req->entry)) {
+        return -E_NO_DEV;
+    }
+    return ide_write_secsv_async(swapfs_request_init(req));
+}
@@ -3,10 +3,35 @@
 
 #include <memlayout.h>
 #include <swap.h>
+#include <ide.h>
+
+#define SWAPFS_MAX_PAGES        16  // max pages per read/write, MAX_NSECS / PAGE_NSECT
+
+// an asynchronous read or write of the pages of n consecutive slots from entry
+struct swapfs_request {
+    swap_entry_t entry;
+    size_t n;
+    struct Page *pages[SWAPFS_MAX_PAGES];
+    // called in the interrupt handler, error is 0 on success
+    void (*complete)(struct swapfs_request *req, int error);
+    list_entry_t link;          // for the owner of the request
+    int error;                  // for the owner of the request
+    void *bufs[SWAPFS_MAX_PAGES];
+    struct ide_request ide;
+};
+
+#define le2sreq(le, member)                 \
+    to_struct((le), struct swapfs_request, member)
 
 void swapfs_init(void);
+int swapfs_attach(int type, unsigned short ideno, size_t *nr_pages_store);
+void swapfs_detach(int type);
 int swapfs_read(swap_entry_t entry, struct Page *page);
 int swapfs_write(swap_entry_t entry, struct Page *page);
+int swapfs_read_pages(swap_entry_t entry, struct Page *pages[], size_t n);
+int swapfs_write_pages(swap_entry_t entry, struct Page *pages[], size_t n);
+int swapfs_read_pages_async(struct swapfs_request *req);
+int swapfs_write_pages_async(struct swapfs_request *req);
 
 #endif /* !__KERN_FS_SWAP_SWAPFS_H__ */
 
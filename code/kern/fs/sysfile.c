@@ -75,17 +75,13 @@ sysfile_read(int fd, void *base, size_t len) {
         }
         ret = file_read(fd, buffer, alen, &alen);
         if (alen != 0) {
-            lock_mm(mm);
-            {
-                if (copy_to_user(mm, base, buffer, alen)) {
-                    assert(len >= alen);
-                    base += alen, len -= alen, copied += alen;
-                }
-                else if (ret == 0) {
-                    ret = -E_INVAL;
-                }
+            if (copy_to_user(mm, base, buffer, alen)) {
+                assert(len >= alen);
+                base += alen, len -= alen, copied += alen;
+            }
+            else if (ret == 0) {
+                ret = -E_INVAL;
             }
-            unlock_mm(mm);
         }
         if (ret != 0 || alen == 0) {
             goto out;
@@ -120,13 +116,9 @@ sysfile_write(int fd, void *base, size_t len) {
         if ((alen = IOBUF_SIZE) > len) {
             alen = len;
         }
-        lock_mm(mm);
-        {
-            if (!copy_from_user(mm, buffer, base, alen, 0)) {
-                ret = -E_INVAL;
-            }
+        if (!copy_from_user(mm, buffer, base, alen, 0)) {
+            ret = -E_INVAL;
         }
-        unlock_mm(mm);
         if (ret == 0) {
             ret = file_write(fd, buffer, alen, &alen);
             if (alen != 0) {
@@ -161,13 +153,9 @@ sysfile_fstat(int fd, struct stat *__stat) {
         return ret;
     }
 
-    lock_mm(mm);
-    {
-        if (!copy_to_user(mm, __stat, stat, sizeof(struct stat))) {
-            ret = -E_INVAL;
-        }
+    if (!copy_to_user(mm, __stat, stat, sizeof(struct stat))) {
+        ret = -E_INVAL;
     }
-    unlock_mm(mm);
     return ret;
 }
 
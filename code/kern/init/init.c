@@ -12,8 +12,11 @@
 #include <ide.h>
 #include <fs.h>
 #include <swap.h>
+#include <ksm.h>
 #include <proc.h>
 #include <sched.h>
+#include <mp.h>
+#include <apic.h>
 
 int kern_init(void) __attribute__((noreturn));
 
@@ -31,6 +34,9 @@ kern_init(void) {
 
     debug_init();               // init debug registers
     pmm_init();                 // init physical memory management
+    mp_init();                  // detect the processors
+    lapic_init();               // init local apic
+    ioapic_init();              // init io apic
 
     pic_init();                 // init interrupt controller
     idt_init();                 // init interrupt descriptor table
@@ -42,11 +48,36 @@ kern_init(void) {
 
     ide_init();                 // init ide devices
     swap_init();                // init swap
+    ksm_init();                 // init same-page merging
     fs_init();                  // init fs
 
     clock_init();               // init clock interrupt
+    mp_start();                 // boot the other processors
     intr_enable();              // enable irq interrupt
 
     cpu_idle();                 // run idle process
 }
 
+void mp_main(void) __attribute__((noreturn));
+
+// mp_main - the APs come here from mpentry.S, on the kernel stack of their idle proc
+void
+mp_main(void) {
+    ncpu_online ++;
+    struct cpu *cpu = mycpu();
+    gdt_init(cpu, cpu->idle->kstack + KSTACKSIZE);
+    idt_load();
+    lapic_init_ap();
+    cpu->started = 1;
+
+    // wait for the others, boot_pgdir still maps the low memory
+    while (!mp_commenced) {
+        tlb_shootdown_poll();
+        asm volatile ("pause");
+    }
+    cpu_load_cr3(boot_cr3);
+    cprintf("mp: cpu %d (apic %d) started.\n", cpu->id, cpu->apicid);
+
+    cpu_idle();                 // run idle process
+}
+
@@ -0,0 +1,199 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <assert.h>
+#include <lz.h>
+
+#define LZ_HASH_BITS                12
+#define LZ_MIN_MATCH                4
+#define LZ_LAST_LITERALS            5       // the last bytes are always literals
+#define LZ_MAX_OFFSET               0xFFFF
+
+// the positions (+1) of the recent 4-byte sequences, indexed by their hash.
+// lz_compress never sleeps, so one table is enough.
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static inline uint32_t
+lz_read32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t
+lz_hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// lz_put_length - emit the extra bytes of a length longer than 14
+static inline uint8_t *
+lz_put_length(uint8_t *op, uint8_t *oend, size_t len) {
+    while (op != NULL && len >= 255) {
+        if (op >= oend) {
+            return NULL;
+        }
+        *op ++ = 255, len -= 255;
+    }
+    if (op == NULL || op >= oend) {
+        return NULL;
+    }
+    *op ++ = len;
+    return op;
+}
+
+// lz_put_sequence - emit the literals [lit, lit + nlit) followed by a match
+//                 - (offset, mlen), or by nothing if mlen == 0
+static uint8_t *
+lz_put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t nlit,
+        size_t offset, size_t mlen) {
+    if (op >= oend) {
+        return NULL;
+    }
+    uint8_t *token = op ++;
+    *token = ((nlit < 15) ? nlit : 15) << 4;
+    if (nlit >= 15 && (op = lz_put_length(op, oend, nlit - 15)) == NULL) {
+        return NULL;
+    }
+    if (op + nlit > oend) {
+        return NULL;
+    }
+    memcpy(op, lit, nlit), op += nlit;
+    if (mlen != 0) {
+        if (op + 2 > oend) {
+            return NULL;
+        }
+        *op ++ = offset & 0xFF, *op ++ = offset >> 8;
+        mlen -= LZ_MIN_MATCH;
+        *token |= (mlen < 15) ? mlen : 15;
+        if (mlen >= 15 && (op = lz_put_length(op, oend, mlen - 15)) == NULL) {
+            return NULL;
+        }
+    }
+    return op;
+}
+
+// lz_compress - compress len bytes at src into dst, return the compressed size,
+//             - or 0 if it doesn't fit in cap bytes
+size_t
+lz_compress(const void *src, size_t len, void *dst, size_t cap) {
+    assert(len <= LZ_MAX_OFFSET);
+    const uint8_t *base = src, *ip = base, *anchor = base, *end = base + len;
+    uint8_t *op = dst, *oend = op + cap;
+
+    memset(lz_table, 0, sizeof(lz_table));
+    while (len >= LZ_MIN_MATCH + LZ_LAST_LITERALS && ip + LZ_MIN_MATCH + LZ_LAST_LITERALS <= end) {
+        uint32_t v = lz_read32(ip), h = lz_hash(v);
+        const uint8_t *ref = base + lz_table[h] - 1;
+        lz_table[h] = ip - base + 1;
+        if (ref < base || lz_read32(ref) != v) {
+            ip ++;
+            continue ;
+        }
+        size_t mlen = LZ_MIN_MATCH;
+        while (ip + mlen < end - LZ_LAST_LITERALS && ref[mlen] == ip[mlen]) {
+            mlen ++;
+        }
+        if ((op = lz_put_sequence(op, oend, anchor, ip - anchor, ip - ref, mlen)) == NULL) {
+            return 0;
+        }
+        ip += mlen, anchor = ip;
+    }
+    if ((op = lz_put_sequence(op, oend, anchor, end - anchor, 0, 0)) == NULL) {
+        return 0;
+    }
+    return op - (uint8_t *)dst;
+}
+
+// lz_get_length - read the extra bytes of a length field
+static inline const uint8_t *
+lz_get_length(const uint8_t *ip, const uint8_t *iend, size_t *lenp) {
+    uint8_t c;
+    do {
+        if (ip >= iend) {
+            return NULL;
+        }
+        c = *ip ++, *lenp += c;
+    } while (c == 255);
+    return ip;
+}
+
+// lz_decompress - decompress len bytes at src into dst, which must come out as
+//               - exactly dst_len bytes. return 0 on success, -1 if src is corrupted.
+int
+lz_decompress(const void *src, size_t len, void *dst, size_t dst_len) {
+    const uint8_t *ip = src, *iend = ip + len;
+    uint8_t *op = dst, *oend = op + dst_len;
+    while (ip < iend) {
+        uint8_t token = *ip ++;
+        size_t nlit = token >> 4, mlen = token & 15;
+        if (nlit == 15 && (ip = lz_get_length(ip, iend, &nlit)) == NULL) {
+            return -1;
+        }
+        if (ip + nlit > iend || op + nlit > oend) {
+            return -1;
+        }
+        memcpy(op, ip, nlit), op += nlit, ip += nlit;
+        if (ip == iend) {
+            break;
+        }
+        if (ip + 2 > iend) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (mlen == 15 && (ip = lz_get_length(ip, iend, &mlen)) == NULL) {
+            return -1;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op - (uint8_t *)dst || op + mlen > oend) {
+            return -1;
+        }
+        // the match may overlap the bytes it produces, copy one by one
+        const uint8_t *ref = op - offset;
+        while (mlen -- > 0) {
+            *op ++ = *ref ++;
+        }
+    }
+    return (op == oend) ? 0 : -1;
+}
+
+void
+check_lz(void) {
+    const size_t size = 4096;
+    uint8_t *data = kmalloc(size), *comp = kmalloc(size), *out = kmalloc(size);
+    assert(data != NULL && comp != NULL && out != NULL);
+
+    // zeros compress very well
+    memset(data, 0, size);
+    size_t clen = lz_compress(data, size, comp, size);
+    assert(clen != 0 && clen < 64);
+    assert(lz_decompress(comp, clen, out, size) == 0 && memcmp(data, out, size) == 0);
+
+    // text-like data with repeats
+    size_t i;
+    for (i = 0; i < size; i ++) {
+        data[i] = "ucore swaps pages"[i % 17] + (i / 1024);
+    }
+    clen = lz_compress(data, size, comp, size);
+    assert(clen != 0 && clen < size / 4);
+    memset(out, 0, size);
+    assert(lz_decompress(comp, clen, out, size) == 0 && memcmp(data, out, size) == 0);
+    assert(lz_decompress(comp, clen, out, size - 1) != 0);
+    assert(lz_decompress(comp, clen - 1, out, size) != 0);
+
+    // random data doesn't fit in half of the input
+    for (i = 0; i < size; i ++) {
+        data[i] = rand();
+    }
+    assert(lz_compress(data, size, comp, size / 2) == 0);
+    clen = lz_compress(data, size, comp, size);
+    assert(clen == 0 || (lz_decompress(comp, clen, out, size) == 0 && memcmp(data, out, size) == 0));
+
+    // short inputs are all literals
+    assert((clen = lz_compress("abc", 3, comp, size)) == 4);
+    assert(lz_decompress(comp, clen, out, 3) == 0 && memcmp(out, "abc", 3) == 0);
+
+    kfree(data), kfree(comp), kfree(out);
+    cprintf("check_lz() succeeded.\n");
+}
+
@@ -0,0 +1,20 @@
+#ifndef __KERN_LIBS_LZ_H__
+#define __KERN_LIBS_LZ_H__
+
+#include <types.h>
+
+/* *
+ * A small LZ77 compressor using the LZ4 block format: a sequence is a token
+ * (literal length in the high nibble, match length - 4 in the low one, 15 means
+ * more length bytes follow), the literals, and a 2-byte little endian offset of
+ * the match. The last sequence holds only literals.
+ * Inputs are limited to 64KB.
+ * */
+
+size_t lz_compress(const void *src, size_t len, void *dst, size_t cap);
+int lz_decompress(const void *src, size_t len, void *dst, size_t dst_len);
+
+void check_lz(void);
+
+#endif /* !__KERN_LIBS_LZ_H__ */
+
@@ -376,6 +376,32 @@ rb_node_right(rb_tree *tree, rb_node *node) {
     return (right != tree->nil) ? right : NULL;
 }
 
+/* rb_node_first - returns the smallest node of @tree, or 'NULL' if tree is empty */
+rb_node *
+rb_node_first(rb_tree *tree) {
+    rb_node *node = tree->root->left, *nil = tree->nil;
+    if (node == nil) {
+        return NULL;
+    }
+    while (node->left != nil) {
+        node = node->left;
+    }
+    return node;
+}
+
+/* rb_node_last - returns the largest node of @tree, or 'NULL' if tree is empty */
+rb_node *
+rb_node_last(rb_tree *tree) {
+    rb_node *node = tree->root->left, *nil = tree->nil;
+    if (node == nil) {
+        return NULL;
+    }
+    while (node->right != nil) {
+        node = node->right;
+    }
+    return node;
+}
+
 int
 check_tree(rb_tree *tree, rb_node *node) {
     rb_node *nil = tree->nil;
@@ -516,6 +542,14 @@ check_rb_tree(void) {
         check_tree(tree, root->left);
     }
 
+    rb_node *next;
+    assert((node = rb_node_first(tree)) != NULL && rb_node_prev(tree, node) == NULL);
+    for (i = 1; i < total; i ++, node = next) {
+        assert((next = rb_node_next(tree, node)) != NULL);
+        assert(rbn2data(node)->data <= rbn2data(next)->data);
+    }
+    assert(rb_node_next(tree, node) == NULL && node == rb_node_last(tree));
+
     rb_tree_destroy(tree);
 
     for (i = 0; i < total; i ++) {
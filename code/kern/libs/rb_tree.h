@@ -25,6 +25,8 @@ rb_node *rb_node_next(rb_tree *tree, rb_node *node);
 rb_node *rb_node_root(rb_tree *tree);
 rb_node *rb_node_left(rb_tree *tree, rb_node *node);
 rb_node *rb_node_right(rb_tree *tree, rb_node *node);
+rb_node *rb_node_first(rb_tree *tree);
+rb_node *rb_node_last(rb_tree *tree);
 
 void check_rb_tree(void);
 
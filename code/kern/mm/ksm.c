@@ -0,0 +1,241 @@
+#include <types.h>
+#include <list.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <slab.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sync.h>
+#include <proc.h>
+#include <error.h>
+#include <assert.h>
+#include <ksminfo.h>
+#include <ksm.h>
+
+/* *
+ * ksm - kernel same-page merging
+ *
+ * ksmd scans the present pages of VM_MERGEABLE vmas. A page owned by a single
+ * pte whose checksum didn't change since the last scan is looked up in the
+ * stable table:
+ *   - if an identical page is found, the pte is pointed to it read-only and the
+ *     candidate page is freed; a later write breaks the sharing via the cow path
+ *     of do_pgfault, as for the pages shared after fork;
+ *   - otherwise the page is write-protected and added to the stable table, which
+ *     holds a reference on it, so its contents can't change any more.
+ * The checksum of the last scan is kept in page->index, which is only used by
+ * the pages in swap cache (and these are never candidates).
+ * The stable pages only referenced by the table are dropped before each scan.
+ * */
+
+struct ksm_item {
+    struct Page *page;
+    uint32_t checksum;
+    list_entry_t hash_link;
+};
+
+#define le2item(le, member)                 \
+    to_struct((le), struct ksm_item, member)
+
+#define KSM_HASH_SHIFT          8
+#define KSM_HASH_LIST_SIZE      (1 << KSM_HASH_SHIFT)
+#define ksm_hashfn(x)           (hash32(x, KSM_HASH_SHIFT))
+
+#define KSM_MAX_ITEMS           512     // the max number of pages in stable table
+#define KSM_SCAN_PAGES          256     // pages scanned in each round
+#define KSM_SLEEP_TICKS         20      // ticks slept between two rounds
+
+static list_entry_t hash_list[KSM_HASH_LIST_SIZE];
+static size_t nr_items;
+
+static size_t ksm_pages_merged, ksm_pages_scanned;
+
+void
+ksm_init(void) {
+    int i;
+    for (i = 0; i < KSM_HASH_LIST_SIZE; i ++) {
+        list_init(hash_list + i);
+    }
+    nr_items = ksm_pages_merged = ksm_pages_scanned = 0;
+}
+
+static uint32_t
+ksm_checksum(struct Page *page) {
+    uint32_t *p = page2kva(page), checksum = 0;
+    int i;
+    for (i = 0; i < PGSIZE / sizeof(uint32_t); i ++) {
+        checksum = (checksum << 5) + checksum + p[i];
+    }
+    return checksum;
+}
+
+// ksm_lookup - find a stable page with the same contents as page
+static struct ksm_item *
+ksm_lookup(struct Page *page, uint32_t checksum) {
+    list_entry_t *list = hash_list + ksm_hashfn(checksum), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct ksm_item *item = le2item(le, hash_link);
+        if (item->checksum == checksum && item->page != page) {
+            if (memcmp(page2kva(item->page), page2kva(page), PGSIZE) == 0) {
+                return item;
+            }
+        }
+    }
+    return NULL;
+}
+
+// ksm_drop - remove item from stable table, and release its reference on the page
+static void
+ksm_drop(struct ksm_item *item) {
+    struct Page *page = item->page;
+    if (page_ref_dec(page) == 0 && !PageSwap(page)) {
+        free_page(page);
+    }
+    list_del(&(item->hash_link));
+    kfree(item);
+    nr_items --;
+}
+
+// ksm_prune - drop the stable pages nobody maps any more
+static void
+ksm_prune(void) {
+    int i;
+    for (i = 0; i < KSM_HASH_LIST_SIZE; i ++) {
+        list_entry_t *list = hash_list + i, *le = list_next(list);
+        while (le != list) {
+            struct ksm_item *item = le2item(le, hash_link);
+            le = list_next(le);
+            if (page_ref(item->page) == 1) {
+                ksm_drop(item);
+            }
+        }
+    }
+}
+
+// ksm_cleanup - drop all stable pages
+void
+ksm_cleanup(void) {
+    int i;
+    for (i = 0; i < KSM_HASH_LIST_SIZE; i ++) {
+        list_entry_t *list = hash_list + i;
+        while (!list_empty(list)) {
+            ksm_drop(le2item(list_next(list), hash_link));
+        }
+    }
+    assert(nr_items == 0);
+}
+
+// ksm_scan_page - merge the page mapped by ptep, or make it a stable page
+//                 using *item_store
+static void
+ksm_scan_page(struct mm_struct *mm, uintptr_t addr, pte_t *ptep, struct ksm_item **item_store) {
+    struct Page *page = pte2page(*ptep);
+    if (PageReserved(page) || PageSwap(page) || page_ref(page) != 1) {
+        return ;
+    }
+
+    ksm_pages_scanned ++;
+
+    uint32_t checksum = ksm_checksum(page);
+    if (page->index != checksum) {
+        page->index = checksum;
+        return ;
+    }
+
+    struct ksm_item *item;
+    if ((item = ksm_lookup(page, checksum)) != NULL) {
+        page_insert(mm->pgdir, item->page, addr, PTE_U);
+        ksm_pages_merged ++;
+    }
+    else if ((item = *item_store) != NULL && nr_items < KSM_MAX_ITEMS) {
+        *ptep &= ~PTE_W;
+        tlb_invalidate(mm->pgdir, addr);
+        page_ref_inc(page);
+        item->page = page, item->checksum = checksum;
+        list_add(hash_list + ksm_hashfn(checksum), &(item->hash_link));
+        nr_items ++;
+        *item_store = NULL;
+    }
+}
+
+// ksm_scan_mm - scan at most 'budget' pages of mm from mm->ksm_address,
+//             - return the number of pages scanned.
+//   NOTE: mm should be locked by ksmd, no sleep is allowed here.
+static int
+ksm_scan_mm(struct mm_struct *mm, int budget, struct ksm_item **item_store) {
+    int scanned = 0;
+    uintptr_t addr = mm->ksm_address;
+    struct vma_struct *vma;
+    while (scanned < budget && (vma = find_vma(mm, addr)) != NULL) {
+        if (addr < vma->vm_start) {
+            addr = vma->vm_start;
+        }
+        if (!(vma->vm_flags & VM_MERGEABLE) || (vma->vm_flags & VM_SHARE)) {
+            addr = vma->vm_end;
+            continue ;
+        }
+        while (addr < vma->vm_end && scanned < budget) {
+            pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+            if (ptep == NULL) {
+                addr = ROUNDDOWN(addr + PTSIZE, PTSIZE);
+                continue ;
+            }
+            if (*ptep & PTE_P) {
+                ksm_scan_page(mm, addr, ptep, item_store);
+                scanned ++;
+            }
+            addr += PGSIZE;
+        }
+    }
+    mm->ksm_address = (vma == NULL) ? 0 : addr;
+    return scanned;
+}
+
+int
+ksmd_main(void *arg) {
+    struct ksm_item *item = NULL;
+    while (1) {
+        ksm_prune();
+        int budget = KSM_SCAN_PAGES, rounds = 16;
+        list_entry_t *list = &proc_mm_list;
+        while (budget > 0 && rounds -- > 0 && !list_empty(list)) {
+            if (item == NULL && (item = kmalloc(sizeof(struct ksm_item))) == NULL) {
+                break;
+            }
+            list_entry_t *le = list_next(list);
+            list_del(le);
+            list_add_before(list, le);
+            struct mm_struct *mm = le2mm(le, proc_mm_link);
+            if (try_lock_mm(mm)) {
+                budget -= ksm_scan_mm(mm, budget, &item);
+                unlock_mm(mm);
+            }
+        }
+        do_sleep(KSM_SLEEP_TICKS);
+    }
+}
+
+// ksm_info - report the merged/shared page counts to user
+int
+ksm_info(struct ksminfo *info) {
+    struct ksminfo __local_info, *local_info = &__local_info;
+    memset(local_info, 0, sizeof(struct ksminfo));
+
+    int i;
+    for (i = 0; i < KSM_HASH_LIST_SIZE; i ++) {
+        list_entry_t *list = hash_list + i, *le = list;
+        while ((le = list_next(le)) != list) {
+            int mapped = page_ref(le2item(le, hash_link)->page) - 1;
+            if (mapped > 1) {
+                local_info->pages_shared ++;
+                local_info->pages_sharing += mapped - 1;
+            }
+        }
+    }
+    local_info->pages_merged = ksm_pages_merged;
+    local_info->pages_scanned = ksm_pages_scanned;
+
+    // copy_to_user tolerates the faults, the mm needn't be locked
+    return (copy_to_user(current->mm, info, local_info, sizeof(struct ksminfo))) ? 0 : -E_INVAL;
+}
+
@@ -0,0 +1,15 @@
+#ifndef __KERN_MM_KSM_H__
+#define __KERN_MM_KSM_H__
+
+#include <types.h>
+
+struct ksminfo;
+
+void ksm_init(void);
+void ksm_cleanup(void);
+int ksm_info(struct ksminfo *info);
+
+int ksmd_main(void *arg) __attribute__((noreturn));
+
+#endif /* !__KERN_MM_KSM_H__ */
+
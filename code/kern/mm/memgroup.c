@@ -0,0 +1,245 @@
+#include <types.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <swap.h>
+#include <sync.h>
+#include <string.h>
+#include <stdio.h>
+#include <error.h>
+#include <assert.h>
+#include <unistd.h>
+#include <memgroupinfo.h>
+#include <memgroup.h>
+
+/* *
+ * memgroup - per-process memory limits
+ *
+ * A memory group has a page limit. The processes attached to it (a process
+ * attaches its whole thread group, and its children inherit the group) charge
+ * the pages they fault in to it: page->memgroup is set when the page is mapped
+ * and cleared when the page is freed, so the pages stay charged while they are
+ * mapped or in the swap cache. A fault finding its group at the limit doesn't
+ * push the whole system into reclaim, it asks kswapd to swap out the pages of
+ * the group's mms and free the group's pages on the inactive list, and waits.
+ * If the group can't be shrunk, the fault fails.
+ * */
+
+struct memgroup memgroups[MAX_MEMGROUPS];
+
+// the times a fault lets kswapd shrink its group before it fails
+#define MEMGROUP_RECLAIM_ROUNDS         4
+
+void
+memgroup_init(void) {
+    int i;
+    for (i = 0; i < MAX_MEMGROUPS; i ++) {
+        memset(memgroups + i, 0, sizeof(struct memgroup));
+        wait_queue_init(&(memgroups[i].reclaim_wait));
+    }
+}
+
+static struct memgroup *
+memgroup_find(int id) {
+    if (id > 0 && id <= MAX_MEMGROUPS && memgroups[id - 1].id == id) {
+        return memgroups + id - 1;
+    }
+    return NULL;
+}
+
+static inline bool
+memgroup_over_limit(struct memgroup *mg) {
+    return mg->limit != 0 && mg->usage >= mg->limit;
+}
+
+// memgroup_try_charge - make room for a page to be faulted in by mm. if its group
+//   is at its limit, let kswapd shrink the group first. return -E_NO_MEM if it can't.
+int
+memgroup_try_charge(struct mm_struct *mm) {
+    struct memgroup *mg = mm->memgroup;
+    if (mg == NULL || !memgroup_over_limit(mg)) {
+        return 0;
+    }
+    mg->nr_limit_hits ++;
+    int round;
+    for (round = 0; round < MEMGROUP_RECLAIM_ROUNDS && memgroup_over_limit(mg); round ++) {
+        if (!try_free_group_pages(mg)) {
+            break;
+        }
+    }
+    if (memgroup_over_limit(mg)) {
+        mg->nr_failed ++;
+        warn("memgroup %d: %d pages, no more can be reclaimed under the limit %d.\n",
+                mg->id, mg->usage, mg->limit);
+        return -E_NO_MEM;
+    }
+    return 0;
+}
+
+// memgroup_charge - charge page mapped into mm to its group, if it is not charged yet
+void
+memgroup_charge(struct mm_struct *mm, struct Page *page) {
+    struct memgroup *mg = mm->memgroup;
+    if (mg != NULL && page->memgroup == NULL) {
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            page->memgroup = mg;
+            if (++ mg->usage > mg->max_usage) {
+                mg->max_usage = mg->usage;
+            }
+        }
+        local_intr_restore(intr_flag);
+    }
+}
+
+// memgroup_uncharge - the pages are freed, uncharge them. called by free_pages
+//                   - with interrupts disabled.
+void
+memgroup_uncharge(struct Page *base, size_t n) {
+    struct Page *page;
+    for (page = base; page < base + n; page ++) {
+        if (page->memgroup != NULL) {
+            page->memgroup->usage --;
+            page->memgroup = NULL;
+        }
+    }
+}
+
+// memgroup_move_charges - move the charges of the pages mapped by mm to its group
+static void
+memgroup_move_charges(struct mm_struct *mm) {
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_flags & VM_SHARE) {
+            continue ;
+        }
+        uintptr_t addr = vma->vm_start;
+        while (addr < vma->vm_end) {
+            pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+            if (ptep == NULL) {
+                addr = ROUNDDOWN(addr + PTSIZE, PTSIZE);
+                continue ;
+            }
+            if (*ptep & PTE_P) {
+                struct Page *page = pte2page(*ptep);
+                bool intr_flag;
+                local_intr_save(intr_flag);
+                {
+                    memgroup_uncharge(page, 1);
+                }
+                local_intr_restore(intr_flag);
+                memgroup_charge(mm, page);
+            }
+            addr += PGSIZE;
+        }
+    }
+}
+
+// memgroup_attach - move the process pid (0 for the current one), the processes
+//   sharing its mm and the pages they map into group mg (NULL for none)
+static int
+memgroup_attach(struct memgroup *mg, int pid) {
+    struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+    if (proc == NULL || proc->mm == NULL) {
+        return -E_INVAL;
+    }
+    struct mm_struct *mm = proc->mm;
+    list_entry_t *list = &proc_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct proc_struct *p = le2proc(le, list_link);
+        if (p->mm == mm) {
+            p->memgroup = mg;
+        }
+    }
+    lock_mm(mm);
+    {
+        mm->memgroup = mg;
+        memgroup_move_charges(mm);
+    }
+    unlock_mm(mm);
+    return 0;
+}
+
+static int
+memgroup_info(struct memgroup *mg, struct memgroupinfo *info) {
+    struct memgroupinfo __local_info, *local_info = &__local_info;
+    local_info->limit = mg->limit;
+    local_info->usage = mg->usage;
+    local_info->max_usage = mg->max_usage;
+    local_info->nr_limit_hits = mg->nr_limit_hits;
+    local_info->nr_failed = mg->nr_failed;
+
+    // copy_to_user tolerates the faults, the mm needn't be locked
+    return (copy_to_user(current->mm, info, local_info, sizeof(struct memgroupinfo))) ? 0 : -E_INVAL;
+}
+
+// memgroup_destroy - free the id of group mg, refused while a process is attached
+//                  - to it or a page is still charged to it (e.g. in swap cache)
+static int
+memgroup_destroy(struct memgroup *mg) {
+    if (mg->usage != 0 || mg->reclaim || !wait_queue_empty(&(mg->reclaim_wait))) {
+        return -E_BUSY;
+    }
+    list_entry_t *list = &proc_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct proc_struct *proc = le2proc(le, list_link);
+        if (proc->memgroup == mg && proc->state != PROC_ZOMBIE) {
+            return -E_BUSY;
+        }
+    }
+    memset(mg, 0, sizeof(struct memgroup));
+    wait_queue_init(&(mg->reclaim_wait));
+    return 0;
+}
+
+// do_memgroup - the memgroup syscall, see the MEMGROUP_* commands in unistd.h
+int
+do_memgroup(int cmd, int id, uintptr_t arg) {
+    struct memgroup *mg = NULL;
+    if (cmd == MEMGROUP_CREATE) {
+        int i;
+        for (i = 0; i < MAX_MEMGROUPS; i ++) {
+            if (memgroups[i].id == 0) {
+                mg = memgroups + i;
+                mg->id = i + 1, mg->limit = arg;
+                return mg->id;
+            }
+        }
+        return -E_NO_MEM;
+    }
+    if (!(cmd == MEMGROUP_ATTACH && id == 0) && (mg = memgroup_find(id)) == NULL) {
+        return -E_INVAL;
+    }
+    switch (cmd) {
+    case MEMGROUP_LIMIT:
+        mg->limit = arg;
+        return 0;
+    case MEMGROUP_ATTACH:
+        return memgroup_attach(mg, (int)arg);
+    case MEMGROUP_INFO:
+        return memgroup_info(mg, (struct memgroupinfo *)arg);
+    case MEMGROUP_DESTROY:
+        return memgroup_destroy(mg);
+    }
+    return -E_INVAL;
+}
+
+void
+print_memgroupinfo(void) {
+    int i, count = 0;
+    for (i = 0; i < MAX_MEMGROUPS; i ++) {
+        struct memgroup *mg = memgroups + i;
+        if (mg->id != 0) {
+            cprintf("memgroup %d: %d/%d pages, max %d, %d limit hits, %d failed, %s.\n",
+                    mg->id, mg->usage, mg->limit, mg->max_usage, mg->nr_limit_hits,
+                    mg->nr_failed, mg->reclaim ? "reclaiming" : "idle");
+            count ++;
+        }
+    }
+    if (count == 0) {
+        cprintf("memgroup: no memory groups.\n");
+    }
+}
+
@@ -0,0 +1,35 @@
+#ifndef __KERN_MM_MEMGROUP_H__
+#define __KERN_MM_MEMGROUP_H__
+
+#include <types.h>
+#include <memlayout.h>
+#include <wait.h>
+
+struct mm_struct;
+struct memgroupinfo;
+
+struct memgroup {
+    int id;                         // 0 if the slot is unused
+    size_t limit;                   // in pages, 0 for no limit
+    size_t usage;                   // the pages charged to the group
+    size_t max_usage;
+    size_t nr_limit_hits;
+    size_t nr_failed;
+    volatile bool reclaim;          // the waiters want kswapd to shrink the group
+    int stalls;                     // the reclaim passes in a row making no progress
+    wait_queue_t reclaim_wait;      // the faults waiting for the group to shrink
+};
+
+#define MAX_MEMGROUPS                   8
+
+extern struct memgroup memgroups[MAX_MEMGROUPS];
+
+void memgroup_init(void);
+int memgroup_try_charge(struct mm_struct *mm);
+void memgroup_charge(struct mm_struct *mm, struct Page *page);
+void memgroup_uncharge(struct Page *base, size_t n);
+int do_memgroup(int cmd, int id, uintptr_t arg);
+void print_memgroupinfo(void);
+
+#endif /* !__KERN_MM_MEMGROUP_H__ */
+
@@ -33,7 +33,9 @@
  *                            |                                 |
  *                            |         Empty Memory (*)        |
  *                            |                                 |
- *                            +---------------------------------+ 0xFB000000
+ *                            +---------------------------------+ 0xFB400000
+ *                            |      Memory-mapped I/O (Kern)   | RW/-- PTSIZE
+ *     MMIOBASE ------------> +---------------------------------+ 0xFB000000
  *                            |   Cur. Page Table (Kern, RW)    | RW/-- PTSIZE
  *     VPT -----------------> +---------------------------------+ 0xFAC00000
  *                            |        Invalid Memory (*)       | --/--
@@ -79,6 +81,13 @@
  * */
 #define VPT                 0xFAC00000
 
+/* the registers of the local and I/O APICs are mapped here by mmio_map */
+#define MMIOBASE            0xFB000000
+#define MMIOLIM             (MMIOBASE + PTSIZE)
+
+/* the APs start in real mode at this physical address, see kern/init/mpentry.S */
+#define MPENTRY_PADDR       0x7000
+
 #define KSTACKPAGE          2                           // # of pages in kernel stack
 #define KSTACKSIZE          (KSTACKPAGE * PGSIZE)       // sizeof kernel stack
 
@@ -126,6 +135,8 @@ struct e820map {
  * physical page. In kern/mm/pmm.h, you can find lots of useful functions
  * that convert Page to other data types, such as phyical address.
  * */
+struct memgroup;
+
 struct Page {
     atomic_t ref;                   // page frame's reference counter
     uint32_t flags;                 // array of flags that describe the status of the page frame
@@ -134,6 +145,7 @@ struct Page {
     list_entry_t page_link;         // free list link
     swap_entry_t index;             // stores a swapped-out page identifier
     list_entry_t swap_link;         // swap hash link
+    struct memgroup *memgroup;      // the memory group charged for the page, or NULL
 };
 
 /* Flags describing the status of a page frame */
@@ -143,6 +155,11 @@ struct Page {
 #define PG_dirty                    3       // the page has been modified
 #define PG_swap                     4       // the page is in the active or inactive page list (and swap hash table)
 #define PG_active                   5       // the page is in the active page list
+#define PG_readahead                6       // the page was read ahead and has not been used yet
+#define PG_locked                   7       // the swap cache page is under I/O
+#define PG_workingset               8       // the swap cache page came back soon after eviction (hot)
+#define PG_writeback                9       // the swap cache page is being written to the disk
+#define PG_pgdir                    10      // the page directory of an mm, 'index' points to the mm
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -162,6 +179,21 @@ struct Page {
 #define SetPageActive(page)         set_bit(PG_active, &((page)->flags))
 #define ClearPageActive(page)       clear_bit(PG_active, &((page)->flags))
 #define PageActive(page)            test_bit(PG_active, &((page)->flags))
+#define SetPageReadahead(page)      set_bit(PG_readahead, &((page)->flags))
+#define ClearPageReadahead(page)    clear_bit(PG_readahead, &((page)->flags))
+#define PageReadahead(page)         test_bit(PG_readahead, &((page)->flags))
+#define SetPageLocked(page)         set_bit(PG_locked, &((page)->flags))
+#define ClearPageLocked(page)       clear_bit(PG_locked, &((page)->flags))
+#define PageLocked(page)            test_bit(PG_locked, &((page)->flags))
+#define SetPageWorkingset(page)     set_bit(PG_workingset, &((page)->flags))
+#define ClearPageWorkingset(page)   clear_bit(PG_workingset, &((page)->flags))
+#define PageWorkingset(page)        test_bit(PG_workingset, &((page)->flags))
+#define SetPageWriteback(page)      set_bit(PG_writeback, &((page)->flags))
+#define ClearPageWriteback(page)    clear_bit(PG_writeback, &((page)->flags))
+#define PageWriteback(page)         test_bit(PG_writeback, &((page)->flags))
+#define SetPagePgdir(page)          set_bit(PG_pgdir, &((page)->flags))
+#define ClearPagePgdir(page)        clear_bit(PG_pgdir, &((page)->flags))
+#define PagePgdir(page)             test_bit(PG_pgdir, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
@@ -0,0 +1,160 @@
+#include <types.h>
+#include <list.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <stdio.h>
+#include <error.h>
+#include <assert.h>
+#include <oom.h>
+
+/* *
+ * oom - the out-of-memory killer
+ *
+ * kswapd calls oom_kill when OOM_RECLAIM_PASSES reclaim passes in a row free
+ * nothing while processes wait for memory. The victim is the process with the
+ * highest badness: its resident pages plus its pages in swap, moved by its
+ * oom_score_adj in thousandths of the memory. The processes sharing its mm
+ * are killed too, the memory comes back only when the last of them exits.
+ * The victims are marked PF_MEMDIE, they don't wait for kswapd any more and
+ * take pages from a small reserve when the allocator fails, so they can reach
+ * do_exit. kswapd doesn't kill again while a victim is still alive.
+ * */
+
+#define OOM_RESERVE_PAGES           32
+
+static list_entry_t reserve_list;
+static size_t nr_reserve_pages;
+
+void
+oom_init(void) {
+    list_init(&reserve_list);
+    oom_refill_reserve();
+}
+
+// oom_alloc_reserve - give a page of the reserve to an OOM victim, called by
+//                   - alloc_pages when the allocator fails
+struct Page *
+oom_alloc_reserve(size_t n) {
+    if (n != 1 || current == NULL || !(current->flags & PF_MEMDIE)) {
+        return NULL;
+    }
+    struct Page *page = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (!list_empty(&reserve_list)) {
+            page = le2page(list_next(&reserve_list), page_link);
+            list_del(&(page->page_link));
+            nr_reserve_pages --;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return page;
+}
+
+// oom_refill_reserve - take the pages the victims used back into the reserve,
+//                    - if they can be spared. called by kswapd without pressure.
+void
+oom_refill_reserve(void) {
+    while (nr_reserve_pages < OOM_RESERVE_PAGES && nr_free_pages() > OOM_RESERVE_PAGES * 2) {
+        struct Page *page;
+        if ((page = alloc_page()) == NULL) {
+            break;
+        }
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            list_add(&reserve_list, &(page->page_link));
+            nr_reserve_pages ++;
+        }
+        local_intr_restore(intr_flag);
+    }
+}
+
+// oom_victim_exiting - is a process killed by oom_kill still alive, or its memory
+//                    - not freed yet: a zombie victim has handed its mm to the
+//                    - reaper, which may still be tearing it down
+bool
+oom_victim_exiting(void) {
+    list_entry_t *list = &proc_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct proc_struct *proc = le2proc(le, list_link);
+        if ((proc->flags & PF_MEMDIE) && proc->state != PROC_ZOMBIE) {
+            return 1;
+        }
+    }
+    return mm_reap_pending() != 0;
+}
+
+// oom_badness - the score of proc, the higher the more likely it is killed,
+//             - 0 if it must not be killed
+static int
+oom_badness(struct proc_struct *proc, size_t *rss_store, size_t *swap_store) {
+    *rss_store = *swap_store = 0;
+    if (proc->mm == NULL || proc->state == PROC_ZOMBIE || (proc->flags & PF_EXITING)) {
+        return 0;
+    }
+    if (proc->oom_score_adj == OOM_SCORE_ADJ_MIN) {
+        return 0;
+    }
+    *rss_store = proc->mm->rss, *swap_store = proc->mm->nr_swapped;
+    int points = *rss_store + *swap_store;
+    points += proc->oom_score_adj * (int)npage / 1000;
+    return (points > 0) ? points : 1;
+}
+
+// oom_kill - kill the process with the highest badness and all the processes
+//            sharing its mm. return false if there is none to kill.
+bool
+oom_kill(void) {
+    struct proc_struct *victim = NULL;
+    size_t rss, swap, victim_rss = 0, victim_swap = 0;
+    int points, victim_points = 0;
+
+    cprintf("oom: out of memory, %d reclaim passes freed nothing.\n", OOM_RECLAIM_PASSES);
+    list_entry_t *list = &proc_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct proc_struct *proc = le2proc(le, list_link);
+        if ((points = oom_badness(proc, &rss, &swap)) == 0) {
+            continue ;
+        }
+        cprintf("oom:   pid %d (%s): rss %d, swap %d, adj %d, score %d.\n",
+                proc->pid, proc->name, rss, swap, proc->oom_score_adj, points);
+        if (points > victim_points) {
+            victim = proc, victim_points = points;
+            victim_rss = rss, victim_swap = swap;
+        }
+    }
+    if (victim == NULL) {
+        return 0;
+    }
+
+    struct mm_struct *mm = victim->mm;
+    le = list;
+    while ((le = list_next(le)) != list) {
+        struct proc_struct *proc = le2proc(le, list_link);
+        if (proc->mm == mm && proc->state != PROC_ZOMBIE) {
+            proc->flags |= PF_MEMDIE;
+            do_kill(proc->pid, -E_KILLED);
+        }
+    }
+    cprintf("oom: killed pid %d (%s), score %d, freeing %d pages (%d in swap).\n",
+            victim->pid, victim->name, victim_points, victim_rss + victim_swap, victim_swap);
+    return 1;
+}
+
+// oom_set_adj - set the oom_score_adj of the process pid (0 for the current one)
+int
+oom_set_adj(int pid, int adj) {
+    if (adj < OOM_SCORE_ADJ_MIN || adj > OOM_SCORE_ADJ_MAX) {
+        return -E_INVAL;
+    }
+    struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+    if (proc == NULL) {
+        return -E_INVAL;
+    }
+    proc->oom_score_adj = adj;
+    return 0;
+}
+
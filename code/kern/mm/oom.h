@@ -0,0 +1,22 @@
+#ifndef __KERN_MM_OOM_H__
+#define __KERN_MM_OOM_H__
+
+#include <types.h>
+#include <memlayout.h>
+
+// the range of proc->oom_score_adj, OOM_SCORE_ADJ_MIN exempts the process
+#define OOM_SCORE_ADJ_MIN           (-1000)
+#define OOM_SCORE_ADJ_MAX           1000
+
+// the reclaim passes in a row freeing nothing before kswapd kills
+#define OOM_RECLAIM_PASSES          16
+
+void oom_init(void);
+struct Page *oom_alloc_reserve(size_t n);
+void oom_refill_reserve(void);
+bool oom_victim_exiting(void);
+bool oom_kill(void);
+int oom_set_adj(int pid, int adj);
+
+#endif /* !__KERN_MM_OOM_H__ */
+
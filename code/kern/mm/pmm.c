@@ -7,9 +7,15 @@
 #include <pmm.h>
 #include <buddy_pmm.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <slab.h>
 #include <swap.h>
+#include <oom.h>
+#include <memgroup.h>
+#include <vmm.h>
 #include <error.h>
+#include <proc.h>
+#include <apic.h>
 
 /* *
  * Task State Segment:
@@ -30,8 +36,10 @@
  * contains the new ESP value for CPL = 0. When an interrupt happens in protected
  * mode, the x86 CPU will look in the TSS for SS0 and ESP0 and load their value
  * into SS and ESP respectively.
+ *
+ * Each cpu has its own TSS and GDT in struct cpu: ESP0 is the kernel stack of
+ * the process it runs, and ltr marks the TSS descriptor busy.
  * */
-static struct taskstate ts = {0};
 
 // virtual address of physicall page array
 struct Page *pages;
@@ -45,6 +53,10 @@ uintptr_t boot_cr3;
 
 // physical memory management
 const struct pmm_manager *pmm_manager;
+// protects the free lists of pmm_manager
+static spinlock_t pmm_lock;
+// one TLB shootdown at a time, see tlb_shootdown
+static spinlock_t tlb_lock;
 
 /* *
  * The page directory entry corresponding to the virtual address range
@@ -84,10 +96,6 @@ static struct segdesc gdt[] = {
     [SEG_TSS]   = SEG_NULL,
 };
 
-static struct pseudodesc gdt_pd = {
-    sizeof(gdt) - 1, (uintptr_t)gdt
-};
-
 static void check_alloc_page(void);
 static void check_pgdir(void);
 static void check_boot_pgdir(void);
@@ -115,20 +123,27 @@ lgdt(struct pseudodesc *pd) {
  * */
 void
 load_esp0(uintptr_t esp0) {
-    ts.ts_esp0 = esp0;
+    mycpu()->ts.ts_esp0 = esp0;
 }
 
-/* gdt_init - initialize the default GDT and TSS */
-static void
-gdt_init(void) {
+/* *
+ * gdt_init - initialize the GDT and TSS of cpu, the running one, from gdt.
+ * esp0 is the kernel stack it runs on.
+ * */
+void
+gdt_init(struct cpu *cpu, uintptr_t esp0) {
+    static_assert(sizeof(cpu->gdt) == sizeof(gdt));
     // set boot kernel stack and default SS0
-    load_esp0((uintptr_t)bootstacktop);
-    ts.ts_ss0 = KERNEL_DS;
+    memset(&(cpu->ts), 0, sizeof(cpu->ts));
+    cpu->ts.ts_esp0 = esp0;
+    cpu->ts.ts_ss0 = KERNEL_DS;
 
     // initialize the TSS filed of the gdt
-    gdt[SEG_TSS] = SEGTSS(STS_T32A, (uintptr_t)&ts, sizeof(ts), DPL_KERNEL);
+    memcpy(cpu->gdt, gdt, sizeof(gdt));
+    cpu->gdt[SEG_TSS] = SEGTSS(STS_T32A, (uintptr_t)&(cpu->ts), sizeof(cpu->ts), DPL_KERNEL);
 
     // reload all segment registers
+    struct pseudodesc gdt_pd = {sizeof(cpu->gdt) - 1, (uintptr_t)(cpu->gdt)};
     lgdt(&gdt_pd);
 
     // load the TSS
@@ -140,6 +155,8 @@ static void
 init_pmm_manager(void) {
     pmm_manager = &buddy_pmm_manager;
     cprintf("memory management: %s\n", pmm_manager->name);
+    spinlock_init(&pmm_lock);
+    spinlock_init(&tlb_lock);
     pmm_manager->init();
 }
 
@@ -155,14 +172,17 @@ alloc_pages(size_t n) {
     bool intr_flag;
     struct Page *page;
 try_again:
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&pmm_lock, intr_flag);
     {
         page = pmm_manager->alloc_pages(n);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&pmm_lock, intr_flag);
     if (page == NULL && try_free_pages(n)) {
         goto try_again;
     }
+    if (page == NULL) {
+        page = oom_alloc_reserve(n);
+    }
     return page;
 }
 
@@ -170,11 +190,12 @@ try_again:
 void
 free_pages(struct Page *base, size_t n) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&pmm_lock, intr_flag);
     {
+        memgroup_uncharge(base, n);
         pmm_manager->free_pages(base, n);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&pmm_lock, intr_flag);
 }
 
 //nr_free_pages - call pmm->nr_free_pages to get the size (nr*PAGESIZE) 
@@ -183,11 +204,11 @@ size_t
 nr_free_pages(void) {
     size_t ret;
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&pmm_lock, intr_flag);
     {
         ret = pmm_manager->nr_free_pages();
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&pmm_lock, intr_flag);
     return ret;
 }
 
@@ -220,6 +241,7 @@ page_init(void) {
 
     for (i = 0; i < npage; i ++) {
         SetPageReserved(pages + i);
+        pages[i].memgroup = NULL;
     }
 
     uintptr_t freemem = PADDR((uintptr_t)pages + sizeof(struct Page) * npage);
@@ -332,7 +354,7 @@ pmm_init(void) {
     //reload gdt(third time,the last time) to map all physical memory
     //virtual_addr 0~4G=liear_addr 0~4G
     //then set kernel stack(ss:esp) in TSS, setup TSS in gdt, load TSS
-    gdt_init();
+    gdt_init(cpus, (uintptr_t)bootstacktop);
 
     boot_pgdir[0] = boot_pgdir[1] = 0;
 
@@ -343,6 +365,23 @@ pmm_init(void) {
     slab_init();
 }
 
+//mmio_map - map size bytes of device registers at physical address pa into the
+//         - MMIO window of the kernel, uncached. return the kernel virtual address.
+//  NOTE: must be called before the first process is forked, all page directories
+//        are copied from boot_pgdir and share the page table of the window.
+void *
+mmio_map(uintptr_t pa, size_t size) {
+    static uintptr_t mmio_next = MMIOBASE;
+    uintptr_t la = mmio_next + PGOFF(pa);
+    size_t len = ROUNDUP(size + PGOFF(pa), PGSIZE);
+    if (mmio_next + len > MMIOLIM) {
+        panic("mmio_map: out of the MMIO window.\n");
+    }
+    boot_map_segment(boot_pgdir, la, size, pa, PTE_W | PTE_PCD | PTE_PWT);
+    mmio_next += len;
+    return (void *)la;
+}
+
 //get_pte - get pte and return the kernel virtual address of this pte for la
 //        - if the PT contians this pte didn't exist, alloc a page for PT
 // parameter:
@@ -358,6 +397,11 @@ get_pte(pde_t *pgdir, uintptr_t la, bool create) {
         if (!create || (page = alloc_page()) == NULL) {
             return NULL;
         }
+        // alloc_page may sleep, and the PT may be created by others meanwhile
+        if (*pdep & PTE_P) {
+            free_page(page);
+            return &((pte_t *)KADDR(PDE_ADDR(*pdep)))[PTX(la)];
+        }
         set_page_ref(page, 1);
         uintptr_t pa = page2pa(page);
         memset(KADDR(pa), 0, PGSIZE);
@@ -379,6 +423,34 @@ get_page(pde_t *pgdir, uintptr_t la, pte_t **ptep_store) {
     return NULL;
 }
 
+// pgdir_set_mm - the page directory pgdir belongs to mm (NULL for none), the
+//               - changes of its entries are counted in mm (see pgdir_account)
+void
+pgdir_set_mm(pde_t *pgdir, struct mm_struct *mm) {
+    struct Page *page = kva2page(pgdir);
+    if (mm != NULL) {
+        page->index = (uintptr_t)mm;
+        SetPagePgdir(page);
+    }
+    else {
+        ClearPagePgdir(page);
+    }
+}
+
+// pgdir_account - rss pages are mapped and swapped pages are swapped out into
+//                 pgdir (negative if unmapped), count them in the mm it belongs to
+void
+pgdir_account(pde_t *pgdir, int rss, int swapped) {
+    struct Page *page = kva2page(pgdir);
+    if (PagePgdir(page)) {
+        struct mm_struct *mm = (struct mm_struct *)(page->index);
+        mm->rss += rss, mm->nr_swapped += swapped;
+        if (mm->rss > mm->max_rss) {
+            mm->max_rss = mm->rss;
+        }
+    }
+}
+
 //page_remove_pte - free an Page sturct which is related linear address la
 //                - and clean(invalidate) pte which is related linear address la
 //note: PT is changed, so the TLB need to be invalidate 
@@ -399,10 +471,12 @@ page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
         }
         *ptep = 0;
         tlb_invalidate(pgdir, la);
+        pgdir_account(pgdir, -1, 0);
     }
     else if (*ptep != 0) {
         swap_remove_entry(*ptep);
         *ptep = 0;
+        pgdir_account(pgdir, 0, -1);
     }
 }
 
@@ -437,6 +511,7 @@ page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
         }
         page_remove_pte(pgdir, la, ptep);
     }
+    pgdir_account(pgdir, 1, 0);
 
 out:
     *ptep = page2pa(page) | PTE_P | perm;
@@ -444,13 +519,80 @@ out:
     return 0;
 }
 
+/* *
+ * TLB shootdown: the other cpus may cache the mapping changed too, those
+ * running on the page directory, or all of them for the kernel part shared
+ * by all page directories. The cpu changing it posts a request, sends them
+ * T_IPI_TLB and waits until each one has invalidated the entry. One request
+ * at a time: a cpu waiting for tlb_lock, or any spinlock, with interrupts
+ * disabled answers the requests by tlb_shootdown_poll meanwhile.
+ * */
+static struct {
+    uintptr_t cr3;                  // the page directory, 0 for the kernel part
+    uintptr_t la;
+    volatile uint32_t pending;      // the bitmap of the cpus to invalidate la
+} tlb_request;
+
+// tlb_shootdown_poll - invalidate the entry of the request if this cpu is asked to
+void
+tlb_shootdown_poll(void) {
+    if (tlb_request.pending != 0) {
+        int id = mycpu()->id;
+        if (test_bit(id, &(tlb_request.pending))) {
+            if (tlb_request.cr3 == 0 || rcr3() == tlb_request.cr3) {
+                invlpg((void *)tlb_request.la);
+            }
+            clear_bit(id, &(tlb_request.pending));
+        }
+    }
+}
+
+// tlb_shootdown - invalidate la on the other cpus using the page directory
+//               - cr3 (0 for all), and wait for them
+static void
+tlb_shootdown(uintptr_t cr3, uintptr_t la) {
+    struct cpu *self = mycpu();
+    bool intr_flag;
+    spin_lock_irqsave(&tlb_lock, intr_flag);
+    {
+        // the pte is written before the cr3 of the cpus are read, a cpu
+        // loading cr3 later flushes its TLB anyway
+        asm volatile ("mfence" ::: "memory");
+        uint32_t targets = 0;
+        int i;
+        for (i = 0; i < ncpu; i ++) {
+            if (cpus + i != self && cpus[i].started && (cr3 == 0 || cpus[i].cr3 == cr3)) {
+                targets |= (1 << i);
+            }
+        }
+        if (targets != 0) {
+            tlb_request.cr3 = cr3, tlb_request.la = la;
+            tlb_request.pending = targets;
+            for (i = 0; i < ncpu; i ++) {
+                if (targets & (1 << i)) {
+                    lapic_ipi(cpus[i].apicid, T_IPI_TLB);
+                }
+            }
+            while (tlb_request.pending != 0) {
+                asm volatile ("pause");
+            }
+        }
+    }
+    spin_unlock_irqrestore(&tlb_lock, intr_flag);
+}
+
 // invalidate a TLB entry, but only if the page tables being
-// edited are the ones currently in use by the processor.
+// edited are the ones currently in use by the processor (the
+// kernel part is in all of them). the other cpus using them are
+// asked to do the same.
 void
 tlb_invalidate(pde_t *pgdir, uintptr_t la) {
-    if (rcr3() == PADDR(pgdir)) {
+    if (la >= KERNBASE || rcr3() == PADDR(pgdir)) {
         invlpg((void *)la);
     }
+    if (ncpu_online > 1) {
+        tlb_shootdown((la >= KERNBASE) ? 0 : PADDR(pgdir), la);
+    }
 }
 
 // pgdir_alloc_page - call alloc_page & page_insert functions to 
@@ -486,6 +628,51 @@ unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     } while (start != 0 && start < end);
 }
 
+// reclaim_range - free the page tables covering [start, end) that hold no
+//               - present or swap entry any more (called after unmap_range)
+void
+reclaim_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
+    assert(start % PGSIZE == 0 && end % PGSIZE == 0);
+    assert(USER_ACCESS(start, end));
+
+    start = ROUNDDOWN(start, PTSIZE);
+    do {
+        int pde_idx = PDX(start);
+        if (pgdir[pde_idx] & PTE_P) {
+            pte_t *pt = KADDR(PDE_ADDR(pgdir[pde_idx]));
+            int i;
+            for (i = 0; i < NPTEENTRY; i ++) {
+                if (pt[i] != 0) {
+                    break;
+                }
+            }
+            if (i == NPTEENTRY) {
+                struct Page *page = pde2page(pgdir[pde_idx]);
+                // unhook the table and drop every cached walk through it
+                // (including the VPT alias) before the page can be reused
+                pgdir[pde_idx] = 0;
+                tlb_invalidate(pgdir, start);
+                tlb_invalidate(pgdir, (uintptr_t)(VPT + pde_idx * PGSIZE));
+                free_page(page);
+            }
+        }
+        start += PTSIZE;
+    } while (start != 0 && start < end);
+}
+
+// pt_count - count the user page tables present in pgdir
+size_t
+pt_count(pde_t *pgdir) {
+    size_t count = 0;
+    int i;
+    for (i = PDX(USERBASE); i < PDX(USERTOP); i ++) {
+        if (pgdir[i] & PTE_P) {
+            count ++;
+        }
+    }
+    return count;
+}
+
 void
 exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     assert(start % PGSIZE == 0 && end % PGSIZE == 0);
@@ -533,6 +720,7 @@ copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share) {
                 swap_entry_t entry = *ptep;
                 swap_duplicate(entry);
                 *nptep = entry;
+                pgdir_account(to, 0, 1);
             }
         }
         start += PGSIZE;
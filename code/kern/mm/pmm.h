@@ -27,6 +27,7 @@ extern pde_t *boot_pgdir;
 extern uintptr_t boot_cr3;
 
 void pmm_init(void);
+void *mmio_map(uintptr_t pa, size_t size);
 
 struct Page *alloc_pages(size_t n);
 void free_pages(struct Page *base, size_t n);
@@ -41,11 +42,18 @@ void page_remove(pde_t *pgdir, uintptr_t la);
 int page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm);
 
 void load_esp0(uintptr_t esp0);
+struct cpu;
+void gdt_init(struct cpu *cpu, uintptr_t esp0);
 void tlb_invalidate(pde_t *pgdir, uintptr_t la);
 struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm);
 void unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
+void reclaim_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
+size_t pt_count(pde_t *pgdir);
 int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share);
+struct mm_struct;
+void pgdir_set_mm(pde_t *pgdir, struct mm_struct *mm);
+void pgdir_account(pde_t *pgdir, int rss, int swapped);
 
 void print_pgdir(void);
 
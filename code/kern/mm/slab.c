@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <slab.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <pmm.h>
 #include <stdio.h>
 #include <rb_tree.h>
@@ -94,6 +95,8 @@ struct kmem_cache_s {
     size_t page_order;
 
     kmem_cache_t *slab_cachep;
+
+    spinlock_t lock;             // protects the slab lists and the slabs on them
 };
 
 #define MIN_SIZE_ORDER          5           // 32
@@ -123,10 +126,10 @@ slab_allocated(void) {
     size_t total = 0;
     int i;
     bool intr_flag;
-    local_intr_save(intr_flag);
-    {
-        for (i = 0; i < SLAB_CACHE_NUM; i ++) {
-            kmem_cache_t *cachep = slab_cache + i;
+    for (i = 0; i < SLAB_CACHE_NUM; i ++) {
+        kmem_cache_t *cachep = slab_cache + i;
+        spin_lock_irqsave(&(cachep->lock), intr_flag);
+        {
             list_entry_t *list, *le;
             list = le = &(cachep->slabs_full);
             while ((le = list_next(le)) != list) {
@@ -138,8 +141,8 @@ slab_allocated(void) {
                 total += slabp->inuse * cachep->objsize;
             }
         }
+        spin_unlock_irqrestore(&(cachep->lock), intr_flag);
     }
-    local_intr_restore(intr_flag);
     return total;
 }
 
@@ -227,6 +230,7 @@ static void
 init_kmem_cache(kmem_cache_t *cachep, size_t objsize, size_t align) {
     list_init(&(cachep->slabs_full));
     list_init(&(cachep->slabs_notfull));
+    spinlock_init(&(cachep->lock));
 
     objsize = ROUNDUP(objsize, align);
     cachep->objsize = objsize;
@@ -323,11 +327,11 @@ kmem_cache_grow(kmem_cache_t *cachep) {
     slabp->free = 0;
 
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(cachep->lock), intr_flag);
     {
         list_add(&(cachep->slabs_notfull), &(slabp->slab_link));
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(cachep->lock), intr_flag);
     return 1;
 
 oops:
@@ -358,17 +362,17 @@ kmem_cache_alloc(kmem_cache_t *cachep) {
     bool intr_flag;
 
 try_again:
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(cachep->lock), intr_flag);
     if (list_empty(&(cachep->slabs_notfull))) {
         goto alloc_new_slab;
     }
     slab_t *slabp = le2slab(list_next(&(cachep->slabs_notfull)), slab_link);
     objp = kmem_cache_alloc_one(cachep, slabp);
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(cachep->lock), intr_flag);
     return objp;
 
 alloc_new_slab:
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(cachep->lock), intr_flag);
 
     if (kmem_cache_grow(cachep)) {
         goto try_again;
@@ -446,11 +450,11 @@ kmem_cache_free(kmem_cache_t *cachep, void *objp) {
     if (!PageSlab(page)) {
         panic("not a slab page %08x\n", objp);
     }
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(cachep->lock), intr_flag);
     {
         kmem_cache_free_one(cachep, GET_PAGE_SLAB(page), objp);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(cachep->lock), intr_flag);
 }
 
 // kfree - simple interface used by ooutside functions to free an obj
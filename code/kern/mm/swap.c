@@ -15,6 +15,12 @@
 #include <proc.h>
 #include <wait.h>
 #include <sync.h>
+#include <spinlock.h>
+#include <zswap.h>
+#include <fs.h>
+#include <ide.h>
+#include <oom.h>
+#include <memgroup.h>
 
 /* ------------- swap in/out & page replacement mechanism design&implementation -------------
 Hardware Requrirement:
@@ -48,6 +54,12 @@ maintained in a pseudo-LRU manner: Items are added to the tail and removed from
 enough free page to alloc, the page items from the active list are moved back to the inactive list, making them available 
 to evict. The two-list strategy solves the only-used-once failure in a classic LRU and also enables simpler, pseudo-LRU 
 semantics to perform well.This two-list approach is also known as LRU/2; it can be generalized to n-lists, called LRU/n. 
+  To resist scans, ucore also keeps a non-resident history like 2Q's A1out: the slots of the pages evicted lately. A page
+faulted in without history is cold, the clock hand of swap_out_vma unmaps it the first time it finds the page unreferenced.
+A page faulted in again while its slot is still in the history is a refault, it belongs to a working set and comes back
+hot (PG_workingset), the hand has to pass it unreferenced once more before unmapping it. So the pages a streaming process
+touches only once are evicted before the working sets of others. kswapd asks each mm for pages in proportion to its
+resident size, less the more of its pages have refaulted lately.
 
 Implementation:
 ----------------------------
@@ -73,9 +85,6 @@ swap implementation is in kswapd_main(swap.c::proj11::lab3), and the steps are s
     swap out some inactive swap page frame to swap space(disk).
 */
 
-// the max offset of swap entry
-size_t max_swap_offset;
-
 // the list of pages for swap
 typedef struct {
     list_entry_t swap_list;
@@ -91,13 +100,57 @@ static swap_list_t inactive_list;
 #define nr_active_pages                 (active_list.nr_pages)
 #define nr_inactive_pages               (inactive_list.nr_pages)
 
-// the array element is used to record the offset of swap entry
-// the value of array element is the reference number of swap out page
-// page->ref+mem_map[offset]= the total reference number of a page(in mem OR swap space)
-// the index of array element is the offset of swap space(disk)
-static unsigned short *mem_map;
-
 #define SWAP_UNUSED                     0xFFFF
+
+// the free slots are also kept in a two-level bitmap, so allocation needn't scan
+// the map: one bit per slot, SWAP_CLUSTER_SLOTS slots (one word) make a cluster;
+// one bit per cluster in cluster_map says the cluster has a free slot.
+// cluster_free[] counts the free slots of each cluster, fully free clusters are
+// preferred so that the pages swapped out together get contiguous slots.
+#define SWAP_CLUSTER_SHIFT              5
+#define SWAP_CLUSTER_SLOTS              (1 << SWAP_CLUSTER_SHIFT)
+
+// a swap device, the type in swap_entry_t is its index in swap_devs
+struct swap_device {
+    uint32_t flags;                     // SWP_USED, SWP_WRITEOK
+    unsigned short ideno;               // the IDE device
+    int prio;                           // the devices of higher prio are used first
+    size_t max_offset;                  // the slots are [1, max_offset)
+    // the array element is the reference number of swap out page in the slot
+    // page->ref+map[offset]= the total reference number of a page(in mem OR swap space)
+    unsigned short *map;
+    uint32_t *slot_map;
+    uint32_t *cluster_map;
+    unsigned char *cluster_free;
+    size_t nr_clusters, nr_free_clusters, nr_free_slots;
+    // the cluster the following allocations take slots from in order, so the
+    // pages swapped out together get contiguous slots and page_launder can
+    // write them in one I/O
+    size_t cluster_cur, cluster_pos;
+};
+
+#define SWP_USED                        0x1     // the device is in use
+#define SWP_WRITEOK                     0x2     // new slots may be allocated on it
+
+static struct swap_device swap_devs[MAX_SWAP_DEVS];
+
+// the device new slots come from, the devices of the same prio take turns
+// cluster by cluster, so the swap I/O is spread over the IDE channels
+static int swap_cur_dev = 0;
+
+// swap_map_ptr - the reference number of the slot of entry
+static inline unsigned short *
+swap_map_ptr(swap_entry_t entry) {
+    struct swap_device *dev = swap_devs + swap_type(entry);
+    size_t offset = swap_offset(entry);
+    if (!((dev->flags & SWP_USED) && offset < dev->max_offset)) {
+        panic("invalid swap_entry_t = %08x.\n", entry);
+    }
+    return dev->map + offset;
+}
+
+#define swap_map(entry)                 (*swap_map_ptr(entry))
+
 #define MAX_SWAP_REF                    0xFFFE
 
 static volatile bool swap_init_ok = 0;
@@ -109,11 +162,83 @@ static volatile bool swap_init_ok = 0;
 // the hash list used to find swap page according to swap entry quickly.
 static list_entry_t hash_list[HASH_LIST_SIZE];
 
+// protects hash_list, the two swap lists and the wait queues of the swap code.
+// each operation on them is atomic, a scan of a list relies on the kernel lock
+// (sched.h) to keep it from changing under it while the scanner sleeps.
+static spinlock_t swap_lock;
+
+static void swap_map_set(swap_entry_t entry, unsigned short count);
+
 static void check_swap(void);
 static void check_mm_swap(void);
 static void check_mm_shm_swap(void);
-
-static semaphore_t swap_in_sem;
+#ifdef CHECK_SWAP_POLICY
+static void check_swap_policy(void);
+#endif
+
+// the processes waiting for a swap cache page under I/O (PG_locked), hashed by
+// page, so faults on different entries never wait for each other
+#define SWAP_WAIT_SHIFT                 6
+#define SWAP_WAIT_TABLE_SIZE            (1 << SWAP_WAIT_SHIFT)
+
+static wait_queue_t swap_wait_table[SWAP_WAIT_TABLE_SIZE];
+
+// swap readahead: a major fault also reads up to swap_ra_window - 1 neighbouring
+// slots into the swap cache. the window grows when a page read ahead is used,
+// and shrinks when one is reclaimed before anyone used it.
+#define SWAP_RA_MIN_WINDOW              2
+#define SWAP_RA_RESERVE                 (SWAPFS_MAX_PAGES * 4)
+
+static size_t swap_ra_window = SWAP_RA_MIN_WINDOW * 2;
+static size_t swap_ra_hits, swap_ra_misses, swap_ra_pages, swap_ra_wasted;
+
+// the non-resident history (2Q's A1out): the slots of the pages evicted lately
+// and when, a fault on one of them is a refault. a direct-mapped table, a newer
+// eviction overwrites an older one of the same hash.
+#define SWAP_HISTORY_SHIFT              10
+#define SWAP_HISTORY_SIZE               (1 << SWAP_HISTORY_SHIFT)
+
+struct swap_history {
+    uint32_t clock;                     // the number of evictions so far
+    struct {
+        swap_entry_t entry;
+        uint32_t time;
+    } slots[SWAP_HISTORY_SIZE];
+};
+
+static struct swap_history swap_history;
+static size_t swap_refaults;
+
+// a refault counts as much as SWAP_REFAULT_WEIGHT resident pages against the
+// share of the reclaim of an mm
+#define SWAP_REFAULT_WEIGHT             8
+
+// asynchronous writeback: page_launder starts the writes with the requests
+// in swap_wb_free, the interrupt handler moves them to swap_wb_done when the
+// writes complete, and kswapd frees the pages. at most SWAP_WB_REQUESTS
+// writes are in flight, page_launder writes synchronously beyond that.
+#define SWAP_WB_REQUESTS                32
+
+static struct swapfs_request swap_wb_requests[SWAP_WB_REQUESTS];
+static list_entry_t swap_wb_free, swap_wb_done;
+static volatile int nr_wb_inflight;
+static size_t nr_wb_started, nr_wb_sync;
+static wait_queue_t swap_wb_wait;
+// protects swap_wb_done, nr_wb_inflight and swap_wb_wait, shared with the
+// interrupt handler, which may run on another cpu
+static spinlock_t swap_wb_lock;
+
+// asynchronous prefetch: MADV_WILLNEED starts the reads with the requests in
+// swap_pf_free and returns, the interrupt handler moves them to swap_pf_done
+// when the reads complete, and kswapd puts the pages on the inactive list and
+// unlocks them. the faults on the pages wait for the reads meanwhile.
+#define SWAP_PF_REQUESTS                8
+
+static struct swapfs_request swap_pf_requests[SWAP_PF_REQUESTS];
+static list_entry_t swap_pf_free, swap_pf_done;
+static size_t nr_pf_started;
+// protects swap_pf_done, shared with the interrupt handler
+static spinlock_t swap_pf_lock;
 
 static volatile int pressure = 0;
 static wait_queue_t kswapd_done;
@@ -131,8 +256,10 @@ swap_active_list_add(struct Page *page) {
     assert(PageSwap(page));
     SetPageActive(page);
     swap_list_t *list = &active_list;
+    spin_lock(&swap_lock);
     list->nr_pages ++;
     list_add_before(&(list->swap_list), &(page->swap_link));
+    spin_unlock(&swap_lock);
 }
 
 // swap_inactive_list_add - add the page to inactive_list
@@ -141,48 +268,75 @@ swap_inactive_list_add(struct Page *page) {
     assert(PageSwap(page));
     ClearPageActive(page);
     swap_list_t *list = &inactive_list;
+    spin_lock(&swap_lock);
     list->nr_pages ++;
     list_add_before(&(list->swap_list), &(page->swap_link));
+    spin_unlock(&swap_lock);
 }
 
 // swap_list_del - delete page from the swap list
 static inline void
 swap_list_del(struct Page *page) {
     assert(PageSwap(page));
+    spin_lock(&swap_lock);
     (PageActive(page) ? &active_list : &inactive_list)->nr_pages --;
     list_del(&(page->swap_link));
+    spin_unlock(&swap_lock);
 }
 
-// swap_init - init swap fs, two swap lists, alloc memory & init for swap_entry record array mem_map
+// swap_init - init swap fs, two swap lists, add the swap devices
 //           - init the hash list.
 void
 swap_init(void) {
     swapfs_init();
     swap_list_init(&active_list);
     swap_list_init(&inactive_list);
+    spinlock_init(&swap_lock);
+    spinlock_init(&swap_wb_lock);
+    spinlock_init(&swap_pf_lock);
 
-    if (!(1024 <= max_swap_offset && max_swap_offset < MAX_SWAP_OFFSET_LIMIT)) {
-        panic("bad max_swap_offset %08x.\n", max_swap_offset);
+    int i;
+    for (i = 0; i < HASH_LIST_SIZE; i ++) {
+        list_init(hash_list + i);
     }
 
-    mem_map = kmalloc(sizeof(short) * max_swap_offset);
-    assert(mem_map != NULL);
+    for (i = 0; i < SWAP_WAIT_TABLE_SIZE; i ++) {
+        wait_queue_init(swap_wait_table + i);
+    }
 
-    size_t offset;
-    for (offset = 0; offset < max_swap_offset; offset ++) {
-        mem_map[offset] = SWAP_UNUSED;
+    list_init(&swap_wb_free), list_init(&swap_wb_done);
+    for (i = 0; i < SWAP_WB_REQUESTS; i ++) {
+        list_add(&swap_wb_free, &(swap_wb_requests[i].link));
     }
+    wait_queue_init(&swap_wb_wait);
 
-    int i;
-    for (i = 0; i < HASH_LIST_SIZE; i ++) {
-        list_init(hash_list + i);
+    list_init(&swap_pf_free), list_init(&swap_pf_done);
+    for (i = 0; i < SWAP_PF_REQUESTS; i ++) {
+        list_add(&swap_pf_free, &(swap_pf_requests[i].link));
     }
 
-    sem_init(&swap_in_sem, 1);
+    // the checks below expect a single swap device
+    if ((i = swap_add_device(SWAP_DEV_NO, 0)) != 0) {
+        panic("swap: can't use ide %d as swap device, error %d.\n", SWAP_DEV_NO, i);
+    }
+    if (swap_devs[0].max_offset < 1024) {
+        panic("bad swap device size %08x.\n", swap_devs[0].max_offset);
+    }
 
     check_swap();
     check_mm_swap();
     check_mm_shm_swap();
+#ifdef CHECK_SWAP_POLICY
+    check_swap_policy();
+#endif
+
+    zswap_init();
+    oom_init();
+    memgroup_init();
+
+    if (ide_device_valid(SWAP1_DEV_NO)) {
+        swap_add_device(SWAP1_DEV_NO, 0);
+    }
 
     wait_queue_init(&kswapd_done);
     swap_init_ok = 1;
@@ -198,6 +352,10 @@ try_free_pages(size_t n) {
     if (current == kswapd) {
         panic("kswapd call try_free_pages!!.\n");
     }
+    if (current->flags & PF_MEMDIE) {
+        // killed by the OOM killer, take the reserve and exit
+        return 0;
+    }
     if (n >= (1 << 7)) {
         return 0;
     }
@@ -206,7 +364,7 @@ try_free_pages(size_t n) {
     wait_t __wait, *wait = &__wait;
 
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&swap_lock, intr_flag);
     {
         wait_init(wait, current);
         current->state = PROC_SLEEPING;
@@ -216,7 +374,7 @@ try_free_pages(size_t n) {
             wakeup_proc(kswapd);
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
 
     schedule();
 
@@ -224,14 +382,48 @@ try_free_pages(size_t n) {
     return 1;
 }
 
+// try_free_group_pages - ask kswapd to shrink memory group mg under its limit,
+//                      - and wait for it.
+bool
+try_free_group_pages(struct memgroup *mg) {
+    if (!swap_init_ok || kswapd == NULL || current == kswapd) {
+        return 0;
+    }
+    if (current->flags & PF_MEMDIE) {
+        return 0;
+    }
+
+    wait_t __wait, *wait = &__wait;
+
+    bool intr_flag;
+    spin_lock_irqsave(&swap_lock, intr_flag);
+    {
+        mg->reclaim = 1;
+        wait_current_set(&(mg->reclaim_wait), wait, WT_KSWAPD);
+        if (kswapd->wait_state == WT_TIMER) {
+            wakeup_proc(kswapd);
+        }
+    }
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
+
+    schedule();
+
+    spin_lock_irqsave(&swap_lock, intr_flag);
+    {
+        wait_current_del(&(mg->reclaim_wait), wait);
+    }
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
+    return 1;
+}
+
 static void
 kswapd_wakeup_all(void) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&swap_lock, intr_flag);
     {
         wakeup_queue(&kswapd_done, WT_KSWAPD, 1);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
 }
 
 static swap_entry_t try_alloc_swap_entry(void);
@@ -245,13 +437,15 @@ swap_page_add(struct Page *page, swap_entry_t entry) {
         if ((entry = try_alloc_swap_entry()) == 0) {
             return 0;
         }
-        assert(mem_map[swap_offset(entry)] == SWAP_UNUSED);
-        mem_map[swap_offset(entry)] = 0;
+        assert(swap_map(entry) == SWAP_UNUSED);
+        swap_map_set(entry, 0);
         SetPageDirty(page);
     }
     SetPageSwap(page);
     page->index = entry;
+    spin_lock(&swap_lock);
     list_add(hash_list + entry_hashfn(entry), &(page->page_link));
+    spin_unlock(&swap_lock);
     return 1;
 }
 
@@ -259,8 +453,18 @@ swap_page_add(struct Page *page, swap_entry_t entry) {
 static void
 swap_page_del(struct Page *page) {
     assert(PageSwap(page));
+    if (PageReadahead(page)) {
+        ClearPageReadahead(page);
+        swap_ra_wasted ++;
+        if (swap_ra_window > SWAP_RA_MIN_WINDOW) {
+            swap_ra_window --;
+        }
+    }
+    ClearPageWorkingset(page);
     ClearPageSwap(page);
+    spin_lock(&swap_lock);
     list_del(&(page->page_link));
+    spin_unlock(&swap_lock);
 }
 
 // swap_free_page - call swap_page_del&free_page to generate a free page
@@ -275,42 +479,227 @@ swap_free_page(struct Page *page) {
 static struct Page *
 swap_hash_find(swap_entry_t entry) {
     list_entry_t *list = hash_list + entry_hashfn(entry), *le= list;
+    struct Page *page = NULL;
+    spin_lock(&swap_lock);
     while ((le = list_next(le)) != list) {
-        struct Page *page = le2page(le, page_link);
-        if (page->index == entry) {
-            return page;
+        if (le2page(le, page_link)->index == entry) {
+            page = le2page(le, page_link);
+            break;
+        }
+    }
+    spin_unlock(&swap_lock);
+    return page;
+}
+
+// swap_history_add - remember that the page of entry is evicted now
+static inline void
+swap_history_add(struct swap_history *h, swap_entry_t entry) {
+    size_t i = hash32(entry, SWAP_HISTORY_SHIFT);
+    h->slots[i].entry = entry, h->slots[i].time = ++ h->clock;
+}
+
+// swap_history_test - check whether the page of entry was evicted within the
+//                   - last SWAP_HISTORY_SIZE evictions, and forget it
+static inline bool
+swap_history_test(struct swap_history *h, swap_entry_t entry) {
+    size_t i = hash32(entry, SWAP_HISTORY_SHIFT);
+    if (h->slots[i].entry != entry) {
+        return 0;
+    }
+    h->slots[i].entry = 0;
+    return h->clock - h->slots[i].time < SWAP_HISTORY_SIZE;
+}
+
+// swap_history_forget - the slot of entry is freed, it may hold another page later
+static inline void
+swap_history_forget(struct swap_history *h, swap_entry_t entry) {
+    size_t i = hash32(entry, SWAP_HISTORY_SHIFT);
+    if (h->slots[i].entry == entry) {
+        h->slots[i].entry = 0;
+    }
+}
+
+// swap_clock_hand - the clock hand passes a resident page: a referenced page
+//   gets another round, so does a hot one, which becomes cold. return true if
+//   the page may be evicted now.
+static inline bool
+swap_clock_hand(bool referenced, bool *hot) {
+    if (referenced) {
+        return 0;
+    }
+    if (*hot) {
+        *hot = 0;
+        return 0;
+    }
+    return 1;
+}
+
+// swap_mm_weight - the share of the reclaim of an mm with rss evictable pages
+//                - resident, of which refaults came back lately
+static inline size_t
+swap_mm_weight(size_t rss, size_t refaults) {
+    return (rss == 0) ? 0 : rss * rss / (rss + SWAP_REFAULT_WEIGHT * refaults);
+}
+
+// swap_map_set - set the reference number of the slot of entry, SWAP_UNUSED
+//              - frees it. the free bitmaps follow the transitions of the map.
+static void
+swap_map_set(swap_entry_t entry, unsigned short count) {
+    struct swap_device *dev = swap_devs + swap_type(entry);
+    size_t offset = (entry >> 8);
+    assert((dev->flags & SWP_USED) && offset < dev->max_offset);
+    bool was_free = (dev->map[offset] == SWAP_UNUSED), now_free = (count == SWAP_UNUSED);
+    dev->map[offset] = count;
+    if (offset == 0 || was_free == now_free) {
+        return ;
+    }
+    size_t cluster = (offset >> SWAP_CLUSTER_SHIFT);
+    uint32_t bit = (1u << (offset & (SWAP_CLUSTER_SLOTS - 1)));
+    if (now_free) {
+        zswap_invalidate(entry);
+        swap_history_forget(&swap_history, entry);
+        dev->slot_map[cluster] |= bit;
+        dev->cluster_map[cluster >> 5] |= (1u << (cluster & 31));
+        if (++ dev->cluster_free[cluster] == SWAP_CLUSTER_SLOTS) {
+            dev->nr_free_clusters ++;
+        }
+        dev->nr_free_slots ++;
+    }
+    else {
+        dev->slot_map[cluster] &= ~bit;
+        if (dev->slot_map[cluster] == 0) {
+            dev->cluster_map[cluster >> 5] &= ~(1u << (cluster & 31));
+        }
+        if (dev->cluster_free[cluster] -- == SWAP_CLUSTER_SLOTS) {
+            dev->nr_free_clusters --;
         }
+        dev->nr_free_slots --;
     }
-    return NULL;
 }
 
-// try_alloc_swap_entry - try to alloc a unused swap entry
+// try_alloc_swap_cluster - find a fully free cluster of dev and make it current
+static bool
+try_alloc_swap_cluster(struct swap_device *dev) {
+    size_t scan, next = dev->cluster_cur;
+    if (dev->nr_free_clusters == 0) {
+        return 0;
+    }
+    for (scan = 0; scan < dev->nr_clusters; scan ++) {
+        if (++ next >= dev->nr_clusters) {
+            next = 0;
+        }
+        if (dev->cluster_free[next] == SWAP_CLUSTER_SLOTS) {
+            dev->cluster_cur = next, dev->cluster_pos = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// cluster_first_free - the first free slot in cluster at or after pos, 0 if none
+static inline size_t
+cluster_first_free(struct swap_device *dev, size_t cluster, size_t pos) {
+    uint32_t bits = (pos < SWAP_CLUSTER_SLOTS) ? dev->slot_map[cluster] & ~((1u << pos) - 1) : 0;
+    if (bits == 0) {
+        return 0;
+    }
+    return (cluster << SWAP_CLUSTER_SHIFT) + __builtin_ctz(bits);
+}
+
+// swap_dev_usable - new slots may be allocated on dev
+static inline bool
+swap_dev_usable(struct swap_device *dev) {
+    return (dev->flags & SWP_WRITEOK) && dev->nr_free_slots != 0;
+}
+
+// swap_pick_device - choose the device for a new slot: the usable device of the
+//   highest prio; the devices of that prio take turns, each fills up its current
+//   cluster before the next one takes over. return -1 if all of them are full.
+static int
+swap_pick_device(void) {
+    int i, type = -1;
+    for (i = 0; i < MAX_SWAP_DEVS; i ++) {
+        if (swap_dev_usable(swap_devs + i) && (type < 0 || swap_devs[i].prio > swap_devs[type].prio)) {
+            type = i;
+        }
+    }
+    if (type < 0) {
+        return -1;
+    }
+    int prio = swap_devs[type].prio;
+    struct swap_device *dev = swap_devs + swap_cur_dev;
+    if (swap_dev_usable(dev) && dev->prio == prio
+            && cluster_first_free(dev, dev->cluster_cur, dev->cluster_pos) != 0) {
+        return swap_cur_dev;
+    }
+    for (i = 1; i <= MAX_SWAP_DEVS; i ++) {
+        type = (swap_cur_dev + i) % MAX_SWAP_DEVS;
+        dev = swap_devs + type;
+        if (swap_dev_usable(dev) && dev->prio == prio) {
+            break;
+        }
+    }
+    return swap_cur_dev = type;
+}
+
+// swap_dev_alloc - alloc a free slot of dev: from its current cluster, a fully
+//                - free cluster, any cluster with free slots in order.
+static size_t
+swap_dev_alloc(struct swap_device *dev) {
+    size_t offset;
+    do {
+        if ((offset = cluster_first_free(dev, dev->cluster_cur, dev->cluster_pos)) != 0) {
+            dev->cluster_pos = (offset & (SWAP_CLUSTER_SLOTS - 1)) + 1;
+            return offset;
+        }
+    } while (try_alloc_swap_cluster(dev));
+
+    size_t i, n = (dev->nr_clusters + 31) >> 5;
+    for (i = 0; i < n; i ++) {
+        uint32_t bits = dev->cluster_map[i];
+        if (bits != 0) {
+            size_t cluster = (i << 5) + __builtin_ctz(bits);
+            offset = cluster_first_free(dev, cluster, 0);
+            assert(offset != 0);
+            return offset;
+        }
+    }
+    panic("swap: nr_free_slots = %d, but no free slot found.\n", dev->nr_free_slots);
+}
+
+// try_alloc_swap_entry - try to alloc a unused swap entry. if swap is full,
+//                      - drop a cached page nobody references any more and
+//                      - reuse its slot.
 static swap_entry_t
 try_alloc_swap_entry(void) {
+    int type;
+    if ((type = swap_pick_device()) >= 0) {
+        return swap_entry(type, swap_dev_alloc(swap_devs + type));
+    }
+
+    static int next_type = 0;
     static size_t next = 1;
-    size_t empty = 0, zero = 0, end = next;
-    do {
-        switch (mem_map[next]) {
-        case SWAP_UNUSED:
-            empty = next;
-            break;
-        case 0:
-            if (zero == 0) {
-                zero = next;
-            }
-            break;
+    size_t total = 0, scan;
+    for (type = 0; type < MAX_SWAP_DEVS; type ++) {
+        if (swap_devs[type].flags & SWP_WRITEOK) {
+            total += swap_devs[type].max_offset;
         }
-        if (++ next == max_swap_offset) {
-            next = 1;
-        }
-    } while (empty == 0 && next != end);
+    }
 
     swap_entry_t entry = 0;
-    if (empty != 0) {
-        entry = (empty << 8);
+    for (scan = 0; entry == 0 && scan < total + MAX_SWAP_DEVS * 2; scan ++) {
+        struct swap_device *dev = swap_devs + next_type;
+        if (!(dev->flags & SWP_WRITEOK) || next >= dev->max_offset) {
+            next_type = (next_type + 1) % MAX_SWAP_DEVS, next = 1;
+            continue ;
+        }
+        if (dev->map[next] == 0) {
+            entry = swap_entry(next_type, next);
+        }
+        next ++;
     }
-    else if (zero != 0) {
-        entry = (zero << 8);
+
+    if (entry != 0) {
         struct Page *page = swap_hash_find(entry);
         assert(page != NULL && PageSwap(page));
         swap_list_del(page);
@@ -320,7 +709,7 @@ try_alloc_swap_entry(void) {
         else {
             swap_page_del(page);
         }
-        mem_map[zero] = SWAP_UNUSED;
+        swap_map_set(entry, SWAP_UNUSED);
     }
 
     static unsigned int failed_counter = 0;
@@ -334,9 +723,8 @@ try_alloc_swap_entry(void) {
 //                   - and call swap_free_page to generate a free page 
 void
 swap_remove_entry(swap_entry_t entry) {
-    size_t offset = swap_offset(entry);
-    assert(mem_map[offset] > 0);
-    if (-- mem_map[offset] == 0) {
+    assert(swap_map(entry) > 0);
+    if (-- swap_map(entry) == 0) {
         struct Page *page = swap_hash_find(entry);
         if (page != NULL) {
             if (page_ref(page) != 0) {
@@ -345,7 +733,7 @@ swap_remove_entry(swap_entry_t entry) {
             swap_list_del(page);
             swap_free_page(page);
         }
-        mem_map[offset] = SWAP_UNUSED;
+        swap_map_set(entry, SWAP_UNUSED);
     }
 }
 
@@ -355,68 +743,456 @@ swap_page_count(struct Page *page) {
     if (!PageSwap(page)) {
         return 0;
     }
-    size_t offset = swap_offset(page->index);
-    assert(mem_map[offset] >= 0);
-    return mem_map[offset];
+    assert(swap_map(page->index) >= 0);
+    return swap_map(page->index);
 }
 
-// swap_duplicate - reference number of mem_map[offset] ++
+// swap_duplicate - reference number of the slot ++
 void
 swap_duplicate(swap_entry_t entry) {
-    size_t offset = swap_offset(entry);
-    assert(mem_map[offset] >= 0 && mem_map[offset] < MAX_SWAP_REF);
-    mem_map[offset] ++;
+    unsigned short *map = swap_map_ptr(entry);
+    assert(*map >= 0 && *map < MAX_SWAP_REF);
+    (*map) ++;
 }
 
-// swap_in_page - swap in a content of a page frame from swap space to memory
-//              - set the PG_swap flag in this page and add this page to swap active list
-int
-swap_in_page(swap_entry_t entry, struct Page **pagep) {
-    if (pagep == NULL) {
-        return -E_INVAL;
+// swap_ra_slot_ok - check whether the slot at offset of device type is worth
+//                 - reading ahead: it is in use and its page is not in the
+//                 - swap cache (or the compressed pool) yet
+static inline bool
+swap_ra_slot_ok(int type, size_t offset) {
+    struct swap_device *dev = swap_devs + type;
+    if (!(offset > 0 && offset < dev->max_offset)) {
+        return 0;
     }
-    size_t offset = swap_offset(entry);
-    assert(mem_map[offset] >= 0);
+    if (dev->map[offset] == 0 || dev->map[offset] == SWAP_UNUSED) {
+        return 0;
+    }
+    swap_entry_t entry = swap_entry(type, offset);
+    return swap_hash_find(entry) == NULL && !zswap_contains(entry);
+}
 
-    int ret;
-    struct Page *page, *newpage;
-    if ((page = swap_hash_find(entry)) != NULL) {
-        goto found;
+// swap_page_waitqueue - get the wait queue for the page under I/O
+static inline wait_queue_t *
+swap_page_waitqueue(struct Page *page) {
+    return swap_wait_table + hash32(page2ppn(page), SWAP_WAIT_SHIFT);
+}
+
+// swap_lock_page - add page to the swap cache as the frame for entry and lock it,
+//                - the faults on entry wait for the I/O instead of reading it again.
+//   the slot is pinned until swap_unlock_page, as its owners may go away meanwhile.
+static void
+swap_lock_page(struct Page *page, swap_entry_t entry) {
+    swap_duplicate(entry);
+    swap_page_add(page, entry);
+    SetPageLocked(page);
+}
+
+// swap_unlock_page - the I/O on page is done, wake up the waiters. if the read
+//                  - failed, page is dropped from the swap cache and freed,
+//                  - otherwise the caller has already put it on a swap list.
+static void
+swap_unlock_page(struct Page *page, bool uptodate) {
+    assert(PageSwap(page) && PageLocked(page));
+    swap_entry_t entry = page->index;
+    ClearPageLocked(page);
+    if (!uptodate) {
+        swap_page_del(page);
+        free_page(page);
     }
 
-    newpage = alloc_page();
+    bool intr_flag;
+    spin_lock_irqsave(&swap_lock, intr_flag);
+    {
+        wakeup_queue(swap_page_waitqueue(page), WT_SWAPIN, 1);
+    }
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
+
+    swap_remove_entry(entry);
+}
+
+// swap_page_wait - wait for the I/O on a locked swap cache page to finish.
+//   the page may be freed meanwhile, the caller must look it up again.
+static void
+swap_page_wait(struct Page *page) {
+    wait_queue_t *queue = swap_page_waitqueue(page);
+    wait_t __wait, *wait = &__wait;
+
+    bool intr_flag;
+    spin_lock_irqsave(&swap_lock, intr_flag);
+    {
+        if (!PageLocked(page)) {
+            spin_unlock_irqrestore(&swap_lock, intr_flag);
+            return ;
+        }
+        wait_current_set(queue, wait, WT_SWAPIN);
+    }
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
+
+    schedule();
+
+    spin_lock_irqsave(&swap_lock, intr_flag);
+    {
+        wait_current_del(queue, wait);
+    }
+    spin_unlock_irqrestore(&swap_lock, intr_flag);
+}
+
+// swap_ra_range - find the run of slots around offset worth reading together,
+//               - at most window slots, at most half of them before offset
+static size_t
+swap_ra_range(int type, size_t offset, size_t window, size_t *lop) {
+    size_t lo = offset, hi = offset + 1;
+    while (lo - 1 > 0 && offset - lo < window / 2 && swap_ra_slot_ok(type, lo - 1)) {
+        lo --;
+    }
+    while (hi - lo < window && swap_ra_slot_ok(type, hi)) {
+        hi ++;
+    }
+    *lop = lo;
+    return hi - lo;
+}
+
+// swap_readahead - read the page of entry together with the neighbouring slots
+//                - in one I/O, at most window slots. the extra pages go into the
+//                - swap cache (clean, inactive and unmapped) so a later fault on
+//                - them is minor.
+//   page is the frame for entry itself, locked in the swap cache by the caller.
+static int
+swap_readahead(swap_entry_t entry, struct Page *page, size_t window) {
+    int type = swap_type(entry);
+    size_t offset = swap_offset(entry), lo, i, n, nr_extra = 0;
+    struct Page *pages[SWAPFS_MAX_PAGES], *extra[SWAPFS_MAX_PAGES];
+
+    // readahead must not push the system into reclaim
+    size_t free = nr_free_pages();
+    free = (free > SWAP_RA_RESERVE) ? free - SWAP_RA_RESERVE : 0;
+    if (window - 1 > free) {
+        window = free + 1;
+    }
+    n = swap_ra_range(type, offset, window, &lo);
+    while (nr_extra < n - 1 && (extra[nr_extra] = alloc_page()) != NULL) {
+        nr_extra ++;
+    }
+
+    // alloc_page may sleep, so look for the slots again
+    n = swap_ra_range(type, offset, nr_extra + 1, &lo);
+    for (i = 0; i < n; i ++) {
+        if (lo + i == offset) {
+            pages[i] = page;
+            continue ;
+        }
+        pages[i] = extra[-- nr_extra];
+        swap_lock_page(pages[i], swap_entry(type, lo + i));
+    }
+    while (nr_extra > 0) {
+        free_page(extra[-- nr_extra]);
+    }
 
-    down(&swap_in_sem);
+    int ret = (n == 1) ? swapfs_read(entry, page) : swapfs_read_pages(swap_entry(type, lo), pages, n);
+
+    for (i = 0; i < n; i ++) {
+        if (pages[i] == page) {
+            continue ;
+        }
+        if (ret == 0) {
+            swap_inactive_list_add(pages[i]);
+            SetPageReadahead(pages[i]);
+            swap_ra_pages ++;
+        }
+        swap_unlock_page(pages[i], ret == 0);
+    }
+    return ret;
+}
+
+// swap_ra_hit - a page read ahead is used for the first time
+static inline void
+swap_ra_hit(struct Page *page) {
+    if (PageReadahead(page)) {
+        ClearPageReadahead(page);
+        swap_ra_hits ++;
+        if (swap_ra_window < SWAPFS_MAX_PAGES) {
+            swap_ra_window ++;
+        }
+    }
+}
+
+// swap_ra_window_of - the readahead window of a fault in a vma with vm_flags:
+//                   - MADV_RANDOM reads the faulting page only, others use the
+//                   - adaptive window
+static inline size_t
+swap_ra_window_of(uint32_t vm_flags) {
+    if (!swap_init_ok || (vm_flags & VM_RAND_READ)) {
+        return 1;
+    }
+    return swap_ra_window;
+}
+
+// __swap_in_page - find the page of entry in the swap cache, or read it in with
+//                - the neighbouring slots within window.
+//   if ra, the page is read ahead for a fault to come: it is not read if already
+//   cached or nearly out of memory, and goes to the inactive list marked
+//   PG_readahead like the neighbouring slots.
+//   the faults on the same entry share one I/O: the first one adds a locked page
+//   to the swap cache before reading, the others wait for it to be unlocked.
+static int
+__swap_in_page(swap_entry_t entry, struct Page **pagep, size_t window, bool ra) {
+    int ret;
+    struct Page *page, *newpage = NULL;
+
+try_again:
     if ((page = swap_hash_find(entry)) != NULL) {
+        if (PageLocked(page)) {
+            swap_page_wait(page);
+            goto try_again;
+        }
+        if (newpage != NULL) {
+            free_page(newpage);
+        }
+        goto found;
+    }
+    if (ra && !swap_ra_slot_ok(swap_type(entry), swap_offset(entry))) {
+        // freed or compressed meanwhile, a fault on it will be cheap anyway
         if (newpage != NULL) {
             free_page(newpage);
         }
-        goto found_unlock;
+        return -E_INVAL;
     }
     if (newpage == NULL) {
-        ret = -E_NO_MEM;
-        goto failed_unlock;
+        if (ra && nr_free_pages() <= SWAP_RA_RESERVE) {
+            return -E_NO_MEM;
+        }
+        if ((newpage = alloc_page()) == NULL) {
+            return -E_NO_MEM;
+        }
+        // alloc_page may sleep, somebody may have read it in meanwhile
+        goto try_again;
     }
+
     page = newpage;
-    if (swapfs_read(entry, page) != 0) {
-        free_page(page);
-        ret = -E_SWAP_FAULT;
-        goto failed_unlock;
+    swap_lock_page(page, entry);
+    if (!ra) {
+        if (current != NULL) {
+            current->maj_flt ++;
+        }
+        if (swap_history_test(&swap_history, entry)) {
+            // evicted lately, it is in a working set
+            SetPageWorkingset(page);
+            swap_refaults ++;
+            if (current != NULL && current->mm != NULL) {
+                current->mm->swap_refaults ++;
+            }
+        }
+    }
+    if ((ret = zswap_load(entry, page)) != 0) {
+        if (!ra) {
+            swap_ra_misses ++;
+        }
+        ret = swap_readahead(entry, page, window);
+    }
+    if (ret == 0) {
+        if (ra) {
+            swap_inactive_list_add(page);
+            SetPageReadahead(page);
+            swap_ra_pages ++;
+        }
+        else {
+            swap_active_list_add(page);
+        }
+    }
+    swap_unlock_page(page, ret == 0);
+    if (ret != 0) {
+        return -E_SWAP_FAULT;
+    }
+    if (ra) {
+        *pagep = page;
+        return 0;
     }
-    swap_page_add(page, entry);
-    swap_active_list_add(page);
 
-found_unlock:
-    up(&swap_in_sem);
 found:
+    if (!ra) {
+        swap_ra_hit(page);
+    }
     *pagep = page;
     return 0;
+}
+
+// swap_in_page - swap in a content of a page frame from swap space to memory
+//              - set the PG_swap flag in this page and add this page to swap active list
+int
+swap_in_page(swap_entry_t entry, struct Page **pagep) {
+    if (pagep == NULL) {
+        return -E_INVAL;
+    }
+    assert(swap_map(entry) >= 0);
+    return __swap_in_page(entry, pagep, swap_ra_window_of(0), 0);
+}
+
+#define SWAP_VMA_RA_PAGES               8
+
+// swap_in_fault - swap in the page of entry mapped at addr in vma for a page fault,
+//               - reading ahead as the madvise advice of vma asks:
+//   MADV_RANDOM (VM_RAND_READ) reads the faulting page only;
+//   MADV_SEQUENTIAL (VM_SEQ_READ) also reads the swapped out pages of the next
+//   SWAP_VMA_RA_PAGES addresses, wherever their slots are;
+//   otherwise the neighbouring slots in the adaptive window are read.
+//   the mm of vma is locked by the caller.
+int
+swap_in_fault(struct vma_struct *vma, uintptr_t addr, swap_entry_t entry, struct Page **pagep) {
+    if (pagep == NULL) {
+        return -E_INVAL;
+    }
+    assert(swap_map(entry) >= 0);
+
+    int ret;
+    size_t window = swap_ra_window_of(vma->vm_flags);
+    if ((ret = __swap_in_page(entry, pagep, window, 0)) != 0 || !(vma->vm_flags & VM_SEQ_READ)) {
+        return ret;
+    }
+
+    // the fault page is not mapped yet, keep kswapd off it while reading ahead
+    struct Page *page;
+    page_ref_inc(*pagep);
+
+    pde_t *pgdir = vma->vm_mm->pgdir;
+    uintptr_t end = ROUNDDOWN(addr, PGSIZE) + (SWAP_VMA_RA_PAGES + 1) * PGSIZE;
+    if (end > vma->vm_end || end < addr) {
+        end = vma->vm_end;
+    }
+    for (addr = ROUNDDOWN(addr, PGSIZE) + PGSIZE; addr < end; addr += PGSIZE) {
+        pte_t *ptep = get_pte(pgdir, addr, 0);
+        if (ptep == NULL) {
+            break;
+        }
+        if (*ptep != 0 && !(*ptep & PTE_P)) {
+            if (__swap_in_page(*ptep, &page, window, 1) == -E_NO_MEM) {
+                break;
+            }
+        }
+    }
+    page_ref_dec(*pagep);
+    return 0;
+}
+
+// swap_prefetch_complete - the interrupt handler completes a prefetch, queue the
+//   request for kswapd, as the swap lists aren't interrupt safe
+static void
+swap_prefetch_complete(struct swapfs_request *req, int error) {
+    req->error = error;
+    spin_lock(&swap_pf_lock);
+    list_add_before(&swap_pf_done, &(req->link));
+    spin_unlock(&swap_pf_lock);
+    if (kswapd != NULL && kswapd->wait_state == WT_TIMER) {
+        wakeup_proc(kswapd);
+    }
+}
+
+/* *
+ * swap_prefetch - start reading the page of entry and the following slots into
+ * the swap cache in one I/O, at most SWAPFS_MAX_PAGES, and return at once. the
+ * pages are locked in the swap cache till kswapd finishes the read (see
+ * swap_prefetch_reap). the slots cached already or in the compressed pool are
+ * not read, a fault on them is cheap. return -E_BUSY if all the requests are in
+ * flight.
+ * */
+int
+swap_prefetch(swap_entry_t entry) {
+    int type = swap_type(entry);
+    size_t offset = swap_offset(entry), n = 0;
+    if (!swap_init_ok || !swap_ra_slot_ok(type, offset)) {
+        return 0;
+    }
+    if (list_empty(&swap_pf_free)) {
+        return -E_BUSY;
+    }
+    struct swapfs_request *req = le2sreq(list_next(&swap_pf_free), link);
+    list_del(&(req->link));
+
+    // readahead must not push the system into reclaim
+    while (n < SWAPFS_MAX_PAGES && nr_free_pages() > SWAP_RA_RESERVE) {
+        struct Page *page;
+        if (!swap_ra_slot_ok(type, offset + n) || (page = alloc_page()) == NULL) {
+            break;
+        }
+        // alloc_page may sleep, somebody may have read it in meanwhile
+        if (!swap_ra_slot_ok(type, offset + n)) {
+            free_page(page);
+            break;
+        }
+        swap_lock_page(page, swap_entry(type, offset + n));
+        req->pages[n ++] = page;
+    }
 
-failed_unlock:
-    up(&swap_in_sem);
+    int ret = 0;
+    if (n != 0) {
+        req->entry = entry, req->n = n;
+        req->complete = swap_prefetch_complete;
+        if ((ret = swapfs_read_pages_async(req)) == 0) {
+            nr_pf_started ++;
+            return 0;
+        }
+        while (n > 0) {
+            swap_unlock_page(req->pages[-- n], 0);
+        }
+    }
+    list_add(&swap_pf_free, &(req->link));
     return ret;
 }
 
+// swap_prefetch_reap - finish the prefetches completed: the pages read go to the
+//                    - inactive list as read ahead, the others are dropped
+static void
+swap_prefetch_reap(void) {
+    while (1) {
+        struct swapfs_request *req = NULL;
+        bool intr_flag;
+        spin_lock_irqsave(&swap_pf_lock, intr_flag);
+        {
+            if (!list_empty(&swap_pf_done)) {
+                req = le2sreq(list_next(&swap_pf_done), link);
+                list_del(&(req->link));
+            }
+        }
+        spin_unlock_irqrestore(&swap_pf_lock, intr_flag);
+
+        if (req == NULL) {
+            break;
+        }
+        size_t i;
+        for (i = 0; i < req->n; i ++) {
+            struct Page *page = req->pages[i];
+            if (req->error == 0) {
+                swap_inactive_list_add(page);
+                SetPageReadahead(page);
+                swap_ra_pages ++;
+            }
+            swap_unlock_page(page, req->error == 0);
+        }
+        list_add(&swap_pf_free, &(req->link));
+    }
+}
+
+// print_swapinfo - print the usage of swap space and the readahead statistics
+void
+print_swapinfo(void) {
+    int type;
+    for (type = 0; type < MAX_SWAP_DEVS; type ++) {
+        struct swap_device *dev = swap_devs + type;
+        if (dev->flags & SWP_USED) {
+            cprintf("swap %d: ide %d, prio %d, %d/%d slots used, %d free clusters%s.\n",
+                    type, dev->ideno, dev->prio, dev->max_offset - 1 - dev->nr_free_slots,
+                    dev->max_offset - 1, dev->nr_free_clusters,
+                    (dev->flags & SWP_WRITEOK) ? "" : ", being removed");
+        }
+    }
+    cprintf("swap: %d active, %d inactive pages cached.\n", nr_active_pages, nr_inactive_pages);
+    cprintf("workingset: %d evictions, %d refaults.\n", swap_history.clock, swap_refaults);
+    cprintf("writeback: %d in flight, %d written asynchronously, %d synchronously.\n",
+            nr_wb_inflight, nr_wb_started, nr_wb_sync);
+    cprintf("readahead: window %d, %d misses, %d pages read ahead, %d hits, %d wasted, %d prefetches.\n",
+            swap_ra_window, swap_ra_misses, swap_ra_pages, swap_ra_hits, swap_ra_wasted, nr_pf_started);
+    print_zswapinfo();
+}
+
 // swap_copy_entry - copy a content of swap out page frame to a new page
 //                 - set this new page PG_swap flag and add to swap active list
 int
@@ -446,27 +1222,236 @@ out:
     swap_remove_entry(entry);
     return ret;
 
-failed_free_page:
-    free_page(newpage);
-failed:
-    goto out;
+failed_free_page:
+    free_page(newpage);
+failed:
+    goto out;
+}
+
+// try_free_swap_entry - if the slot has no reference, set it SWAP_UNUSED
+static bool
+try_free_swap_entry(swap_entry_t entry) {
+    if (swap_map(entry) == 0) {
+        swap_map_set(entry, SWAP_UNUSED);
+        return 1;
+    }
+    return 0;
+}
+
+// swap_cluster_collect - collect page and the dirty inactive pages in the slots
+//                      - following it, so they can be written in one I/O.
+//   the pages are taken off the inactive list, *lep is moved on if it points
+//   to one of them. return the number of pages stored in cluster.
+static size_t
+swap_cluster_collect(struct Page *page, struct Page *cluster[], list_entry_t **lep) {
+    int type = swap_type(page->index);
+    struct swap_device *dev = swap_devs + type;
+    size_t n = 0, offset = swap_offset(page->index);
+    cluster[n ++] = page;
+    while (n < SWAPFS_MAX_PAGES && ++ offset < dev->max_offset) {
+        if (dev->map[offset] == 0 || dev->map[offset] == SWAP_UNUSED) {
+            break;
+        }
+        struct Page *p = swap_hash_find(swap_entry(type, offset));
+        if (p == NULL || PageActive(p) || PageWriteback(p) || page_ref(p) != 0 || !PageDirty(p)) {
+            break;
+        }
+        if (*lep == &(p->swap_link)) {
+            *lep = list_next(*lep);
+        }
+        swap_list_del(p);
+        cluster[n ++] = p;
+    }
+    return n;
+}
+
+// swap_writeback_end - the write of page is over (or failed, the page is dirty
+//   then): unpin its slot, free the page if nobody uses it, otherwise put it
+//   back on the list it belongs to. return 1 if the page is freed.
+static int
+swap_writeback_end(struct Page *page) {
+    assert(PageSwap(page) && !PageWriteback(page));
+    swap_entry_t entry = page->index;
+    swap_map(entry) --;
+    if (page_ref(page) != 0) {
+        swap_active_list_add(page);
+        return 0;
+    }
+    if (PageDirty(page)) {
+        swap_inactive_list_add(page);
+        return 0;
+    }
+    if (!try_free_swap_entry(entry)) {
+        swap_history_add(&swap_history, entry);
+    }
+    swap_free_page(page);
+    return 1;
+}
+
+// swap_wb_complete - the interrupt handler completes a write: mark the pages
+//   clean (dirty again if it failed), and queue the request for kswapd, which
+//   frees or re-activates the pages, as the swap lists aren't interrupt safe.
+static void
+swap_wb_complete(struct swapfs_request *req, int error) {
+    size_t i;
+    for (i = 0; i < req->n; i ++) {
+        if (error != 0) {
+            SetPageDirty(req->pages[i]);
+        }
+        ClearPageWriteback(req->pages[i]);
+    }
+    spin_lock(&swap_wb_lock);
+    list_add_before(&swap_wb_done, &(req->link));
+    nr_wb_inflight --;
+    wakeup_queue(&swap_wb_wait, WT_WRITEBACK, 1);
+    spin_unlock(&swap_wb_lock);
+    if (kswapd != NULL && kswapd->wait_state == WT_TIMER) {
+        wakeup_proc(kswapd);
+    }
+}
+
+// swap_write_run - write the pages of n consecutive slots to the disk. the
+//   write is started asynchronously if there is a free request, otherwise it
+//   is done at once. return the number of pages freed.
+static int
+swap_write_run(struct Page *pages[], size_t n) {
+    size_t i;
+    int free_count = 0;
+    if (swap_init_ok && !list_empty(&swap_wb_free)) {
+        struct swapfs_request *req = le2sreq(list_next(&swap_wb_free), link);
+        req->entry = pages[0]->index, req->n = n;
+        req->complete = swap_wb_complete;
+        for (i = 0; i < n; i ++) {
+            req->pages[i] = pages[i];
+            SetPageWriteback(pages[i]);
+        }
+
+        // counted in flight before it starts, it may complete on another cpu
+        // at once. the I/O is started without swap_wb_lock, the completion
+        // takes it under the lock of the IDE channel.
+        bool intr_flag;
+        list_del(&(req->link));
+        spin_lock_irqsave(&swap_wb_lock, intr_flag);
+        nr_wb_inflight ++;
+        spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+        if (swapfs_write_pages_async(req) == 0) {
+            nr_wb_started ++;
+            req = NULL;
+        }
+        else {
+            spin_lock_irqsave(&swap_wb_lock, intr_flag);
+            nr_wb_inflight --;
+            spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+            list_add(&swap_wb_free, &(req->link));
+        }
+
+        if (req == NULL) {
+            return 0;
+        }
+        for (i = 0; i < n; i ++) {
+            ClearPageWriteback(pages[i]);
+        }
+    }
+
+    nr_wb_sync ++;
+    if (swapfs_write_pages(pages[0]->index, pages, n) != 0) {
+        for (i = 0; i < n; i ++) {
+            SetPageDirty(pages[i]);
+        }
+    }
+    for (i = 0; i < n; i ++) {
+        free_count += swap_writeback_end(pages[i]);
+    }
+    return free_count;
+}
+
+// swap_write_pages - write the pages of n consecutive slots: into the compressed
+//   pool if possible, the others to the disk, each run in one I/O. the slots
+//   are pinned by the caller. return the number of pages freed at once.
+static int
+swap_write_pages(struct Page *pages[], size_t n) {
+    int free_count = 0;
+    size_t i, start = 0;
+    for (i = 0; i <= n; i ++) {
+        if (i < n && zswap_store(pages[i]->index, pages[i]) != 0) {
+            continue ;
+        }
+        if (start < i) {
+            free_count += swap_write_run(pages + start, i - start);
+        }
+        if (i < n) {
+            free_count += swap_writeback_end(pages[i]);
+        }
+        start = i + 1;
+    }
+    return free_count;
+}
+
+// swap_writeback_reap - finish the writes completed, return the number of pages freed
+static int
+swap_writeback_reap(void) {
+    int free_count = 0;
+    while (1) {
+        struct swapfs_request *req = NULL;
+        bool intr_flag;
+        spin_lock_irqsave(&swap_wb_lock, intr_flag);
+        {
+            if (!list_empty(&swap_wb_done)) {
+                req = le2sreq(list_next(&swap_wb_done), link);
+                list_del(&(req->link));
+            }
+        }
+        spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+
+        if (req == NULL) {
+            break;
+        }
+        size_t i;
+        for (i = 0; i < req->n; i ++) {
+            free_count += swap_writeback_end(req->pages[i]);
+        }
+        list_add(&swap_wb_free, &(req->link));
+    }
+    return free_count;
 }
 
-// try_free_swap_entry - if mem_map[offset] == 0 (no reference), then mem_map[offset] = SWAP_UNUSED
+// swap_writeback_wait - wait until a write in flight completes, return false
+//                     - at once if there is nothing to wait for
 static bool
-try_free_swap_entry(swap_entry_t entry) {
-    size_t offset = swap_offset(entry);
-    if (mem_map[offset] == 0) {
-        mem_map[offset] = SWAP_UNUSED;
-        return 1;
+swap_writeback_wait(void) {
+    wait_t __wait, *wait = &__wait;
+    bool intr_flag;
+    spin_lock_irqsave(&swap_wb_lock, intr_flag);
+    {
+        if (!list_empty(&swap_wb_done)) {
+            spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+            return 1;
+        }
+        if (nr_wb_inflight == 0) {
+            spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+            return 0;
+        }
+        wait_current_set(&swap_wb_wait, wait, WT_WRITEBACK);
     }
-    return 0;
+    spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+
+    schedule();
+
+    spin_lock_irqsave(&swap_wb_lock, intr_flag);
+    {
+        wait_current_del(&swap_wb_wait, wait);
+    }
+    spin_unlock_irqrestore(&swap_wb_lock, intr_flag);
+    return 1;
 }
 
 // page_launder - try to move page to swap_active_list OR swap_inactive_list, 
 //              - and call swap_fs_write to swap out pages in swap_inactive_list
+//   the dirty pages are written asynchronously, they are freed when the
+//   writes complete (see swap_writeback_reap). if mg isn't NULL, only the
+//   pages charged to memory group mg are laundered.
 static int
-page_launder(void) {
+page_launder_group(struct memgroup *mg) {
     size_t maxscan = nr_inactive_pages, free_count = 0;
     list_entry_t *list = &(inactive_list.swap_list), *le = list_next(list);
     while (maxscan -- > 0 && le != list) {
@@ -475,6 +1460,9 @@ page_launder(void) {
         if (!(PageSwap(page) && !PageActive(page))) {
             panic("inactive: wrong swap list.\n");
         }
+        if (mg != NULL && page->memgroup != mg) {
+            continue ;
+        }
         swap_list_del(page);
         if (page_ref(page) != 0) {
             swap_active_list_add(page);
@@ -483,22 +1471,16 @@ page_launder(void) {
         swap_entry_t entry = page->index;
         if (!try_free_swap_entry(entry)) {
             if (PageDirty(page)) {
-                ClearPageDirty(page);
-                swap_duplicate(entry);
-                if (swapfs_write(entry, page) != 0) {
-                    SetPageDirty(page);
-                }
-                mem_map[swap_offset(entry)] --;
-                if (page_ref(page) != 0) {
-                    swap_active_list_add(page);
-                    continue ;
-                }
-                if (PageDirty(page)) {
-                    swap_inactive_list_add(page);
-                    continue ;
+                struct Page *cluster[SWAPFS_MAX_PAGES];
+                size_t i, n = swap_cluster_collect(page, cluster, &le);
+                for (i = 0; i < n; i ++) {
+                    ClearPageDirty(cluster[i]);
+                    swap_duplicate(cluster[i]->index);
                 }
-                try_free_swap_entry(entry);
+                free_count += swap_write_pages(cluster, n);
+                continue ;
             }
+            swap_history_add(&swap_history, entry);
         }
         free_count ++;
         swap_free_page(page);
@@ -506,6 +1488,11 @@ page_launder(void) {
     return free_count;
 }
 
+static inline int
+page_launder(void) {
+    return page_launder_group(NULL);
+}
+
 // refill_inactive_scan - try to move page in swap_active_list into swap_inactive_list
 static void
 refill_inactive_scan(void) {
@@ -530,6 +1517,9 @@ swap_out_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, size_
     if (require == 0 || !(addr >= vma->vm_start && addr < vma->vm_end)) {
         return 0;
     }
+    if (vma->vm_flags & VM_LOCKED) {
+        return 0;
+    }
     uintptr_t end;
     size_t free_count = 0;
     addr = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(vma->vm_end, PGSIZE);
@@ -542,11 +1532,26 @@ swap_out_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, size_
         if (*ptep & PTE_P) {
             struct Page *page = pte2page(*ptep);
             assert(!PageReserved(page));
+            bool referenced = 0, hot = PageWorkingset(page);
             if (*ptep & PTE_A) {
                 *ptep &= ~PTE_A;
                 tlb_invalidate(mm->pgdir, addr);
+                // sequentially accessed pages are unlikely to be used again soon
+                referenced = !(vma->vm_flags & VM_SEQ_READ);
+            }
+            if (!swap_clock_hand(referenced, &hot)) {
+                if (!hot) {
+                    ClearPageWorkingset(page);
+                }
                 goto try_next_entry;
             }
+            if (PageSwap(page) && !(swap_devs[swap_type(page->index)].flags & SWP_WRITEOK)
+                    && swap_page_count(page) == 0) {
+                // its device is being removed, take a slot on another one
+                swap_list_del(page);
+                swap_page_del(page);
+                swap_map_set(page->index, SWAP_UNUSED);
+            }
             if (!PageSwap(page)) {
                 if (!swap_page_add(page, 0)) {
                     goto try_next_entry;
@@ -561,6 +1566,8 @@ swap_out_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, size_
             page_ref_dec(page);
             *ptep = entry;
             tlb_invalidate(mm->pgdir, addr);
+            pgdir_account(mm->pgdir, -1, 1);
+            mm->nr_swapouts ++;
             mm->swap_address = addr + PGSIZE;
             free_count ++, require --;
             if ((vma->vm_flags & VM_SHARE) && page_ref(page) == 1) {
@@ -618,33 +1625,403 @@ swap_out_mm(struct mm_struct *mm, size_t require) {
     return free_count;
 }
 
+// swap_mm_rss - the number of resident pages of mm kswapd may unmap, the
+//   VM_LOCKED vmas are populated by mlock, their pages are all resident
+static inline size_t
+swap_mm_rss(struct mm_struct *mm) {
+    return (mm->rss > mm->locked_vm) ? mm->rss - mm->locked_vm : 0;
+}
+
+// swap_reclaim_mms - unmap about needs pages from the mms (of memory group mg
+//   if it isn't NULL), each gives its share by swap_mm_weight, the rest of the
+//   division goes to the heaviest. return the number of pages unmapped.
+static int
+swap_reclaim_mms(int needs, struct memgroup *mg) {
+    list_entry_t *list = &proc_mm_list, *le = list;
+    struct mm_struct *mm, *heaviest = NULL;
+    size_t total = 0;
+    while ((le = list_next(le)) != list) {
+        mm = le2mm(le, proc_mm_link);
+        if (mg != NULL && mm->memgroup != mg) {
+            mm->swap_weight = 0;
+            continue ;
+        }
+        mm->swap_weight = swap_mm_weight(swap_mm_rss(mm), mm->swap_refaults);
+        total += mm->swap_weight;
+        if (heaviest == NULL || mm->swap_weight > heaviest->swap_weight) {
+            heaviest = mm;
+        }
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    int free_count = 0, assigned = 0;
+    while ((le = list_next(le)) != list) {
+        mm = le2mm(le, proc_mm_link);
+        int target = needs * mm->swap_weight / total;
+        assigned += target;
+        free_count += swap_out_mm(mm, target);
+    }
+    free_count += swap_out_mm(heaviest, needs - assigned);
+    return free_count;
+}
+
+// swap_decay_refaults - the refaults of an mm count less as time goes by
+static void
+swap_decay_refaults(void) {
+    list_entry_t *list = &proc_mm_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct mm_struct *mm = le2mm(le, proc_mm_link);
+        mm->swap_refaults >>= 1;
+    }
+}
+
+// swap_add_device - use IDE device ideno as a swap device of priority prio
+int
+swap_add_device(unsigned short ideno, int prio) {
+    int type, ret;
+    for (type = 0; type < MAX_SWAP_DEVS; type ++) {
+        if ((swap_devs[type].flags & SWP_USED) && swap_devs[type].ideno == ideno) {
+            return -E_EXISTS;
+        }
+    }
+    for (type = 0; type < MAX_SWAP_DEVS; type ++) {
+        if (!(swap_devs[type].flags & SWP_USED)) {
+            break;
+        }
+    }
+    if (type == MAX_SWAP_DEVS) {
+        return -E_MAX_OPEN;
+    }
+
+    struct swap_device *dev = swap_devs + type;
+    size_t max_offset;
+    if ((ret = swapfs_attach(type, ideno, &max_offset)) != 0) {
+        return ret;
+    }
+    ret = -E_INVAL;
+    if (max_offset < 2) {
+        goto failed_detach;
+    }
+
+    ret = -E_NO_MEM;
+    size_t nr_clusters = ROUNDUP(max_offset, SWAP_CLUSTER_SLOTS) / SWAP_CLUSTER_SLOTS;
+    size_t map_words = ROUNDUP(nr_clusters, 32) / 32;
+    memset(dev, 0, sizeof(struct swap_device));
+    if ((dev->map = kmalloc(sizeof(short) * max_offset)) == NULL) {
+        goto failed_detach;
+    }
+    if ((dev->slot_map = kmalloc(sizeof(uint32_t) * nr_clusters)) == NULL) {
+        goto failed_free_map;
+    }
+    if ((dev->cluster_map = kmalloc(sizeof(uint32_t) * map_words)) == NULL) {
+        goto failed_free_slot_map;
+    }
+    if ((dev->cluster_free = kmalloc(sizeof(unsigned char) * nr_clusters)) == NULL) {
+        goto failed_free_cluster_map;
+    }
+    memset(dev->slot_map, 0, sizeof(uint32_t) * nr_clusters);
+    memset(dev->cluster_map, 0, sizeof(uint32_t) * map_words);
+    memset(dev->cluster_free, 0, sizeof(unsigned char) * nr_clusters);
+
+    dev->flags = SWP_USED, dev->ideno = ideno, dev->prio = prio;
+    dev->max_offset = max_offset, dev->nr_clusters = nr_clusters;
+
+    size_t offset;
+    dev->map[0] = SWAP_UNUSED;
+    for (offset = 1; offset < max_offset; offset ++) {
+        dev->map[offset] = 0;
+        swap_map_set(swap_entry(type, offset), SWAP_UNUSED);
+    }
+    dev->flags |= SWP_WRITEOK;
+    return 0;
+
+failed_free_cluster_map:
+    kfree(dev->cluster_map);
+failed_free_slot_map:
+    kfree(dev->slot_map);
+failed_free_map:
+    kfree(dev->map);
+failed_detach:
+    swapfs_detach(type);
+    return ret;
+}
+
+// swap_mm_put - drop the pin swap_unuse holds on mm
+static inline void
+swap_mm_put(struct mm_struct *mm) {
+    if (mm != NULL && mm_count_dec(mm) == 0) {
+        mm_reap(mm);
+    }
+}
+
+// swap_unuse_shmem - read the pages of shmem swapped out to device type back in
+static int
+swap_unuse_shmem(struct shmem_struct *shmem, int type) {
+    int ret = 0;
+    uintptr_t addr;
+    lock_shmem(shmem);
+    for (addr = 0; addr < shmem->len; addr += PGSIZE) {
+        pte_t *sh_ptep = shmem_get_entry(shmem, addr, 0);
+        if (sh_ptep == NULL) {
+            continue ;
+        }
+        pte_t entry = *sh_ptep;
+        if (entry != 0 && !(entry & PTE_P) && swap_type(entry) == type) {
+            struct Page *page;
+            if ((ret = swap_in_page(entry, &page)) != 0) {
+                break;
+            }
+            if (*sh_ptep == entry) {
+                shmem_insert_entry(shmem, addr, page2pa(page) | PTE_P);
+            }
+        }
+    }
+    unlock_shmem(shmem);
+    return ret;
+}
+
+// swap_unuse_mm - read the pages of mm swapped out to device type back in and
+//               - map them again. mm is locked by the caller.
+//   private pages are mapped read only, a write fault copies them if needed.
+static int
+swap_unuse_mm(struct mm_struct *mm, int type) {
+    int ret;
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        uint32_t perm = PTE_U;
+        if ((vma->vm_flags & (VM_SHARE | VM_WRITE)) == (VM_SHARE | VM_WRITE)) {
+            perm |= PTE_W;
+        }
+        uintptr_t addr = vma->vm_start;
+        while (addr < vma->vm_end) {
+            pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+            if (ptep == NULL) {
+                addr = ROUNDDOWN(addr + PTSIZE, PTSIZE);
+                continue ;
+            }
+            pte_t entry = *ptep;
+            if (entry != 0 && !(entry & PTE_P) && swap_type(entry) == type) {
+                struct Page *page;
+                if ((ret = swap_in_page(entry, &page)) != 0) {
+                    return ret;
+                }
+                // kswapd may have changed the pte meanwhile
+                if (*ptep == entry) {
+                    page_insert(mm->pgdir, page, addr, perm);
+                }
+            }
+            addr += PGSIZE;
+        }
+        if ((vma->vm_flags & VM_SHARE) && (ret = swap_unuse_shmem(vma->shmem, type)) != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// swap_unuse - bring all the pages swapped out to device type back into memory.
+//   the mm is pinned while we sleep on it, so it stays on proc_mm_list and
+//   its link leads us to the next one.
+static int
+swap_unuse(int type) {
+    int ret = 0;
+    struct mm_struct *prev = NULL;
+    list_entry_t *list = &proc_mm_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct mm_struct *mm = le2mm(le, proc_mm_link);
+        mm_count_inc(mm);
+        swap_mm_put(prev);
+        prev = mm;
+
+        lock_mm(mm);
+        ret = swap_unuse_mm(mm, type);
+        unlock_mm(mm);
+        if (ret != 0) {
+            break;
+        }
+    }
+    swap_mm_put(prev);
+    return ret;
+}
+
+// swap_dev_drain - drop the swap cache pages of device type whose slots nobody
+//                - refers to, return true if all the slots are free then
+static bool
+swap_dev_drain(int type) {
+    struct swap_device *dev = swap_devs + type;
+    size_t offset;
+    for (offset = 1; offset < dev->max_offset; offset ++) {
+        if (dev->map[offset] != 0) {
+            continue ;
+        }
+        swap_entry_t entry = swap_entry(type, offset);
+        struct Page *page = swap_hash_find(entry);
+        if (page != NULL) {
+            assert(!PageLocked(page));
+            swap_list_del(page);
+            if (page_ref(page) == 0) {
+                swap_free_page(page);
+            }
+            else {
+                swap_page_del(page);
+            }
+        }
+        swap_map_set(entry, SWAP_UNUSED);
+    }
+    return dev->nr_free_slots == dev->max_offset - 1;
+}
+
+// the slots of a device being removed may be referenced again by kswapd or
+// still be held by a dying process, swap_del_device tries a few times
+#define SWAP_UNUSE_ROUNDS               8
+
+// swap_del_device - stop using IDE device ideno for swap. no new slot is taken
+//                 - from it, the pages in it are read back into memory.
+int
+swap_del_device(unsigned short ideno) {
+    int type, ret = -E_BUSY, round;
+    for (type = 0; type < MAX_SWAP_DEVS; type ++) {
+        if ((swap_devs[type].flags & SWP_USED) && swap_devs[type].ideno == ideno) {
+            break;
+        }
+    }
+    if (type == MAX_SWAP_DEVS) {
+        return -E_NO_DEV;
+    }
+
+    struct swap_device *dev = swap_devs + type;
+    if (!(dev->flags & SWP_WRITEOK)) {
+        // somebody else is removing it
+        return -E_BUSY;
+    }
+    dev->flags &= ~SWP_WRITEOK;
+
+    for (round = 0; round < SWAP_UNUSE_ROUNDS; round ++) {
+        if ((ret = swap_unuse(type)) != 0) {
+            break;
+        }
+        if (swap_dev_drain(type)) {
+            break;
+        }
+        ret = -E_BUSY;
+        do_sleep(1);
+    }
+    if (ret != 0) {
+        dev->flags |= SWP_WRITEOK;
+        return ret;
+    }
+
+    swapfs_detach(type);
+    kfree(dev->map), kfree(dev->slot_map), kfree(dev->cluster_map), kfree(dev->cluster_free);
+    memset(dev, 0, sizeof(struct swap_device));
+    return 0;
+}
+
+// the pages a group is shrunk under its limit by, so the next faults don't wait again
+#define MEMGROUP_RECLAIM_BATCH          32
+
+// swap_shrink_groups - reclaim within the memory groups their faults wait for:
+//   unmap the pages of their mms and launder their pages. the waiters are woken
+//   up when the group is under its limit, or when nothing more is reclaimed.
+//   return true if some groups are still being shrunk.
+static bool
+swap_shrink_groups(void) {
+    bool pending = 0;
+    int i;
+    for (i = 0; i < MAX_MEMGROUPS; i ++) {
+        struct memgroup *mg = memgroups + i;
+        if (!mg->reclaim) {
+            continue ;
+        }
+        if (mg->limit != 0 && mg->usage >= mg->limit) {
+            int progress = swap_reclaim_mms(mg->usage - mg->limit + MEMGROUP_RECLAIM_BATCH, mg);
+            refill_inactive_scan();
+            progress += page_launder_group(mg);
+            if (progress != 0 || nr_wb_inflight != 0) {
+                mg->stalls = 0, pending = 1;
+                continue ;
+            }
+            if ((++ mg->stalls) < OOM_RECLAIM_PASSES) {
+                pending = 1;
+                continue ;
+            }
+        }
+        mg->reclaim = 0, mg->stalls = 0;
+
+        bool intr_flag;
+        spin_lock_irqsave(&swap_lock, intr_flag);
+        {
+            wakeup_queue(&(mg->reclaim_wait), WT_KSWAPD, 1);
+        }
+        spin_unlock_irqrestore(&swap_lock, intr_flag);
+    }
+    return pending;
+}
+
 int
 kswapd_main(void *arg) {
-    int guard = 0;
+    int stalls = 0;
     while (1) {
+        swap_prefetch_reap();
+        int progress = swap_writeback_reap();
+        pressure -= progress;
+        bool shrinking = swap_shrink_groups();
         if (pressure > 0) {
-            int needs = (pressure << 5), rounds = 16;
-            list_entry_t *list = &proc_mm_list;
-            assert(!list_empty(list));
+            int needs = (pressure << 5), rounds = 4, ret;
+            assert(!list_empty(&proc_mm_list));
             while (needs > 0 && rounds -- > 0) {
-                list_entry_t *le = list_next(list);
-                list_del(le);
-                list_add_before(list, le);
-                struct mm_struct *mm = le2mm(le, proc_mm_link);
-                needs -= swap_out_mm(mm, (needs < 32) ? needs : 32);
+                if ((ret = swap_reclaim_mms(needs, NULL)) == 0) {
+                    break;
+                }
+                needs -= ret, progress += ret;
             }
         }
-        pressure -= page_launder();
+        int free_count = page_launder();
+        pressure -= free_count, progress += free_count;
+        zswap_writeback();
         refill_inactive_scan();
         if (pressure > 0) {
-            if ((++ guard) >= 1000) {
-                guard = 0;
-                warn("kswapd: may out of memory");
+            // the pages under writeback are freed when their writes complete
+            if (swap_writeback_wait()) {
+                continue ;
+            }
+            if (progress != 0) {
+                stalls = 0;
+                continue ;
+            }
+            // nothing to reclaim, unless the pages were freed by somebody else
+            if (nr_free_pages() < (size_t)pressure) {
+                if (oom_victim_exiting()) {
+                    // give the memory of the last victim a chance first
+                    stalls = 0;
+                    do_sleep(1);
+                    continue ;
+                }
+                if ((++ stalls) < OOM_RECLAIM_PASSES) {
+                    do_sleep(1);
+                    continue ;
+                }
+                stalls = 0;
+                if (!oom_kill()) {
+                    warn("kswapd: out of memory, nothing to kill.\n");
+                    do_sleep(1);
+                    continue ;
+                }
             }
-            continue ;
         }
-        pressure = 0, guard = 0;
+        // the waiters try again, the OOM victims take the reserve then
+        pressure = 0, stalls = 0;
+        oom_refill_reserve();
         kswapd_wakeup_all();
+        if (shrinking) {
+            // the groups being shrunk wait for the writes in flight
+            swap_writeback_wait();
+            continue ;
+        }
+        swap_decay_refaults();
         do_sleep(1000);
     }
 }
@@ -656,8 +2033,8 @@ check_swap(void) {
     size_t slab_allocated_store = slab_allocated();
 
     size_t offset;
-    for (offset = 2; offset < max_swap_offset; offset ++) {
-        mem_map[offset] = 1;
+    for (offset = 2; offset < swap_devs[0].max_offset; offset ++) {
+        swap_map_set(swap_entry(0, offset), 1);
     }
 
     struct mm_struct *mm = mm_create();
@@ -689,9 +2066,11 @@ check_swap(void) {
 
     // check try_alloc_swap_entry
 
+    assert(swap_devs[0].nr_free_slots == 1 && swap_devs[0].nr_free_clusters == 0);
     swap_entry_t entry = try_alloc_swap_entry();
     assert(swap_offset(entry) == 1);
-    mem_map[1] = 1;
+    swap_map_set(swap_entry(0, 1), 1);
+    assert(swap_devs[0].nr_free_slots == 0 && swap_devs[0].cluster_map[0] == 0);
     assert(try_alloc_swap_entry() == 0);
 
     // set rp1, Swap, Active, add to hash_list, active_list
@@ -700,7 +2079,7 @@ check_swap(void) {
     swap_active_list_add(rp1);
     assert(PageSwap(rp1));
 
-    mem_map[1] = 0;
+    swap_map_set(swap_entry(0, 1), 0);
     entry = try_alloc_swap_entry();
     assert(swap_offset(entry) == 1);
     assert(!PageSwap(rp1));
@@ -708,15 +2087,15 @@ check_swap(void) {
     // check swap_remove_entry
 
     assert(swap_hash_find(entry) == NULL);
-    mem_map[1] = 2;
+    swap_map_set(swap_entry(0, 1), 2);
     swap_remove_entry(entry);
-    assert(mem_map[1] == 1);
+    assert(swap_devs[0].map[1] == 1);
 
     swap_page_add(rp1, entry);
     swap_inactive_list_add(rp1);
     swap_remove_entry(entry);
     assert(PageSwap(rp1));
-    assert(rp1->index == entry && mem_map[1] == 0);
+    assert(rp1->index == entry && swap_devs[0].map[1] == 0);
 
     // check page_launder, move page from inactive_list to active_list
 
@@ -739,7 +2118,7 @@ check_swap(void) {
     swap_page_add(rp1, 0);
     assert(PageSwap(rp1) && swap_offset(rp1->index) == 1);
     swap_inactive_list_add(rp1);
-    mem_map[1] = 1;
+    swap_map_set(swap_entry(0, 1), 1);
     assert(nr_inactive_pages == 1);
     page_ref_dec(rp1);
 
@@ -759,7 +2138,7 @@ check_swap(void) {
     assert(ret == 1 && mm->swap_address == PGSIZE);
 
     ret = swap_out_mm(mm, 10);
-    assert(ret == 0 && *ptep0 == entry && mem_map[1] == 1);
+    assert(ret == 0 && *ptep0 == entry && swap_devs[0].map[1] == 1);
     assert(PageDirty(rp0) && PageActive(rp0) && page_ref(rp0) == 0);
     assert(nr_active_pages == 1 && list_next(&(active_list.swap_list)) == &(rp0->swap_link));
 
@@ -787,7 +2166,7 @@ check_swap(void) {
 
     page_launder();
     assert(nr_inactive_pages == 0 && list_empty(&(inactive_list.swap_list)));
-    assert(mem_map[1] == 1);
+    assert(swap_devs[0].map[1] == 1);
 
     rp1 = alloc_page();
     assert(rp1 != NULL);
@@ -807,7 +2186,7 @@ check_swap(void) {
     assert(PageSwap(rp0) && PageActive(rp0));
 
     entry = try_alloc_swap_entry();
-    assert(swap_offset(entry) == 1 && mem_map[1] == SWAP_UNUSED);
+    assert(swap_offset(entry) == 1 && swap_devs[0].map[1] == SWAP_UNUSED);
     assert(!PageSwap(rp0) && nr_active_pages == 0 && nr_inactive_pages == 0);
 
     // clear accessed flag
@@ -823,7 +2202,7 @@ check_swap(void) {
 
     ret = swap_out_mm(mm, 10);
     assert(ret == 1);
-    assert(*ptep0 == entry && page_ref(rp0) == 0 && mem_map[1] == 1);
+    assert(*ptep0 == entry && page_ref(rp0) == 0 && swap_devs[0].map[1] == 1);
 
     count = nr_free_pages();
     refill_inactive_scan();
@@ -859,7 +2238,7 @@ check_swap(void) {
 
     entry = try_alloc_swap_entry();
     assert(!PageSwap(rp0) && !PageSwap(rp1));
-    assert(swap_offset(entry) == 1 && mem_map[1] == SWAP_UNUSED);
+    assert(swap_offset(entry) == 1 && swap_devs[0].map[1] == SWAP_UNUSED);
     assert(list_empty(&(active_list.swap_list)));
     assert(list_empty(&(inactive_list.swap_list)));
 
@@ -876,26 +2255,26 @@ check_swap(void) {
 
     ret = swap_out_mm(mm, 2);
     assert(ret == 2);
-    assert(mem_map[1] == 2 && page_ref(rp0) == 0);
+    assert(swap_devs[0].map[1] == 2 && page_ref(rp0) == 0);
 
     refill_inactive_scan();
     page_launder();
-    assert(mem_map[1] == 2 && swap_hash_find(entry) == NULL);
+    assert(swap_devs[0].map[1] == 2 && swap_hash_find(entry) == NULL);
 
     // check copy entry
 
     swap_remove_entry(entry);
     *ptep1 = 0;
-    assert(mem_map[1] == 1);
+    assert(swap_devs[0].map[1] == 1);
 
     swap_entry_t store;
     ret = swap_copy_entry(entry, &store);
     assert(ret == -E_NO_MEM);
-    mem_map[2] = SWAP_UNUSED;
+    swap_map_set(swap_entry(0, 2), SWAP_UNUSED);
 
     ret = swap_copy_entry(entry, &store);
-    assert(ret == 0 && swap_offset(store) == 2 && mem_map[2] == 0);
-    mem_map[2] = 1;
+    assert(ret == 0 && swap_offset(store) == 2 && swap_devs[0].map[2] == 0);
+    swap_map_set(swap_entry(0, 2), 1);
     *ptep1 = store;
 
     assert(*(char *)PGSIZE == (char)0xEE && *(char *)(PGSIZE + 1)== (char)0x88);
@@ -933,9 +2312,10 @@ check_swap(void) {
     check_mm_struct = NULL;
 
     assert(nr_active_pages == 0 && nr_inactive_pages == 0);
-    for (offset = 0; offset < max_swap_offset; offset ++) {
-        mem_map[offset] = SWAP_UNUSED;
+    for (offset = 0; offset < swap_devs[0].max_offset; offset ++) {
+        swap_map_set(swap_entry(0, offset), SWAP_UNUSED);
     }
+    assert(swap_devs[0].nr_free_slots == swap_devs[0].max_offset - 1);
 
     assert(nr_free_pages_store == nr_free_pages());
     assert(slab_allocated_store == slab_allocated());
@@ -949,8 +2329,8 @@ check_mm_swap(void) {
     size_t slab_allocated_store = slab_allocated();
 
     int ret, i, j;
-    for (i = 0; i < max_swap_offset; i ++) {
-        assert(mem_map[i] == SWAP_UNUSED);
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
     }
 
     extern struct mm_struct *check_mm_struct;
@@ -1112,6 +2492,7 @@ check_mm_swap(void) {
 
     ret = mm_unmap(mm0, addr0, PGSIZE * 2);
     assert(ret == 0 && mm0->map_count == 0);
+    assert(get_pte(pgdir, addr0, 0) == NULL);
 
     cprintf("check_mm_swap: step2, mm_unmap ok.\n");
 
@@ -1133,8 +2514,8 @@ check_mm_swap(void) {
 
     // step4: check dup_mmap
 
-    for (i = 0; i < max_swap_offset; i ++) {
-        assert(mem_map[i] == SWAP_UNUSED);
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
     }
 
     ret = mm_map(mm0, addr0, PTSIZE, vm_flags, NULL);
@@ -1150,6 +2531,13 @@ check_mm_swap(void) {
     ret += swap_out_mm(mm0, 10);
     assert(ret == 4);
 
+    // the pages swapped out together get contiguous slots
+    ptep = get_pte(pgdir, addr0, 0);
+    for (j = 1; j < 4; j ++) {
+        pte_t *ptep_next = get_pte(pgdir, addr0 + j * PGSIZE, 0);
+        assert(ptep_next != NULL && *ptep_next == *ptep + (j << 8));
+    }
+
     for (; i < 8; i ++, addr1 += PGSIZE) {
         *(char *)addr1 = (char)(i * i);
     }
@@ -1209,8 +2597,8 @@ check_mm_swap(void) {
 
     refill_inactive_scan();
     page_launder();
-    for (i = 0; i < max_swap_offset; i ++) {
-        assert(mem_map[i] == SWAP_UNUSED);
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
     }
 
     assert(nr_free_pages_store == nr_free_pages());
@@ -1225,8 +2613,8 @@ check_mm_shm_swap(void) {
     size_t slab_allocated_store = slab_allocated();
 
     int ret, i;
-    for (i = 0; i < max_swap_offset; i ++) {
-        assert(mem_map[i] == SWAP_UNUSED);
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
     }
 
     extern struct mm_struct *check_mm_struct;
@@ -1379,8 +2767,8 @@ check_mm_shm_swap(void) {
 
     refill_inactive_scan();
     page_launder();
-    for (i = 0; i < max_swap_offset; i ++) {
-        assert(mem_map[i] == SWAP_UNUSED);
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
     }
 
     assert(nr_free_pages_store == nr_free_pages());
@@ -1389,3 +2777,194 @@ check_mm_shm_swap(void) {
     cprintf("check_mm_shm_swap() succeeded.\n");
 }
 
+
+#ifdef CHECK_SWAP_POLICY
+
+/* *
+ * check_swap_policy - a trace-driven check of the replacement policy.
+ * two mms share POLICY_FRAMES page frames: mm0 loops over a working set of
+ * POLICY_WSET_PAGES pages, mm1 streams through its pages, two each step. the
+ * pages are touched through the MMU and faulted in by do_pgfault; whenever the
+ * frames are used up, the check reclaims POLICY_RECLAIM pages as kswapd does
+ * (see kswapd_main), with swap_out_mm and page_launder. the trace runs twice:
+ * under the previous policy of kswapd, which takes up to 32 pages from the mms
+ * in turn and knows no hot pages, and under swap_reclaim_mms. the refaults of
+ * the working set must drop. it replays about 1500 faults with their swap I/O,
+ * so it is not run at every boot: build with DEFS=-DCHECK_SWAP_POLICY.
+ * */
+
+#define POLICY_FRAMES                   64
+#define POLICY_WSET_PAGES               24
+#define POLICY_STEPS                    512
+#define POLICY_STREAM_PAGES             (POLICY_STEPS * 2)
+#define POLICY_RECLAIM                  32      // pressure 1, as kswapd_main
+
+// policy_reclaim_rr - the previous policy: up to 32 pages from each mm in turn
+static int
+policy_reclaim_rr(int needs) {
+    list_entry_t *list = &proc_mm_list, *le;
+    int rounds = 16, free_count = 0;
+    while (needs > 0 && rounds -- > 0) {
+        le = list_next(list);
+        list_del(le);
+        list_add_before(list, le);
+        int ret = swap_out_mm(le2mm(le, proc_mm_link), (needs < 32) ? needs : 32);
+        needs -= ret, free_count += ret;
+    }
+    return free_count;
+}
+
+// policy_reclaim - unmap POLICY_RECLAIM pages and free them, as a round of kswapd
+static void
+policy_reclaim(bool scan_resistant) {
+    int needs = POLICY_RECLAIM, rounds = 4, ret;
+    if (scan_resistant) {
+        while (needs > 0 && rounds -- > 0) {
+            if ((ret = swap_reclaim_mms(needs, NULL)) == 0) {
+                break;
+            }
+            needs -= ret;
+        }
+    }
+    else {
+        needs -= policy_reclaim_rr(needs);
+    }
+    assert(needs < POLICY_RECLAIM);
+    refill_inactive_scan();
+    page_launder();
+    swap_decay_refaults();
+}
+
+// policy_access - mm touches the page at addr, return true if it is a refault
+static bool
+policy_access(struct mm_struct **mms, int idx, uintptr_t addr, bool scan_resistant) {
+    extern struct mm_struct *check_mm_struct;
+    struct mm_struct *mm = mms[idx];
+    pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+    pte_t entry = (ptep != NULL) ? *ptep : 0;
+    if (!(entry & PTE_P)) {
+        if (mms[0]->rss + mms[1]->rss >= POLICY_FRAMES) {
+            policy_reclaim(scan_resistant);
+            assert(mms[0]->rss + mms[1]->rss < POLICY_FRAMES);
+        }
+    }
+
+    size_t refaults_store = swap_refaults;
+    check_mm_struct = mm;
+    lcr3(PADDR(mm->pgdir));
+
+    char *p = (char *)addr, value = (char)(idx + (addr >> PGSHIFT));
+    if (entry == 0) {
+        *p = value;
+    }
+    else {
+        assert(*p == value);
+    }
+
+    check_mm_struct = NULL;
+    lcr3(boot_cr3);
+
+    if (entry != 0 && !(entry & PTE_P)) {
+        // swap_in_page charges current->mm, which is NULL here
+        mm->swap_refaults += swap_refaults - refaults_store;
+        if (!scan_resistant) {
+            struct Page *page = get_page(mm->pgdir, addr, NULL);
+            assert(page != NULL);
+            ClearPageWorkingset(page);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// policy_mm_create - an mm on proc_mm_list with npages pages mapped at UTEXT
+static struct mm_struct *
+policy_mm_create(size_t npages) {
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+
+    struct Page *page = alloc_page();
+    assert(page != NULL);
+    pde_t *pgdir = page2kva(page);
+    memcpy(pgdir, boot_pgdir, PGSIZE);
+    pgdir[PDX(VPT)] = PADDR(pgdir) | PTE_P | PTE_W;
+    mm->pgdir = pgdir;
+    pgdir_set_mm(pgdir, mm);
+
+    int ret = mm_map(mm, UTEXT, npages * PGSIZE, VM_READ | VM_WRITE, NULL);
+    assert(ret == 0);
+    list_add_before(&proc_mm_list, &(mm->proc_mm_link));
+    return mm;
+}
+
+static void
+policy_mm_destroy(struct mm_struct *mm) {
+    list_del(&(mm->proc_mm_link));
+    exit_mmap(mm);
+    pgdir_set_mm(mm->pgdir, NULL);
+    free_page(kva2page(mm->pgdir));
+    mm_destroy(mm);
+}
+
+// policy_run - replay the trace, return the refaults of the working set
+static size_t
+policy_run(bool scan_resistant, size_t *stream_refaults) {
+    memset(&swap_history, 0, sizeof(struct swap_history));
+
+    struct mm_struct *mms[2];
+    mms[0] = policy_mm_create(POLICY_WSET_PAGES);
+    mms[1] = policy_mm_create(POLICY_STREAM_PAGES);
+
+    size_t step, refaults = 0;
+    *stream_refaults = 0;
+    for (step = 0; step < POLICY_STEPS; step ++) {
+        uintptr_t addr = UTEXT + (step % POLICY_WSET_PAGES) * PGSIZE;
+        refaults += policy_access(mms, 0, addr, scan_resistant);
+        addr = UTEXT + (step * 2) * PGSIZE;
+        *stream_refaults += policy_access(mms, 1, addr, scan_resistant);
+        *stream_refaults += policy_access(mms, 1, addr + PGSIZE, scan_resistant);
+    }
+    assert(mms[0]->rss + mms[1]->rss <= POLICY_FRAMES);
+
+    policy_mm_destroy(mms[0]);
+    policy_mm_destroy(mms[1]);
+    refill_inactive_scan();
+    page_launder();
+    return refaults;
+}
+
+static void
+check_swap_policy(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    size_t slab_allocated_store = slab_allocated();
+    size_t refaults_store = swap_refaults;
+
+    int i;
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
+    }
+    assert(list_empty(&proc_mm_list));
+
+    size_t old_refaults, new_refaults, old_stream, new_stream;
+    old_refaults = policy_run(0, &old_stream);
+    new_refaults = policy_run(1, &new_stream);
+    cprintf("check_swap_policy: working set refaults %d -> %d, stream refaults %d -> %d.\n",
+            old_refaults, new_refaults, old_stream, new_stream);
+    assert(new_refaults * 2 <= old_refaults);
+
+    memset(&swap_history, 0, sizeof(struct swap_history));
+    swap_refaults = refaults_store;
+
+    for (i = 0; i < swap_devs[0].max_offset; i ++) {
+        assert(swap_devs[0].map[i] == SWAP_UNUSED);
+    }
+    assert(list_empty(&proc_mm_list));
+
+    assert(nr_free_pages_store == nr_free_pages());
+    assert(slab_allocated_store == slab_allocated());
+
+    cprintf("check_swap_policy() succeeded.\n");
+}
+
+#endif /* CHECK_SWAP_POLICY */
+
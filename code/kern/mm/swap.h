@@ -7,22 +7,25 @@
 /* *
  * swap_entry_t
  * --------------------------------------------
- * |         offset        |   reserved   | 0 |
+ * |         offset        | reserved | type | 0 |
  * --------------------------------------------
- *           24 bits            7 bits    1 bit
+ *           24 bits          5 bits   2 bits 1 bit
+ * the type is the index of the swap device, the offset is the slot in it.
  * */
 
 #define MAX_SWAP_OFFSET_LIMIT                   (1 << 24)
+#define MAX_SWAP_DEVS                           4
 
-extern size_t max_swap_offset;
+#define swap_entry(type, offset)                (((offset) << 8) | ((type) << 1))
+#define swap_type(entry)                        (((entry) >> 1) & (MAX_SWAP_DEVS - 1))
 
 /* *
  * swap_offset - takes a swap_entry (saved in pte), and returns
- * the corresponding offset in swap mem_map.
+ * the corresponding offset in the swap device.
  * */
 #define swap_offset(entry) ({                                       \
             size_t __offset = (entry >> 8);                         \
-            if (!(__offset > 0 && __offset < max_swap_offset)) {    \
+            if (!(__offset > 0 && __offset < MAX_SWAP_OFFSET_LIMIT)) {  \
                 panic("invalid swap_entry_t = %08x.\n", entry);     \
             }                                                       \
             __offset;                                               \
@@ -30,12 +33,20 @@ extern size_t max_swap_offset;
 
 void swap_init(void);
 bool try_free_pages(size_t n);
+struct memgroup;
+bool try_free_group_pages(struct memgroup *mg);
 
 void swap_remove_entry(swap_entry_t entry);
 int swap_page_count(struct Page *page);
 void swap_duplicate(swap_entry_t entry);
 int swap_in_page(swap_entry_t entry, struct Page **pagep);
+struct vma_struct;
+int swap_in_fault(struct vma_struct *vma, uintptr_t addr, swap_entry_t entry, struct Page **pagep);
+int swap_prefetch(swap_entry_t entry);
 int swap_copy_entry(swap_entry_t entry, swap_entry_t *store);
+int swap_add_device(unsigned short ideno, int prio);
+int swap_del_device(unsigned short ideno);
+void print_swapinfo(void);
 
 int kswapd_main(void *arg) __attribute__((noreturn));
 
@@ -11,6 +11,9 @@
 #include <shmem.h>
 #include <proc.h>
 #include <sem.h>
+#include <event.h>
+#include <sched.h>
+#include <memgroup.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
@@ -45,10 +48,11 @@ static void check_vmm(void);
 static void check_vma_struct(void);
 static void check_pgfault(void);
 
+// lock_mm - lock mm exclusively, for changing the vmas of mm
 void
 lock_mm(struct mm_struct *mm) {
     if (mm != NULL) {
-        down(&(mm->mm_sem));
+        down_write(&(mm->mm_sem));
         if (current != NULL) {
             mm->locked_by = current->pid;
         }
@@ -58,7 +62,7 @@ lock_mm(struct mm_struct *mm) {
 void
 unlock_mm(struct mm_struct *mm) {
     if (mm != NULL) {
-        up(&(mm->mm_sem));
+        up_write(&(mm->mm_sem));
         mm->locked_by = 0;
     }
 }
@@ -66,7 +70,7 @@ unlock_mm(struct mm_struct *mm) {
 bool
 try_lock_mm(struct mm_struct *mm) {
     if (mm != NULL) {
-        if (!try_down(&(mm->mm_sem))) {
+        if (!try_down_write(&(mm->mm_sem))) {
             return 0;
         }
         if (current != NULL) {
@@ -76,6 +80,30 @@ try_lock_mm(struct mm_struct *mm) {
     return 1;
 }
 
+// lock_mm_read - lock mm shared, the vmas are stable while it is held,
+//              - page faults of different threads can be handled concurrently
+void
+lock_mm_read(struct mm_struct *mm) {
+    if (mm != NULL) {
+        down_read(&(mm->mm_sem));
+    }
+}
+
+void
+unlock_mm_read(struct mm_struct *mm) {
+    if (mm != NULL) {
+        up_read(&(mm->mm_sem));
+    }
+}
+
+bool
+try_lock_mm_read(struct mm_struct *mm) {
+    if (mm != NULL) {
+        return try_down_read(&(mm->mm_sem));
+    }
+    return 1;
+}
+
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
 mm_create(void) {
@@ -91,7 +119,16 @@ mm_create(void) {
         mm->locked_by = 0;
         mm->brk_start = mm->brk = 0;
         list_init(&(mm->proc_mm_link));
-        sem_init(&(mm->mm_sem), 1);
+        rw_sem_init(&(mm->mm_sem));
+        mm->locked_vm = 0;
+        mm->locked_limit = MLOCK_DEFAULT_LIMIT;
+        mm->def_flags = 0;
+        mm->uffd_handler = 0;
+        wait_queue_init(&(mm->uffd_wait));
+        mm->ksm_address = 0;
+        mm->swap_refaults = mm->swap_weight = 0;
+        mm->memgroup = NULL;
+        mm->rss = mm->max_rss = mm->nr_swapped = mm->nr_swapouts = 0;
     }
     return mm;
 }
@@ -278,6 +315,12 @@ remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     return 0;
 }
 
+// the dead mms waiting for the reaper, linked by proc_mm_link
+static list_entry_t reap_list;
+static int nr_reap_mms = 0;
+
+#define REAP_BATCH_PAGES        256 // pages freed between two checks of need_resched
+
 // mm_destroy - free mm and mm internal fields
 void
 mm_destroy(struct mm_struct *mm) {
@@ -297,6 +340,7 @@ mm_destroy(struct mm_struct *mm) {
 //          - now just call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    list_init(&reap_list);
     check_vmm();
 }
 
@@ -318,10 +362,17 @@ mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
     }
     ret = -E_NO_MEM;
     vm_flags &= ~VM_SHARE;
+    vm_flags |= mm->def_flags;
+    if ((vm_flags & VM_LOCKED) && mm->locked_vm + (end - start) / PGSIZE > mm->locked_limit) {
+        goto out;
+    }
     if ((vma = vma_create(start, end, vm_flags)) == NULL) {
         goto out;
     }
     insert_vma_struct(mm, vma);
+    if (vm_flags & VM_LOCKED) {
+        mm->locked_vm += (end - start) / PGSIZE;
+    }
     if (vma_store != NULL) {
         *vma_store = vma;
     }
@@ -377,6 +428,9 @@ mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
         return 0;
     }
 
+    // let the threads waiting for a user filled page recheck their vma
+    wakeup_queue(&(mm->uffd_wait), WT_UFFD, 1);
+
     if (vma->vm_start < start && end < vma->vm_end) {
         struct vma_struct *nvma;
         if ((nvma = vma_create(vma->vm_start, start, vma->vm_flags)) == NULL) {
@@ -384,7 +438,11 @@ mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
         }
         vma_resize(vma, end, vma->vm_end);
         insert_vma_struct(mm, nvma);
+        if (vma->vm_flags & VM_LOCKED) {
+            mm->locked_vm -= (end - start) / PGSIZE;
+        }
         unmap_range(mm->pgdir, start, end);
+        reclaim_range(mm->pgdir, start, end);
         return 0;
     }
 
@@ -405,6 +463,7 @@ mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
         vma = le2vma(le, list_link);
         le = list_next(le);
         uintptr_t un_start, un_end;
+        bool locked = (vma->vm_flags & VM_LOCKED);
         if (vma->vm_start < start) {
             un_start = start, un_end = vma->vm_end;
             vma_resize(vma, vma->vm_start, un_start);
@@ -421,7 +480,11 @@ mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
                 vma_destroy(vma);
             }
         }
+        if (locked) {
+            mm->locked_vm -= (un_end - un_start) / PGSIZE;
+        }
         unmap_range(mm->pgdir, un_start, un_end);
+        reclaim_range(mm->pgdir, un_start, un_end);
     }
     return 0;
 }
@@ -433,7 +496,8 @@ dup_mmap(struct mm_struct *to, struct mm_struct *from) {
     while ((le = list_prev(le)) != list) {
         struct vma_struct *vma, *nvma;
         vma = le2vma(le, list_link);
-        nvma = vma_create(vma->vm_start, vma->vm_end, vma->vm_flags);
+        // memory locks and fault handlers are not inherited by the child
+        nvma = vma_create(vma->vm_start, vma->vm_end, vma->vm_flags & ~(VM_LOCKED | VM_UFFD));
         if (nvma == NULL) {
             return -E_NO_MEM;
         }
@@ -468,6 +532,98 @@ exit_mmap(struct mm_struct *mm) {
     }
 }
 
+// mm_reap - hand a dead mm (mm_count == 0) to the reaper, so the exiting
+//         - process needn't wait for its address space to be torn down
+void
+mm_reap(struct mm_struct *mm) {
+    assert(mm != NULL && mm_count(mm) == 0);
+    bool intr_flag;
+    spin_lock_irqsave(&proc_lock, intr_flag);
+    {
+        list_del(&(mm->proc_mm_link));
+        if (reaper != NULL) {
+            list_add_before(&reap_list, &(mm->proc_mm_link));
+            nr_reap_mms ++;
+            if (reaper->wait_state == WT_REAPER) {
+                wakeup_proc(reaper);
+            }
+        }
+    }
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
+
+    if (reaper == NULL) {
+        exit_mmap(mm);
+        free_page(kva2page(mm->pgdir));
+        mm_destroy(mm);
+    }
+}
+
+// mm_reap_pending - the number of dead mms not torn down yet
+int
+mm_reap_pending(void) {
+    return nr_reap_mms;
+}
+
+// reap_mm - tear down a dead mm REAP_BATCH_PAGES pages at a time, and give
+//         - up the cpu between two batches when others need it
+static void
+reap_mm(struct mm_struct *mm) {
+    pde_t *pgdir = mm->pgdir;
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        uintptr_t start = vma->vm_start, end;
+        while (start < vma->vm_end) {
+            end = start + REAP_BATCH_PAGES * PGSIZE;
+            if (end > vma->vm_end) {
+                end = vma->vm_end;
+            }
+            unmap_range(pgdir, start, end);
+            reclaim_range(pgdir, start, end);
+            start = end;
+            if (current->need_resched) {
+                schedule();
+            }
+        }
+    }
+    free_page(kva2page(pgdir));
+    mm_destroy(mm);
+}
+
+// reaper_main - the kernel thread freeing the address spaces given by mm_reap
+int
+reaper_main(void *arg) {
+    while (1) {
+        struct mm_struct *mm = NULL;
+        bool intr_flag;
+        spin_lock_irqsave(&proc_lock, intr_flag);
+        {
+            list_entry_t *le = list_next(&reap_list);
+            if (le != &reap_list) {
+                list_del(le);
+                mm = le2mm(le, proc_mm_link);
+            }
+            else {
+                current->state = PROC_SLEEPING;
+                current->wait_state = WT_REAPER;
+            }
+        }
+        spin_unlock_irqrestore(&proc_lock, intr_flag);
+
+        if (mm == NULL) {
+            schedule();
+            continue ;
+        }
+        reap_mm(mm);
+
+        spin_lock_irqsave(&proc_lock, intr_flag);
+        {
+            nr_reap_mms --;
+        }
+        spin_unlock_irqrestore(&proc_lock, intr_flag);
+    }
+}
+
 uintptr_t
 get_unmapped_area(struct mm_struct *mm, size_t len) {
     if (len == 0 || len > USERTOP) {
@@ -501,19 +657,596 @@ mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len) {
     if ((ret = mm_unmap(mm, start, end - start)) != 0) {
         return ret;
     }
-    uint32_t vm_flags = VM_READ | VM_WRITE;
+    uint32_t vm_flags = VM_READ | VM_WRITE | mm->def_flags;
+    if (vm_flags & VM_LOCKED) {
+        if (mm->locked_vm + (end - start) / PGSIZE > mm->locked_limit) {
+            return -E_NO_MEM;
+        }
+    }
     struct vma_struct *vma = find_vma(mm, start - 1);
     if (vma != NULL && vma->vm_end == start && vma->vm_flags == vm_flags) {
         vma->vm_end = end;
-        return 0;
+        goto out;
     }
     if ((vma = vma_create(start, end, vm_flags)) == NULL) {
         return -E_NO_MEM;
     }
     insert_vma_struct(mm, vma);
+out:
+    if (vm_flags & VM_LOCKED) {
+        mm->locked_vm += (end - start) / PGSIZE;
+    }
     return 0;
 }
 
+// vma_split - split vma at addr: vma keeps [vm_start, addr), and the new vma
+//           - [addr, vm_end) is inserted into mm and returned
+static struct vma_struct *
+vma_split(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr) {
+    assert(vma->vm_start < addr && addr < vma->vm_end);
+    struct vma_struct *nvma;
+    if ((nvma = vma_create(addr, vma->vm_end, vma->vm_flags)) == NULL) {
+        return NULL;
+    }
+    if (vma->vm_flags & VM_SHARE) {
+        nvma->shmem = vma->shmem;
+        nvma->shmem_off = vma->shmem_off + (addr - vma->vm_start);
+        shmem_ref_inc(vma->shmem);
+    }
+    vma_resize(vma, vma->vm_start, addr);
+    insert_vma_struct(mm, nvma);
+    return nvma;
+}
+
+// vma_range_mapped - check whether [start, end) is fully covered by vmas
+static bool
+vma_range_mapped(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct vma_struct *vma;
+    while (start < end) {
+        if ((vma = find_vma(mm, start)) == NULL || start < vma->vm_start) {
+            return 0;
+        }
+        start = vma->vm_end;
+    }
+    return 1;
+}
+
+// vma_range_setflags - set (vm_flags & mask) = flags for the vmas in [start, end),
+//                    - the vmas are split at start and end if necessary
+static int
+vma_range_setflags(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t mask, uint32_t flags) {
+    struct vma_struct *vma = find_vma(mm, start);
+    while (vma != NULL && vma->vm_start < end) {
+        if ((vma->vm_flags & mask) != flags) {
+            if (vma->vm_start < start) {
+                if ((vma = vma_split(mm, vma, start)) == NULL) {
+                    return -E_NO_MEM;
+                }
+            }
+            if (end < vma->vm_end) {
+                if (vma_split(mm, vma, end) == NULL) {
+                    return -E_NO_MEM;
+                }
+            }
+            if ((vma->vm_flags ^ flags) & mask & VM_LOCKED) {
+                size_t npages = (vma->vm_end - vma->vm_start) / PGSIZE;
+                if (flags & VM_LOCKED) {
+                    mm->locked_vm += npages;
+                }
+                else {
+                    mm->locked_vm -= npages;
+                }
+            }
+            vma->vm_flags = (vma->vm_flags & ~mask) | flags;
+        }
+        list_entry_t *le = list_next(&(vma->list_link));
+        if (le == &(mm->mmap_list)) {
+            break;
+        }
+        vma = le2vma(le, list_link);
+    }
+    return 0;
+}
+
+// madvise_willneed - start reading the swapped out pages in [start, end) into
+//                  - swap cache and return without waiting for the I/O, so that
+//                  - the following page faults needn't wait for disk
+static int
+madvise_willneed(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    while (start < end) {
+        pte_t *ptep = get_pte(mm->pgdir, start, 0);
+        if (ptep == NULL) {
+            start = ROUNDDOWN(start + PTSIZE, PTSIZE);
+            continue ;
+        }
+        if (*ptep != 0 && !(*ptep & PTE_P)) {
+            if (swap_prefetch(*ptep) == -E_BUSY) {
+                // all the requests are in flight, the faults read the rest
+                break;
+            }
+        }
+        start += PGSIZE;
+    }
+    return 0;
+}
+
+// mm_madvise - apply the advice to the vmas in [addr, addr + len)
+//   MADV_NORMAL/MADV_RANDOM/MADV_SEQUENTIAL are recorded in vm_flags, the vmas are
+//   split at the boundary of the range if necessary. they set the swap readahead
+//   of a fault, see swap_in_fault: MADV_RANDOM turns it off, MADV_SEQUENTIAL reads
+//   the following addresses ahead;
+//   MADV_WILLNEED starts reading the swapped out pages in advance, it does not wait;
+//   MADV_MERGEABLE/MADV_UNMERGEABLE turn ksm scanning on/off (see ksm.c);
+//   MADV_DONTNEED unmaps the pages, the next access gets a zero page (or shmem page).
+int
+mm_madvise(struct mm_struct *mm, uintptr_t addr, size_t len, int advice) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    if (!vma_range_mapped(mm, start, end)) {
+        return -E_INVAL;
+    }
+
+    switch (advice) {
+    case MADV_NORMAL:
+        return vma_range_setflags(mm, start, end, VM_ADVICE_MASK, 0);
+    case MADV_RANDOM:
+        return vma_range_setflags(mm, start, end, VM_ADVICE_MASK, VM_RAND_READ);
+    case MADV_SEQUENTIAL:
+        return vma_range_setflags(mm, start, end, VM_ADVICE_MASK, VM_SEQ_READ);
+    case MADV_WILLNEED:
+        return madvise_willneed(mm, start, end);
+    case MADV_MERGEABLE:
+        return vma_range_setflags(mm, start, end, VM_MERGEABLE, VM_MERGEABLE);
+    case MADV_UNMERGEABLE:
+        return vma_range_setflags(mm, start, end, VM_MERGEABLE, 0);
+    case MADV_DONTNEED:
+        break;
+    default:
+        return -E_INVAL;
+    }
+
+    uintptr_t addr_next = start;
+    while (addr_next < end) {
+        struct vma_struct *vma = find_vma(mm, addr_next);
+        if (vma->vm_flags & VM_LOCKED) {
+            return -E_INVAL;
+        }
+        addr_next = vma->vm_end;
+    }
+    unmap_range(mm->pgdir, start, end);
+    return 0;
+}
+
+// mm_populate - fault in all pages of the vmas in [start, end), break cow of the
+//             - writable private pages, so the following accesses won't fault.
+//   NOTE: mm should be locked by current process.
+int
+mm_populate(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    int ret;
+    struct vma_struct *vma;
+    start = ROUNDDOWN(start, PGSIZE), end = ROUNDUP(end, PGSIZE);
+    while (start < end && (vma = find_vma(mm, start)) != NULL && vma->vm_start < end) {
+        uintptr_t addr = (vma->vm_start > start) ? vma->vm_start : start;
+        uintptr_t un_end = (vma->vm_end < end) ? vma->vm_end : end;
+        if (vma->vm_flags & VM_STACK) {
+            if (addr < vma->vm_start + PGSIZE) {
+                addr = vma->vm_start + PGSIZE;
+            }
+        }
+        for (; addr < un_end; addr += PGSIZE) {
+            uint32_t error_code;
+            pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+            if (ptep == NULL || !(*ptep & PTE_P)) {
+                error_code = (vma->vm_flags & VM_WRITE) ? 2 : 0;
+            }
+            else if ((vma->vm_flags & (VM_SHARE | VM_WRITE)) == VM_WRITE && !(*ptep & PTE_W)) {
+                error_code = 3;
+            }
+            else {
+                continue ;
+            }
+            if ((ret = do_pgfault(mm, error_code, addr)) != 0) {
+                return ret;
+            }
+        }
+        start = vma->vm_end;
+    }
+    return 0;
+}
+
+// vma_range_unlocked - count the pages in [start, end) which are not in VM_LOCKED vmas
+static size_t
+vma_range_unlocked(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    size_t count = 0;
+    struct vma_struct *vma;
+    while (start < end && (vma = find_vma(mm, start)) != NULL && vma->vm_start < end) {
+        uintptr_t un_start = (vma->vm_start > start) ? vma->vm_start : start;
+        uintptr_t un_end = (vma->vm_end < end) ? vma->vm_end : end;
+        if (!(vma->vm_flags & VM_LOCKED)) {
+            count += (un_end - un_start) / PGSIZE;
+        }
+        start = vma->vm_end;
+    }
+    return count;
+}
+
+// mm_mlock - lock (or unlock) the pages in [addr, addr + len) in memory
+int
+mm_mlock(struct mm_struct *mm, uintptr_t addr, size_t len, bool lock) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    if (!vma_range_mapped(mm, start, end)) {
+        return -E_INVAL;
+    }
+
+    int ret;
+    if (lock) {
+        if (mm->locked_vm + vma_range_unlocked(mm, start, end) > mm->locked_limit) {
+            return -E_NO_MEM;
+        }
+        if ((ret = vma_range_setflags(mm, start, end, VM_LOCKED, VM_LOCKED)) != 0) {
+            return ret;
+        }
+        return mm_populate(mm, start, end);
+    }
+    return vma_range_setflags(mm, start, end, VM_LOCKED, 0);
+}
+
+// mm_mlockall - lock all pages currently mapped (MCL_CURRENT) and/or
+//             - all pages mapped in the future (MCL_FUTURE)
+int
+mm_mlockall(struct mm_struct *mm, int flags) {
+    if (flags == 0 || (flags & ~(MCL_CURRENT | MCL_FUTURE)) != 0) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    int ret;
+    if (flags & MCL_CURRENT) {
+        if (mm->locked_vm + vma_range_unlocked(mm, 0, USERTOP) > mm->locked_limit) {
+            return -E_NO_MEM;
+        }
+        if ((ret = vma_range_setflags(mm, 0, USERTOP, VM_LOCKED, VM_LOCKED)) != 0) {
+            return ret;
+        }
+        if ((ret = mm_populate(mm, 0, USERTOP)) != 0) {
+            return ret;
+        }
+    }
+    if (flags & MCL_FUTURE) {
+        mm->def_flags |= VM_LOCKED;
+    }
+    return 0;
+}
+
+// move_ptes - move the ptes (present pages or swap entries) of [start, end) to
+//           - [to, to + end - start), the page tables of the destination should
+//           - have been allocated, so it never sleeps and the pages aren't copied.
+static void
+move_ptes(pde_t *pgdir, uintptr_t start, uintptr_t end, uintptr_t to) {
+    while (start < end) {
+        pte_t *ptep = get_pte(pgdir, start, 0), *nptep;
+        if (ptep == NULL) {
+            uintptr_t next = ROUNDDOWN(start + PTSIZE, PTSIZE);
+            to += next - start, start = next;
+            continue ;
+        }
+        if (*ptep != 0) {
+            nptep = get_pte(pgdir, to, 0);
+            assert(nptep != NULL && *nptep == 0);
+            *nptep = *ptep, *ptep = 0;
+            tlb_invalidate(pgdir, start);
+        }
+        start += PGSIZE, to += PGSIZE;
+    }
+}
+
+// mm_mremap - resize the mapping [addr, addr + old_len) to new_len. It grows in place
+//           - if the following area is free, otherwise with MREMAP_MAYMOVE its ptes and
+//           - swap entries are moved to a new area without copying the pages.
+//           - the (new) address is stored in addr_store.
+int
+mm_mremap(struct mm_struct *mm, uintptr_t addr, size_t old_len, size_t new_len,
+        uint32_t flags, uintptr_t *addr_store) {
+    if (addr % PGSIZE != 0 || old_len == 0 || new_len == 0 || new_len > USERTOP
+            || (flags & ~MREMAP_MAYMOVE) != 0) {
+        return -E_INVAL;
+    }
+    uintptr_t old_end = ROUNDUP(addr + old_len, PGSIZE);
+    if (!USER_ACCESS(addr, old_end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    old_len = old_end - addr, new_len = ROUNDUP(new_len, PGSIZE);
+
+    struct vma_struct *vma;
+    if ((vma = find_vma(mm, addr)) == NULL || addr < vma->vm_start || vma->vm_end < old_end) {
+        return -E_INVAL;
+    }
+
+    *addr_store = addr;
+    if (new_len <= old_len) {
+        if (new_len < old_len) {
+            return mm_unmap(mm, addr + new_len, old_len - new_len);
+        }
+        return 0;
+    }
+
+    // the shared memory can't grow
+    if (vma->vm_flags & VM_SHARE) {
+        return -E_INVAL;
+    }
+    if ((vma->vm_flags & VM_LOCKED) && mm->locked_vm + (new_len - old_len) / PGSIZE > mm->locked_limit) {
+        return -E_NO_MEM;
+    }
+
+    uintptr_t new_addr = addr, new_end = addr + new_len;
+    if (old_end == vma->vm_end && USER_ACCESS(addr, new_end)) {
+        if (find_vma_intersection(mm, old_end, new_end) == NULL) {
+            vma->vm_end = new_end;
+            if (vma->vm_flags & VM_LOCKED) {
+                mm->locked_vm += (new_len - old_len) / PGSIZE;
+                int ret;
+                if ((ret = mm_populate(mm, old_end, new_end)) != 0) {
+                    mm_unmap(mm, old_end, new_len - old_len);
+                    return ret;
+                }
+            }
+            return 0;
+        }
+    }
+
+    if (!(flags & MREMAP_MAYMOVE)) {
+        return -E_NO_MEM;
+    }
+
+    // make [addr, old_end) a whole vma, so that the final mm_unmap never fails
+    if (vma->vm_start < addr) {
+        if ((vma = vma_split(mm, vma, addr)) == NULL) {
+            return -E_NO_MEM;
+        }
+    }
+    if (old_end < vma->vm_end) {
+        if (vma_split(mm, vma, old_end) == NULL) {
+            return -E_NO_MEM;
+        }
+    }
+
+    struct vma_struct *nvma;
+    if ((new_addr = get_unmapped_area(mm, new_len)) == 0) {
+        return -E_NO_MEM;
+    }
+    if ((nvma = vma_create(new_addr, new_addr + new_len, vma->vm_flags)) == NULL) {
+        return -E_NO_MEM;
+    }
+
+    // alloc the page tables first: only kswapd may run while sleeping, and it never
+    // clears a pte, so all non-empty ptes found here have their destination ready.
+    uintptr_t start;
+    for (start = addr; start < old_end; start += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, start, 0);
+        if (ptep == NULL) {
+            start = ROUNDDOWN(start + PTSIZE, PTSIZE) - PGSIZE;
+            continue ;
+        }
+        if (*ptep != 0 && get_pte(mm->pgdir, start - addr + new_addr, 1) == NULL) {
+            vma_destroy(nvma);
+            return -E_NO_MEM;
+        }
+    }
+
+    int ret;
+    insert_vma_struct(mm, nvma);
+    if (nvma->vm_flags & VM_LOCKED) {
+        mm->locked_vm += new_len / PGSIZE;
+        // populate the grown tail before the move: if it fails, the new range
+        // goes away and the old one is left as it was
+        if ((ret = mm_populate(mm, new_addr + old_len, new_addr + new_len)) != 0) {
+            mm_unmap(mm, new_addr, new_len);
+            return ret;
+        }
+    }
+    move_ptes(mm->pgdir, addr, old_end, new_addr);
+    ret = mm_unmap(mm, addr, old_len);
+    assert(ret == 0);
+    *addr_store = new_addr;
+    return 0;
+}
+
+// mm_munlockall - unlock all pages and clear MCL_FUTURE
+int
+mm_munlockall(struct mm_struct *mm) {
+    assert(mm != NULL);
+    mm->def_flags &= ~VM_LOCKED;
+    return vma_range_setflags(mm, 0, USERTOP, VM_LOCKED, 0);
+}
+
+// mm_uffd_register - let thread handler fill the missing pages in [addr, addr + len),
+//                  - handler must share mm with the faulting threads
+int
+mm_uffd_register(struct mm_struct *mm, uintptr_t addr, size_t len, int handler) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    if (!vma_range_mapped(mm, start, end)) {
+        return -E_INVAL;
+    }
+    if (mm->uffd_handler != 0 && mm->uffd_handler != handler) {
+        return -E_BUSY;
+    }
+
+    uintptr_t addr_next = start;
+    while (addr_next < end) {
+        struct vma_struct *vma = find_vma(mm, addr_next);
+        if (vma->vm_flags & (VM_SHARE | VM_LOCKED)) {
+            return -E_INVAL;
+        }
+        addr_next = vma->vm_end;
+    }
+
+    int ret;
+    if ((ret = vma_range_setflags(mm, start, end, VM_UFFD, VM_UFFD)) == 0) {
+        mm->uffd_handler = handler;
+    }
+    return ret;
+}
+
+// mm_uffd_unregister - give the pages in [addr, addr + len) back to do_pgfault
+int
+mm_uffd_unregister(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    int ret;
+    if ((ret = vma_range_setflags(mm, start, end, VM_UFFD, 0)) == 0) {
+        wakeup_queue(&(mm->uffd_wait), WT_UFFD, 1);
+    }
+    return ret;
+}
+
+// mm_uffd_release - the thread pid leaves mm (exit or exec), if it is the handler,
+//                 - wake up the threads waiting for it, their faults fail with -E_FAULT
+//   mm is locked as writer, so a fault can't go to sleep after missing the wakeup.
+void
+mm_uffd_release(struct mm_struct *mm, int pid) {
+    if (mm->uffd_handler == pid) {
+        lock_mm(mm);
+        mm->uffd_handler = 0;
+        wakeup_queue(&(mm->uffd_wait), WT_UFFD, 1);
+        unlock_mm(mm);
+    }
+}
+
+// mm_uffd_copy - fill the missing pages in [dst, dst + len) with the data at src,
+//              - every page is filled before it is mapped, and the threads waiting
+//              - for it are woken up.
+//   NOTE: mm should be locked by current process.
+int
+mm_uffd_copy(struct mm_struct *mm, uintptr_t dst, uintptr_t src, size_t len) {
+    if (dst % PGSIZE != 0 || len % PGSIZE != 0 || len == 0) {
+        return -E_INVAL;
+    }
+    if (!USER_ACCESS(dst, dst + len)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    int ret = 0;
+    uintptr_t end = dst + len;
+    for (; dst < end; dst += PGSIZE, src += PGSIZE) {
+        struct vma_struct *vma = find_vma(mm, dst);
+        if (vma == NULL || vma->vm_start > dst || !(vma->vm_flags & VM_UFFD)) {
+            ret = -E_INVAL;
+            break;
+        }
+        pte_t *ptep;
+        if ((ptep = get_pte(mm->pgdir, dst, 1)) == NULL) {
+            ret = -E_NO_MEM;
+            break;
+        }
+        if (*ptep != 0) {
+            ret = -E_EXISTS;
+            break;
+        }
+        struct Page *page;
+        if ((ret = memgroup_try_charge(mm)) != 0) {
+            break;
+        }
+        if ((page = alloc_page()) == NULL) {
+            ret = -E_NO_MEM;
+            break;
+        }
+        if (!copy_from_user(mm, page2kva(page), (void *)src, PGSIZE, 0)) {
+            free_page(page);
+            ret = -E_FAULT;
+            break;
+        }
+        uint32_t perm = PTE_U;
+        if (vma->vm_flags & VM_WRITE) {
+            perm |= PTE_W;
+        }
+        if ((ret = page_insert(mm->pgdir, page, dst, perm)) != 0) {
+            free_page(page);
+            break;
+        }
+        memgroup_charge(mm, page);
+    }
+    wakeup_queue(&(mm->uffd_wait), WT_UFFD, 1);
+    return ret;
+}
+
+// uffd_handle_fault - post the fault at addr to the handler of mm, and wait
+//                   - until the page is filled (or the vma is not VM_UFFD any more).
+//   NOTE: called from do_pgfault without mm locked, the fault is retried on success.
+//   a fault on a VM_UFFD vma without a handler (never set, or exited) is -E_FAULT.
+static int
+uffd_handle_fault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
+    int ret, event = (int)(addr | ((error_code & 2) ? UFFD_EVENT_WRITE : 0));
+    if (mm->uffd_handler == 0) {
+        return -E_FAULT;
+    }
+    if ((ret = ipc_event_send(mm->uffd_handler, event, 0)) != 0) {
+        return ret;
+    }
+
+    bool intr_flag;
+    wait_t __wait, *wait = &__wait;
+    while (1) {
+        lock_mm_read(mm);
+        struct vma_struct *vma = find_vma(mm, addr);
+        if (vma == NULL || vma->vm_start > addr || !(vma->vm_flags & VM_UFFD)) {
+            unlock_mm_read(mm);
+            return 0;
+        }
+        pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+        if (ptep != NULL && *ptep != 0) {
+            unlock_mm_read(mm);
+            return 0;
+        }
+        if (mm->uffd_handler == 0) {
+            unlock_mm_read(mm);
+            return -E_FAULT;
+        }
+        // the filler needs the write lock, so it cannot slip in before we sleep
+        local_intr_save(intr_flag);
+        wait_current_set(&(mm->uffd_wait), wait, WT_UFFD);
+        local_intr_restore(intr_flag);
+        unlock_mm_read(mm);
+
+        schedule();
+
+        local_intr_save(intr_flag);
+        wait_current_del(&(mm->uffd_wait), wait);
+        local_intr_restore(intr_flag);
+
+        if (wait->wakeup_flags != WT_UFFD) {
+            return -E_KILLED;
+        }
+    }
+}
+
 bool
 user_mem_check(struct mm_struct *mm, uintptr_t addr, size_t len, bool write) {
     if (mm != NULL) {
@@ -541,42 +1274,66 @@ user_mem_check(struct mm_struct *mm, uintptr_t addr, size_t len, bool write) {
     return KERN_ACCESS(addr, addr + len);
 }
 
+// copy_from_user - copy len bytes from user space, __copy_user is fault-tolerant,
+//                - so only the range is checked, the vmas are walked only if the
+//                - source should be writable. mm needn't be locked.
 bool
 copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len, bool writable) {
-    if (!user_mem_check(mm, (uintptr_t)src, len, writable)) {
+    if (mm == NULL || writable) {
+        if (!user_mem_check(mm, (uintptr_t)src, len, writable)) {
+            return 0;
+        }
+        if (mm == NULL) {
+            memcpy(dst, src, len);
+            return 1;
+        }
+    }
+    else if (!USER_ACCESS((uintptr_t)src, (uintptr_t)src + len)) {
         return 0;
     }
-    memcpy(dst, src, len);
-    return 1;
+    return __copy_user(dst, src, len) == 0;
 }
 
+// copy_to_user - copy len bytes to user space, mm needn't be locked.
 bool
 copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len) {
-    if (!user_mem_check(mm, (uintptr_t)dst, len, 1)) {
+    if (mm == NULL) {
+        if (!KERN_ACCESS((uintptr_t)dst, (uintptr_t)dst + len)) {
+            return 0;
+        }
+        memcpy(dst, src, len);
+        return 1;
+    }
+    if (!USER_ACCESS((uintptr_t)dst, (uintptr_t)dst + len)) {
         return 0;
     }
-    memcpy(dst, src, len);
-    return 1;
+    return __copy_user(dst, src, len) == 0;
 }
 
+// copy_string - copy a string (at most maxn bytes including '\0') from user space,
+//             - page by page, so it never reads beyond the page holding '\0'.
 bool
 copy_string(struct mm_struct *mm, char *dst, const char *src, size_t maxn) {
-    size_t alen, part = ROUNDDOWN((uintptr_t)src + PGSIZE, PGSIZE) - (uintptr_t)src;
+    size_t part = ROUNDDOWN((uintptr_t)src + PGSIZE, PGSIZE) - (uintptr_t)src;
     while (1) {
         if (part > maxn) {
             part = maxn;
         }
-        if (!user_mem_check(mm, (uintptr_t)src, part, 0)) {
+        if (mm == NULL) {
+            if (!user_mem_check(mm, (uintptr_t)src, part, 0)) {
+                return 0;
+            }
+            memcpy(dst, src, part);
+        }
+        else if (!copy_from_user(mm, dst, src, part, 0)) {
             return 0;
         }
-        if ((alen = strnlen(src, part)) < part) {
-            memcpy(dst, src, alen + 1);
+        if (strnlen(dst, part) < part) {
             return 1;
         }
         if (part == maxn) {
             return 0;
         }
-        memcpy(dst, src, part);
         dst += part, src += part, maxn -= part;
         part = PGSIZE;
     }
@@ -680,6 +1437,11 @@ check_pgfault(void) {
     }
     assert(sum == 0);
 
+    char buf[8];
+    assert(__copy_user(buf, (void *)addr, sizeof(buf)) == 0 && buf[7] == 7);
+    assert(__copy_user((void *)PTSIZE, buf, sizeof(buf)) == -E_FAULT);
+    assert(__copy_user(buf, (void *)(PTSIZE * 2 + 3), sizeof(buf)) == -E_FAULT);
+
     page_remove(pgdir, ROUNDDOWN(addr, PGSIZE));
     free_page(pa2page(pgdir[0]));
     pgdir[0] = 0;
@@ -695,6 +1457,10 @@ check_pgfault(void) {
 }
 
 // do_pgfault - interrupt handler to process the page fault execption
+//   mm is locked as reader, so the faults of threads sharing mm may be handled
+//   concurrently. Whenever it may sleep (alloc page, swap in, lock shmem), the pte
+//   is checked again before being changed, if it is changed by others meanwhile,
+//   just return and let the access fault again if necessary.
 int
 do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     if (mm == NULL) {
@@ -703,13 +1469,16 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
                 current->pid, error_code, addr);
     }
 
+    // the fault is major if the swap is read meanwhile, see swap_in_fault
+    size_t maj_flt = (current != NULL) ? current->maj_flt : 0;
+
     bool need_unlock = 1;
-    if (!try_lock_mm(mm)) {
+    if (!try_lock_mm_read(mm)) {
         if (current != NULL && mm->locked_by == current->pid) {
             need_unlock = 0;
         }
         else {
-            lock_mm(mm);
+            lock_mm_read(mm);
         }
     }
 
@@ -752,11 +1521,35 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     if ((ptep = get_pte(mm->pgdir, addr, 1)) == NULL) {
         goto failed;
     }
-    if (*ptep == 0) {
+    pte_t entry = *ptep;
+    if (entry == 0) {
+        if (vma->vm_flags & VM_UFFD) {
+            // we can't sleep for the handler while holding mm as writer
+            if (!need_unlock) {
+                ret = -E_FAULT;
+                goto failed;
+            }
+            unlock_mm_read(mm);
+            return uffd_handle_fault(mm, error_code, addr);
+        }
         if (!(vma->vm_flags & VM_SHARE)) {
-            if (pgdir_alloc_page(mm->pgdir, addr, perm) == NULL) {
+            struct Page *page;
+            if ((ret = memgroup_try_charge(mm)) != 0) {
+                goto failed;
+            }
+            ret = -E_NO_MEM;
+            if ((page = alloc_page()) == NULL) {
                 goto failed;
             }
+            if (*ptep != entry) {
+                free_page(page);
+                goto out_retry;
+            }
+            if (page_insert(mm->pgdir, page, addr, perm) != 0) {
+                free_page(page);
+                goto failed;
+            }
+            memgroup_charge(mm, page);
         }
         else {
             lock_shmem(vma->shmem);
@@ -767,12 +1560,16 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
                 goto failed;
             }
             unlock_shmem(vma->shmem);
+            if (*ptep != entry) {
+                goto out_retry;
+            }
             if (*sh_ptep & PTE_P) {
                 page_insert(mm->pgdir, pa2page(*sh_ptep), addr, perm);
             }
             else {
-                swap_duplicate(*ptep);
+                swap_duplicate(*sh_ptep);
                 *ptep = *sh_ptep;
+                pgdir_account(mm->pgdir, 0, 1);
             }
         }
     }
@@ -780,15 +1577,28 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
         struct Page *page, *newpage = NULL;
         bool cow = ((vma->vm_flags & (VM_SHARE | VM_WRITE)) == VM_WRITE), may_copy = 1;
 
-        assert(!(*ptep & PTE_P) || ((error_code & 2) && !(*ptep & PTE_W) && cow));
+        if ((entry & PTE_P) && (!(error_code & 2) || (entry & PTE_W))) {
+            // already handled by others while waiting for the lock
+            goto out_retry;
+        }
+        assert(!(entry & PTE_P) || ((error_code & 2) && !(entry & PTE_W) && cow));
+        if (!(vma->vm_flags & VM_SHARE)) {
+            if ((ret = memgroup_try_charge(mm)) != 0) {
+                goto failed;
+            }
+            if (*ptep != entry) {
+                goto out_retry;
+            }
+            ret = -E_NO_MEM;
+        }
         if (cow) {
             newpage = alloc_page();
         }
-        if (*ptep & PTE_P) {
-            page = pte2page(*ptep);
+        if (entry & PTE_P) {
+            page = pte2page(entry);
         }
         else {
-            if ((ret = swap_in_page(*ptep, &page)) != 0) {
+            if ((ret = swap_in_fault(vma, addr, entry, &page)) != 0) {
                 if (newpage != NULL) {
                     free_page(newpage);
                 }
@@ -799,6 +1609,12 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
                 may_copy = 0;
             }
         }
+        if (*ptep != entry) {
+            if (newpage != NULL) {
+                free_page(newpage);
+            }
+            goto out_retry;
+        }
 
         if (cow && may_copy) {
             if (page_ref(page) + swap_page_count(page) > 1) {
@@ -810,15 +1626,23 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
             }
         }
         page_insert(mm->pgdir, page, addr, perm);
+        if (!(vma->vm_flags & VM_SHARE)) {
+            memgroup_charge(mm, page);
+        }
         if (newpage != NULL) {
             free_page(newpage);
         }
     }
+
+out_retry:
     ret = 0;
+    if (current != NULL && current->maj_flt == maj_flt) {
+        current->min_flt ++;
+    }
 
 failed:
     if (need_unlock) {
-        unlock_mm(mm);
+        unlock_mm_read(mm);
     }
     return ret;
 }
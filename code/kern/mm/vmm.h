@@ -36,6 +36,13 @@ struct vma_struct {
 #define VM_EXEC                 0x00000004
 #define VM_STACK                0x00000008
 #define VM_SHARE                0x00000010
+#define VM_SEQ_READ             0x00000020  // madvise: sequential access, read ahead
+#define VM_RAND_READ            0x00000040  // madvise: random access, no read ahead
+#define VM_LOCKED               0x00000080  // mlock: pages are never swapped out
+#define VM_UFFD                 0x00000100  // missing pages are filled by a user handler
+#define VM_MERGEABLE            0x00000200  // ksmd may merge identical pages
+
+#define VM_ADVICE_MASK          (VM_SEQ_READ | VM_RAND_READ)
 
 // the control struct for a set of vma using the same PDT
 struct mm_struct {
@@ -49,18 +56,38 @@ struct mm_struct {
     int locked_by;
     uintptr_t brk_start, brk;
     list_entry_t proc_mm_link;
-    semaphore_t mm_sem;
+    rw_semaphore_t mm_sem;         // page faults hold it as reader, others as writer
+    size_t locked_vm;              // the number of pages in VM_LOCKED vmas
+    size_t locked_limit;           // the max of locked_vm, from the process
+    uint32_t def_flags;            // the flags added to new vmas (VM_LOCKED for MCL_FUTURE)
+    int uffd_handler;              // the pid of the thread handling faults on VM_UFFD vmas
+    wait_queue_t uffd_wait;        // threads waiting for the handler to fill a page
+    uintptr_t ksm_address;         // where ksmd goes on scanning
+    size_t swap_refaults;          // the recent refaults of its pages, decays
+    size_t swap_weight;            // its share of the reclaim, set by kswapd
+    struct memgroup *memgroup;     // the memory group its pages are charged to, or NULL
+    size_t rss, max_rss;           // the pages mapped, see pgdir_account
+    size_t nr_swapped;             // the entries pointing to swap slots
+    size_t nr_swapouts;            // the pages unmapped by kswapd
 };
 
 void lock_mm(struct mm_struct *mm);
 void unlock_mm(struct mm_struct *mm);
 bool try_lock_mm(struct mm_struct *mm);
+void lock_mm_read(struct mm_struct *mm);
+void unlock_mm_read(struct mm_struct *mm);
+bool try_lock_mm_read(struct mm_struct *mm);
 
 #define le2mm(le, member)                   \
     to_struct((le), struct mm_struct, member)
 
 #define RB_MIN_MAP_COUNT        32 // If the count of vma >32 then redblack tree link is used
 
+// the max number of locked pages of a process (locked_limit) is 1/8 of the memory
+// by default, mlocklimit may set it up to 1/2 of the memory
+#define MLOCK_DEFAULT_LIMIT     (npage / 8)
+#define MLOCK_MAX_LIMIT         (npage / 2)
+
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
 struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end);
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags);
@@ -75,14 +102,30 @@ int mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
 int mm_map_shmem(struct mm_struct *mm, uintptr_t addr, uint32_t vm_flags,
         struct shmem_struct *shmem, struct vma_struct **vma_store);
 int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_mremap(struct mm_struct *mm, uintptr_t addr, size_t old_len, size_t new_len,
+        uint32_t flags, uintptr_t *addr_store);
 int dup_mmap(struct mm_struct *to, struct mm_struct *from);
 void exit_mmap(struct mm_struct *mm);
+void mm_reap(struct mm_struct *mm);
+int mm_reap_pending(void);
+int reaper_main(void *arg) __attribute__((noreturn));
 uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_madvise(struct mm_struct *mm, uintptr_t addr, size_t len, int advice);
+int mm_populate(struct mm_struct *mm, uintptr_t start, uintptr_t end);
+int mm_mlock(struct mm_struct *mm, uintptr_t addr, size_t len, bool lock);
+int mm_mlockall(struct mm_struct *mm, int flags);
+int mm_munlockall(struct mm_struct *mm);
+int mm_uffd_register(struct mm_struct *mm, uintptr_t addr, size_t len, int handler);
+int mm_uffd_unregister(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_uffd_copy(struct mm_struct *mm, uintptr_t dst, uintptr_t src, size_t len);
+void mm_uffd_release(struct mm_struct *mm, int pid);
 
 int do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr);
 bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len, bool write);
 
+int __copy_user(void *dst, const void *src, size_t len);
+
 bool copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len, bool writable);
 bool copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len);
 bool copy_string(struct mm_struct *mm, char *dst, const char *src, size_t maxn);
@@ -0,0 +1,217 @@
+#include <types.h>
+#include <list.h>
+#include <pmm.h>
+#include <swap.h>
+#include <swapfs.h>
+#include <slab.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <error.h>
+#include <assert.h>
+#include <lz.h>
+#include <zswap.h>
+
+/* *
+ * zswap - compressed in-memory cache in front of the swap device
+ *
+ * page_launder stores the pages it swaps out here if they compress to at most
+ * ZSWAP_MAX_LEN bytes, the others are written to the disk as before. The slot
+ * is allocated as usual, the entry keeps the compressed data (kmalloc'ed, so
+ * it lives in the slab) until the slot is freed or stored again.
+ * swap_in_page looks here before reading the disk.
+ * When the pool grows over zswap_max_pages, kswapd writes the least recently
+ * used entries back to their slots on the disk and drops them.
+ * An entry under writeback stays visible to zswap_load until the write is done,
+ * so a fault never reads a slot before its data reaches the disk.
+ * */
+
+struct zswap_entry {
+    swap_entry_t entry;
+    size_t len;                     // the size of compressed data
+    bool writeback;                 // being written back to the disk
+    list_entry_t hash_link;         // link in zswap_hash, empty if invalidated
+    list_entry_t lru_link;          // link in zswap_lru, empty under writeback
+    uint8_t data[0];
+};
+
+#define le2zentry(le, member)               \
+    to_struct((le), struct zswap_entry, member)
+
+#define ZSWAP_HASH_SHIFT            8
+#define ZSWAP_HASH_SIZE             (1 << ZSWAP_HASH_SHIFT)
+#define zswap_hashfn(x)             (hash32(x, ZSWAP_HASH_SHIFT))
+
+// the pages compressed to more than ZSWAP_MAX_LEN bytes go to the disk
+#define ZSWAP_MAX_LEN               (PGSIZE / 2)
+// keep some free pages, storing into the pool must not push kswapd into reclaim
+#define ZSWAP_RESERVE               16
+// the default pool size cap, in percent of the free pages at boot
+#define ZSWAP_DEFAULT_PERCENT       10
+
+static list_entry_t zswap_hash[ZSWAP_HASH_SIZE];
+static list_entry_t zswap_lru;
+
+static bool zswap_ready = 0;
+static size_t zswap_max_pages;
+static size_t pool_bytes, nr_entries;
+static struct Page *wb_page;
+
+// only kswapd stores pages, one buffer for compression is enough
+static uint8_t zswap_buf[ZSWAP_MAX_LEN];
+
+static size_t nr_stored, nr_rejected, nr_written, nr_hits, nr_misses;
+static size_t total_orig_bytes, total_comp_bytes;
+
+void
+zswap_init(void) {
+    int i;
+    for (i = 0; i < ZSWAP_HASH_SIZE; i ++) {
+        list_init(zswap_hash + i);
+    }
+    list_init(&zswap_lru);
+    if ((wb_page = alloc_page()) == NULL) {
+        panic("zswap: no memory for writeback page.\n");
+    }
+    zswap_max_pages = nr_free_pages() * ZSWAP_DEFAULT_PERCENT / 100;
+    check_lz();
+    zswap_ready = 1;
+}
+
+static struct zswap_entry *
+zswap_find(swap_entry_t entry) {
+    list_entry_t *list = zswap_hash + zswap_hashfn(entry), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct zswap_entry *ze = le2zentry(le, hash_link);
+        if (ze->entry == entry) {
+            return ze;
+        }
+    }
+    return NULL;
+}
+
+// zswap_free_entry - drop ze from the pool and free it
+static void
+zswap_free_entry(struct zswap_entry *ze) {
+    list_del_init(&(ze->hash_link));
+    list_del_init(&(ze->lru_link));
+    pool_bytes -= ze->len, nr_entries --;
+    kfree(ze);
+}
+
+// zswap_contains - is the data of the slot in the pool (and maybe not on disk)
+bool
+zswap_contains(swap_entry_t entry) {
+    return zswap_ready && zswap_find(entry) != NULL;
+}
+
+// zswap_invalidate - the slot is freed or about to be stored again, drop its
+//                  - data. an entry under writeback is freed by zswap_writeback.
+void
+zswap_invalidate(swap_entry_t entry) {
+    struct zswap_entry *ze;
+    if (zswap_ready && (ze = zswap_find(entry)) != NULL) {
+        if (ze->writeback) {
+            list_del_init(&(ze->hash_link));
+        }
+        else {
+            zswap_free_entry(ze);
+        }
+    }
+}
+
+// zswap_store - compress the page swapped out to the slot of entry into the pool.
+//   return 0 on success, otherwise the caller must write the page to the disk.
+int
+zswap_store(swap_entry_t entry, struct Page *page) {
+    zswap_invalidate(entry);
+    if (!zswap_ready || zswap_max_pages == 0) {
+        return -E_NA_DEV;
+    }
+
+    size_t len = lz_compress(page2kva(page), PGSIZE, zswap_buf, ZSWAP_MAX_LEN);
+    if (len == 0) {
+        nr_rejected ++;
+        return -E_TOO_BIG;
+    }
+    if (nr_free_pages() < ZSWAP_RESERVE) {
+        return -E_NO_MEM;
+    }
+
+    struct zswap_entry *ze;
+    if ((ze = kmalloc(sizeof(struct zswap_entry) + len)) == NULL) {
+        return -E_NO_MEM;
+    }
+    ze->entry = entry, ze->len = len, ze->writeback = 0;
+    memcpy(ze->data, zswap_buf, len);
+    list_add(zswap_hash + zswap_hashfn(entry), &(ze->hash_link));
+    list_add_before(&zswap_lru, &(ze->lru_link));
+
+    pool_bytes += len, nr_entries ++;
+    nr_stored ++, total_orig_bytes += PGSIZE, total_comp_bytes += len;
+    return 0;
+}
+
+// zswap_load - decompress the data of entry into page if it is in the pool.
+//   return -E_NOENT if it is not, the caller reads the disk then.
+int
+zswap_load(swap_entry_t entry, struct Page *page) {
+    if (!zswap_ready) {
+        return -E_NOENT;
+    }
+    struct zswap_entry *ze;
+    if ((ze = zswap_find(entry)) == NULL) {
+        nr_misses ++;
+        return -E_NOENT;
+    }
+    if (lz_decompress(ze->data, ze->len, page2kva(page), PGSIZE) != 0) {
+        panic("zswap: corrupted entry %08x.\n", entry);
+    }
+    if (!ze->writeback) {
+        list_del(&(ze->lru_link));
+        list_add_before(&zswap_lru, &(ze->lru_link));
+    }
+    nr_hits ++;
+    return 0;
+}
+
+// zswap_writeback - write the least recently used entries to the disk until the
+//                 - pool fits in zswap_max_pages again. called by kswapd.
+void
+zswap_writeback(void) {
+    while (zswap_ready && pool_bytes > zswap_max_pages * PGSIZE && !list_empty(&zswap_lru)) {
+        struct zswap_entry *ze = le2zentry(list_next(&zswap_lru), lru_link);
+        if (lz_decompress(ze->data, ze->len, page2kva(wb_page), PGSIZE) != 0) {
+            panic("zswap: corrupted entry %08x.\n", ze->entry);
+        }
+        list_del_init(&(ze->lru_link));
+        ze->writeback = 1;
+        int ret = swapfs_write(ze->entry, wb_page);
+        ze->writeback = 0;
+        if (ret != 0 && !list_empty(&(ze->hash_link))) {
+            list_add_before(&zswap_lru, &(ze->lru_link));
+            warn("zswap: writeback failed, error %d.\n", ret);
+            break;
+        }
+        zswap_free_entry(ze);
+        nr_written ++;
+    }
+}
+
+// zswap_set_max_pages - set the size cap of the pool, 0 stops storing pages
+void
+zswap_set_max_pages(size_t max_pages) {
+    zswap_max_pages = max_pages;
+}
+
+void
+print_zswapinfo(void) {
+    size_t ratio = (total_orig_bytes == 0) ? 0 : total_comp_bytes * 100 / total_orig_bytes;
+    size_t loads = nr_hits + nr_misses, hit_rate = (loads == 0) ? 0 : nr_hits * 100 / loads;
+    cprintf("zswap: %d entries, pool %d/%d KB, %d stored, %d rejected, %d written back.\n",
+            nr_entries, pool_bytes / 1024, zswap_max_pages * PGSIZE / 1024,
+            nr_stored, nr_rejected, nr_written);
+    cprintf("zswap: compressed to %d%% of the size, %d hits, %d misses, hit rate %d%%.\n",
+            ratio, nr_hits, nr_misses, hit_rate);
+}
+
@@ -0,0 +1,17 @@
+#ifndef __KERN_MM_ZSWAP_H__
+#define __KERN_MM_ZSWAP_H__
+
+#include <types.h>
+#include <memlayout.h>
+
+void zswap_init(void);
+bool zswap_contains(swap_entry_t entry);
+int zswap_store(swap_entry_t entry, struct Page *page);
+int zswap_load(swap_entry_t entry, struct Page *page);
+void zswap_invalidate(swap_entry_t entry);
+void zswap_writeback(void);
+void zswap_set_max_pages(size_t max_pages);
+void print_zswapinfo(void);
+
+#endif /* !__KERN_MM_ZSWAP_H__ */
+
@@ -2,6 +2,7 @@
 #include <slab.h>
 #include <string.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <pmm.h>
 #include <error.h>
 #include <sched.h>
@@ -19,6 +20,9 @@
 #include <sysfile.h>
 #include <swap.h>
 #include <mbox.h>
+#include <ksm.h>
+#include <rusage.h>
+#include <apic.h>
 
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
@@ -70,6 +74,9 @@ SYS_getpid      : get the process's pid
 list_entry_t proc_list;
 // the process set's mm's list
 list_entry_t proc_mm_list;
+// protects proc_list, hash_list, the family and thread group links, and
+// proc_mm_list (and the reap_list of vmm.c, the dead mms move there)
+spinlock_t proc_lock;
 
 #define HASH_SHIFT          10
 #define HASH_LIST_SIZE      (1 << HASH_SHIFT)
@@ -78,17 +85,33 @@ list_entry_t proc_mm_list;
 // has list for process set based on pid
 static list_entry_t hash_list[HASH_LIST_SIZE];
 
-// idle proc
-struct proc_struct *idleproc = NULL;
+// the per-cpu state, with the current and idle proc of each cpu
+struct cpu cpus[NCPU];
+// the cpus found by mp_init, and the ones running the kernel
+int ncpu = 1, ncpu_online = 1;
 // init proc
 struct proc_struct *initproc = NULL;
-// current proc
-struct proc_struct *current = NULL;
 // swap daemon proc
 struct proc_struct *kswapd = NULL;
+// mm reaper proc
+struct proc_struct *reaper = NULL;
+// same-page merging daemon proc
+struct proc_struct *ksmd = NULL;
 
 static int nr_process = 0;
 
+// cpu_lookup - find the running cpu by the id of its local APIC
+struct cpu *
+cpu_lookup(void) {
+    int i, apicid = lapic_id();
+    for (i = 0; i < ncpu; i ++) {
+        if (cpus[i].apicid == apicid) {
+            return cpus + i;
+        }
+    }
+    panic("unknown cpu, apic id %d.\n", apicid);
+}
+
 void kernel_thread_entry(void);
 void forkrets(struct trapframe *tf);
 void switch_to(struct context *from, struct context *to);
@@ -119,9 +142,20 @@ alloc_proc(void) {
         proc->rq = NULL;
         list_init(&(proc->run_link));
         proc->time_slice = 0;
+        proc->exec_start = proc->sum_exec = 0;
+        proc->mlfq_base = 0;
+        proc->mlfq_epoch = 0;
+        proc->nice = 0;
+        proc->vruntime = 0;
         proc->sem_queue = NULL;
         event_box_init(&(proc->event_box));
         proc->fs_struct = NULL;
+        proc->oom_score_adj = 0;
+        proc->memgroup = NULL;
+        proc->locked_limit = MLOCK_DEFAULT_LIMIT;
+        proc->min_flt = proc->maj_flt = 0;
+        proc->cpu = 0;
+        proc->klocked = 0;
     }
     return proc;
 }
@@ -215,7 +249,7 @@ proc_run(struct proc_struct *proc) {
         {
             current = proc;
             load_esp0(next->kstack + KSTACKSIZE);
-            lcr3(next->cr3);
+            cpu_load_cr3(next->cr3);
             switch_to(&(prev->context), &(next->context));
         }
         local_intr_restore(intr_flag);
@@ -227,6 +261,8 @@ proc_run(struct proc_struct *proc) {
 //       after switch_to, the current proc will execute here.
 static void
 forkret(void) {
+    schedule_tail();
+    schedule_relock();
     forkrets(current->tf);
 }
 
@@ -299,6 +335,7 @@ setup_pgdir(struct mm_struct *mm) {
     pde_t *pgdir = page2kva(page);
     memcpy(pgdir, boot_pgdir, PGSIZE);
     pgdir[PDX(VPT)] = PADDR(pgdir) | PTE_P | PTE_W;
+    pgdir_set_mm(pgdir, mm);
     mm->pgdir = pgdir;
     return 0;
 }
@@ -306,19 +343,15 @@ setup_pgdir(struct mm_struct *mm) {
 // put_pgdir - free the memory space of PDT
 static void
 put_pgdir(struct mm_struct *mm) {
+    pgdir_set_mm(mm->pgdir, NULL);
     free_page(kva2page(mm->pgdir));
 }
 
-// de_thread - delete this thread "proc" from thread_group list
+// de_thread - delete this thread "proc" from thread_group list, called with proc_lock held
 static void
 de_thread(struct proc_struct *proc) {
     if (!list_empty(&(proc->thread_group))) {
-        bool intr_flag;
-        local_intr_save(intr_flag);
-        {
-            list_del_init(&(proc->thread_group));
-        }
-        local_intr_restore(intr_flag);
+        list_del_init(&(proc->thread_group));
     }
 }
 
@@ -350,6 +383,8 @@ copy_mm(uint32_t clone_flags, struct proc_struct *proc) {
     if (setup_pgdir(mm) != 0) {
         goto bad_pgdir_cleanup_mm;
     }
+    mm->memgroup = proc->memgroup;
+    mm->locked_limit = proc->locked_limit;
 
     lock_mm(oldmm);
     {
@@ -366,11 +401,11 @@ good_mm:
         mm->brk_start = oldmm->brk_start;
         mm->brk = oldmm->brk;
         bool intr_flag;
-        local_intr_save(intr_flag);
+        spin_lock_irqsave(&proc_lock, intr_flag);
         {
             list_add(&(proc_mm_list), &(mm->proc_mm_link));
         }
-        local_intr_restore(intr_flag);
+        spin_unlock_irqrestore(&proc_lock, intr_flag);
     }
     mm_count_inc(mm);
     proc->mm = mm;
@@ -397,6 +432,8 @@ copy_thread(struct proc_struct *proc, uintptr_t esp, struct trapframe *tf) {
 
     proc->context.eip = (uintptr_t)forkret;
     proc->context.esp = (uintptr_t)(proc->tf);
+    // a kernel thread runs the kernel code all the time, a user proc enters it by traps
+    proc->klocked = trap_in_kernel(tf);
 }
 
 static int
@@ -519,6 +556,10 @@ do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf) {
 
     proc->parent = current;
     list_init(&(proc->thread_group));
+    proc->oom_score_adj = current->oom_score_adj;
+    proc->nice = current->nice;
+    proc->memgroup = current->memgroup;
+    proc->locked_limit = current->locked_limit;
     assert(current->wait_state == 0);
 
     assert(current->time_slice >= 0);
@@ -540,7 +581,7 @@ do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf) {
     copy_thread(proc, stack, tf);
 
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&proc_lock, intr_flag);
     {
         proc->pid = get_pid();
         hash_proc(proc);
@@ -549,7 +590,7 @@ do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf) {
             list_add_before(&(current->thread_group), &(proc->thread_group));
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
 
     wakeup_proc(proc);
 
@@ -569,7 +610,7 @@ bad_fork_cleanup_proc:
 }
 
 // __do_exit - cause a thread exit (use do_exit, do_exit_thread instead)
-//   1. call exit_mmap & put_pgdir & mm_destroy to free the almost all memory space of process
+//   1. call mm_reap to let the reaper free the almost all memory space of process
 //   2. set process' state as PROC_ZOMBIE, then call wakeup_proc(parent) to ask parent reclaim itself.
 //   3. call scheduler to switch to other process
 static int
@@ -583,17 +624,10 @@ __do_exit(void) {
 
     struct mm_struct *mm = current->mm;
     if (mm != NULL) {
-        lcr3(boot_cr3);
+        cpu_load_cr3(boot_cr3);
+        mm_uffd_release(mm, current->pid);
         if (mm_count_dec(mm) == 0) {
-            exit_mmap(mm);
-            put_pgdir(mm);
-            bool intr_flag;
-            local_intr_save(intr_flag);
-            {
-                list_del(&(mm->proc_mm_link));
-            }
-            local_intr_restore(intr_flag);
-            mm_destroy(mm);
+            mm_reap(mm);
         }
         current->mm = NULL;
     }
@@ -603,7 +637,7 @@ __do_exit(void) {
 
     bool intr_flag;
     struct proc_struct *proc, *parent;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&proc_lock, intr_flag);
     {
         proc = parent = current->parent;
         do {
@@ -637,7 +671,7 @@ __do_exit(void) {
 
     wakeup_queue(&(current->event_box.wait_queue), WT_INTERRUPTED, 1);
 
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
 
     schedule();
     panic("__do_exit will not return!! %d %d.\n", current->pid, current->exit_code);
@@ -647,7 +681,7 @@ __do_exit(void) {
 int
 do_exit(int error_code) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&proc_lock, intr_flag);
     {
         list_entry_t *list = &(current->thread_group), *le = list;
         while ((le = list_next(le)) != list) {
@@ -655,7 +689,7 @@ do_exit(int error_code) {
             __do_kill(proc, error_code);
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
     return do_exit_thread(error_code);
 }
 
@@ -696,6 +730,8 @@ load_icode(int fd, int argc, char **kargv) {
         goto bad_pgdir_cleanup_mm;
     }
 
+    mm->memgroup = current->memgroup;
+    mm->locked_limit = current->locked_limit;
     mm->brk_start = 0;
 
     struct Page *page;
@@ -798,15 +834,15 @@ load_icode(int fd, int argc, char **kargv) {
     }
 
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&proc_lock, intr_flag);
     {
         list_add(&(proc_mm_list), &(mm->proc_mm_link));
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
     mm_count_inc(mm);
     current->mm = mm;
     current->cr3 = PADDR(mm->pgdir);
-    lcr3(PADDR(mm->pgdir));
+    cpu_load_cr3(PADDR(mm->pgdir));
 
     uintptr_t stacktop = USTACKTOP - argc * PGSIZE;
     char **uargv = (char **)(stacktop - argc * sizeof(char *));
@@ -915,17 +951,10 @@ do_execve(const char *name, int argc, const char **argv) {
     }
 
     if (mm != NULL) {
-        lcr3(boot_cr3);
+        cpu_load_cr3(boot_cr3);
+        mm_uffd_release(mm, current->pid);
         if (mm_count_dec(mm) == 0) {
-            exit_mmap(mm);
-            put_pgdir(mm);
-            bool intr_flag;
-            local_intr_save(intr_flag);
-            {
-                list_del(&(mm->proc_mm_link));
-            }
-            local_intr_restore(intr_flag);
-            mm_destroy(mm);
+            mm_reap(mm);
         }
         current->mm = NULL;
     }
@@ -941,7 +970,10 @@ do_execve(const char *name, int argc, const char **argv) {
         goto execve_exit;
     }
     put_kargv(argc, kargv);
+    bool intr_flag;
+    spin_lock_irqsave(&proc_lock, intr_flag);
     de_thread(current);
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
     set_proc_name(current, local_name);
     return 0;
 
@@ -1016,12 +1048,12 @@ found:
         panic("wait idleproc or initproc.\n");
     }
     int exit_code = proc->exit_code;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&proc_lock, intr_flag);
     {
         unhash_proc(proc);
         remove_links(proc);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&proc_lock, intr_flag);
     put_kstack(proc);
     kfree(proc);
 
@@ -1062,6 +1094,72 @@ do_kill(int pid, int error_code) {
     return -E_INVAL;
 }
 
+// proc_rusage - fill usage with the counters of proc and its mm
+static void
+proc_rusage(struct proc_struct *proc, struct rusage *usage) {
+    memset(usage, 0, sizeof(struct rusage));
+    struct mm_struct *mm = proc->mm;
+    if (mm != NULL) {
+        usage->ru_rss = mm->rss, usage->ru_maxrss = mm->max_rss;
+        usage->ru_swap = mm->nr_swapped, usage->ru_swapouts = mm->nr_swapouts;
+    }
+    usage->ru_minflt = proc->min_flt, usage->ru_majflt = proc->maj_flt;
+}
+
+// do_nice - set the nice value of process pid (0 for current)
+int
+do_nice(int pid, int nice) {
+    if (nice < NICE_MIN || nice > NICE_MAX) {
+        return -E_INVAL;
+    }
+    struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+    if (proc == NULL) {
+        return -E_INVAL;
+    }
+    sched_setnice(proc, nice);
+    return 0;
+}
+
+// do_schedclass - copy the name of the scheduling class to name, len bytes at most
+int
+do_schedclass(char *name, size_t len) {
+    const char *class_name = sched_class_name();
+    size_t n = strlen(class_name) + 1;
+    if (len < n) {
+        return -E_INVAL;
+    }
+    return (copy_to_user(current->mm, name, class_name, n)) ? 0 : -E_INVAL;
+}
+
+// do_getrusage - get the memory and page fault counters of process pid (0 for current)
+int
+do_getrusage(int pid, struct rusage *usage) {
+    struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+    if (proc == NULL) {
+        return -E_INVAL;
+    }
+    struct rusage __local_usage, *local_usage = &__local_usage;
+    proc_rusage(proc, local_usage);
+
+    // copy_to_user tolerates the faults, the mm needn't be locked
+    return (copy_to_user(current->mm, usage, local_usage, sizeof(struct rusage))) ? 0 : -E_INVAL;
+}
+
+// print_rusage - print the memory and page fault counters of the processes
+void
+print_rusage(void) {
+    cprintf("  pid name             rss  maxrss    swap swapouts   minflt   majflt\n");
+    list_entry_t *list = &proc_list, *le = list;
+    while ((le = list_next(le)) != list) {
+        struct proc_struct *proc = le2proc(le, list_link);
+        struct rusage usage;
+        proc_rusage(proc, &usage);
+        cprintf("%5d %-15s %6d %7d %7d %8d %8d %8d\n", proc->pid, proc->name,
+                usage.ru_rss, usage.ru_maxrss, usage.ru_swap, usage.ru_swapouts,
+                usage.ru_minflt, usage.ru_majflt);
+    }
+}
+
 // do_brk - adjust(increase/decrease) the size of process heap, align with page size
 // NOTE: will change the process vma
 int
@@ -1075,6 +1173,7 @@ do_brk(uintptr_t *brk_store) {
     }
 
     uintptr_t brk;
+    int ret = 0;
 
     lock_mm(mm);
     if (!copy_from_user(mm, &brk, brk_store, sizeof(uintptr_t), 1)) {
@@ -1102,24 +1201,36 @@ do_brk(uintptr_t *brk_store) {
         if (mm_brk(mm, oldbrk, newbrk - oldbrk) != 0) {
             goto out_unlock;
         }
+        if (mm->def_flags & VM_LOCKED) {
+            if ((ret = mm_populate(mm, oldbrk, newbrk)) != 0) {
+                mm_unmap(mm, oldbrk, newbrk - oldbrk);
+                goto out_unlock;
+            }
+        }
     }
     mm->brk = newbrk;
 out_unlock:
     *brk_store = mm->brk;
     unlock_mm(mm);
-    return 0;
+    return ret;
 }
 
-// do_sleep - set current process state to sleep and add timer with "time"
+// do_sleep - set current process state to sleep and add timer with "time" ticks,
 //          - then call scheduler. if process run again, delete timer first.
 int
 do_sleep(unsigned int time) {
-    if (time == 0) {
+    return do_sleep_units(timer_units(time, TIMEOUT_TICKS));
+}
+
+// do_sleep_units - sleep for units 1 / TIMER_HZ, see timer_units
+int
+do_sleep_units(unsigned int units) {
+    if (units == 0) {
         return 0;
     }
     bool intr_flag;
     local_intr_save(intr_flag);
-    timer_t __timer, *timer = timer_init(&__timer, current, time);
+    timer_t __timer, *timer = timer_init(&__timer, current, units);
     current->state = PROC_SLEEPING;
     current->wait_state = WT_TIMER;
     add_timer(timer);
@@ -1165,6 +1276,12 @@ do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags) {
         }
     }
     if ((ret = mm_map(mm, addr, len, vm_flags, NULL)) == 0) {
+        if (mm->def_flags & VM_LOCKED) {
+            if ((ret = mm_populate(mm, addr, addr + len)) != 0) {
+                mm_unmap(mm, addr, len);
+                goto out_unlock;
+            }
+        }
         *addr_store = addr;
     }
 out_unlock:
@@ -1191,6 +1308,198 @@ do_munmap(uintptr_t addr, size_t len) {
     return ret;
 }
 
+// do_ptcount - return the number of page table pages in current's address space
+int
+do_ptcount(void) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call ptcount!!.\n");
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = pt_count(mm->pgdir);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_uffd - user fault handling: UFFD_REGISTER(addr, len, handler),
+//         - UFFD_UNREGISTER(addr, len) and UFFD_COPY(dst, src, len)
+int
+do_uffd(int cmd, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call uffd!!.\n");
+    }
+    if (cmd == UFFD_REGISTER) {
+        struct proc_struct *proc;
+        int handler = (int)arg2;
+        if ((proc = find_proc(handler)) == NULL || proc->mm != mm || proc == current) {
+            return -E_INVAL;
+        }
+    }
+    else if (cmd != UFFD_UNREGISTER && cmd != UFFD_COPY) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        switch (cmd) {
+        case UFFD_REGISTER:
+            ret = mm_uffd_register(mm, arg0, arg1, (int)arg2);
+            break;
+        case UFFD_UNREGISTER:
+            ret = mm_uffd_unregister(mm, arg0, arg1);
+            break;
+        default:
+            ret = mm_uffd_copy(mm, arg0, arg1, arg2);
+        }
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_mremap - resize the mapping at *addr_store from old_len to new_len,
+//           - the new address is stored in addr_store.
+int
+do_mremap(uintptr_t *addr_store, size_t old_len, size_t new_len, uint32_t flags) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call mremap!!.\n");
+    }
+    if (addr_store == NULL) {
+        return -E_INVAL;
+    }
+
+    int ret = -E_INVAL;
+
+    uintptr_t addr;
+
+    lock_mm(mm);
+    if (!copy_from_user(mm, &addr, addr_store, sizeof(uintptr_t), 1)) {
+        goto out_unlock;
+    }
+    // addr_store may be in the range just unmapped or moved
+    if ((ret = mm_mremap(mm, addr, old_len, new_len, flags, &addr)) == 0) {
+        if (!copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t))) {
+            ret = -E_FAULT;
+        }
+    }
+out_unlock:
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_madvise - give advice about the use of memory in [addr, addr + len)
+int
+do_madvise(uintptr_t addr, size_t len, int advice) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call madvise!!.\n");
+    }
+    if (len == 0) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_madvise(mm, addr, len, advice);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_mlock - lock the pages in [addr, addr + len) in memory
+int
+do_mlock(uintptr_t addr, size_t len) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call mlock!!.\n");
+    }
+    if (len == 0) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_mlock(mm, addr, len, 1);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_munlock - unlock the pages in [addr, addr + len)
+int
+do_munlock(uintptr_t addr, size_t len) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call munlock!!.\n");
+    }
+    if (len == 0) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_mlock(mm, addr, len, 0);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_mlockall - lock all current (MCL_CURRENT) and/or future (MCL_FUTURE) pages
+int
+do_mlockall(int flags) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call mlockall!!.\n");
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_mlockall(mm, flags);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_munlockall - unlock all pages of current process
+int
+do_munlockall(void) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call munlockall!!.\n");
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_munlockall(mm);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_mlocklimit - set the max number of locked pages of current process to limit
+//               - if it isn't 0, return the limit in effect. the pages locked
+//               - already stay locked if it's lowered below them.
+int
+do_mlocklimit(size_t limit) {
+    if (limit > MLOCK_MAX_LIMIT) {
+        return -E_INVAL;
+    }
+    if (limit != 0) {
+        current->locked_limit = limit;
+        struct mm_struct *mm = current->mm;
+        if (mm != NULL) {
+            lock_mm(mm);
+            mm->locked_limit = limit;
+            unlock_mm(mm);
+        }
+    }
+    return current->locked_limit;
+}
+
 // do_shmem - create a share memory with addr, len, flags(VM_READ/M_WRITE/VM_STACK)
 int
 do_shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags) {
@@ -1233,6 +1542,12 @@ do_shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags) {
         shmem_destroy(shmem);
         goto out_unlock;
     }
+    if (mm->def_flags & VM_LOCKED) {
+        if ((ret = mm_populate(mm, addr, addr + len)) != 0) {
+            mm_unmap(mm, addr, len);
+            goto out_unlock;
+        }
+    }
     *addr_store = addr;
 out_unlock:
     unlock_mm(mm);
@@ -1283,7 +1598,8 @@ user_main(void *arg) {
     panic("user_main execve failed.\n");
 }
 
-// init_main - the second kernel thread used to create kswapd_main & user_main kernel threads
+// init_main - the second kernel thread used to create kswapd_main, reaper_main, ksmd_main
+//           - & user_main kernel threads
 static int
 init_main(void *arg) {
     int pid;
@@ -1293,6 +1609,18 @@ init_main(void *arg) {
     kswapd = find_proc(pid);
     set_proc_name(kswapd, "kswapd");
 
+    if ((pid = kernel_thread(reaper_main, NULL, 0)) <= 0) {
+        panic("reaper init failed.\n");
+    }
+    reaper = find_proc(pid);
+    set_proc_name(reaper, "reaper");
+
+    if ((pid = kernel_thread(ksmd_main, NULL, 0)) <= 0) {
+        panic("ksmd init failed.\n");
+    }
+    ksmd = find_proc(pid);
+    set_proc_name(ksmd, "ksmd");
+
     int ret;
     if ((ret = vfs_set_bootfs("disk0:")) != 0) {
         panic("set boot fs failed: %e.\n", ret);
@@ -1315,7 +1643,11 @@ init_main(void *arg) {
         schedule();
     }
 
-    assert(kswapd != NULL);
+    assert(kswapd != NULL && reaper != NULL && ksmd != NULL);
+
+    while (mm_reap_pending() != 0) {
+        schedule();
+    }
 
     int i;
     for (i = 0; i < 10; i ++) {
@@ -1327,11 +1659,14 @@ init_main(void *arg) {
 
     mbox_cleanup();
     fs_cleanup();
+    ksm_cleanup();
 
     cprintf("all user-mode processes have quit.\n");
-    assert(initproc->cptr == kswapd && initproc->yptr == NULL && initproc->optr == NULL);
-    assert(kswapd->cptr == NULL && kswapd->yptr == NULL && kswapd->optr == NULL);
-    assert(nr_process == 3);
+    assert(initproc->cptr == ksmd && initproc->yptr == NULL && initproc->optr == NULL);
+    assert(ksmd->cptr == NULL && ksmd->yptr == NULL && ksmd->optr == reaper);
+    assert(reaper->cptr == NULL && reaper->yptr == ksmd && reaper->optr == kswapd);
+    assert(kswapd->cptr == NULL && kswapd->yptr == reaper && kswapd->optr == NULL);
+    assert(nr_process == 5);
     assert(nr_free_pages_store == nr_free_pages());
     assert(slab_allocated_store == slab_allocated());
     cprintf("init check memory pass.\n");
@@ -1346,6 +1681,7 @@ proc_init(void) {
 
     list_init(&proc_list);
     list_init(&proc_mm_list);
+    spinlock_init(&proc_lock);
     for (i = 0; i < HASH_LIST_SIZE; i ++) {
         list_init(hash_list + i);
     }
@@ -1367,6 +1703,27 @@ proc_init(void) {
     nr_process ++;
 
     current = idleproc;
+    cpus[0].cr3 = boot_cr3;
+
+    // the idle procs of the APs, mp_start boots them on their kernel stacks
+    for (i = 1; i < ncpu; i ++) {
+        struct proc_struct *idle;
+        if ((idle = alloc_proc()) == NULL || setup_kstack(idle) != 0) {
+            panic("cannot alloc idleproc of cpu %d.\n", i);
+        }
+        idle->pid = 0;
+        idle->state = PROC_RUNNABLE;
+        idle->need_resched = 1;
+        idle->cpu = i;
+        idle->fs_struct = idleproc->fs_struct;
+        fs_count_inc(idle->fs_struct);
+
+        set_proc_name(idle, "idle");
+        nr_process ++;
+
+        cpus[i].idle = cpus[i].curproc = idle;
+        cpus[i].cr3 = boot_cr3;
+    }
 
     int pid = kernel_thread(init_main, NULL, 0);
     if (pid <= 0) {
@@ -1380,10 +1737,16 @@ proc_init(void) {
     assert(initproc != NULL && initproc->pid == 1);
 }
 
-// cpu_idle - at the end of kern_init, the first kernel thread idleproc will do below works
+// cpu_idle - at the end of kern_init, the first kernel thread idleproc will do below works.
+//   with nothing to run it halts till an interrupt, the clock event is not ticking then.
 void
 cpu_idle(void) {
     while (1) {
+        cli();
+        if (!current->need_resched) {
+            sti_hlt();
+        }
+        sti();
         if (current->need_resched) {
             schedule();
         }
@@ -3,8 +3,11 @@
 
 #include <types.h>
 #include <list.h>
+#include <rb_tree.h>
 #include <trap.h>
+#include <x86.h>
 #include <memlayout.h>
+#include <mmu.h>
 #include <unistd.h>
 #include <sem.h>
 #include <event.h>
@@ -41,9 +44,11 @@ struct context {
 
 extern list_entry_t proc_list;
 extern list_entry_t proc_mm_list;
+extern spinlock_t proc_lock;
 
 struct inode;
 struct fs_struct;
+struct memgroup;
 
 struct proc_struct {
     enum proc_state state;                      // Process state
@@ -67,32 +72,90 @@ struct proc_struct {
     struct run_queue *rq;                       // running queue contains Process
     list_entry_t run_link;                      // the entry linked in run queue
     int time_slice;                             // time slice for occupying the CPU
+    uint64_t exec_start;                        // the clock_read() when it last started running
+    uint64_t sum_exec;                          // the total run time, in ns
+    uint64_t mlfq_base;                         // MLFQ: sum_exec when it came to its level
+    size_t mlfq_epoch;                          // MLFQ: the boost period it was last queued in
+    int nice;                                   // the nice value, NICE_MIN (most CPU) ~ NICE_MAX
+    uint32_t vruntime;                          // the virtual run time of CFS, weighted by nice
+    rb_node rb_link;                            // the entry in the tree of the CFS run queue
     sem_queue_t *sem_queue;                     // the user semaphore queue which process waits
     event_t event_box;                          // the event which process waits   
     struct fs_struct *fs_struct;                // the file related info(pwd, files_count, files_array, fs_semaphore) of process
+    int oom_score_adj;                          // added to the badness of the process by the OOM killer
+    struct memgroup *memgroup;                  // the memory group of the process, inherited by its mms
+    size_t locked_limit;                        // the max number of locked pages, inherited by its mms
+    size_t min_flt;                             // the page faults handled without I/O
+    size_t maj_flt;                             // the page faults which read the swap
+    int cpu;                                    // the cpu whose run queue holds the process, or it ran on
+    bool klocked;                               // holds the kernel lock while it runs, see sched.c
 };
 
 #define PF_EXITING                  0x00000001      // getting shutdown
+#define PF_MEMDIE                   0x00000002      // killed by the OOM killer, may use the reserve
 
 //the wait state
 #define WT_CHILD                    (0x00000001 | WT_INTERRUPTED)  // wait child process
 #define WT_TIMER                    (0x00000002 | WT_INTERRUPTED)  // wait timer
 #define WT_KSWAPD                    0x00000003                    // wait kswapd to free page
+#define WT_REAPER                    0x00000005                    // wait dead mms to tear down
+#define WT_SWAPIN                    0x00000006                    // wait the swap page under I/O
+#define WT_WRITEBACK                 0x00000007                    // wait a swap write to complete
 #define WT_KBD                      (0x00000004 | WT_INTERRUPTED)  // wait the input of keyboard
 #define WT_KSEM                      0x00000100                    // wait kernel semaphore
+#define WT_KSEM_READ                 0x00000102                    // wait kernel rw semaphore as reader
+#define WT_KSEM_WRITE                0x00000103                    // wait kernel rw semaphore as writer
 #define WT_USEM                     (0x00000101 | WT_INTERRUPTED)  // wait user semaphore
 #define WT_EVENT_SEND               (0x00000110 | WT_INTERRUPTED)  // wait the sending event
 #define WT_EVENT_RECV               (0x00000111 | WT_INTERRUPTED)  // wait the recving event 
 #define WT_MBOX_SEND                (0x00000120 | WT_INTERRUPTED)  // wait the sending mbox
 #define WT_MBOX_RECV                (0x00000121 | WT_INTERRUPTED)  // wait the recving mbox
+#define WT_UFFD                     (0x00000130 | WT_INTERRUPTED)  // wait the user fault handler
 #define WT_PIPE                     (0x00000200 | WT_INTERRUPTED)  // wait the pipe
 #define WT_INTERRUPTED               0x80000000                    // the wait state could be interrupted
 
 #define le2proc(le, member)         \
     to_struct((le), struct proc_struct, member)
 
-extern struct proc_struct *idleproc, *initproc, *current;
+#define NCPU                        8
+
+// the per-cpu state, cpus[0] is the BSP
+struct cpu {
+    int id;                                     // index in cpus
+    uint8_t apicid;                             // the id of its local APIC
+    volatile bool started;                      // running the kernel
+    struct proc_struct *curproc;                // the process running on the cpu
+    struct proc_struct *idle;                   // the idle process of the cpu
+    volatile uintptr_t cr3;                     // the page directory loaded, for the TLB shootdowns
+    struct taskstate ts;                        // the TSS of the cpu, its ESP0 is the kstack of curproc
+    struct segdesc gdt[SEG_TSS + 1];            // the GDT of the cpu, the TSS descriptor is its own
+};
+
+extern struct cpu cpus[NCPU];
+extern int ncpu, ncpu_online;
+
+struct cpu *cpu_lookup(void);
+
+// mycpu - the running cpu, found by its local APIC id once the APs run
+static inline struct cpu *
+mycpu(void) {
+    return (ncpu_online == 1) ? cpus : cpu_lookup();
+}
+
+#define current                     (mycpu()->curproc)
+#define idleproc                    (mycpu()->idle)
+
+// cpu_load_cr3 - switch the running cpu to the page directory cr3
+static inline void
+cpu_load_cr3(uintptr_t cr3) {
+    mycpu()->cr3 = cr3;
+    lcr3(cr3);
+}
+
+extern struct proc_struct *initproc;
 extern struct proc_struct *kswapd;
+extern struct proc_struct *reaper;
+extern struct proc_struct *ksmd;
 
 void proc_init(void);
 void proc_run(struct proc_struct *proc);
@@ -112,9 +175,24 @@ int do_yield(void);
 int do_wait(int pid, int *code_store);
 int do_kill(int pid, int error_code);
 int do_brk(uintptr_t *brk_store);
+struct rusage;
+int do_nice(int pid, int nice);
+int do_schedclass(char *name, size_t len);
+int do_getrusage(int pid, struct rusage *usage);
+void print_rusage(void);
 int do_sleep(unsigned int time);
+int do_sleep_units(unsigned int units);
 int do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags);
 int do_munmap(uintptr_t addr, size_t len);
+int do_ptcount(void);
+int do_uffd(int cmd, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2);
+int do_mremap(uintptr_t *addr_store, size_t old_len, size_t new_len, uint32_t flags);
+int do_madvise(uintptr_t addr, size_t len, int advice);
+int do_mlock(uintptr_t addr, size_t len);
+int do_munlock(uintptr_t addr, size_t len);
+int do_mlockall(int flags);
+int do_munlockall(void);
+int do_mlocklimit(size_t limit);
 int do_shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags);
 
 #endif /* !__KERN_PROCESS_PROC_H__ */
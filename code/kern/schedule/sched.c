@@ -1,64 +1,516 @@
 #include <list.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <proc.h>
 #include <sched.h>
 #include <stdio.h>
+#include <string.h>
+#include <slab.h>
 #include <assert.h>
 #include <sched_MLFQ.h>
+#include <sched_CFS.h>
+#include <clock.h>
+#include <apic.h>
 
-static list_entry_t timer_list;
+/* *
+ * Each cpu has its own run queues, one per MLFQ level, under its own rq_lock.
+ * A new proc goes to the cpu with the fewest runnable procs, a woken one back
+ * to the cpu it ran on. A cpu with nothing to run steals a proc from the
+ * busiest one, and every SCHED_BALANCE_TICKS ticks it pulls procs from the
+ * busiest one until both have about the same number. Only the started cpus
+ * take part.
+ * */
+
+// the scheduling class, build with DEFS=-DSCHED_CLASS=CFS_sched_class for CFS
+#ifndef SCHED_CLASS
+#define SCHED_CLASS                 MLFQ_sched_class
+#endif
+
+#define SCHED_NR_LEVELS             MLFQ_NR_LEVELS  // one run queue each
+#define SCHED_BALANCE_TICKS         16      // the ticks between two balancing passes
+#define SCHED_MOVE_MAX              8       // the max procs moved by one pass
+
+/* *
+ * The timers are kept in a hierarchical timing wheel: tv1 has a list for each
+ * of the next TVR_SIZE ticks, each level of tvn a list for each TVN_SIZE spans
+ * of a list of the level below. A timer goes to the list of its expiry tick in
+ * the lowest level that reaches it, so add_timer and del_timer are O(1). Each
+ * time tv1 wraps the next list of tvn[0] is cascaded down into tv1, and so on
+ * up the levels; a timer moves down at most once per level before it expires.
+ * Each level has a bitmap of the lists that aren't empty, so the next list to
+ * run or to cascade is a find-first-set away instead of a scan of the heads.
+ *
+ * The wheel ticks TIMER_HZ times per second of clock_read, but nothing drives
+ * it periodically: run_timer_list skips the wheel ticks with nothing to do up
+ * to the clock time, and the clock event is set to the next wheel tick with
+ * something to do, timer_next, or to the next tick of 'ticks' if a proc is
+ * running, for its time slice.
+ * */
+
+#define TVR_BITS                    8
+#define TVN_BITS                    6
+#define TVR_SIZE                    (1 << TVR_BITS)
+#define TVN_SIZE                    (1 << TVN_BITS)
+#define TVR_MASK                    (TVR_SIZE - 1)
+#define TVN_MASK                    (TVN_SIZE - 1)
+#define TVN_LEVELS                  ((32 - TVR_BITS) / TVN_BITS)
+
+struct timer_wheel {
+    unsigned int jiffies;                   // the next tick to run
+    list_entry_t tv1[TVR_SIZE];
+    list_entry_t tvn[TVN_LEVELS][TVN_SIZE];
+    uint32_t tv1_map[TVR_SIZE / 32];        // a bit set for each list not empty
+    uint32_t tvn_map[TVN_LEVELS][TVN_SIZE / 32];
+};
+
+static struct timer_wheel timer_wheel;
+static spinlock_t timer_lock;
+static uint64_t timer_next = ~0ULL;         // the time the wheel has work to do next
 
 static struct sched_class *sched_class;
 
-static struct run_queue *rq;
+/* *
+ * The kernel lock: most of the kernel was written for one cpu, it runs the
+ * kernel code of one proc at a time. A kernel thread holds it all the time it
+ * runs, a user proc from the trap that enters the kernel (not an interrupt)
+ * till it returns to user mode, proc->klocked says which. The interrupt
+ * handlers never take it, what they share is under spinlocks. It stays with
+ * the cpu across switch_to and goes to the next proc if that one holds it too,
+ * otherwise schedule_tail releases it: an exiting proc keeps the others off
+ * its kernel stack until it has switched away.
+ * */
+static spinlock_t kernel_lock;
+static volatile int kernel_lock_cpu = -1;   // the cpu holding the kernel lock
+
+static struct sched_cpu {
+    spinlock_t rq_lock;                     // protects rq and nr_running
+    struct run_queue rq[SCHED_NR_LEVELS];   // rq[0] heads the list of the levels
+    int nr_running;                         // the procs in rq
+    int balance_ticks;                      // the ticks till the next balancing pass
+    size_t last_tick;                       // the tick of the last sched_class->proc_tick on the cpu
+    size_t nr_switches, nr_pulled, nr_stolen;
+} sched_cpus[NCPU];
+
+static inline struct sched_cpu *
+this_sched(void) {
+    return sched_cpus + mycpu()->id;
+}
+
+static inline bool
+kernel_lock_held(void) {
+    return kernel_lock_cpu == mycpu()->id;
+}
+
+static void
+kernel_lock_acquire(void) {
+    spin_lock(&kernel_lock);
+    kernel_lock_cpu = mycpu()->id;
+}
+
+static void
+kernel_lock_release(void) {
+    assert(kernel_lock_held());
+    kernel_lock_cpu = -1;
+    spin_unlock(&kernel_lock);
+}
 
 static inline void
-sched_class_enqueue(struct proc_struct *proc) {
-    if (proc != idleproc) {
-        sched_class->enqueue(rq, proc);
+sched_class_enqueue(struct sched_cpu *sc, struct proc_struct *proc) {
+    int id = sc - sched_cpus;
+    if (proc != cpus[id].idle) {
+        sched_class->enqueue(sc->rq, proc);
+        proc->cpu = id;
+        sc->nr_running ++;
     }
 }
 
 static inline void
-sched_class_dequeue(struct proc_struct *proc) {
-    sched_class->dequeue(rq, proc);
+sched_class_dequeue(struct sched_cpu *sc, struct proc_struct *proc) {
+    sched_class->dequeue(sc->rq, proc);
+    sc->nr_running --;
+}
+
+static inline void
+sched_class_remove(struct sched_cpu *sc, struct proc_struct *proc) {
+    if (sched_class->remove != NULL) {
+        sched_class->remove(sc->rq, proc);
+    }
+    else {
+        sched_class->dequeue(sc->rq, proc);
+    }
+    sc->nr_running --;
 }
 
 static inline struct proc_struct *
-sched_class_pick_next(void) {
-    return sched_class->pick_next(rq);
+sched_class_pick_next(struct sched_cpu *sc) {
+    return sched_class->pick_next(sc->rq);
+}
+
+// sched_account - charge the run time since it last started to the running proc
+static inline void
+sched_account(struct proc_struct *proc, uint64_t now) {
+    proc->sum_exec += now - proc->exec_start;
+    proc->exec_start = now;
 }
 
+// sched_class_proc_tick - charge the n ticks passed since the last call to proc,
+//                       - the running proc of the cpu of sc
 static void
-sched_class_proc_tick(struct proc_struct *proc) {
+sched_class_proc_tick(struct sched_cpu *sc, struct proc_struct *proc, uint64_t now, size_t n) {
+    sched_account(proc, now);
     if (proc != idleproc) {
-        sched_class->proc_tick(rq, proc);
+        spin_lock(&(sc->rq_lock));
+        while (n -- > 0) {
+            sched_class->proc_tick(sc->rq, proc);
+        }
+        spin_unlock(&(sc->rq_lock));
     }
     else {
         proc->need_resched = 1;
     }
 }
 
-static struct run_queue __rq[4];
+#define timer_map_set(map, i)       ((map)[(i) >> 5] |= (1u << ((i) & 31)))
+#define timer_map_clear(map, i)     ((map)[(i) >> 5] &= ~(1u << ((i) & 31)))
+#define timer_map_test(map, i)      (((map)[(i) >> 5] >> ((i) & 31)) & 1)
+
+// timer_map_find - the first bit set in the circular bitmap map of n bits (a
+//                - power of 2) from start on, as an offset from start, n if none
+static unsigned int
+timer_map_find(const uint32_t *map, unsigned int n, unsigned int start) {
+    unsigned int off = 0;
+    while (off < n) {
+        unsigned int bit = (start + off) & (n - 1);
+        uint32_t bits = map[bit >> 5] >> (bit & 31);
+        if (bits != 0) {
+            // the bits below start in its word are the last ones, when it comes round again
+            return off + __builtin_ctz(bits);
+        }
+        off += 32 - (bit & 31);
+    }
+    return n;
+}
+
+static void
+timer_wheel_init(struct timer_wheel *tw, unsigned int jiffies) {
+    int i, level;
+    tw->jiffies = jiffies;
+    memset(tw->tv1_map, 0, sizeof(tw->tv1_map));
+    memset(tw->tvn_map, 0, sizeof(tw->tvn_map));
+    for (i = 0; i < TVR_SIZE; i ++) {
+        list_init(tw->tv1 + i);
+    }
+    for (level = 0; level < TVN_LEVELS; level ++) {
+        for (i = 0; i < TVN_SIZE; i ++) {
+            list_init(tw->tvn[level] + i);
+        }
+    }
+}
+
+// timer_wheel_add - put timer into the list of its expiry tick timer->expires
+static void
+timer_wheel_add(struct timer_wheel *tw, timer_t *timer) {
+    unsigned int expires = timer->expires, idx = expires - tw->jiffies;
+    list_entry_t *list;
+    if (idx < TVR_SIZE) {
+        list = tw->tv1 + (expires & TVR_MASK);
+        timer_map_set(tw->tv1_map, expires & TVR_MASK);
+    }
+    else {
+        int level = 0, shift = TVR_BITS;
+        while ((idx >> shift) >= TVN_SIZE) {
+            level ++, shift += TVN_BITS;
+        }
+        list = tw->tvn[level] + ((expires >> shift) & TVN_MASK);
+        timer_map_set(tw->tvn_map[level], (expires >> shift) & TVN_MASK);
+    }
+    list_add_before(list, &(timer->timer_link));
+}
+
+// timer_wheel_del - take timer off the wheel, clear the bit of its list if it
+//                 - was the last timer there
+static void
+timer_wheel_del(struct timer_wheel *tw, timer_t *timer) {
+    list_entry_t *le = &(timer->timer_link), *list = list_prev(le);
+    if (!list_empty(le) && list == list_next(le)) {
+        if (list >= tw->tv1 && list < tw->tv1 + TVR_SIZE) {
+            timer_map_clear(tw->tv1_map, list - tw->tv1);
+        }
+        else if (list >= tw->tvn[0] && list < tw->tvn[0] + TVN_LEVELS * TVN_SIZE) {
+            int i = list - tw->tvn[0];
+            timer_map_clear(tw->tvn_map[i / TVN_SIZE], i % TVN_SIZE);
+        }
+    }
+    list_del_init(le);
+}
+
+// timer_wheel_cascade - move the timers of the current list of tvn[level] down
+//                     - the wheel, return the index of the list
+static int
+timer_wheel_cascade(struct timer_wheel *tw, int level) {
+    int index = (tw->jiffies >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+    list_entry_t *list = tw->tvn[level] + index, *le;
+    timer_map_clear(tw->tvn_map[level], index);
+    while ((le = list_next(list)) != list) {
+        list_del(le);
+        timer_wheel_add(tw, le2timer(le, timer_link));
+    }
+    return index;
+}
+
+// timer_wheel_run - run the tick tw->jiffies, move the timers expired to expired
+static void
+timer_wheel_run(struct timer_wheel *tw, list_entry_t *expired) {
+    int index = tw->jiffies & TVR_MASK, level;
+    if (index == 0) {
+        for (level = 0; level < TVN_LEVELS; level ++) {
+            if (timer_wheel_cascade(tw, level) != 0) {
+                break;
+            }
+        }
+    }
+    tw->jiffies ++;
+    list_entry_t *list = tw->tv1 + index, *le;
+    timer_map_clear(tw->tv1_map, index);
+    while ((le = list_next(list)) != list) {
+        list_del(le);
+        list_add_before(expired, le);
+    }
+}
+
+// timer_wheel_next - the wheel ticks from tw->jiffies to the next one with a list
+//                   - to run or to cascade, ~0 if the wheel is empty
+static unsigned int
+timer_wheel_next(struct timer_wheel *tw) {
+    unsigned int i, next = ~0;
+    if ((i = timer_map_find(tw->tv1_map, TVR_SIZE, tw->jiffies & TVR_MASK)) < TVR_SIZE) {
+        next = i;
+    }
+    // the list of each level which is cascaded first, on a wheel tick with all
+    // the lower bits 0: at tw->jiffies if it is one, otherwise a round later
+    int level, shift;
+    for (level = 0, shift = TVR_BITS; level < TVN_LEVELS; level ++, shift += TVN_BITS) {
+        unsigned int index = tw->jiffies >> shift, first = ((tw->jiffies & ((1u << shift) - 1)) == 0) ? 0 : 1;
+        if ((i = timer_map_find(tw->tvn_map[level], TVN_SIZE, (index + first) & TVN_MASK)) < TVN_SIZE) {
+            unsigned int delta = ((index + first + i) << shift) - tw->jiffies;
+            if (delta < next) {
+                next = delta;
+            }
+        }
+    }
+    return next;
+}
+
+// timer_wheel_advance - run the wheel ticks up to and including jiffies, skipping
+//                     - the ones with nothing to do, move the timers expired to expired
+static void
+timer_wheel_advance(struct timer_wheel *tw, unsigned int jiffies, list_entry_t *expired) {
+    while ((int)(jiffies - tw->jiffies) >= 0) {
+        unsigned int next = timer_wheel_next(tw);
+        if (next > jiffies - tw->jiffies) {
+            tw->jiffies = jiffies + 1;
+            break;
+        }
+        tw->jiffies += next;
+        timer_wheel_run(tw, expired);
+    }
+}
+
+// check_timer_map - each bit of the wheel is set iff its list isn't empty
+static void
+check_timer_map(struct timer_wheel *tw) {
+    int i, level;
+    for (i = 0; i < TVR_SIZE; i ++) {
+        assert(timer_map_test(tw->tv1_map, i) == !list_empty(tw->tv1 + i));
+    }
+    for (level = 0; level < TVN_LEVELS; level ++) {
+        for (i = 0; i < TVN_SIZE; i ++) {
+            assert(timer_map_test(tw->tvn_map[level], i) == !list_empty(tw->tvn[level] + i));
+        }
+    }
+}
+
+static void
+check_timer_wheel(void) {
+    static const unsigned int delays[] = {
+        1, 2, 255, 256, 257, 300, 16383, 16384, 16385, 70000, 70000,
+    };
+    const int n = sizeof(delays) / sizeof(delays[0]);
+    struct timer_wheel *tw = kmalloc(sizeof(struct timer_wheel));
+    timer_t *timers = kmalloc(sizeof(timer_t) * (n + 1));
+    assert(tw != NULL && timers != NULL);
+
+    // start close to the wrap of jiffies, the timers expire at base + delay
+    unsigned int base = -1000;
+    timer_wheel_init(tw, base + 1);
+    assert(timer_wheel_next(tw) == ~0);
+    int i, fired = 0;
+    for (i = 0; i <= n; i ++) {
+        timer_init(timers + i, NULL, 0);
+        timers[i].expires = base + ((i < n) ? delays[i] : 500);
+        timer_wheel_add(tw, timers + i);
+    }
+    assert(timer_wheel_next(tw) == 0);
+    check_timer_map(tw);
+
+    // advance by steps of different lengths, some skip over whole lists
+    unsigned int now = 0, step = 1;
+    while (fired < n) {
+        assert(now < delays[n - 1]);
+        now += step, step = step * 3 % 1021;
+        if (now >= 400 && !list_empty(&(timers[n].timer_link))) {
+            // deleted before it expires
+            timer_wheel_del(tw, timers + n);
+        }
+        list_entry_t expired, *le;
+        list_init(&expired);
+        timer_wheel_advance(tw, base + now, &expired);
+        assert(tw->jiffies == base + now + 1);
+        check_timer_map(tw);
+        while ((le = list_next(&expired)) != &expired) {
+            timer_t *timer = le2timer(le, timer_link);
+            list_del_init(le);
+            assert(timer != timers + n && delays[timer - timers] <= now);
+            fired ++;
+        }
+        // the timers left expire after now, none before the next wheel tick to run
+        unsigned int next = timer_wheel_next(tw);
+        for (i = 0; i < n; i ++) {
+            if (!list_empty(&(timers[i].timer_link))) {
+                assert(delays[i] > now && delays[i] - now - 1 >= next);
+            }
+        }
+    }
+    assert(timer_wheel_next(tw) == ~0);
+
+    kfree(timers);
+    kfree(tw);
+    cprintf("check_timer_wheel() succeeded.\n");
+}
+
+// timer_time - the time the wheel tick jiffies starts, now is at or before it
+static inline uint64_t
+timer_time(unsigned int jiffies, uint64_t now) {
+    uint64_t units = now;
+    do_div(units, TIMER_NSEC);
+    return (units + (jiffies - (unsigned int)units)) * TIMER_NSEC;
+}
+
+// sched_set_event - set the clock event to the next timer, and to the next tick
+//                 - if tick is set: the ticks stop while the cpu is idle
+static void
+sched_set_event(bool tick) {
+    uint64_t deadline = timer_next;
+    if (tick && (uint64_t)(ticks + 1) * TICK_NSEC < deadline) {
+        deadline = (uint64_t)(ticks + 1) * TICK_NSEC;
+    }
+    clock_set_event(deadline);
+}
 
 void
 sched_init(void) {
-    list_init(&timer_list);
+    timer_wheel_init(&timer_wheel, 0);
+    spinlock_init(&timer_lock);
+    spinlock_init(&kernel_lock);
 
-    rq = __rq;
-    list_init(&(rq->rq_link));
-    rq->max_time_slice = 8;
+    sched_class = &SCHED_CLASS;
+
+    int id, i;
+    for (id = 0; id < NCPU; id ++) {
+        struct sched_cpu *sc = sched_cpus + id;
+        struct run_queue *rq = sc->rq;
+        spinlock_init(&(sc->rq_lock));
+        list_init(&(rq->rq_link));
+        rq->max_time_slice = 8;
+        for (i = 1; i < SCHED_NR_LEVELS; i ++) {
+            list_add_before(&(rq->rq_link), &(sc->rq[i].rq_link));
+        }
+        sched_class->init(rq);
+        sc->balance_ticks = SCHED_BALANCE_TICKS;
+    }
 
+    cprintf("sched class: %s\n", sched_class->name);
+    check_mlfq();
+    check_timer_wheel();
+}
+
+// sched_idlest - the started cpu with the fewest runnable procs, this one on a tie
+static struct sched_cpu *
+sched_idlest(void) {
+    struct sched_cpu *idlest = this_sched();
     int i;
-    for (i = 1; i < sizeof(__rq) / sizeof(__rq[0]); i ++) {
-        list_add_before(&(rq->rq_link), &(__rq[i].rq_link));
-        __rq[i].max_time_slice = rq->max_time_slice * (1 << i);
+    for (i = 0; i < ncpu; i ++) {
+        if (cpus[i].started && sched_cpus[i].nr_running < idlest->nr_running) {
+            idlest = sched_cpus + i;
+        }
     }
+    return idlest;
+}
 
-    sched_class = &MLFQ_sched_class;
-    sched_class->init(rq);
+// sched_busiest - the other started cpu with the most runnable procs
+static struct sched_cpu *
+sched_busiest(struct sched_cpu *sc) {
+    struct sched_cpu *busiest = NULL;
+    int i;
+    for (i = 0; i < ncpu; i ++) {
+        struct sched_cpu *other = sched_cpus + i;
+        if (other != sc && cpus[i].started) {
+            if (busiest == NULL || other->nr_running > busiest->nr_running) {
+                busiest = other;
+            }
+        }
+    }
+    return busiest;
+}
 
-    cprintf("sched class: %s\n", sched_class->name);
+// sched_move - move at most n procs from the run queues of src to the ones of
+//            - dst, both locked. return the number of procs moved.
+static int
+sched_move(struct sched_cpu *dst, struct sched_cpu *src, int n) {
+    struct proc_struct *procs[SCHED_MOVE_MAX];
+    if (n > SCHED_MOVE_MAX) {
+        n = SCHED_MOVE_MAX;
+    }
+    int i, moved = sched_class->get_proc(src->rq, procs, n);
+    src->nr_running -= moved;
+    for (i = 0; i < moved; i ++) {
+        sched_class_enqueue(dst, procs[i]);
+    }
+    return moved;
+}
+
+// sched_steal - the cpu of sc (locked) has nothing to run, take a proc from the
+//             - busiest cpu. never waits for its lock: two idle cpus may steal
+//             - from each other.
+static bool
+sched_steal(struct sched_cpu *sc) {
+    struct sched_cpu *busiest = sched_busiest(sc);
+    int moved = 0;
+    if (busiest != NULL && busiest->nr_running > 0 && spin_trylock(&(busiest->rq_lock))) {
+        moved = sched_move(sc, busiest, 1);
+        spin_unlock(&(busiest->rq_lock));
+    }
+    sc->nr_stolen += moved;
+    return moved != 0;
+}
+
+// sched_balance - pull half of the difference from the busiest cpu, called on
+//               - the timer tick
+static void
+sched_balance(struct sched_cpu *sc) {
+    struct sched_cpu *busiest = sched_busiest(sc);
+    if (busiest == NULL || busiest->nr_running - sc->nr_running < 2) {
+        return ;
+    }
+    spin_lock(&(sc->rq_lock));
+    if (spin_trylock(&(busiest->rq_lock))) {
+        int n = (busiest->nr_running - sc->nr_running) / 2;
+        if (n > 0) {
+            sc->nr_pulled += sched_move(sc, busiest, n);
+        }
+        spin_unlock(&(busiest->rq_lock));
+    }
+    spin_unlock(&(sc->rq_lock));
 }
 
 void
@@ -67,16 +519,27 @@ wakeup_proc(struct proc_struct *proc) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
+        struct sched_cpu *sc = (proc->state == PROC_UNINIT) ? sched_idlest() : sched_cpus + proc->cpu;
+        spin_lock(&(sc->rq_lock));
         if (proc->state != PROC_RUNNABLE) {
             proc->state = PROC_RUNNABLE;
             proc->wait_state = 0;
-            if (proc != current) {
-                sched_class_enqueue(proc);
+            if (proc != cpus[proc->cpu].curproc) {
+                sched_class_enqueue(sc, proc);
+                // an idle cpu is halted till the next interrupt, not ticking
+                struct proc_struct *idle = cpus[proc->cpu].idle;
+                if (idle != NULL && cpus[proc->cpu].curproc == idle) {
+                    idle->need_resched = 1;
+                    if (cpus + proc->cpu != mycpu()) {
+                        lapic_ipi(cpus[proc->cpu].apicid, T_IPI_RESCHED);
+                    }
+                }
             }
         }
         else {
             warn("wakeup runnable process.\n");
         }
+        spin_unlock(&(sc->rq_lock));
     }
     local_intr_restore(intr_flag);
 }
@@ -87,94 +550,191 @@ schedule(void) {
     struct proc_struct *next;
     local_intr_save(intr_flag);
     {
+        struct sched_cpu *sc = this_sched();
+        uint64_t now = clock_read();
+        spin_lock(&(sc->rq_lock));
+        sched_account(current, now);
         current->need_resched = 0;
         if (current->state == PROC_RUNNABLE) {
-            sched_class_enqueue(current);
+            sched_class_enqueue(sc, current);
+        }
+        if ((next = sched_class_pick_next(sc)) == NULL && sched_steal(sc)) {
+            next = sched_class_pick_next(sc);
         }
-        if ((next = sched_class_pick_next()) != NULL) {
-            sched_class_dequeue(next);
+        if (next != NULL) {
+            sched_class_dequeue(sc, next);
         }
-        if (next == NULL) {
+        else {
             next = idleproc;
         }
         next->runs ++;
+        next->exec_start = now;
+        sched_set_event(next != idleproc);
         if (next != current) {
+            sc->nr_switches ++;
             proc_run(next);
         }
+        schedule_tail();
     }
     local_intr_restore(intr_flag);
+    schedule_relock();
 }
 
+// sched_setnice - set the nice value of proc, requeue it if it waits to run
 void
-add_timer(timer_t *timer) {
+sched_setnice(struct proc_struct *proc, int nice) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        assert(timer->expires > 0 && timer->proc != NULL);
-        assert(list_empty(&(timer->timer_link)));
-        list_entry_t *le = list_next(&timer_list);
-        while (le != &timer_list) {
-            timer_t *next = le2timer(le, timer_link);
-            if (timer->expires < next->expires) {
-                next->expires -= timer->expires;
-                break;
-            }
-            timer->expires -= next->expires;
-            le = list_next(le);
+        struct sched_cpu *sc = sched_cpus + proc->cpu;
+        spin_lock(&(sc->rq_lock));
+        bool queued = (proc->state == PROC_RUNNABLE && proc != cpus[proc->cpu].curproc
+                && proc != cpus[proc->cpu].idle);
+        if (queued) {
+            sched_class_remove(sc, proc);
+        }
+        proc->nice = nice;
+        if (queued) {
+            sched_class_enqueue(sc, proc);
         }
-        list_add_before(le, &(timer->timer_link));
+        spin_unlock(&(sc->rq_lock));
     }
     local_intr_restore(intr_flag);
 }
 
+// schedule_tail - unlock the run queues locked by schedule before the switch.
+//   the lock is held across switch_to, so no other cpu takes the previous proc
+//   off them before its context is saved. called by the next proc: back in
+//   schedule, or in forkret the first time it runs. the kernel lock is dropped
+//   here too if the next proc doesn't hold it.
 void
-del_timer(timer_t *timer) {
+schedule_tail(void) {
+    spin_unlock(&(this_sched()->rq_lock));
+    if (!current->klocked && kernel_lock_held()) {
+        kernel_lock_release();
+    }
+}
+
+// schedule_relock - take the kernel lock back if current holds it but the cpu
+//                 - doesn't, after schedule_tail with the interrupts enabled
+void
+schedule_relock(void) {
+    if (current->klocked && !kernel_lock_held()) {
+        kernel_lock_acquire();
+    }
+}
+
+// lock_kernel - current enters the kernel code from user mode
+void
+lock_kernel(void) {
+    if (!current->klocked) {
+        kernel_lock_acquire();
+        current->klocked = 1;
+    }
+}
+
+// unlock_kernel - current returns to user mode
+void
+unlock_kernel(void) {
+    if (current->klocked) {
+        current->klocked = 0;
+        kernel_lock_release();
+    }
+}
+
+void
+add_timer(timer_t *timer) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    uint64_t now = clock_read();
+    spin_lock_irqsave(&timer_lock, intr_flag);
     {
-        if (!list_empty(&(timer->timer_link))) {
-            if (timer->expires != 0) {
-                list_entry_t *le = list_next(&(timer->timer_link));
-                if (le != &timer_list) {
-                    timer_t *next = le2timer(le, timer_link);
-                    next->expires += timer->expires;
-                }
-            }
-            list_del_init(&(timer->timer_link));
+        assert(timer->expires > 0 && timer->proc != NULL);
+        assert(list_empty(&(timer->timer_link)));
+        // from the first wheel tick at or after now, so it never expires early
+        uint64_t units = now;
+        if (do_div(units, TIMER_NSEC) != 0) {
+            units ++;
+        }
+        uint64_t deadline = (units + timer->expires) * TIMER_NSEC;
+        timer->expires += (unsigned int)units;
+        timer_wheel_add(&timer_wheel, timer);
+        // the clock event is set in schedule, where the caller goes next
+        if (deadline < timer_next) {
+            timer_next = deadline;
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&timer_lock, intr_flag);
+}
+
+void
+del_timer(timer_t *timer) {
+    bool intr_flag;
+    spin_lock_irqsave(&timer_lock, intr_flag);
+    timer_wheel_del(&timer_wheel, timer);
+    spin_unlock_irqrestore(&timer_lock, intr_flag);
 }
 
+// run_timer_list - the clock event interrupt: expire the timers due, and if a
+//                - tick has passed, do the tick of the scheduler
 void
 run_timer_list(void) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    uint64_t now = clock_read();
+    spin_lock_irqsave(&timer_lock, intr_flag);
     {
-        list_entry_t *le = list_next(&timer_list);
-        if (le != &timer_list) {
+        list_entry_t expired, *le;
+        list_init(&expired);
+        uint64_t units = now;
+        do_div(units, TIMER_NSEC);
+        timer_wheel_advance(&timer_wheel, units, &expired);
+        while ((le = list_next(&expired)) != &expired) {
             timer_t *timer = le2timer(le, timer_link);
-            assert(timer->expires != 0);
-            timer->expires --;
-            while (timer->expires == 0) {
-                le = list_next(le);
-                struct proc_struct *proc = timer->proc;
-                if (proc->wait_state != 0) {
-                    assert(proc->wait_state & WT_INTERRUPTED);
-                }
-                else {
-                    warn("process %d's wait_state == 0.\n", proc->pid);
-                }
-                wakeup_proc(proc);
-                del_timer(timer);
-                if (le == &timer_list) {
-                    break;
-                }
-                timer = le2timer(le, timer_link);
+            list_del_init(le);
+            struct proc_struct *proc = timer->proc;
+            if (proc->wait_state != 0) {
+                assert(proc->wait_state & WT_INTERRUPTED);
+            }
+            else {
+                warn("process %d's wait_state == 0.\n", proc->pid);
             }
+            wakeup_proc(proc);
         }
-        sched_class_proc_tick(current);
+        unsigned int next = timer_wheel_next(&timer_wheel);
+        timer_next = (next == ~0) ? ~0ULL : timer_time(timer_wheel.jiffies + next, now);
     }
+    spin_unlock(&timer_lock);
+
+    struct sched_cpu *sc = this_sched();
+    if (ticks != sc->last_tick) {
+        // the clock event may come late, or be put off by a tickless idle
+        size_t n = ticks - sc->last_tick;
+        sc->last_tick = ticks;
+        sched_class_proc_tick(sc, current, now, n);
+
+        if ((sc->balance_ticks -= (int)n) <= 0) {
+            sc->balance_ticks = SCHED_BALANCE_TICKS;
+            sched_balance(sc);
+        }
+    }
+    sched_set_event(current != idleproc);
     local_intr_restore(intr_flag);
 }
 
+// sched_class_name - the name of the scheduling class in use
+const char *
+sched_class_name(void) {
+    return sched_class->name;
+}
+
+void
+print_schedinfo(void) {
+    int i;
+    for (i = 0; i < ncpu; i ++) {
+        struct sched_cpu *sc = sched_cpus + i;
+        struct proc_struct *proc = cpus[i].curproc;
+        cprintf("cpu %d: apic %d, %s, pid %d running, %d runnable, %d switches, %d pulled, %d stolen.\n",
+                i, cpus[i].apicid, cpus[i].started ? "online" : "offline", (proc != NULL) ? proc->pid : -1,
+                sc->nr_running, sc->nr_switches, sc->nr_pulled, sc->nr_stolen);
+    }
+}
+
@@ -3,20 +3,41 @@
 
 #include <types.h>
 #include <list.h>
+#include <rb_tree.h>
+#include <unistd.h>
+#include <clock.h>
 
 struct proc_struct;
 
+// the timers expire with a resolution of 1 / TIMER_HZ seconds
+#define TIMER_HZ                        10000
+#define TIMER_NSEC                      (NSEC_PER_SEC / TIMER_HZ)
+#define TIMER_MAX                       0x7FFFFFFF      // the longest timer, in 1 / TIMER_HZ
+
 typedef struct {
-    unsigned int expires;
-    struct proc_struct *proc;
-    list_entry_t timer_link;
+    unsigned int expires;           // the 1 / TIMER_HZ to wait, the wheel tick it expires once added
+    struct proc_struct *proc;       // the proc to wake up
+    list_entry_t timer_link;        // link in a list of the timer wheel
 } timer_t;
 
 #define le2timer(le, member)            \
     to_struct((le), timer_t, member)
 
+// timer_units - the 1 / TIMER_HZ of timeout, in TIMEOUT_TICKS or TIMEOUT_USEC
+//             - (unistd.h) as unit, rounded up. the unit is checked by the caller.
+static inline unsigned int
+timer_units(unsigned int timeout, int unit) {
+    const unsigned int usecs = 1000000 / TIMER_HZ, per_tick = TIMER_HZ / TICK_HZ;
+    if (unit == TIMEOUT_USEC) {
+        timeout = timeout / usecs + (timeout % usecs != 0);
+        return (timeout < TIMER_MAX) ? timeout : TIMER_MAX;
+    }
+    return (timeout < TIMER_MAX / per_tick) ? timeout * per_tick : TIMER_MAX;
+}
+
+// timer_init - a timer of expires 1 / TIMER_HZ, see timer_units
 static inline timer_t *
-timer_init(timer_t *timer, struct proc_struct *proc, int expires) {
+timer_init(timer_t *timer, struct proc_struct *proc, unsigned int expires) {
     timer->expires = expires;
     timer->proc = proc;
     list_init(&(timer->timer_link));
@@ -37,17 +58,16 @@ struct sched_class {
     void (*enqueue)(struct run_queue *rq, struct proc_struct *proc);
     // get the proc out runqueue, and this function must be called with rq_lock
     void (*dequeue)(struct run_queue *rq, struct proc_struct *proc);
+    // take the proc out of runqueue without picking it to run, e.g. to requeue it,
+    // called with rq_lock. optional, dequeue is used instead if NULL
+    void (*remove)(struct run_queue *rq, struct proc_struct *proc);
     // choose the next runnable task
     struct proc_struct *(*pick_next)(struct run_queue *rq);
     // dealer of the time-tick
     void (*proc_tick)(struct run_queue *rq, struct proc_struct *proc);
-     /* for SMP support in the future
-      *  load_balance
-      *     void (*load_balance)(struct rq* rq);
-      *  get some proc from this rq, used in load_balance,
-      *  return value is the num of gotten proc
-      *  int (*get_proc)(struct rq* rq, struct proc* procs_moved[]);
-      */
+    // take at most n procs out of rq to move them to another cpu, the ones least
+    // likely to run soon first. return the number of procs gotten, called with rq_lock
+    int (*get_proc)(struct run_queue *rq, struct proc_struct *procs_moved[], int n);
 };
 
 struct run_queue {
@@ -55,17 +75,38 @@ struct run_queue {
     unsigned int proc_num;
     int max_time_slice;
     list_entry_t rq_link;
+    // for MLFQ: the level of the queue; in the first one, the bitmap of the
+    // levels not empty and the boost period of its last boost
+    int mlfq_level;
+    uint32_t mlfq_bitmap;
+    size_t mlfq_epoch;
+    // for CFS: the procs sorted by vruntime, the leftmost one runs next
+    rb_tree *cfs_tree;
+    struct proc_struct *cfs_first;
+    uint32_t cfs_load;                  // the total weight of the procs
+    uint32_t min_vruntime;              // the smallest vruntime, never goes back
 };
 
+// the nice values of the procs, only CFS weights the procs by them
+#define NICE_MIN                    (-20)
+#define NICE_MAX                    19
+
 #define le2rq(le, member)           \
     to_struct((le), struct run_queue, member)
 
 void sched_init(void);
 void wakeup_proc(struct proc_struct *proc);
 void schedule(void);
+void schedule_tail(void);
+void schedule_relock(void);
+void lock_kernel(void);
+void unlock_kernel(void);
+void sched_setnice(struct proc_struct *proc, int nice);
 void add_timer(timer_t *timer);
 void del_timer(timer_t *timer);
 void run_timer_list(void);
+void print_schedinfo(void);
+const char *sched_class_name(void);
 
 #endif /* !__KERN_SCHEDULE_SCHED_H__ */
 
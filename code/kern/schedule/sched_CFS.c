@@ -0,0 +1,184 @@
+#include <types.h>
+#include <list.h>
+#include <proc.h>
+#include <stdio.h>
+#include <assert.h>
+#include <rb_tree.h>
+#include <sched.h>
+#include <sched_CFS.h>
+
+/* *
+ * CFS - the completely fair scheduler, after Linux.
+ * Each tick a proc runs adds CFS_TICK_VRUNTIME * NICE_0_LOAD / weight to its
+ * virtual run time, so a proc of twice the weight gets twice the CPU. The
+ * runnable procs are sorted by vruntime in a red-black tree, the leftmost one
+ * runs next. A proc runs for its share of CFS_LATENCY ticks, at least
+ * CFS_MIN_GRANULARITY, unless a woken proc is CFS_WAKEUP_GRANULARITY behind it.
+ * A woken proc gets at most half of CFS_LATENCY of credit for its sleep, a new
+ * one starts from min_vruntime.
+ * The vruntimes may wrap around, they are compared by their signed difference.
+ * */
+
+#define NICE_0_LOAD                 1024
+#define CFS_TICK_VRUNTIME           1024                // the vruntime of a tick at nice 0
+#define CFS_LATENCY                 12                  // ticks to run every proc once
+#define CFS_MIN_GRANULARITY         2                   // the shortest slice, in ticks
+#define CFS_WAKEUP_GRANULARITY      CFS_TICK_VRUNTIME   // the lead over a woken proc to preempt
+#define CFS_SLEEPER_CREDIT          (CFS_LATENCY * CFS_TICK_VRUNTIME / 2)
+
+// the weights of nice -20 ~ 19, one nice level is about 10% of CPU
+static const uint32_t nice_to_weight[NICE_MAX - NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+};
+
+#define rbn2proc(node)                      \
+    to_struct((node), struct proc_struct, rb_link)
+
+static inline uint32_t
+CFS_weight(struct proc_struct *proc) {
+    return nice_to_weight[proc->nice - NICE_MIN];
+}
+
+static inline int32_t
+vruntime_diff(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+static int
+CFS_compare(rb_node *node1, rb_node *node2) {
+    int32_t diff = vruntime_diff(rbn2proc(node1)->vruntime, rbn2proc(node2)->vruntime);
+    return (diff < 0) ? -1 : (diff > 0);
+}
+
+static void
+CFS_init(struct run_queue *rq) {
+    list_init(&(rq->run_list));
+    rq->proc_num = 0;
+    if ((rq->cfs_tree = rb_tree_create(CFS_compare)) == NULL) {
+        panic("CFS: no memory for the run queue.\n");
+    }
+    rq->cfs_first = NULL;
+    rq->cfs_load = 0;
+    rq->min_vruntime = 0;
+}
+
+// CFS_update_min - move min_vruntime up to the smaller vruntime of the running
+//                - proc and the leftmost one
+static void
+CFS_update_min(struct run_queue *rq, struct proc_struct *running) {
+    uint32_t vruntime = running->vruntime;
+    if (rq->cfs_first != NULL && vruntime_diff(rq->cfs_first->vruntime, vruntime) < 0) {
+        vruntime = rq->cfs_first->vruntime;
+    }
+    if (vruntime_diff(vruntime, rq->min_vruntime) > 0) {
+        rq->min_vruntime = vruntime;
+    }
+}
+
+static void
+CFS_enqueue(struct run_queue *rq, struct proc_struct *proc) {
+    if (proc->rq == NULL) {
+        // new, or moved from another cpu by CFS_get_proc: relative to min_vruntime
+        proc->vruntime += rq->min_vruntime;
+    }
+    else {
+        uint32_t floor = rq->min_vruntime - CFS_SLEEPER_CREDIT;
+        if (vruntime_diff(proc->vruntime, floor) < 0) {
+            proc->vruntime = floor;
+        }
+    }
+    rb_insert(rq->cfs_tree, &(proc->rb_link));
+    if (rq->cfs_first == NULL || vruntime_diff(proc->vruntime, rq->cfs_first->vruntime) < 0) {
+        rq->cfs_first = proc;
+    }
+    proc->rq = rq;
+    rq->cfs_load += CFS_weight(proc);
+    rq->proc_num ++;
+
+    // wakeup preemption, the running proc is not in the tree
+    struct proc_struct *curr = current;
+    if (curr != proc && curr->rq == rq && curr->state == PROC_RUNNABLE) {
+        if (vruntime_diff(curr->vruntime, proc->vruntime) > CFS_WAKEUP_GRANULARITY) {
+            curr->need_resched = 1;
+        }
+    }
+}
+
+// CFS_remove - take proc out of the tree of rq, its slice and min_vruntime
+//            - are left alone (sched_setnice requeues it with this)
+static void
+CFS_remove(struct run_queue *rq, struct proc_struct *proc) {
+    assert(proc->rq == rq);
+    if (rq->cfs_first == proc) {
+        rb_node *next = rb_node_next(rq->cfs_tree, &(proc->rb_link));
+        rq->cfs_first = (next != NULL) ? rbn2proc(next) : NULL;
+    }
+    rb_delete(rq->cfs_tree, &(proc->rb_link));
+    rq->cfs_load -= CFS_weight(proc);
+    rq->proc_num --;
+}
+
+// CFS_dequeue - proc is picked to run, its slice is its share of CFS_LATENCY
+static void
+CFS_dequeue(struct run_queue *rq, struct proc_struct *proc) {
+    CFS_remove(rq, proc);
+    uint32_t weight = CFS_weight(proc);
+    proc->time_slice = CFS_LATENCY * weight / (rq->cfs_load + weight);
+    if (proc->time_slice < CFS_MIN_GRANULARITY) {
+        proc->time_slice = CFS_MIN_GRANULARITY;
+    }
+    CFS_update_min(rq, proc);
+}
+
+static struct proc_struct *
+CFS_pick_next(struct run_queue *rq) {
+    return rq->cfs_first;
+}
+
+static void
+CFS_proc_tick(struct run_queue *rq, struct proc_struct *proc) {
+    proc->vruntime += CFS_TICK_VRUNTIME * NICE_0_LOAD / CFS_weight(proc);
+    CFS_update_min(rq, proc);
+    if (proc->time_slice > 0) {
+        proc->time_slice --;
+    }
+    if (proc->time_slice == 0) {
+        proc->need_resched = 1;
+    }
+}
+
+// CFS_get_proc - take the procs of the largest vruntime, they run last.
+//   their vruntime becomes relative to min_vruntime, CFS_enqueue on the other
+//   cpu adds its own one.
+static int
+CFS_get_proc(struct run_queue *rq, struct proc_struct *procs_moved[], int n) {
+    int got = 0;
+    rb_node *node;
+    while (got < n && (node = rb_node_last(rq->cfs_tree)) != NULL) {
+        struct proc_struct *proc = rbn2proc(node);
+        CFS_remove(rq, proc);
+        proc->vruntime -= rq->min_vruntime;
+        proc->rq = NULL;
+        procs_moved[got ++] = proc;
+    }
+    return got;
+}
+
+struct sched_class CFS_sched_class = {
+    .name = "CFS_scheduler",
+    .init = CFS_init,
+    .enqueue = CFS_enqueue,
+    .dequeue = CFS_dequeue,
+    .remove = CFS_remove,
+    .pick_next = CFS_pick_next,
+    .proc_tick = CFS_proc_tick,
+    .get_proc = CFS_get_proc,
+};
+
@@ -1,58 +1,168 @@
 #include <types.h>
+#include <x86.h>
 #include <list.h>
 #include <proc.h>
+#include <slab.h>
+#include <stdio.h>
 #include <assert.h>
+#include <clock.h>
 #include <sched.h>
 #include <sched_RR.h>
 #include <sched_MLFQ.h>
 
+/* *
+ * MLFQ - the multi-level feedback queue, MLFQ_NR_LEVELS round-robin queues
+ * rq[0] ~ rq[MLFQ_NR_LEVELS - 1] linked by rq_link, level 0 runs first. The
+ * first queue keeps a bitmap of the levels not empty, pick_next is a bit scan.
+ *
+ * A proc stays at its level until it has run for the time slice of the level,
+ * in however many runs: the run time is measured by clock_read() at each
+ * switch, so sleeping or yielding just before a slice or a tick ends does not
+ * keep it up. Then it goes down a level, and its slice grows every
+ * MLFQ_NR_LEVELS / MLFQ_SLICE_STEPS levels.
+ * Every MLFQ_BOOST_TICKS all procs go back to level 0, so the long running
+ * ones are not starved by new interactive work. The queued procs are moved at
+ * once, the others when they are queued again.
+ * */
+
+#define MLFQ_BASE_SLICE             8       // the time slice of level 0, in ticks
+#define MLFQ_SLICE_STEPS            4       // the slice doubles this many times
+#define MLFQ_BOOST_TICKS            100     // the boost period
+
 static struct sched_class *sched_class;
 
+static inline size_t
+MLFQ_epoch(void) {
+    return ticks / MLFQ_BOOST_TICKS;
+}
+
+// MLFQ_used - the run time of proc at its level, in ns
+static inline uint64_t
+MLFQ_used(struct proc_struct *proc) {
+    return proc->sum_exec - proc->mlfq_base;
+}
+
+static inline uint64_t
+MLFQ_slice(struct run_queue *lrq) {
+    return (uint64_t)lrq->max_time_slice * TICK_NSEC;
+}
+
 static void
 MLFQ_init(struct run_queue *rq) {
+    static_assert(MLFQ_NR_LEVELS <= 32);
     sched_class = &RR_sched_class;
     list_entry_t *list = &(rq->rq_link), *le = list;
+    int level = 0;
     do {
-        sched_class->init(le2rq(le, rq_link));
+        struct run_queue *lrq = le2rq(le, rq_link);
+        assert(level < MLFQ_NR_LEVELS && lrq == rq + level);
+        sched_class->init(lrq);
+        lrq->mlfq_level = level;
+        lrq->max_time_slice = MLFQ_BASE_SLICE << (level * MLFQ_SLICE_STEPS / MLFQ_NR_LEVELS);
+        level ++;
         le = list_next(le);
     } while (le != list);
+    assert(level == MLFQ_NR_LEVELS);
+    rq->mlfq_bitmap = 0;
+    rq->mlfq_epoch = MLFQ_epoch();
+}
+
+// MLFQ_boost - move the queued procs of all levels to level 0
+static void
+MLFQ_boost(struct run_queue *rq) {
+    rq->mlfq_epoch = MLFQ_epoch();
+    uint32_t bitmap = rq->mlfq_bitmap & ~1;
+    while (bitmap != 0) {
+        struct run_queue *lrq = rq + bsf(bitmap);
+        struct proc_struct *proc;
+        while ((proc = sched_class->pick_next(lrq)) != NULL) {
+            sched_class->dequeue(lrq, proc);
+            proc->time_slice = 0;
+            proc->mlfq_base = proc->sum_exec;
+            sched_class->enqueue(rq, proc);
+        }
+        bitmap &= ~(1 << lrq->mlfq_level);
+    }
+    list_entry_t *list = &(rq->run_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        le2proc(le, run_link)->mlfq_epoch = rq->mlfq_epoch;
+    }
+    rq->mlfq_bitmap = (rq->proc_num != 0) ? 1 : 0;
 }
 
 static void
 MLFQ_enqueue(struct run_queue *rq, struct proc_struct *proc) {
     assert(list_empty(&(proc->run_link)));
-    struct run_queue *nrq = rq;
-    if (proc->rq != NULL && proc->time_slice == 0) {
-        nrq = le2rq(list_next(&(proc->rq->rq_link)), rq_link);
-        if (nrq == rq) {
-            nrq = proc->rq;
+    if (rq->mlfq_epoch != MLFQ_epoch()) {
+        MLFQ_boost(rq);
+    }
+    int level = 0;
+    if (proc->rq == NULL || proc->mlfq_epoch != rq->mlfq_epoch) {
+        // new, or boosted since it was queued last
+        proc->time_slice = 0;
+        proc->mlfq_base = proc->sum_exec;
+    }
+    else {
+        // the level of proc->rq, which may be on another cpu
+        level = proc->rq->mlfq_level;
+        if (MLFQ_used(proc) >= MLFQ_slice(rq + level)) {
+            if (level < MLFQ_NR_LEVELS - 1) {
+                level ++;
+            }
+            proc->time_slice = 0;
+            proc->mlfq_base = proc->sum_exec;
         }
     }
-    sched_class->enqueue(nrq, proc);
+    proc->mlfq_epoch = rq->mlfq_epoch;
+    sched_class->enqueue(rq + level, proc);
+    rq->mlfq_bitmap |= (1 << level);
 }
 
 static void
 MLFQ_dequeue(struct run_queue *rq, struct proc_struct *proc) {
     assert(!list_empty(&(proc->run_link)));
-    sched_class->dequeue(proc->rq, proc);
+    struct run_queue *lrq = proc->rq;
+    sched_class->dequeue(lrq, proc);
+    if (lrq->proc_num == 0) {
+        rq->mlfq_bitmap &= ~(1 << lrq->mlfq_level);
+    }
 }
 
 static struct proc_struct *
 MLFQ_pick_next(struct run_queue *rq) {
-    struct proc_struct *next;
-    list_entry_t *list = &(rq->rq_link), *le = list;
-    do {
-        if ((next = sched_class->pick_next(le2rq(le, rq_link))) != NULL) {
-            break;
-        }
-        le = list_next(le);
-    } while (le != list);
-    return next;
+    if (rq->mlfq_bitmap == 0) {
+        return NULL;
+    }
+    return sched_class->pick_next(rq + bsf(rq->mlfq_bitmap));
 }
 
+// MLFQ_proc_tick - sum_exec of proc is up to date, it runs until it has used
+//                - the slice of its level, or a boost is due
 static void
 MLFQ_proc_tick(struct run_queue *rq, struct proc_struct *proc) {
-    sched_class->proc_tick(proc->rq, proc);
+    if (proc->rq != NULL && MLFQ_used(proc) >= MLFQ_slice(proc->rq)) {
+        proc->need_resched = 1;
+    }
+    if (rq->mlfq_epoch != MLFQ_epoch()) {
+        MLFQ_boost(rq);
+        proc->need_resched = 1;
+    }
+}
+
+// MLFQ_get_proc - take the procs from the lowest level up
+static int
+MLFQ_get_proc(struct run_queue *rq, struct proc_struct *procs_moved[], int n) {
+    int got = 0, level;
+    for (level = MLFQ_NR_LEVELS - 1; got < n && level >= 0; level --) {
+        struct run_queue *lrq = rq + level;
+        if (rq->mlfq_bitmap & (1 << level)) {
+            got += sched_class->get_proc(lrq, procs_moved + got, n - got);
+            if (lrq->proc_num == 0) {
+                rq->mlfq_bitmap &= ~(1 << level);
+            }
+        }
+    }
+    return got;
 }
 
 struct sched_class MLFQ_sched_class = {
@@ -62,5 +172,91 @@ struct sched_class MLFQ_sched_class = {
     .dequeue = MLFQ_dequeue,
     .pick_next = MLFQ_pick_next,
     .proc_tick = MLFQ_proc_tick,
+    .get_proc = MLFQ_get_proc,
 };
 
+// check_mlfq - run MLFQ on run queues and procs of its own
+void
+check_mlfq(void) {
+    const int nprocs = 3;
+    struct run_queue *rq = kmalloc(sizeof(struct run_queue) * MLFQ_NR_LEVELS);
+    struct proc_struct *procs = kmalloc(sizeof(struct proc_struct) * nprocs);
+    assert(rq != NULL && procs != NULL);
+
+    int i;
+    list_init(&(rq->rq_link));
+    for (i = 1; i < MLFQ_NR_LEVELS; i ++) {
+        list_add_before(&(rq->rq_link), &(rq[i].rq_link));
+    }
+    for (i = 0; i < nprocs; i ++) {
+        procs[i].rq = NULL;
+        list_init(&(procs[i].run_link));
+        procs[i].time_slice = 0;
+        procs[i].sum_exec = 0;
+        procs[i].need_resched = 0;
+    }
+    struct proc_struct *a = procs, *b = procs + 1, *c = procs + 2;
+    struct sched_class *mlfq = &MLFQ_sched_class;
+    mlfq->init(rq);
+    assert(mlfq->pick_next(rq) == NULL && rq->mlfq_bitmap == 0);
+    uint64_t slice0 = MLFQ_slice(rq), slice1 = MLFQ_slice(rq + 1);
+    assert(slice0 != 0 && slice1 >= slice0);
+
+    // a runs for the whole slice of level 0 and goes down
+    mlfq->enqueue(rq, a);
+    assert(a->rq == rq && rq->mlfq_bitmap == 1 && mlfq->pick_next(rq) == a);
+    mlfq->dequeue(rq, a);
+    a->sum_exec += slice0;
+    mlfq->enqueue(rq, a);
+    assert(a->rq == rq + 1 && rq->mlfq_bitmap == 2);
+
+    // b comes later, but level 0 runs first
+    mlfq->enqueue(rq, b);
+    assert(rq->mlfq_bitmap == 3 && mlfq->pick_next(rq) == b);
+
+    // c yields before each tick, its runs add up to the slice all the same
+    mlfq->enqueue(rq, c);
+    for (i = 0; i < 3; i ++) {
+        mlfq->dequeue(rq, c);
+        c->sum_exec += slice0 / 4;
+        mlfq->enqueue(rq, c);
+        assert(c->rq == rq);
+    }
+    mlfq->dequeue(rq, c);
+    c->sum_exec += slice0 - slice0 / 4 * 3;
+    mlfq->enqueue(rq, c);
+    assert(c->rq == rq + 1);
+
+    // the last level keeps its procs
+    mlfq->dequeue(rq, a);
+    a->rq = rq + MLFQ_NR_LEVELS - 1, a->mlfq_base = a->sum_exec;
+    a->sum_exec += MLFQ_slice(a->rq);
+    mlfq->enqueue(rq, a);
+    assert(a->rq == rq + MLFQ_NR_LEVELS - 1);
+    assert(rq->mlfq_bitmap == (1 | 2 | (1 << (MLFQ_NR_LEVELS - 1))));
+
+    // other cpus take the procs of the lowest level first
+    struct proc_struct *moved[1];
+    assert(mlfq->get_proc(rq, moved, 1) == 1 && moved[0] == a && rq->mlfq_bitmap == 3);
+    mlfq->enqueue(rq, a);
+    assert(a->rq == rq + MLFQ_NR_LEVELS - 1);
+
+    // a boost brings all of them to level 0
+    rq->mlfq_epoch --;
+    mlfq->proc_tick(rq, b);
+    assert(rq->mlfq_bitmap == 1 && b->need_resched);
+    for (i = 0; i < nprocs; i ++) {
+        struct proc_struct *proc = mlfq->pick_next(rq);
+        if (proc == NULL) {
+            break;
+        }
+        assert(proc->rq == rq);
+        mlfq->dequeue(rq, proc);
+    }
+    assert(mlfq->pick_next(rq) == NULL && rq->mlfq_bitmap == 0);
+
+    kfree(procs);
+    kfree(rq);
+    cprintf("check_mlfq() succeeded.\n");
+}
+
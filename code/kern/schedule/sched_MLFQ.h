@@ -3,7 +3,12 @@
 
 #include <sched.h>
 
+// the levels of MLFQ, at most 32: one bit each in the bitmap
+#define MLFQ_NR_LEVELS              32
+
 extern struct sched_class MLFQ_sched_class;
 
+void check_mlfq(void);
+
 #endif /* !__KERN_SCHEDULE_SCHED_MLFQ_H__ */
 
@@ -47,6 +47,19 @@ RR_proc_tick(struct run_queue *rq, struct proc_struct *proc) {
     }
 }
 
+// RR_get_proc - take the procs from the tail, they run last
+static int
+RR_get_proc(struct run_queue *rq, struct proc_struct *procs_moved[], int n) {
+    int got = 0;
+    list_entry_t *le;
+    while (got < n && (le = list_prev(&(rq->run_list))) != &(rq->run_list)) {
+        struct proc_struct *proc = le2proc(le, run_link);
+        RR_dequeue(rq, proc);
+        procs_moved[got ++] = proc;
+    }
+    return got;
+}
+
 struct sched_class RR_sched_class = {
     .name = "RR_scheduler",
     .init = RR_init,
@@ -54,5 +67,6 @@ struct sched_class RR_sched_class = {
     .dequeue = RR_dequeue,
     .pick_next = RR_pick_next,
     .proc_tick = RR_proc_tick,
+    .get_proc = RR_get_proc,
 };
 
@@ -43,7 +43,7 @@ ipc_event_send(int pid, int event, unsigned int timeout) {
     if ((proc = find_proc(pid)) == NULL || proc->state == PROC_ZOMBIE) {
         return -E_INVAL;
     }
-    if (proc == current || proc == idleproc || proc == initproc || proc == kswapd) {
+    if (proc == current || proc == idleproc || proc == initproc || proc == kswapd || proc == reaper || proc == ksmd) {
         return -E_INVAL;
     }
     if (proc->wait_state == WT_EVENT_RECV) {
@@ -51,15 +51,15 @@ ipc_event_send(int pid, int event, unsigned int timeout) {
     }
     current->event_box.event = event;
 
-    unsigned long saved_ticks;
-    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+    uint64_t saved_time;
+    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_time, &__timer);
 
     uint32_t flags;
     if ((flags = send_event(proc, timer)) == 0) {
         return 0;
     }
     assert(flags == WT_INTERRUPTED);
-    return ipc_check_timeout(timeout, saved_ticks);
+    return ipc_check_timeout(timeout, saved_time);
 }
 
 static int
@@ -107,8 +107,8 @@ ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout) {
         return -E_INVAL;
     }
 
-    unsigned long saved_ticks;
-    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+    uint64_t saved_time;
+    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_time, &__timer);
 
     int pid, event, ret;
     if ((ret = recv_event(&pid, &event, timer)) == 0) {
@@ -124,6 +124,6 @@ ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout) {
         unlock_mm(mm);
         return ret;
     }
-    return ipc_check_timeout(timeout, saved_ticks);
+    return ipc_check_timeout(timeout, saved_time);
 }
 
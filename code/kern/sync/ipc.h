@@ -21,20 +21,22 @@ ipc_del_timer(timer_t *timer) {
     }
 }
 
+// ipc_timer_init - a timer of timeout 1 / TIMER_HZ (see timer_units), NULL if
+//                 - there is no timeout. saved_time is the start.
 static inline timer_t *
-ipc_timer_init(unsigned int timeout, unsigned long *saved_ticks, timer_t *timer) {
+ipc_timer_init(unsigned int timeout, uint64_t *saved_time, timer_t *timer) {
     if (timeout != 0) {
-        *saved_ticks = ticks;
+        *saved_time = clock_read();
         return timer_init(timer, current, timeout);
     }
     return NULL;
 }
 
 static inline int
-ipc_check_timeout(unsigned int timeout, unsigned long saved_ticks) {
+ipc_check_timeout(unsigned int timeout, uint64_t saved_time) {
     if (timeout != 0) {
-        unsigned long delt = (unsigned long)(ticks - saved_ticks);
-        if (delt >= timeout) {
+        uint64_t delt = clock_read() - saved_time;
+        if (delt >= (uint64_t)timeout * TIMER_NSEC) {
             return -E_TIMEOUT;
         }
     }
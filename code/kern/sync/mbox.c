@@ -312,15 +312,15 @@ ipc_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout) {
     if (ret == 0) {
         ret = -E_INVAL;
         if ((mbox = get_mbox(id)) != NULL) {
-            unsigned long saved_ticks;
-            timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+            uint64_t saved_time;
+            timer_t __timer, *timer = ipc_timer_init(timeout, &saved_time, &__timer);
 
             uint32_t flags;
             if ((flags = send_msg(mbox, msg, timer)) == 0) {
                 return 0;
             }
             assert(flags == WT_INTERRUPTED);
-            ret = ipc_check_timeout(timeout, saved_ticks);
+            ret = ipc_check_timeout(timeout, saved_time);
         }
         free_msg(msg);
     }
@@ -423,11 +423,11 @@ ipc_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout) {
         return -E_INVAL;
     }
 
-    unsigned long saved_ticks;
-    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+    uint64_t saved_time;
+    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_time, &__timer);
     if ((ret = recv_msg(mbox, size, &msg, timer)) != 0) {
         if (ret == -1) {
-            return ipc_check_timeout(timeout, saved_ticks);
+            return ipc_check_timeout(timeout, saved_time);
         }
         return ret;
     }
@@ -51,6 +51,7 @@ Now, ucore didn't implementation 'Special Case&Operation for User Semaphore' in
 
 void
 sem_init(semaphore_t *sem, int value) {
+    spinlock_init(&(sem->lock));
     sem->value = value;
     sem->valid = 1;
     set_sem_count(sem, 0);
@@ -60,7 +61,7 @@ sem_init(semaphore_t *sem, int value) {
 static void __attribute__ ((noinline)) __up(semaphore_t *sem, uint32_t wait_state) {
     assert(sem->valid);
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(sem->lock), intr_flag);
     {
         wait_t *wait;
         if ((wait = wait_queue_first(&(sem->wait_queue))) == NULL) {
@@ -71,29 +72,29 @@ static void __attribute__ ((noinline)) __up(semaphore_t *sem, uint32_t wait_stat
             wakeup_wait(&(sem->wait_queue), wait, wait_state, 1);
         }
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(sem->lock), intr_flag);
 }
 
 static uint32_t __attribute__ ((noinline)) __down(semaphore_t *sem, uint32_t wait_state, timer_t *timer) {
     assert(sem->valid);
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(sem->lock), intr_flag);
     if (sem->value > 0) {
         sem->value --;
-        local_intr_restore(intr_flag);
+        spin_unlock_irqrestore(&(sem->lock), intr_flag);
         return 0;
     }
     wait_t __wait, *wait = &__wait;
     wait_current_set(&(sem->wait_queue), wait, wait_state);
     ipc_add_timer(timer);
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(sem->lock), intr_flag);
 
     schedule();
 
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(sem->lock), intr_flag);
     ipc_del_timer(timer);
     wait_current_del(&(sem->wait_queue), wait);
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(sem->lock), intr_flag);
 
     if (wait->wakeup_flags != wait_state) {
         return wait->wakeup_flags;
@@ -115,11 +116,132 @@ down(semaphore_t *sem) {
 bool
 try_down(semaphore_t *sem) {
     bool intr_flag, ret = 0;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&(sem->lock), intr_flag);
     if (sem->value > 0) {
         sem->value --, ret = 1;
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&(sem->lock), intr_flag);
+    return ret;
+}
+
+/* *
+ * reader/writer semaphore: the waiters are served in FIFO order, and a new
+ * reader has to wait if there is any waiter, so writers won't be starved.
+ * The releaser hands the semaphore over to the waiters it wakes up, that is,
+ * the first writer, or all readers at the head of the wait queue.
+ * */
+void
+rw_sem_init(rw_semaphore_t *rwsem) {
+    spinlock_init(&(rwsem->lock));
+    rwsem->readers = 0;
+    wait_queue_init(&(rwsem->wait_queue));
+}
+
+// __rw_sem_wakeup - hand the semaphore over to the waiters, called with the lock held
+static void
+__rw_sem_wakeup(rw_semaphore_t *rwsem) {
+    wait_t *wait;
+    while ((wait = wait_queue_first(&(rwsem->wait_queue))) != NULL) {
+        uint32_t wait_state = wait->proc->wait_state;
+        if (wait_state == WT_KSEM_WRITE) {
+            if (rwsem->readers == 0) {
+                rwsem->readers = -1;
+                wakeup_wait(&(rwsem->wait_queue), wait, wait_state, 1);
+            }
+            break;
+        }
+        assert(wait_state == WT_KSEM_READ && rwsem->readers >= 0);
+        rwsem->readers ++;
+        wakeup_wait(&(rwsem->wait_queue), wait, wait_state, 1);
+    }
+}
+
+// __rw_sem_wait - sleep until the semaphore is handed over by __rw_sem_wakeup,
+//               - called with the lock held (interrupts saved in intr_flag)
+static void
+__rw_sem_wait(rw_semaphore_t *rwsem, uint32_t wait_state, bool intr_flag) {
+    wait_t __wait, *wait = &__wait;
+    wait_current_set(&(rwsem->wait_queue), wait, wait_state);
+    spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+
+    schedule();
+
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    wait_current_del(&(rwsem->wait_queue), wait);
+    spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+
+    assert(wait->wakeup_flags == wait_state);
+}
+
+void
+down_read(rw_semaphore_t *rwsem) {
+    bool intr_flag;
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    if (rwsem->readers >= 0 && wait_queue_empty(&(rwsem->wait_queue))) {
+        rwsem->readers ++;
+        spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+        return ;
+    }
+    __rw_sem_wait(rwsem, WT_KSEM_READ, intr_flag);
+}
+
+void
+up_read(rw_semaphore_t *rwsem) {
+    bool intr_flag;
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    {
+        assert(rwsem->readers > 0);
+        if (-- rwsem->readers == 0) {
+            __rw_sem_wakeup(rwsem);
+        }
+    }
+    spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+}
+
+bool
+try_down_read(rw_semaphore_t *rwsem) {
+    bool intr_flag, ret = 0;
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    if (rwsem->readers >= 0 && wait_queue_empty(&(rwsem->wait_queue))) {
+        rwsem->readers ++, ret = 1;
+    }
+    spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+    return ret;
+}
+
+void
+down_write(rw_semaphore_t *rwsem) {
+    bool intr_flag;
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    if (rwsem->readers == 0 && wait_queue_empty(&(rwsem->wait_queue))) {
+        rwsem->readers = -1;
+        spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+        return ;
+    }
+    __rw_sem_wait(rwsem, WT_KSEM_WRITE, intr_flag);
+}
+
+void
+up_write(rw_semaphore_t *rwsem) {
+    bool intr_flag;
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    {
+        assert(rwsem->readers == -1);
+        spinlock_init(&(rwsem->lock));
+    rwsem->readers = 0;
+        __rw_sem_wakeup(rwsem);
+    }
+    spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
+}
+
+bool
+try_down_write(rw_semaphore_t *rwsem) {
+    bool intr_flag, ret = 0;
+    spin_lock_irqsave(&(rwsem->lock), intr_flag);
+    if (rwsem->readers == 0 && wait_queue_empty(&(rwsem->wait_queue))) {
+        rwsem->readers = -1, ret = 1;
+    }
+    spin_unlock_irqrestore(&(rwsem->lock), intr_flag);
     return ret;
 }
 
@@ -131,15 +253,15 @@ usem_up(semaphore_t *sem) {
 
 static int
 usem_down(semaphore_t *sem, unsigned int timeout) {
-    unsigned long saved_ticks;
-    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+    uint64_t saved_time;
+    timer_t __timer, *timer = ipc_timer_init(timeout, &saved_time, &__timer);
 
     uint32_t flags;
     if ((flags = __down(sem, WT_USEM, timer)) == 0) {
         return 0;
     }
     assert(flags == WT_INTERRUPTED);
-    return ipc_check_timeout(timeout, saved_ticks);
+    return ipc_check_timeout(timeout, saved_time);
 }
 
 sem_queue_t *
@@ -291,13 +413,13 @@ ipc_sem_free(sem_t sem_id) {
     int ret = -E_INVAL;
     if (semu != NULL) {
         bool intr_flag;
-        local_intr_save(intr_flag);
+        semaphore_t *sem = semu->sem;
+        spin_lock_irqsave(&(sem->lock), intr_flag);
         {
-            semaphore_t *sem = semu->sem;
             sem->valid = 0, ret = 0;
             wakeup_queue(&(sem->wait_queue), WT_INTERRUPTED, 1);
         }
-        local_intr_restore(intr_flag);
+        spin_unlock_irqrestore(&(sem->lock), intr_flag);
     }
     return ret;
 }
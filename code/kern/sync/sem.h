@@ -4,14 +4,23 @@
 #include <types.h>
 #include <atomic.h>
 #include <wait.h>
+#include <spinlock.h>
 
 typedef struct {
+    spinlock_t lock;                // protects value and wait_queue, taken by interrupt handlers too
     int value;
     bool valid;
     atomic_t count;
     wait_queue_t wait_queue;
 } semaphore_t;
 
+// reader/writer semaphore: held by any number of readers, or by one writer
+typedef struct {
+    spinlock_t lock;
+    int readers;                // the number of readers holding it, -1 if a writer holds it
+    wait_queue_t wait_queue;
+} rw_semaphore_t;
+
 // The sem_undo_t is used to permit semaphore manipulations that can be undone. If a process
 // crashes after modifying a semaphore, the information held in the list is used to return the semaphore
 // to its state prior to modification. The mechanism is useful when the crashed process has made changes
@@ -37,6 +46,14 @@ void up(semaphore_t *sem);
 void down(semaphore_t *sem);
 bool try_down(semaphore_t *sem);
 
+void rw_sem_init(rw_semaphore_t *rwsem);
+void down_read(rw_semaphore_t *rwsem);
+void up_read(rw_semaphore_t *rwsem);
+bool try_down_read(rw_semaphore_t *rwsem);
+void down_write(rw_semaphore_t *rwsem);
+void up_write(rw_semaphore_t *rwsem);
+bool try_down_write(rw_semaphore_t *rwsem);
+
 sem_undo_t *semu_create(semaphore_t *sem, int value);
 void semu_destroy(sem_undo_t *semu);
 
@@ -0,0 +1,51 @@
+#ifndef __KERN_SYNC_SPINLOCK_H__
+#define __KERN_SYNC_SPINLOCK_H__
+
+#include <types.h>
+#include <atomic.h>
+#include <sync.h>
+
+/* *
+ * spinlock_t - a test-and-test-and-set lock for the structures shared by the
+ * cpus. The holder must not sleep, and must disable the interrupts if the lock
+ * is also taken by an interrupt handler: use spin_lock_irqsave then.
+ * */
+typedef struct {
+    volatile unsigned int locked;
+} spinlock_t;
+
+static inline void
+spinlock_init(spinlock_t *lock) {
+    lock->locked = 0;
+}
+
+static inline bool
+spin_trylock(spinlock_t *lock) {
+    return !test_and_set_bit(0, &(lock->locked));
+}
+
+void tlb_shootdown_poll(void);
+
+// spin_lock - the waiter answers the TLB shootdowns, it may have interrupts
+//           - disabled while the holder waits for it in tlb_shootdown
+static inline void
+spin_lock(spinlock_t *lock) {
+    while (!spin_trylock(lock)) {
+        while (lock->locked) {
+            tlb_shootdown_poll();
+            asm volatile ("pause");
+        }
+    }
+}
+
+static inline void
+spin_unlock(spinlock_t *lock) {
+    asm volatile ("" ::: "memory");
+    lock->locked = 0;
+}
+
+#define spin_lock_irqsave(lock, x)          do { local_intr_save(x); spin_lock(lock); } while (0)
+#define spin_unlock_irqrestore(lock, x)     do { spin_unlock(lock); local_intr_restore(x); } while (0)
+
+#endif /* !__KERN_SYNC_SPINLOCK_H__ */
+
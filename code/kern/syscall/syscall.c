@@ -12,6 +12,11 @@
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
+#include <ksm.h>
+#include <swap.h>
+#include <oom.h>
+#include <memgroup.h>
+#include <sched.h>
 
 static uint32_t
 sys_exit(uint32_t arg[]) {
@@ -63,10 +68,25 @@ sys_yield(uint32_t arg[]) {
     return do_yield();
 }
 
+// timeout_units - convert timeout of unit (TIMEOUT_TICKS or TIMEOUT_USEC) to the
+//               - 1 / TIMER_HZ the kernel waits take
+static int
+timeout_units(unsigned int timeout, int unit, unsigned int *units_store) {
+    if (unit != TIMEOUT_TICKS && unit != TIMEOUT_USEC) {
+        return -E_INVAL;
+    }
+    *units_store = timer_units(timeout, unit);
+    return 0;
+}
+
 static uint32_t
 sys_sleep(uint32_t arg[]) {
-    unsigned int time = (unsigned int)arg[0];
-    return do_sleep(time);
+    unsigned int time = (unsigned int)arg[0], units;
+    int ret, unit = (int)arg[1];
+    if ((ret = timeout_units(time, unit, &units)) != 0) {
+        return ret;
+    }
+    return do_sleep_units(units);
 }
 
 static uint32_t
@@ -106,6 +126,54 @@ sys_munmap(uint32_t arg[]) {
     return do_munmap(addr, len);
 }
 
+static uint32_t
+sys_mremap(uint32_t arg[]) {
+    uintptr_t *addr_store = (uintptr_t *)arg[0];
+    size_t old_len = (size_t)arg[1];
+    size_t new_len = (size_t)arg[2];
+    uint32_t flags = (uint32_t)arg[3];
+    return do_mremap(addr_store, old_len, new_len, flags);
+}
+
+static uint32_t
+sys_madvise(uint32_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    int advice = (int)arg[2];
+    return do_madvise(addr, len, advice);
+}
+
+static uint32_t
+sys_mlock(uint32_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_mlock(addr, len);
+}
+
+static uint32_t
+sys_munlock(uint32_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_munlock(addr, len);
+}
+
+static uint32_t
+sys_mlockall(uint32_t arg[]) {
+    int flags = (int)arg[0];
+    return do_mlockall(flags);
+}
+
+static uint32_t
+sys_munlockall(uint32_t arg[]) {
+    return do_munlockall();
+}
+
+static uint32_t
+sys_mlocklimit(uint32_t arg[]) {
+    size_t limit = (size_t)arg[0];
+    return do_mlocklimit(limit);
+}
+
 static uint32_t
 sys_shmem(uint32_t arg[]) {
     uintptr_t *addr_store = (uintptr_t *)arg[0];
@@ -127,6 +195,80 @@ sys_pgdir(uint32_t arg[]) {
     return 0;
 }
 
+static uint32_t
+sys_ptcount(uint32_t arg[]) {
+    return do_ptcount();
+}
+
+static uint32_t
+sys_ncpu(uint32_t arg[]) {
+    return ncpu_online;
+}
+
+static uint32_t
+sys_uffd(uint32_t arg[]) {
+    int cmd = (int)arg[0];
+    uintptr_t arg0 = (uintptr_t)arg[1];
+    uintptr_t arg1 = (uintptr_t)arg[2];
+    uintptr_t arg2 = (uintptr_t)arg[3];
+    return do_uffd(cmd, arg0, arg1, arg2);
+}
+
+static uint32_t
+sys_ksminfo(uint32_t arg[]) {
+    struct ksminfo *info = (struct ksminfo *)arg[0];
+    return ksm_info(info);
+}
+
+static uint32_t
+sys_swapon(uint32_t arg[]) {
+    unsigned short ideno = (unsigned short)arg[0];
+    int prio = (int)arg[1];
+    return swap_add_device(ideno, prio);
+}
+
+static uint32_t
+sys_swapoff(uint32_t arg[]) {
+    unsigned short ideno = (unsigned short)arg[0];
+    return swap_del_device(ideno);
+}
+
+static uint32_t
+sys_oomadj(uint32_t arg[]) {
+    int pid = (int)arg[0];
+    int adj = (int)arg[1];
+    return oom_set_adj(pid, adj);
+}
+
+static uint32_t
+sys_memgroup(uint32_t arg[]) {
+    int cmd = (int)arg[0];
+    int id = (int)arg[1];
+    uintptr_t arg0 = (uintptr_t)arg[2];
+    return do_memgroup(cmd, id, arg0);
+}
+
+static uint32_t
+sys_getrusage(uint32_t arg[]) {
+    int pid = (int)arg[0];
+    struct rusage *usage = (struct rusage *)arg[1];
+    return do_getrusage(pid, usage);
+}
+
+static uint32_t
+sys_nice(uint32_t arg[]) {
+    int pid = (int)arg[0];
+    int nice = (int)arg[1];
+    return do_nice(pid, nice);
+}
+
+static uint32_t
+sys_schedclass(uint32_t arg[]) {
+    char *name = (char *)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_schedclass(name, len);
+}
+
 static uint32_t
 sys_sem_init(uint32_t arg[]) {
     int value = (int)arg[0];
@@ -143,6 +285,10 @@ static uint32_t
 sys_sem_wait(uint32_t arg[]) {
     sem_t sem_id = (sem_t)arg[0];
     unsigned int timeout = (unsigned int)arg[1];
+    int ret, unit = (int)arg[2];
+    if ((ret = timeout_units(timeout, unit, &timeout)) != 0) {
+        return ret;
+    }
     return ipc_sem_wait(sem_id, timeout);
 }
 
@@ -164,6 +310,10 @@ sys_event_send(uint32_t arg[]) {
     int pid = (int)arg[0];
     int event = (int)arg[1];
     unsigned int timeout = (unsigned int)arg[2];
+    int ret, unit = (int)arg[3];
+    if ((ret = timeout_units(timeout, unit, &timeout)) != 0) {
+        return ret;
+    }
     return ipc_event_send(pid, event, timeout);
 }
 
@@ -172,6 +322,10 @@ sys_event_recv(uint32_t arg[]) {
     int *pid_store = (int *)arg[0];
     int *event_store = (int *)arg[1];
     unsigned int timeout = (unsigned int)arg[2];
+    int ret, unit = (int)arg[3];
+    if ((ret = timeout_units(timeout, unit, &timeout)) != 0) {
+        return ret;
+    }
     return ipc_event_recv(pid_store, event_store, timeout);
 }
 
@@ -186,6 +340,10 @@ sys_mbox_send(uint32_t arg[]) {
     int id = (int)arg[0];
     struct mboxbuf *buf = (struct mboxbuf *)arg[1];
     unsigned int timeout = (unsigned int)arg[2];
+    int ret, unit = (int)arg[3];
+    if ((ret = timeout_units(timeout, unit, &timeout)) != 0) {
+        return ret;
+    }
     return ipc_mbox_send(id, buf, timeout);
 }
 
@@ -194,6 +352,10 @@ sys_mbox_recv(uint32_t arg[]) {
     int id = (int)arg[0];
     struct mboxbuf *buf = (struct mboxbuf *)arg[1];
     unsigned int timeout = (unsigned int)arg[2];
+    int ret, unit = (int)arg[3];
+    if ((ret = timeout_units(timeout, unit, &timeout)) != 0) {
+        return ret;
+    }
     return ipc_mbox_recv(id, buf, timeout);
 }
 
@@ -342,13 +504,31 @@ static uint32_t (*syscalls[])(uint32_t arg[]) = {
     [SYS_mmap]              sys_mmap,
     [SYS_munmap]            sys_munmap,
     [SYS_shmem]             sys_shmem,
+    [SYS_madvise]           sys_madvise,
+    [SYS_mlock]             sys_mlock,
+    [SYS_munlock]           sys_munlock,
+    [SYS_mlockall]          sys_mlockall,
+    [SYS_munlockall]        sys_munlockall,
+    [SYS_mremap]            sys_mremap,
     [SYS_putc]              sys_putc,
     [SYS_pgdir]             sys_pgdir,
+    [SYS_ptcount]           sys_ptcount,
+    [SYS_ncpu]              sys_ncpu,
+    [SYS_uffd]              sys_uffd,
+    [SYS_ksminfo]           sys_ksminfo,
+    [SYS_swapon]            sys_swapon,
+    [SYS_swapoff]           sys_swapoff,
+    [SYS_oomadj]            sys_oomadj,
+    [SYS_memgroup]          sys_memgroup,
+    [SYS_getrusage]         sys_getrusage,
+    [SYS_nice]              sys_nice,
+    [SYS_schedclass]        sys_schedclass,
     [SYS_sem_init]          sys_sem_init,
     [SYS_sem_post]          sys_sem_post,
     [SYS_sem_wait]          sys_sem_wait,
     [SYS_sem_free]          sys_sem_free,
     [SYS_sem_get_value]     sys_sem_get_value,
+    [SYS_mlocklimit]        sys_mlocklimit,
     [SYS_event_send]        sys_event_send,
     [SYS_event_recv]        sys_event_recv,
     [SYS_mbox_init]         sys_mbox_init,
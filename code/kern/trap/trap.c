@@ -16,6 +16,8 @@
 #include <unistd.h>
 #include <syscall.h>
 #include <error.h>
+#include <ide.h>
+#include <apic.h>
 
 #define TICK_NUM 30
 
@@ -30,9 +32,17 @@ idt_init(void) {
     extern uintptr_t __vectors[];
     int i;
     for (i = 0; i < sizeof(idt) / sizeof(struct gatedesc); i ++) {
-        SETGATE(idt[i], 1, GD_KTEXT, __vectors[i], DPL_KERNEL);
+        // the interrupts come with IF cleared: their handlers take spinlocks
+        bool istrap = !((i >= IRQ_OFFSET && i < IRQ_OFFSET + 32) || i >= T_IPI_TLB);
+        SETGATE(idt[i], istrap, GD_KTEXT, __vectors[i], DPL_KERNEL);
     }
     SETGATE(idt[T_SYSCALL], 1, GD_KTEXT, __vectors[T_SYSCALL], DPL_USER);
+    idt_load();
+}
+
+/* idt_load - load the IDT on the running cpu, all of them share it */
+void
+idt_load(void) {
     lidt(&idt_pd);
 }
 
@@ -78,6 +88,12 @@ trap_in_kernel(struct trapframe *tf) {
     return (tf->tf_cs == (uint16_t)KERNEL_CS);
 }
 
+// trap_is_intr - an interrupt of a device or of another cpu
+static inline bool
+trap_is_intr(struct trapframe *tf) {
+    return (tf->tf_trapno >= IRQ_OFFSET && tf->tf_trapno < IRQ_OFFSET + 32) || tf->tf_trapno >= T_IPI_TLB;
+}
+
 static const char *IA32flags[] = {
     "CF", NULL, "PF", NULL, "AF", NULL, "ZF", "SF",
     "TF", "IF", "DF", "OF", NULL, NULL, "NT", NULL,
@@ -154,6 +170,31 @@ pgfault_handler(struct trapframe *tf) {
     return do_pgfault(mm, tf->tf_err, rcr2());
 }
 
+/* *
+ * The exception table is built by the linker from the __ex_table sections.
+ * Each entry is an instruction which may fault on a user address, and the
+ * fixup code to resume at if the fault can't be handled (see usercopy.S).
+ * */
+struct exception_table_entry {
+    uintptr_t insn;
+    uintptr_t fixup;
+};
+
+// fixup_exception - if the faulting instruction is in exception table,
+//                 - make the trap return to its fixup code.
+static bool
+fixup_exception(struct trapframe *tf) {
+    extern const struct exception_table_entry __EX_TABLE_BEGIN__[], __EX_TABLE_END__[];
+    const struct exception_table_entry *entry;
+    for (entry = __EX_TABLE_BEGIN__; entry < __EX_TABLE_END__; entry ++) {
+        if (entry->insn == tf->tf_eip) {
+            tf->tf_eip = entry->fixup;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static void
 trap_dispatch(struct trapframe *tf) {
     char c;
@@ -167,6 +208,9 @@ trap_dispatch(struct trapframe *tf) {
         break;
     case T_PGFLT:
         if ((ret = pgfault_handler(tf)) != 0) {
+            if (trap_in_kernel(tf) && fixup_exception(tf)) {
+                break;
+            }
             print_trapframe(tf);
             if (current == NULL) {
                 panic("handle pgfault failed. %e\n", ret);
@@ -184,7 +228,7 @@ trap_dispatch(struct trapframe *tf) {
         syscall();
         break;
     case IRQ_OFFSET + IRQ_TIMER:
-        ticks ++;
+        clock_ack();
         assert(current != NULL);
         run_timer_list();
         break;
@@ -200,7 +244,18 @@ trap_dispatch(struct trapframe *tf) {
         break;
     case IRQ_OFFSET + IRQ_IDE1:
     case IRQ_OFFSET + IRQ_IDE2:
-        /* do nothing */
+        ide_intr(tf->tf_trapno - IRQ_OFFSET);
+        break;
+    case T_IPI_TLB:
+        lapic_eoi();
+        tlb_shootdown_poll();
+        break;
+    case T_IPI_RESCHED:
+        // need_resched is set already, the idle cpu is only woken up
+        lapic_eoi();
+        break;
+    case IRQ_OFFSET + IRQ_SPURIOUS:
+        // no EOI for a spurious interrupt
         break;
     default:
         print_trapframe(tf);
@@ -223,16 +278,25 @@ trap(struct trapframe *tf) {
         struct trapframe *otf = current->tf;
         current->tf = tf;
 
-        bool in_kernel = trap_in_kernel(tf);
+        // a trap from user mode enters the kernel code, an interrupt doesn't
+        // (see the kernel lock in sched.c)
+        if (!trap_in_kernel(tf) && !trap_is_intr(tf)) {
+            lock_kernel();
+        }
 
         trap_dispatch(tf);
 
         current->tf = otf;
-        if (!in_kernel) {
+        // kernel_execve returns to user mode from a trap in kernel mode
+        if (!trap_in_kernel(tf)) {
+            if (current->flags & PF_EXITING) {
+                lock_kernel();
+            }
             may_killed();
             if (current->need_resched) {
                 schedule();
             }
+            unlock_kernel();
         }
     }
 }
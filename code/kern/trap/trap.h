@@ -38,6 +38,10 @@
 #define IRQ_ERROR               19
 #define IRQ_SPURIOUS            31
 
+/* the inter-processor interrupts, sent by the local APICs */
+#define T_IPI_TLB               0xF0    // invalidate a TLB entry, see tlb_shootdown
+#define T_IPI_RESCHED           0xF1    // a proc is runnable for an idle cpu
+
 /* registers as pushed by pushal */
 struct pushregs {
     uint32_t reg_edi;
@@ -73,6 +77,7 @@ void idt_init(void);
 void print_trapframe(struct trapframe *tf);
 void print_regs(struct pushregs *regs);
 bool trap_in_kernel(struct trapframe *tf);
+void idt_load(void);
 
 #endif /* !__KERN_TRAP_TRAP_H__ */
 
@@ -0,0 +1,14 @@
+#ifndef __LIBS_KSMINFO_H__
+#define __LIBS_KSMINFO_H__
+
+#include <types.h>
+
+struct ksminfo {
+    size_t pages_shared;        // the stable pages mapped more than once
+    size_t pages_sharing;       // the extra mappings of them, i.e. the pages saved
+    size_t pages_merged;        // the pages merged since boot
+    size_t pages_scanned;       // the pages scanned since boot
+};
+
+#endif /* !__LIBS_KSMINFO_H__ */
+
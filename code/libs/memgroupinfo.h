@@ -0,0 +1,15 @@
+#ifndef __LIBS_MEMGROUPINFO_H__
+#define __LIBS_MEMGROUPINFO_H__
+
+#include <types.h>
+
+struct memgroupinfo {
+    size_t limit;               // the page limit, 0 for no limit
+    size_t usage;               // the pages charged: mapped or in the swap cache
+    size_t max_usage;           // the highest usage seen
+    size_t nr_limit_hits;       // the faults which found the group at its limit
+    size_t nr_failed;           // the faults failed as the group couldn't be shrunk
+};
+
+#endif /* !__LIBS_MEMGROUPINFO_H__ */
+
@@ -0,0 +1,16 @@
+#ifndef __LIBS_RUSAGE_H__
+#define __LIBS_RUSAGE_H__
+
+#include <types.h>
+
+struct rusage {
+    size_t ru_rss;              // the pages mapped
+    size_t ru_maxrss;           // the highest ru_rss seen
+    size_t ru_swap;             // the pages swapped out and not read back yet
+    size_t ru_swapouts;         // the pages unmapped by kswapd
+    size_t ru_minflt;           // the page faults handled without I/O
+    size_t ru_majflt;           // the page faults which read the swap
+};
+
+#endif /* !__LIBS_RUSAGE_H__ */
+
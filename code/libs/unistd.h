@@ -13,12 +13,28 @@
 #define SYS_yield           10
 #define SYS_sleep           11
 #define SYS_kill            12
+#define SYS_ncpu            16
 #define SYS_gettime         17
 #define SYS_getpid          18
 #define SYS_brk             19
 #define SYS_mmap            20
 #define SYS_munmap          21
 #define SYS_shmem           22
+#define SYS_madvise         23
+#define SYS_mlock           24
+#define SYS_munlock         25
+#define SYS_mlockall        26
+#define SYS_munlockall      27
+#define SYS_mremap          28
+#define SYS_ptcount         29
+#define SYS_uffd            32
+#define SYS_ksminfo         33
+#define SYS_swapon          34
+#define SYS_swapoff         35
+#define SYS_oomadj          36
+#define SYS_memgroup        37
+#define SYS_getrusage       38
+#define SYS_nice            39
 #define SYS_putc            30
 #define SYS_pgdir           31
 #define SYS_sem_init        40
@@ -26,6 +42,8 @@
 #define SYS_sem_wait        42
 #define SYS_sem_free        43
 #define SYS_sem_get_value   44
+#define SYS_mlocklimit      45
+#define SYS_schedclass      46
 #define SYS_event_send      48
 #define SYS_event_recv      49
 #define SYS_mbox_init       50
@@ -63,6 +81,42 @@
 #define MMAP_WRITE          0x00000100
 #define MMAP_STACK          0x00000200
 
+/* SYS_mremap flags */
+#define MREMAP_MAYMOVE      0x00000001  // the mapping may be moved to a new address
+
+/* SYS_madvise advice */
+#define MADV_NORMAL         0           // no special treatment
+#define MADV_RANDOM         1           // expect random page references, no read ahead
+#define MADV_SEQUENTIAL     2           // expect sequential page references, read ahead
+#define MADV_WILLNEED       3           // will need these pages, bring them in now
+#define MADV_DONTNEED       4           // don't need these pages, drop them
+#define MADV_MERGEABLE      5           // let ksmd merge identical pages
+#define MADV_UNMERGEABLE    6           // stop merging (merged pages stay cow shared)
+
+/* the unit of the timeouts of SYS_sleep, SYS_sem_wait, SYS_event_* and SYS_mbox_*,
+   passed after the timeout */
+#define TIMEOUT_TICKS       0           // timer ticks
+#define TIMEOUT_USEC        1           // microseconds
+
+/* SYS_mlockall flags */
+#define MCL_CURRENT         0x00000001  // lock all pages currently mapped
+#define MCL_FUTURE          0x00000002  // lock all pages mapped in the future
+
+/* SYS_uffd commands */
+#define UFFD_REGISTER       0           // faults in range are posted to a handler thread
+#define UFFD_UNREGISTER     1           // faults in range get zero pages again
+#define UFFD_COPY           2           // fill missing pages and wake the faulting threads
+
+/* SYS_memgroup commands */
+#define MEMGROUP_CREATE     0           // create a group with a page limit, return its id
+#define MEMGROUP_LIMIT      1           // set the page limit of a group, 0 for no limit
+#define MEMGROUP_ATTACH     2           // move a process into a group (id 0 for none)
+#define MEMGROUP_INFO       3           // get the usage and counters of a group
+#define MEMGROUP_DESTROY    4           // free an empty group (no processes, no pages)
+
+/* the event posted for a fault: page address | flags */
+#define UFFD_EVENT_WRITE    0x00000001  // the fault was a write access
+
 /* VFS flags */
 // flags for open: choose one of these
 #define O_RDONLY            0           // open for reading only
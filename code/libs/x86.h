@@ -39,6 +39,7 @@ struct pseudodesc {
 static inline void lidt(struct pseudodesc *pd) __attribute__((always_inline));
 static inline void sti(void) __attribute__((always_inline));
 static inline void cli(void) __attribute__((always_inline));
+static inline void sti_hlt(void) __attribute__((always_inline));
 static inline void ltr(uint16_t sel) __attribute__((always_inline));
 static inline uint32_t read_eflags(void) __attribute__((always_inline));
 static inline void write_eflags(uint32_t eflags) __attribute__((always_inline));
@@ -49,6 +50,8 @@ static inline uintptr_t rcr1(void) __attribute__((always_inline));
 static inline uintptr_t rcr2(void) __attribute__((always_inline));
 static inline uintptr_t rcr3(void) __attribute__((always_inline));
 static inline void invlpg(void *addr) __attribute__((always_inline));
+static inline uint32_t bsf(uint32_t x) __attribute__((always_inline));
+static inline uint64_t read_tsc(void) __attribute__((always_inline));
 
 static inline uint8_t
 inb(uint16_t port) {
@@ -140,6 +143,15 @@ cli(void) {
     asm volatile ("cli" ::: "memory");
 }
 
+/* *
+ * sti_hlt - enable interrupts and wait for one. sti takes effect after the next
+ * instruction, so an interrupt pending before it still wakes up hlt.
+ * */
+static inline void
+sti_hlt(void) {
+    asm volatile ("sti; hlt" ::: "memory");
+}
+
 static inline void
 ltr(uint16_t sel) {
     asm volatile ("ltr %0" :: "r" (sel) : "memory");
@@ -200,6 +212,21 @@ invlpg(void *addr) {
     asm volatile ("invlpg (%0)" :: "r" (addr) : "memory");
 }
 
+/* bsf - the index of the least significant set bit of x, x must not be 0 */
+static inline uint32_t
+bsf(uint32_t x) {
+    uint32_t index;
+    asm ("bsfl %1, %0" : "=r" (index) : "rm" (x));
+    return index;
+}
+
+static inline uint64_t
+read_tsc(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
 static inline int __strcmp(const char *s1, const char *s2) __attribute__((always_inline));
 static inline char *__strcpy(char *dst, const char *src) __attribute__((always_inline));
 static inline void *__memset(void *s, char c, size_t n) __attribute__((always_inline));
@@ -0,0 +1,140 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <error.h>
+#include <string.h>
+
+// the nice values are weighted by CFS only, the tests below are skipped unless
+// the kernel is built with DEFS=-DSCHED_CLASS=CFS_sched_class (MLFQ is the
+// default class)
+
+// the workers must outnumber the cpus, or each one gets a cpu of its own and
+// the weights don't matter
+#define WORKERS_PER_CPU 4
+#define MAX_WORKERS     32
+
+int nworkers;
+
+// the ticks of a measuring round, gettime_msec counts ticks
+const unsigned int round_ticks = 200;
+
+volatile unsigned int sink;
+
+// burn - spin until deadline, return how many loops were done
+int
+burn(unsigned int deadline) {
+    int count = 0, i;
+    while (gettime_msec() < deadline) {
+        for (i = 0; i < 1000; i ++) {
+            sink = sink * 1103515245 + 12345;
+        }
+        count ++;
+    }
+    return count;
+}
+
+// run_round - run nworkers CPU-bound workers with the nice values in nices for
+//   round_ticks, store the loops each one did in counts
+void
+run_round(const int *nices, int *counts) {
+    int pids[MAX_WORKERS], i;
+    unsigned int deadline = gettime_msec() + round_ticks;
+    for (i = 0; i < nworkers; i ++) {
+        if ((pids[i] = fork()) == 0) {
+            assert(nice(0, nices[i]) == 0);
+            exit(burn(deadline));
+        }
+        assert(pids[i] > 0);
+    }
+    for (i = 0; i < nworkers; i ++) {
+        assert(waitpid(pids[i], counts + i) == 0 && counts[i] > 0);
+    }
+}
+
+void
+test_fairness(void) {
+    int nices[MAX_WORKERS], counts[MAX_WORKERS], i, min, max;
+    memset(nices, 0, sizeof(nices));
+    run_round(nices, counts);
+    min = max = counts[0];
+    for (i = 1; i < nworkers; i ++) {
+        if (counts[i] < min) {
+            min = counts[i];
+        }
+        if (counts[i] > max) {
+            max = counts[i];
+        }
+    }
+    cprintf("nice 0 x %d: %d to %d loops.\n", nworkers, min, max);
+    assert(max * 2 <= min * 3);
+
+    // a nice 5 proc weighs about a third of a nice 0 one; the new procs go to
+    // the cpus in turn, so every ncpu of them alike keep each cpu mixed
+    int fast = 0, slow = 0;
+    for (i = 0; i < nworkers; i ++) {
+        nices[i] = ((i / ncpu()) % 2 == 0) ? 0 : 5;
+    }
+    run_round(nices, counts);
+    for (i = 0; i < nworkers; i ++) {
+        if (nices[i] == 0) {
+            fast += counts[i];
+        }
+        else {
+            slow += counts[i];
+        }
+    }
+    cprintf("nice 0/5 x %d: %d/%d loops, ratio %d.%02d.\n", nworkers / 2, fast, slow,
+            fast / slow, fast * 100 / slow % 100);
+    assert(fast >= slow * 2 && fast * 2 <= slow * 9);
+}
+
+// test_latency - an interactive proc sleeping a tick at a time must not wait
+//   behind the CPU-bound ones after its timer fires
+void
+test_latency(void) {
+    int pids[MAX_WORKERS], i, exit_code;
+    unsigned int deadline = gettime_msec() + round_ticks, max_delay = 0, total = 0;
+    for (i = 0; i < nworkers; i ++) {
+        if ((pids[i] = fork()) == 0) {
+            exit(burn(deadline));
+        }
+        assert(pids[i] > 0);
+    }
+    int rounds = 0;
+    while (gettime_msec() + 2 < deadline) {
+        unsigned int start = gettime_msec();
+        sleep(1);
+        unsigned int delay = gettime_msec() - start - 1;
+        total += delay, rounds ++;
+        if (delay > max_delay) {
+            max_delay = delay;
+        }
+    }
+    for (i = 0; i < nworkers; i ++) {
+        assert(waitpid(pids[i], &exit_code) == 0 && exit_code > 0);
+    }
+    cprintf("latency: %d sleeps, %d ticks late in total, %d at most.\n", rounds, total, max_delay);
+    assert(rounds > 0 && max_delay <= 2);
+}
+
+int
+main(void) {
+    assert(nice(0, -20) == 0 && nice(0, 19) == 0 && nice(0, 0) == 0);
+    assert(nice(0, 20) == -E_INVAL && nice(0, -21) == -E_INVAL);
+
+    char name[32];
+    assert(schedclass(name, sizeof(name)) == 0);
+    if (strcmp(name, "CFS_scheduler") != 0) {
+        cprintf("cfstest: sched class %s, skip the nice tests.\n", name);
+    }
+    else {
+        nworkers = ncpu() * WORKERS_PER_CPU;
+        if (nworkers > MAX_WORKERS) {
+            nworkers = MAX_WORKERS;
+        }
+        test_fairness();
+        test_latency();
+    }
+    cprintf("cfstest pass.\n");
+    return 0;
+}
+
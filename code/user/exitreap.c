@@ -0,0 +1,32 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define PGSIZE          4096
+
+const int npages = 1024, rounds = 8;
+
+int
+main(void) {
+    int i, j, pid, exit_code;
+    unsigned int total = 0;
+    for (i = 0; i < rounds; i ++) {
+        if ((pid = fork()) == 0) {
+            uintptr_t addr = 0;
+            assert(mmap(&addr, npages * PGSIZE, MMAP_WRITE) == 0 && addr != 0);
+            for (j = 0; j < npages; j ++) {
+                *(char *)(addr + j * PGSIZE) = (char)j;
+            }
+            exit(0xbeaf + i);
+        }
+        assert(pid > 0);
+        sleep(10);
+        unsigned int time = gettime_msec();
+        assert(waitpid(pid, &exit_code) == 0 && exit_code == 0xbeaf + i);
+        total += gettime_msec() - time;
+    }
+    cprintf("exitreap: %d children with %d pages, %d msecs in waitpid.\n",
+            rounds, npages, total);
+    cprintf("exitreap pass.\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <ulib.h>
+#include <thread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define PGSIZE          4096
+#define MAX_THREADS     8
+
+const int npages = 2048, rounds = 4;
+
+char *buffer;
+thread_t tids[MAX_THREADS];
+
+struct work_arg {
+    int start, end;
+} args[MAX_THREADS];
+
+int
+work(void *arg) {
+    struct work_arg *warg = (struct work_arg *)arg;
+    int i;
+    for (i = warg->start; i < warg->end; i ++) {
+        buffer[i * PGSIZE] = (char)i;
+    }
+    return 0xbee;
+}
+
+int
+run(int nthreads) {
+    uintptr_t addr = 0;
+    assert(mmap(&addr, npages * PGSIZE, MMAP_WRITE) == 0 && addr != 0);
+    buffer = (char *)addr;
+
+    int i, exit_code;
+    for (i = 0; i < nthreads; i ++) {
+        args[i].start = npages / nthreads * i;
+        args[i].end = npages / nthreads * (i + 1);
+    }
+
+    unsigned int time = gettime_msec();
+    for (i = 0; i < nthreads; i ++) {
+        assert(thread(work, args + i, tids + i) == 0);
+    }
+    for (i = 0; i < nthreads; i ++) {
+        assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0xbee);
+    }
+    time = gettime_msec() - time;
+
+    for (i = 0; i < npages; i ++) {
+        assert(buffer[i * PGSIZE] == (char)i);
+    }
+    assert(munmap(addr, npages * PGSIZE) == 0);
+    return time;
+}
+
+int
+main(void) {
+    int nthreads, i;
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        unsigned int time = 0;
+        for (i = 0; i < rounds; i ++) {
+            time += run(nthreads);
+        }
+        cprintf("faultbench: %d threads, %d faults, %d msecs.\n",
+                nthreads, npages * rounds, time);
+    }
+    cprintf("faultbench pass.\n");
+    return 0;
+}
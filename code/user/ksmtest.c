@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <ksminfo.h>
+
+#define PGSIZE          4096
+
+const int npages = 32, nkinds = 4;
+
+int
+main(void) {
+    const int size = npages * PGSIZE;
+    uintptr_t addr = 0;
+    assert(mmap(&addr, size, MMAP_WRITE) == 0 && addr != 0);
+
+    char *buffer = (char *)addr;
+    int i, j;
+    for (i = 0; i < npages; i ++) {
+        for (j = 0; j < PGSIZE; j ++) {
+            buffer[i * PGSIZE + j] = (char)((i % nkinds) * j + 1);
+        }
+    }
+
+    struct ksminfo info;
+    assert(ksminfo(&info) == 0);
+    size_t merged = info.pages_merged;
+
+    assert(madvise(addr, size, 100) != 0);
+    assert(madvise(addr, size, MADV_MERGEABLE) == 0);
+
+    cprintf("ksm step1 ok.\n");
+
+    for (i = 0; i < 100; i ++) {
+        sleep(20);
+        assert(ksminfo(&info) == 0);
+        if (info.pages_merged - merged >= npages - nkinds) {
+            break;
+        }
+    }
+    cprintf("ksm: shared %d, sharing %d, merged %d, scanned %d.\n", info.pages_shared,
+            info.pages_sharing, info.pages_merged - merged, info.pages_scanned);
+    assert(info.pages_merged - merged >= npages - nkinds);
+    assert(info.pages_shared >= nkinds && info.pages_sharing >= npages - nkinds);
+
+    cprintf("ksm step2 ok.\n");
+
+    for (i = 0; i < npages; i ++) {
+        buffer[i * PGSIZE] = (char)(- i);
+    }
+    for (i = 0; i < npages; i ++) {
+        assert(buffer[i * PGSIZE] == (char)(- i));
+        for (j = 1; j < PGSIZE; j ++) {
+            assert(buffer[i * PGSIZE + j] == (char)((i % nkinds) * j + 1));
+        }
+    }
+
+    cprintf("ksm step3 ok.\n");
+
+    assert(madvise(addr, size, MADV_UNMERGEABLE) == 0);
+    assert(munmap(addr, size) == 0);
+
+    cprintf("ksmtest pass.\n");
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <malloc.h>
 #include <lock.h>
 #include <unistd.h>
+#include <string.h>
 
 // A thread-awared memory allocator based on  the 
 // memory allocatorby Kernighan and Ritchie,
@@ -16,13 +17,18 @@ union header {
     struct {
         union header *ptr;
         size_t size;
-        bool type;          // 0: normal, sys_brk; 1: shared memory, shmem
+        int type;           // 0: normal, sys_brk; 1: shared memory, shmem; 2: large block, mmap
     } s;
     uint32_t align[16];
 };
 
 typedef union header header_t;
 
+#define MALLOC_TYPE_MMAP        2
+
+// the blocks larger than this are mmaped alone, and resized by mremap in realloc
+#define MMAP_THRESHOLD          (128 * 1024)
+
 static header_t base;
 static header_t *freep = NULL;
 
@@ -76,6 +82,32 @@ morecore_shmem_locked(size_t nu) {
     return 1;
 }
 
+static void *
+malloc_mmap(size_t size) {
+    size_t len = ((size + sizeof(header_t) + 0xfff) & (~0xfff));
+    uintptr_t mem = 0;
+    if (len < size || sys_mmap(&mem, len, MMAP_WRITE) != 0 || mem == 0) {
+        return NULL;
+    }
+    header_t *p = (void *)mem;
+    p->s.ptr = NULL;
+    p->s.size = len / sizeof(header_t);
+    p->s.type = MALLOC_TYPE_MMAP;
+    return (void *)(p + 1);
+}
+
+static void *
+realloc_mmap(header_t *bp, size_t size) {
+    size_t len = ((size + sizeof(header_t) + 0xfff) & (~0xfff));
+    uintptr_t mem = (uintptr_t)bp;
+    if (len < size || sys_mremap(&mem, bp->s.size * sizeof(header_t), len, MREMAP_MAYMOVE) != 0) {
+        return NULL;
+    }
+    header_t *p = (void *)mem;
+    p->s.size = len / sizeof(header_t);
+    return (void *)(p + 1);
+}
+
 static void *
 malloc_locked(size_t size, bool type) {
     static_assert(sizeof(header_t) == 0x40);
@@ -149,6 +181,9 @@ free_locked(void *ap) {
 
 void *
 malloc(size_t size) {
+    if (size >= MMAP_THRESHOLD) {
+        return malloc_mmap(size);
+    }
     void *ret;
     lock_malloc();
     ret = malloc_locked(size, 0);
@@ -167,8 +202,38 @@ shmem_malloc(size_t size) {
 
 void
 free(void *ap) {
+    header_t *bp = ((header_t *)ap) - 1;
+    if (bp->s.type == MALLOC_TYPE_MMAP) {
+        sys_munmap((uintptr_t)bp, bp->s.size * sizeof(header_t));
+        return ;
+    }
     lock_malloc();
     free_locked(ap);
     unlock_malloc();
 }
 
+void *
+realloc(void *ap, size_t size) {
+    if (ap == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ap);
+        return NULL;
+    }
+    header_t *bp = ((header_t *)ap) - 1;
+    if (bp->s.type == MALLOC_TYPE_MMAP) {
+        return realloc_mmap(bp, size);
+    }
+    size_t oldsize = (bp->s.size - 1) * sizeof(header_t);
+    if (size <= oldsize) {
+        return ap;
+    }
+    void *np = (bp->s.type == 0) ? malloc(size) : shmem_malloc(size);
+    if (np != NULL) {
+        memcpy(np, ap, oldsize);
+        free(ap);
+    }
+    return np;
+}
+
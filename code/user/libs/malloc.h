@@ -6,6 +6,7 @@
 void *malloc(size_t size);
 void *shmem_malloc(size_t size);
 void free(void *ap);
+void *realloc(void *ap, size_t size);
 
 #endif /* !__USER_LIBS_MALLOC_H__ */
 
@@ -60,8 +60,8 @@ sys_yield(void) {
 }
 
 int
-sys_sleep(unsigned int time) {
-    return syscall(SYS_sleep, time);
+sys_sleep(unsigned int time, int unit) {
+    return syscall(SYS_sleep, time, unit);
 }
 
 int
@@ -94,11 +94,46 @@ sys_munmap(uintptr_t addr, size_t len) {
     return syscall(SYS_munmap, addr, len);
 }
 
+int
+sys_mremap(uintptr_t *addr_store, size_t old_len, size_t new_len, uint32_t flags) {
+    return syscall(SYS_mremap, addr_store, old_len, new_len, flags);
+}
+
 int
 sys_shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags) {
     return syscall(SYS_shmem, addr_store, len, mmap_flags);
 }
 
+int
+sys_madvise(uintptr_t addr, size_t len, int advice) {
+    return syscall(SYS_madvise, addr, len, advice);
+}
+
+int
+sys_mlock(uintptr_t addr, size_t len) {
+    return syscall(SYS_mlock, addr, len);
+}
+
+int
+sys_munlock(uintptr_t addr, size_t len) {
+    return syscall(SYS_munlock, addr, len);
+}
+
+int
+sys_mlockall(int flags) {
+    return syscall(SYS_mlockall, flags);
+}
+
+int
+sys_munlockall(void) {
+    return syscall(SYS_munlockall);
+}
+
+int
+sys_mlocklimit(size_t limit) {
+    return syscall(SYS_mlocklimit, limit);
+}
+
 int
 sys_putc(int c) {
     return syscall(SYS_putc, c);
@@ -109,6 +144,61 @@ sys_pgdir(void) {
     return syscall(SYS_pgdir);
 }
 
+int
+sys_ptcount(void) {
+    return syscall(SYS_ptcount);
+}
+
+int
+sys_ncpu(void) {
+    return syscall(SYS_ncpu);
+}
+
+int
+sys_ksminfo(struct ksminfo *info) {
+    return syscall(SYS_ksminfo, info);
+}
+
+int
+sys_swapon(int ideno, int prio) {
+    return syscall(SYS_swapon, ideno, prio);
+}
+
+int
+sys_swapoff(int ideno) {
+    return syscall(SYS_swapoff, ideno);
+}
+
+int
+sys_oomadj(int pid, int adj) {
+    return syscall(SYS_oomadj, pid, adj);
+}
+
+int
+sys_memgroup(int cmd, int id, uintptr_t arg) {
+    return syscall(SYS_memgroup, cmd, id, arg);
+}
+
+int
+sys_getrusage(int pid, struct rusage *usage) {
+    return syscall(SYS_getrusage, pid, usage);
+}
+
+int
+sys_nice(int pid, int nice) {
+    return syscall(SYS_nice, pid, nice);
+}
+
+int
+sys_schedclass(char *name, size_t len) {
+    return syscall(SYS_schedclass, name, len);
+}
+
+int
+sys_uffd(int cmd, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2) {
+    return syscall(SYS_uffd, cmd, arg0, arg1, arg2);
+}
+
 sem_t
 sys_sem_init(int value) {
     return syscall(SYS_sem_init, value);
@@ -120,8 +210,8 @@ sys_sem_post(sem_t sem_id) {
 }
 
 int
-sys_sem_wait(sem_t sem_id, unsigned int timeout) {
-    return syscall(SYS_sem_wait, sem_id, timeout);
+sys_sem_wait(sem_t sem_id, unsigned int timeout, int unit) {
+    return syscall(SYS_sem_wait, sem_id, timeout, unit);
 }
 
 int
@@ -135,13 +225,13 @@ sys_sem_get_value(sem_t sem_id, int *value_store) {
 }
 
 int
-sys_send_event(int pid, int event, unsigned int timeout) {
-    return syscall(SYS_event_send, pid, event, timeout);
+sys_send_event(int pid, int event, unsigned int timeout, int unit) {
+    return syscall(SYS_event_send, pid, event, timeout, unit);
 }
 
 int
-sys_recv_event(int *pid_store, int *event_store, unsigned int timeout) {
-    return syscall(SYS_event_recv, pid_store, event_store, timeout);
+sys_recv_event(int *pid_store, int *event_store, unsigned int timeout, int unit) {
+    return syscall(SYS_event_recv, pid_store, event_store, timeout, unit);
 }
 
 int
@@ -150,13 +240,13 @@ sys_mbox_init(unsigned int max_slots) {
 }
 
 int
-sys_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout) {
-    return syscall(SYS_mbox_send, id, buf, timeout);
+sys_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout, int unit) {
+    return syscall(SYS_mbox_send, id, buf, timeout, unit);
 }
 
 int
-sys_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout) {
-    return syscall(SYS_mbox_recv, id, buf, timeout);
+sys_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout, int unit) {
+    return syscall(SYS_mbox_recv, id, buf, timeout, unit);
 }
 
 int
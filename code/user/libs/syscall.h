@@ -8,30 +8,50 @@ int sys_fork(void);
 int sys_wait(int pid, int *store);
 int sys_exec(const char *name, int argc, const char **argv);
 int sys_yield(void);
-int sys_sleep(unsigned int time);
+int sys_sleep(unsigned int time, int unit);
 int sys_kill(int pid);
 size_t sys_gettime(void);
 int sys_getpid(void);
 int sys_brk(uintptr_t *brk_store);
 int sys_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags);
 int sys_munmap(uintptr_t addr, size_t len);
+int sys_mremap(uintptr_t *addr_store, size_t old_len, size_t new_len, uint32_t flags);
 int sys_shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags);
+int sys_madvise(uintptr_t addr, size_t len, int advice);
+int sys_mlock(uintptr_t addr, size_t len);
+int sys_munlock(uintptr_t addr, size_t len);
+int sys_mlockall(int flags);
+int sys_munlockall(void);
+int sys_mlocklimit(size_t limit);
 int sys_putc(int c);
 int sys_pgdir(void);
+int sys_ptcount(void);
+int sys_ncpu(void);
+struct ksminfo;
+int sys_ksminfo(struct ksminfo *info);
+int sys_uffd(int cmd, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2);
+int sys_swapon(int ideno, int prio);
+int sys_swapoff(int ideno);
+int sys_oomadj(int pid, int adj);
+int sys_memgroup(int cmd, int id, uintptr_t arg);
+struct rusage;
+int sys_getrusage(int pid, struct rusage *usage);
+int sys_nice(int pid, int nice);
+int sys_schedclass(char *name, size_t len);
 sem_t sys_sem_init(int value);
 int sys_sem_post(sem_t sem_id);
-int sys_sem_wait(sem_t sem_id, unsigned int timeout);
+int sys_sem_wait(sem_t sem_id, unsigned int timeout, int unit);
 int sys_sem_free(sem_t sem_id);
 int sys_sem_get_value(sem_t sem_id, int *value_store);
-int sys_send_event(int pid, int event, unsigned int timeout);
-int sys_recv_event(int *pid_store, int *event_store, unsigned int timeout);
+int sys_send_event(int pid, int event, unsigned int timeout, int unit);
+int sys_recv_event(int *pid_store, int *event_store, unsigned int timeout, int unit);
 
 struct mboxbuf;
 struct mboxinfo;
 
 int sys_mbox_init(unsigned int max_slots);
-int sys_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout);
-int sys_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout);
+int sys_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout, int unit);
+int sys_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout, int unit);
 int sys_mbox_free(int id);
 int sys_mbox_info(int id, struct mboxinfo *info);
 
@@ -5,6 +5,7 @@
 #include <ulib.h>
 #include <stat.h>
 #include <lock.h>
+#include <unistd.h>
 
 static lock_t fork_lock = INIT_LOCK;
 
@@ -51,7 +52,12 @@ yield(void) {
 
 int
 sleep(unsigned int time) {
-    return sys_sleep(time);
+    return sys_sleep(time, TIMEOUT_TICKS);
+}
+
+int
+usleep(unsigned int usec) {
+    return sys_sleep(usec, TIMEOUT_USEC);
 }
 
 int
@@ -75,6 +81,18 @@ print_pgdir(void) {
     sys_pgdir();
 }
 
+//ptcount - the number of page table pages in use
+int
+ptcount(void) {
+    return sys_ptcount();
+}
+
+//ncpu - the number of cpus running
+int
+ncpu(void) {
+    return sys_ncpu();
+}
+
 int
 mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags) {
     return sys_mmap(addr_store, len, mmap_flags);
@@ -85,11 +103,123 @@ munmap(uintptr_t addr, size_t len) {
     return sys_munmap(addr, len);
 }
 
+int
+mremap(uintptr_t *addr_store, size_t old_len, size_t new_len, uint32_t flags) {
+    return sys_mremap(addr_store, old_len, new_len, flags);
+}
+
 int
 shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags) {
     return sys_shmem(addr_store, len, mmap_flags);
 }
 
+int
+madvise(uintptr_t addr, size_t len, int advice) {
+    return sys_madvise(addr, len, advice);
+}
+
+int
+mlock(uintptr_t addr, size_t len) {
+    return sys_mlock(addr, len);
+}
+
+int
+munlock(uintptr_t addr, size_t len) {
+    return sys_munlock(addr, len);
+}
+
+int
+mlockall(int flags) {
+    return sys_mlockall(flags);
+}
+
+int
+munlockall(void) {
+    return sys_munlockall();
+}
+
+//mlocklimit - set the max number of locked pages if limit isn't 0, return the limit in effect
+int
+mlocklimit(size_t limit) {
+    return sys_mlocklimit(limit);
+}
+
+int
+ksminfo(struct ksminfo *info) {
+    return sys_ksminfo(info);
+}
+
+int
+uffd_register(uintptr_t addr, size_t len, int handler) {
+    return sys_uffd(UFFD_REGISTER, addr, len, handler);
+}
+
+int
+uffd_unregister(uintptr_t addr, size_t len) {
+    return sys_uffd(UFFD_UNREGISTER, addr, len, 0);
+}
+
+int
+uffd_copy(uintptr_t dst, uintptr_t src, size_t len) {
+    return sys_uffd(UFFD_COPY, dst, src, len);
+}
+
+int
+swapon(int ideno, int prio) {
+    return sys_swapon(ideno, prio);
+}
+
+int
+swapoff(int ideno) {
+    return sys_swapoff(ideno);
+}
+
+int
+oomadj(int pid, int adj) {
+    return sys_oomadj(pid, adj);
+}
+
+int
+memgroup_create(size_t limit) {
+    return sys_memgroup(MEMGROUP_CREATE, 0, limit);
+}
+
+int
+memgroup_limit(int id, size_t limit) {
+    return sys_memgroup(MEMGROUP_LIMIT, id, limit);
+}
+
+int
+memgroup_attach(int id, int pid) {
+    return sys_memgroup(MEMGROUP_ATTACH, id, pid);
+}
+
+int
+memgroup_info(int id, struct memgroupinfo *info) {
+    return sys_memgroup(MEMGROUP_INFO, id, (uintptr_t)info);
+}
+
+int
+memgroup_destroy(int id) {
+    return sys_memgroup(MEMGROUP_DESTROY, id, 0);
+}
+
+int
+getrusage(int pid, struct rusage *usage) {
+    return sys_getrusage(pid, usage);
+}
+
+int
+nice(int pid, int value) {
+    return sys_nice(pid, value);
+}
+
+//schedclass - store the name of the kernel's scheduling class in name
+int
+schedclass(char *name, size_t len) {
+    return sys_schedclass(name, len);
+}
+
 sem_t
 sem_init(int value) {
     return sys_sem_init(value);
@@ -102,12 +232,17 @@ sem_post(sem_t sem_id) {
 
 int
 sem_wait(sem_t sem_id) {
-    return sys_sem_wait(sem_id, 0);
+    return sys_sem_wait(sem_id, 0, TIMEOUT_TICKS);
 }
 
 int
 sem_wait_timeout(sem_t sem_id, unsigned int timeout) {
-    return sys_sem_wait(sem_id, timeout);
+    return sys_sem_wait(sem_id, timeout, TIMEOUT_TICKS);
+}
+
+int
+sem_wait_timeout_usec(sem_t sem_id, unsigned int usec) {
+    return sys_sem_wait(sem_id, usec, TIMEOUT_USEC);
 }
 
 int
@@ -122,22 +257,32 @@ sem_get_value(sem_t sem_id, int *value_store) {
 
 int
 send_event(int pid, int event) {
-    return sys_send_event(pid, event, 0);
+    return sys_send_event(pid, event, 0, TIMEOUT_TICKS);
 }
 
 int
 send_event_timeout(int pid, int event, unsigned int timeout) {
-    return sys_send_event(pid, event, timeout);
+    return sys_send_event(pid, event, timeout, TIMEOUT_TICKS);
+}
+
+int
+send_event_timeout_usec(int pid, int event, unsigned int usec) {
+    return sys_send_event(pid, event, usec, TIMEOUT_USEC);
 }
 
 int
 recv_event(int *pid_store, int *event_store) {
-    return sys_recv_event(pid_store, event_store, 0);
+    return sys_recv_event(pid_store, event_store, 0, TIMEOUT_TICKS);
 }
 
 int
 recv_event_timeout(int *pid_store, int *event_store, unsigned int timeout) {
-    return sys_recv_event(pid_store, event_store, timeout);
+    return sys_recv_event(pid_store, event_store, timeout, TIMEOUT_TICKS);
+}
+
+int
+recv_event_timeout_usec(int *pid_store, int *event_store, unsigned int usec) {
+    return sys_recv_event(pid_store, event_store, usec, TIMEOUT_USEC);
 }
 
 int
@@ -147,22 +292,32 @@ mbox_init(unsigned int max_slots) {
 
 int
 mbox_send(int id, struct mboxbuf *buf) {
-    return sys_mbox_send(id, buf, 0);
+    return sys_mbox_send(id, buf, 0, TIMEOUT_TICKS);
 }
 
 int
 mbox_send_timeout(int id, struct mboxbuf *buf, unsigned int timeout) {
-    return sys_mbox_send(id, buf, timeout);
+    return sys_mbox_send(id, buf, timeout, TIMEOUT_TICKS);
+}
+
+int
+mbox_send_timeout_usec(int id, struct mboxbuf *buf, unsigned int usec) {
+    return sys_mbox_send(id, buf, usec, TIMEOUT_USEC);
 }
 
 int
 mbox_recv(int id, struct mboxbuf *buf) {
-    return sys_mbox_recv(id, buf, 0);
+    return sys_mbox_recv(id, buf, 0, TIMEOUT_TICKS);
 }
 
 int
 mbox_recv_timeout(int id, struct mboxbuf *buf, unsigned int timeout) {
-    return sys_mbox_recv(id, buf, timeout);
+    return sys_mbox_recv(id, buf, timeout, TIMEOUT_TICKS);
+}
+
+int
+mbox_recv_timeout_usec(int id, struct mboxbuf *buf, unsigned int usec) {
+    return sys_mbox_recv(id, buf, usec, TIMEOUT_USEC);
 }
 
 int
@@ -32,24 +32,56 @@ int wait(void);
 int waitpid(int pid, int *store);
 void yield(void);
 int sleep(unsigned int time);
+int usleep(unsigned int usec);
 int kill(int pid);
 unsigned int gettime_msec(void);
 int getpid(void);
 void print_pgdir(void);
+int ptcount(void);
+int ncpu(void);
 int mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags);
 int munmap(uintptr_t addr, size_t len);
+int mremap(uintptr_t *addr_store, size_t old_len, size_t new_len, uint32_t flags);
 int shmem(uintptr_t *addr_store, size_t len, uint32_t mmap_flags);
+int madvise(uintptr_t addr, size_t len, int advice);
+int mlock(uintptr_t addr, size_t len);
+int munlock(uintptr_t addr, size_t len);
+int mlockall(int flags);
+int munlockall(void);
+int mlocklimit(size_t limit);
+struct ksminfo;
+int ksminfo(struct ksminfo *info);
+int uffd_register(uintptr_t addr, size_t len, int handler);
+int uffd_unregister(uintptr_t addr, size_t len);
+int uffd_copy(uintptr_t dst, uintptr_t src, size_t len);
+int swapon(int ideno, int prio);
+int swapoff(int ideno);
+int oomadj(int pid, int adj);
+struct memgroupinfo;
+int memgroup_create(size_t limit);
+int memgroup_limit(int id, size_t limit);
+int memgroup_attach(int id, int pid);
+int memgroup_info(int id, struct memgroupinfo *info);
+int memgroup_destroy(int id);
+struct rusage;
+int getrusage(int pid, struct rusage *usage);
+int nice(int pid, int value);
+int schedclass(char *name, size_t len);
 int clone(uint32_t clone_flags, uintptr_t stack, int (*fn)(void *), void *arg);
+// the timeouts below are in ticks, in usecs for the *_usec ones
 sem_t sem_init(int value);
 int sem_post(sem_t sem_id);
 int sem_wait(sem_t sem_id);
 int sem_wait_timeout(sem_t sem_id, unsigned int timeout);
+int sem_wait_timeout_usec(sem_t sem_id, unsigned int usec);
 int sem_free(sem_t sem_id);
 int sem_get_value(sem_t sem_id, int *value_store);
 int send_event(int pid, int event);
 int send_event_timeout(int pid, int event, unsigned int timeout);
+int send_event_timeout_usec(int pid, int event, unsigned int usec);
 int recv_event(int *pid_store, int *event_store);
 int recv_event_timeout(int *pid_store, int *event_store, unsigned int timeout);
+int recv_event_timeout_usec(int *pid_store, int *event_store, unsigned int usec);
 
 struct mboxbuf;
 struct mboxinfo;
@@ -57,8 +89,10 @@ struct mboxinfo;
 int mbox_init(unsigned int max_slots);
 int mbox_send(int id, struct mboxbuf *buf);
 int mbox_send_timeout(int id, struct mboxbuf *buf, unsigned int timeout);
+int mbox_send_timeout_usec(int id, struct mboxbuf *buf, unsigned int usec);
 int mbox_recv(int id, struct mboxbuf *buf);
 int mbox_recv_timeout(int id, struct mboxbuf *buf, unsigned int timeout);
+int mbox_recv_timeout_usec(int id, struct mboxbuf *buf, unsigned int usec);
 int mbox_free(int id);
 int mbox_info(int id, struct mboxinfo *info);
 
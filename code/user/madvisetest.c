@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+
+#define PGSIZE          4096
+
+int
+main(void) {
+    const int npages = 16, size = npages * PGSIZE;
+
+    uintptr_t addr = 0;
+    assert(mmap(&addr, size, MMAP_WRITE) == 0 && addr != 0);
+
+    assert(madvise(addr, size, 100) != 0);
+    assert(madvise(addr + size, PGSIZE, MADV_NORMAL) != 0);
+    assert(madvise(addr, size + PGSIZE, MADV_NORMAL) != 0);
+
+    cprintf("madvise step1 ok.\n");
+
+    char *buffer = (char *)addr;
+    int i;
+    for (i = 0; i < size; i ++) {
+        buffer[i] = (char)(i * i);
+    }
+
+    assert(madvise(addr, size, MADV_SEQUENTIAL) == 0);
+    assert(madvise(addr + PGSIZE, PGSIZE * 2, MADV_RANDOM) == 0);
+    assert(madvise(addr + PGSIZE * 4, PGSIZE, MADV_NORMAL) == 0);
+    assert(madvise(addr, size, MADV_WILLNEED) == 0);
+
+    for (i = 0; i < size; i ++) {
+        assert(buffer[i] == (char)(i * i));
+    }
+
+    cprintf("madvise step2 ok.\n");
+
+    assert(madvise(addr + PGSIZE, PGSIZE * 2, MADV_DONTNEED) == 0);
+    for (i = 0; i < size; i ++) {
+        if (i >= PGSIZE && i < PGSIZE * 3) {
+            assert(buffer[i] == 0);
+        }
+        else {
+            assert(buffer[i] == (char)(i * i));
+        }
+    }
+
+    cprintf("madvise step3 ok.\n");
+
+    assert(munmap(addr, size) == 0);
+
+    cprintf("madvisetest pass.\n");
+    return 0;
+}
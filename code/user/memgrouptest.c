@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <error.h>
+#include <string.h>
+#include <malloc.h>
+#include <memgroupinfo.h>
+
+#define LIMIT           256     // 1MB
+#define PGSIZE          4096
+#define SLACK           16      // the pages charged before the group is shrunk
+
+const int size = 4 * 1024 * 1024;
+
+int
+child(int id) {
+    assert(memgroup_attach(id, 0) == 0);
+
+    char *buffer = malloc(size);
+    assert(buffer != NULL);
+    int i, round;
+    for (round = 0; round < 2; round ++) {
+        for (i = 0; i < size; i ++) {
+            buffer[i] = (char)(i * 7 + round);
+        }
+        for (i = 0; i < size; i ++) {
+            assert(buffer[i] == (char)(i * 7 + round));
+        }
+    }
+
+    struct memgroupinfo info;
+    assert(memgroup_info(id, &info) == 0);
+    cprintf("child: usage %d pages, max %d, %d limit hits.\n",
+            info.usage, info.max_usage, info.nr_limit_hits);
+    assert(info.usage <= LIMIT + SLACK && info.max_usage <= LIMIT + SLACK);
+    assert(info.nr_limit_hits > 0 && info.nr_failed == 0);
+    free(buffer);
+    return 0;
+}
+
+int
+main(void) {
+    struct memgroupinfo info;
+    assert(memgroup_info(0, &info) == -E_INVAL);
+    assert(memgroup_attach(100, 0) == -E_INVAL);
+
+    int id = memgroup_create(LIMIT);
+    assert(id > 0);
+    assert(memgroup_attach(id, -1) == -E_INVAL);
+    assert(memgroup_info(id, &info) == 0);
+    assert(info.limit == LIMIT && info.usage == 0);
+
+    int pid, exit_code;
+    if ((pid = fork()) == 0) {
+        exit(child(id));
+    }
+    assert(pid > 0);
+    assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+
+    // the parent is not in the group, it isn't limited
+    char *buffer = malloc(size);
+    assert(buffer != NULL);
+    memset(buffer, 0x5a, size);
+    assert(memgroup_info(id, &info) == 0);
+    assert(info.usage <= LIMIT + SLACK);
+    free(buffer);
+
+    assert(memgroup_limit(id, 0) == 0);
+    assert(memgroup_info(id, &info) == 0 && info.limit == 0);
+
+    // a group is destroyed only when it is empty, then its id is free again
+    int id2 = memgroup_create(LIMIT);
+    assert(id2 > 0 && id2 != id);
+    assert(memgroup_attach(id2, 0) == 0);
+    buffer = malloc(PGSIZE * 4);
+    assert(buffer != NULL);
+    memset(buffer, 0x5a, PGSIZE * 4);
+    assert(memgroup_info(id2, &info) == 0 && info.usage != 0);
+    assert(memgroup_destroy(id2) == -E_BUSY);
+    assert(memgroup_attach(0, 0) == 0);
+    assert(memgroup_info(id2, &info) == 0 && info.usage == 0);
+    assert(memgroup_destroy(id2) == 0);
+    assert(memgroup_info(id2, &info) == -E_INVAL);
+    assert(memgroup_destroy(id2) == -E_INVAL);
+    assert(memgroup_create(LIMIT) == id2 && memgroup_destroy(id2) == 0);
+    free(buffer);
+    cprintf("memgrouptest pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+
+#define PGSIZE          4096
+
+int
+main(void) {
+    const int npages = 16, size = npages * PGSIZE;
+
+    uintptr_t addr = 0;
+    assert(mmap(&addr, size, MMAP_WRITE) == 0 && addr != 0);
+
+    assert(mlock(addr + size, PGSIZE) != 0);
+    assert(mlock(addr, size) == 0);
+    assert(mlock(addr, PGSIZE) == 0);
+
+    char *buffer = (char *)addr;
+    int i, pid, exit_code;
+    for (i = 0; i < size; i ++) {
+        buffer[i] = (char)(i * i);
+    }
+    assert(madvise(addr, size, MADV_DONTNEED) != 0);
+
+    cprintf("mlock step1 ok.\n");
+
+    // the limit of the locked pages, 1/8 of the memory by default
+    int limit = mlocklimit(0);
+    cprintf("mlock limit %d pages.\n", limit);
+    assert(limit >= npages && mlocklimit(0x7FFFFFFF) < 0);
+
+    uintptr_t big = 0;
+    const int bigsize = (limit + 1) * PGSIZE;
+    assert(mmap(&big, bigsize, MMAP_WRITE) == 0 && big != 0);
+    assert(mlock(big, bigsize) != 0);
+
+    // the pages locked already count against a lower limit, inherited by a child
+    assert(mlocklimit(npages + 8) == npages + 8);
+    assert(mlock(big, 9 * PGSIZE) != 0);
+    assert(mlock(big, 8 * PGSIZE) == 0);
+    if ((pid = fork()) == 0) {
+        assert(mlocklimit(0) == npages + 8);
+        exit(0xbeaf);
+    }
+    assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0xbeaf);
+    assert(munlock(big, 8 * PGSIZE) == 0);
+    assert(mlocklimit(limit) == limit);
+    assert(munmap(big, bigsize) == 0);
+
+    cprintf("mlock step2 ok.\n");
+
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < size; i ++) {
+            assert(buffer[i] == (char)(i * i));
+        }
+        assert(madvise(addr, size, MADV_DONTNEED) == 0);
+        for (i = 0; i < size; i ++) {
+            assert(buffer[i] == 0);
+        }
+        exit(0xbeaf);
+    }
+    assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0xbeaf);
+    for (i = 0; i < size; i ++) {
+        assert(buffer[i] == (char)(i * i));
+    }
+
+    cprintf("mlock step3 ok.\n");
+
+    assert(munlock(addr, size) == 0);
+    assert(madvise(addr, PGSIZE, MADV_DONTNEED) == 0);
+
+    assert(mlockall(0) != 0);
+    assert(mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+
+    uintptr_t addr2 = 0;
+    assert(mmap(&addr2, PGSIZE, MMAP_WRITE) == 0 && addr2 != 0);
+    assert(madvise(addr2, PGSIZE, MADV_DONTNEED) != 0);
+    assert(munlockall() == 0);
+    assert(madvise(addr2, PGSIZE, MADV_DONTNEED) == 0);
+
+    cprintf("mlock step4 ok.\n");
+
+    assert(munmap(addr, size) == 0 && munmap(addr2, PGSIZE) == 0);
+
+    cprintf("mlocktest pass.\n");
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#define PGSIZE          4096
+
+static void
+fill(char *buffer, int size) {
+    int i;
+    for (i = 0; i < size; i ++) {
+        buffer[i] = (char)(i * i);
+    }
+}
+
+static void
+check(char *buffer, int size) {
+    int i;
+    for (i = 0; i < size; i ++) {
+        assert(buffer[i] == (char)(i * i));
+    }
+}
+
+int
+main(void) {
+    uintptr_t addr = 0x80000000, blocker = 0x80008000, naddr;
+    assert(mmap(&addr, PGSIZE * 4, MMAP_WRITE) == 0);
+    fill((char *)addr, PGSIZE * 4);
+
+    naddr = addr;
+    assert(mremap(&naddr, PGSIZE * 4, PGSIZE * 8, 0) == 0 && naddr == addr);
+    check((char *)addr, PGSIZE * 4);
+    fill((char *)addr, PGSIZE * 8);
+
+    cprintf("mremap step1 ok.\n");
+
+    assert(mmap(&blocker, PGSIZE, MMAP_WRITE) == 0);
+    naddr = addr;
+    assert(mremap(&naddr, PGSIZE * 8, PGSIZE * 16, 0) != 0);
+    assert(mremap(&naddr, PGSIZE * 8, PGSIZE * 16, MREMAP_MAYMOVE) == 0 && naddr != addr);
+    check((char *)naddr, PGSIZE * 8);
+    fill((char *)naddr, PGSIZE * 16);
+    addr = naddr;
+
+    cprintf("mremap step2 ok.\n");
+
+    int pid, exit_code;
+    if ((pid = fork()) == 0) {
+        check((char *)addr, PGSIZE * 16);
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+
+    assert(mremap(&naddr, PGSIZE * 16, PGSIZE * 2, 0) == 0 && naddr == addr);
+    check((char *)addr, PGSIZE * 2);
+    assert(munmap(addr, PGSIZE * 2) == 0 && munmap(blocker, PGSIZE) == 0);
+
+    cprintf("mremap step3 ok.\n");
+
+    // the address is stored back into the range just unmapped or moved
+    uintptr_t *store;
+    addr = 0x90000000;
+    assert(mmap(&addr, PGSIZE * 4, MMAP_WRITE) == 0);
+    fill((char *)addr, PGSIZE * 3);
+    store = (uintptr_t *)(addr + PGSIZE * 3);
+    *store = addr;
+    assert(mremap(store, PGSIZE * 4, PGSIZE, 0) != 0);
+    check((char *)addr, PGSIZE);
+
+    blocker = addr + PGSIZE * 2;
+    assert(mmap(&blocker, PGSIZE, MMAP_WRITE) == 0);
+    naddr = addr;
+    assert(mremap(&naddr, PGSIZE, PGSIZE * 2, 0) == 0 && naddr == addr);
+    store = (uintptr_t *)(addr + PGSIZE);
+    *store = addr;
+    assert(mremap(store, PGSIZE * 2, PGSIZE * 8, MREMAP_MAYMOVE) != 0);
+    assert(munmap(blocker, PGSIZE) == 0);
+
+    cprintf("mremap step4 ok.\n");
+
+    char *buffer;
+    assert((buffer = malloc(200 * 1024)) != NULL);
+    fill(buffer, 200 * 1024);
+    assert((buffer = realloc(buffer, 1024 * 1024)) != NULL);
+    check(buffer, 200 * 1024);
+    fill(buffer, 1024 * 1024);
+    assert((buffer = realloc(buffer, 300 * 1024)) != NULL);
+    check(buffer, 300 * 1024);
+    free(buffer);
+
+    cprintf("mremaptest pass.\n");
+    return 0;
+}
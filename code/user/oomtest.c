@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <error.h>
+#include <string.h>
+#include <malloc.h>
+
+// the IDE devices of kern/fs/fs.h
+#define SWAP_DEV_NO     1
+#define SWAP1_DEV_NO    3
+
+#define CHUNK           (1024 * 1024)
+#define PGSIZE          4096
+
+// hog - take memory until the OOM killer comes
+void
+hog(void) {
+    assert(oomadj(0, 500) == 0);
+    size_t total = 0;
+    while (1) {
+        char *p = malloc(CHUNK);
+        if (p == NULL) {
+            cprintf("hog: malloc failed after %d MB.\n", total / CHUNK);
+            exit(-1);
+        }
+        int i;
+        for (i = 0; i < CHUNK; i += PGSIZE) {
+            p[i] = (char)i;
+        }
+        total += CHUNK;
+    }
+}
+
+int
+main(void) {
+    assert(oomadj(0, 1001) == -E_INVAL);
+    assert(oomadj(0, -1001) == -E_INVAL);
+    assert(oomadj(-1, 0) == -E_INVAL);
+
+    // without swap the memory runs out quickly
+    bool swap1 = (swapoff(SWAP1_DEV_NO) == 0);
+    assert(swapoff(SWAP_DEV_NO) == 0);
+
+    int pid, exit_code;
+    if ((pid = fork()) == 0) {
+        hog();
+    }
+    assert(pid > 0);
+    assert(waitpid(pid, &exit_code) == 0 && exit_code == -E_KILLED);
+    cprintf("hog killed by the OOM killer.\n");
+
+    // the memory is back
+    char *p = malloc(CHUNK);
+    assert(p != NULL);
+    memset(p, 0x5a, CHUNK);
+    free(p);
+
+    assert(swapon(SWAP_DEV_NO, 0) == 0);
+    if (swap1) {
+        assert(swapon(SWAP1_DEV_NO, 0) == 0);
+    }
+    cprintf("oomtest pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+
+#define PGSIZE          4096
+#define PTSIZE          (PGSIZE * 1024)
+#define NREGIONS        8
+
+int
+main(void) {
+    const int size = PTSIZE * 2;
+    uintptr_t addrs[NREGIONS];
+    int i, base = ptcount();
+    assert(base > 0);
+
+    // the page table covering addr + PTSIZE lies inside the region
+    for (i = 0; i < NREGIONS; i ++) {
+        addrs[i] = 0;
+        assert(mmap(&addrs[i], size, MMAP_WRITE) == 0 && addrs[i] != 0);
+        *(char *)(addrs[i]) = (char)i;
+        *(char *)(addrs[i] + PTSIZE) = (char)i;
+        *(char *)(addrs[i] + PTSIZE + PGSIZE) = (char)i;
+    }
+    int used = ptcount();
+    assert(used >= base + NREGIONS);
+
+    cprintf("ptreclaim step1 ok: %d -> %d page tables.\n", base, used);
+
+    // a page table that still maps something must survive
+    for (i = 0; i < NREGIONS; i ++) {
+        assert(munmap(addrs[i] + PTSIZE + PGSIZE, PGSIZE) == 0);
+    }
+    assert(ptcount() == used);
+    for (i = 0; i < NREGIONS; i ++) {
+        assert(*(char *)(addrs[i] + PTSIZE) == (char)i);
+    }
+
+    cprintf("ptreclaim step2 ok.\n");
+
+    for (i = 0; i < NREGIONS; i ++) {
+        assert(munmap(addrs[i], size) == 0);
+    }
+    assert(ptcount() == base);
+
+    cprintf("ptreclaim step3 ok.\n");
+
+    // page tables come back on demand after being reclaimed
+    uintptr_t addr = 0;
+    assert(mmap(&addr, size, MMAP_WRITE) == 0 && addr != 0);
+    *(char *)(addr + PTSIZE) = (char)0x5A;
+    assert(ptcount() == base + 1 && *(char *)(addr + PTSIZE) == (char)0x5A);
+    assert(munmap(addr, size) == 0 && ptcount() == base);
+
+    cprintf("ptreclaimtest pass.\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <error.h>
+#include <malloc.h>
+#include <rusage.h>
+
+#define PGSIZE          4096
+#define NPAGES          512     // 2MB
+#define LIMIT           128     // the memory group pushing the pages to swap
+
+void
+touch(char *buffer, int round) {
+    int i;
+    for (i = 0; i < NPAGES; i ++) {
+        buffer[i * PGSIZE] = (char)(i + round);
+    }
+}
+
+void
+check(char *buffer, int round) {
+    int i;
+    for (i = 0; i < NPAGES; i ++) {
+        assert(buffer[i * PGSIZE] == (char)(i + round));
+    }
+}
+
+int
+main(void) {
+    struct rusage u0, u1;
+    assert(getrusage(-1, &u0) == -E_INVAL);
+    assert(getrusage(0, &u0) == 0);
+    assert(u0.ru_rss > 0 && u0.ru_maxrss >= u0.ru_rss && u0.ru_minflt > 0);
+
+    char *buffer = malloc(NPAGES * PGSIZE);
+    assert(buffer != NULL);
+    touch(buffer, 0);
+    assert(getrusage(0, &u1) == 0);
+    assert(u1.ru_rss >= u0.ru_rss + NPAGES && u1.ru_maxrss >= u1.ru_rss);
+    assert(u1.ru_minflt >= u0.ru_minflt + NPAGES);
+    cprintf("rss %d -> %d pages, %d -> %d minor faults.\n",
+            u0.ru_rss, u1.ru_rss, u0.ru_minflt, u1.ru_minflt);
+
+    // a small memory group forces the buffers into swap and back
+    int id = memgroup_create(LIMIT);
+    assert(id > 0 && memgroup_attach(id, 0) == 0);
+    char *buffer2 = malloc(NPAGES * PGSIZE);
+    assert(buffer2 != NULL);
+    touch(buffer2, 1);
+    check(buffer, 0);
+    check(buffer2, 1);
+    assert(getrusage(0, &u1) == 0);
+    cprintf("rss %d, maxrss %d, swap %d, %d swapouts, %d major faults.\n",
+            u1.ru_rss, u1.ru_maxrss, u1.ru_swap, u1.ru_swapouts, u1.ru_majflt);
+    assert(u1.ru_swapouts > 0 && u1.ru_swap > 0 && u1.ru_majflt > 0);
+    assert(u1.ru_rss + u1.ru_swap >= NPAGES * 2);
+    assert(memgroup_attach(0, 0) == 0);
+
+    free(buffer2);
+    free(buffer);
+    cprintf("rusagetest pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,69 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_WORKERS     8
+#define MIN_EFFICIENCY  60              // the least speedup per worker with -strict, in percent
+
+const unsigned int total = 32 * 1024 * 1024;
+
+// spin - the same CPU-bound work in every worker, no memory traffic
+unsigned int
+spin(unsigned int n) {
+    unsigned int i, x = 1;
+    for (i = 0; i < n; i ++) {
+        x = x * 1103515245 + 12345;
+    }
+    return x;
+}
+
+// run - split the work among nworkers processes, return the msecs it took. each
+//     - worker exits with its result, which must be the right one.
+unsigned int
+run(int nworkers) {
+    int pids[MAX_WORKERS], results[MAX_WORKERS], i;
+    unsigned int time = gettime_msec();
+    for (i = 0; i < nworkers; i ++) {
+        if ((pids[i] = fork()) == 0) {
+            exit(spin(total / nworkers));
+        }
+        assert(pids[i] > 0);
+    }
+    for (i = 0; i < nworkers; i ++) {
+        assert(waitpid(pids[i], results + i) == 0);
+    }
+    time = gettime_msec() - time;
+
+    int expected = spin(total / nworkers);
+    for (i = 0; i < nworkers; i ++) {
+        assert(results[i] == expected);
+    }
+    return time;
+}
+
+// the speedup is a wall-clock ratio, it depends on how the host runs the cpus
+// (under qemu without MTTCG they share one host thread), so it is only printed.
+// with -strict, the workers up to the number of cpus must run in parallel:
+// under -smp 4, four workers are at least 2.4 times faster than one.
+int
+main(int argc, char **argv) {
+    bool strict = (argc > 1 && strcmp(argv[1], "-strict") == 0);
+    int nworkers, cpus = ncpu();
+    unsigned int base = run(1);
+    cprintf("smpbench: %d cpus, 1 worker, %d msecs.\n", cpus, base);
+    for (nworkers = 2; nworkers <= MAX_WORKERS; nworkers *= 2) {
+        unsigned int time = run(nworkers);
+        if (time == 0) {
+            time = 1;
+        }
+        unsigned int speedup = base * 100 / time;
+        cprintf("smpbench: %d workers, %d msecs, speedup %d.%02d.\n", nworkers, time,
+                speedup / 100, speedup % 100);
+        if (strict && nworkers <= cpus) {
+            assert(speedup >= nworkers * MIN_EFFICIENCY);
+        }
+    }
+    cprintf("smpbench pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <malloc.h>
+#include <rusage.h>
+
+#define PGSIZE          4096
+#define NPAGES          512     // 2MB
+#define LIMIT           128     // the memory group pushing the pages to swap
+#define NCHILDS         4
+
+// the children fault on the same swap entries at once: the first fault on an
+// entry reads it into a locked swap cache page, the others wait for the read
+// instead of reading it again, and the faults on other entries go on meanwhile.
+
+void
+fill(char *buffer) {
+    int i;
+    for (i = 0; i < NPAGES; i ++) {
+        buffer[i * PGSIZE] = (char)(i * i);
+        buffer[i * PGSIZE + PGSIZE - 1] = (char)i;
+    }
+}
+
+// check - read the pages from first on, by step (odd, so all pages are read)
+void
+check(char *buffer, int first, int step) {
+    int i, n;
+    for (n = 0, i = first; n < NPAGES; n ++, i = (i + step) % NPAGES) {
+        assert(buffer[i * PGSIZE] == (char)(i * i));
+        assert(buffer[i * PGSIZE + PGSIZE - 1] == (char)i);
+    }
+}
+
+int
+main(void) {
+    int id = memgroup_create(LIMIT);
+    assert(id > 0 && memgroup_attach(id, 0) == 0);
+
+    char *buffer = malloc(NPAGES * PGSIZE);
+    assert(buffer != NULL);
+    fill(buffer);
+
+    struct rusage usage;
+    assert(getrusage(0, &usage) == 0);
+    assert(usage.ru_swap > 0);
+    cprintf("swapin: %d pages in swap.\n", usage.ru_swap);
+
+    // the children share the swap entries of the buffer with the parent
+    int pids[NCHILDS], i, exit_code, majflt = 0;
+    for (i = 0; i < NCHILDS; i ++) {
+        if ((pids[i] = fork()) == 0) {
+            // half of them read the pages in the same order, the others not
+            check(buffer, (i % 2 == 0) ? 0 : i * 37, (i % 2 == 0) ? 1 : 2 * i + 1);
+            assert(getrusage(0, &usage) == 0);
+            exit(usage.ru_majflt);
+        }
+        assert(pids[i] > 0);
+    }
+    check(buffer, 0, 1);
+
+    for (i = 0; i < NCHILDS; i ++) {
+        assert(waitpid(pids[i], &exit_code) == 0 && exit_code >= 0);
+        majflt += exit_code;
+    }
+    cprintf("swapin: %d childs read the pages back, %d major faults.\n", NCHILDS, majflt);
+
+    free(buffer);
+    assert(memgroup_attach(0, 0) == 0);
+    cprintf("swapintest pass.\n");
+    return 0;
+}
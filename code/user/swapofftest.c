@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <error.h>
+#include <malloc.h>
+
+// the IDE devices of kern/fs/fs.h
+#define KERN_DEV_NO     0
+#define SWAP_DEV_NO     1
+#define DISK0_DEV_NO    2
+#define SWAP1_DEV_NO    3
+
+const int size = 8 * 1024 * 1024;
+char *buffer;
+
+void
+check_buffer(int round) {
+    int i;
+    for (i = 0; i < size; i ++) {
+        assert(buffer[i] == (char)(i * i + round));
+    }
+}
+
+void
+fill_buffer(int round) {
+    int i;
+    for (i = 0; i < size; i ++) {
+        buffer[i] = (char)(i * i + round);
+    }
+}
+
+int
+main(void) {
+    assert(swapon(KERN_DEV_NO, 0) == -E_BUSY);
+    assert(swapon(DISK0_DEV_NO, 0) == -E_BUSY);
+    assert(swapon(SWAP_DEV_NO, 0) == -E_EXISTS);
+    assert(swapoff(DISK0_DEV_NO) == -E_NO_DEV);
+
+    // the kernel uses the second swap disk at boot if there is one
+    bool swap1 = (swapon(SWAP1_DEV_NO, 0) == -E_EXISTS);
+    cprintf("second swap device %s.\n", swap1 ? "found" : "not found");
+
+    assert((buffer = malloc(size)) != NULL);
+    fill_buffer(0);
+    check_buffer(0);
+
+    if (swap1) {
+        assert(swapoff(SWAP1_DEV_NO) == 0);
+        assert(swapoff(SWAP1_DEV_NO) == -E_NO_DEV);
+        check_buffer(0);
+        cprintf("swapoff second device ok.\n");
+
+        // prefer it, then move everything off the first one
+        assert(swapon(SWAP1_DEV_NO, 1) == 0);
+        fill_buffer(1);
+        assert(swapoff(SWAP_DEV_NO) == 0);
+        check_buffer(1);
+        cprintf("swapoff first device ok.\n");
+
+        assert(swapon(SWAP_DEV_NO, 0) == 0);
+        assert(swapoff(SWAP1_DEV_NO) == 0);
+        check_buffer(1);
+        assert(swapon(SWAP1_DEV_NO, 0) == 0);
+    }
+    else {
+        assert(swapoff(SWAP_DEV_NO) == 0);
+        check_buffer(0);
+        assert(swapon(SWAP_DEV_NO, 0) == 0);
+    }
+
+    fill_buffer(2);
+    check_buffer(2);
+    free(buffer);
+    cprintf("swapofftest pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,60 @@
+#include <ulib.h>
+#include <stdio.h>
+
+#define NSLEEPERS       128
+#define SLEEP_TICKS     100000
+#define TIMEOUT         1000
+
+const int rounds = 2000;
+
+int sleepers[NSLEEPERS];
+
+// pingpong - pass rounds events to a child, both sides wait with a timeout, so
+//          - each event arms and cancels a timer or two
+int
+pingpong(void) {
+    int pid, i, from, event, exit_code;
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < rounds; i ++) {
+            assert(recv_event_timeout(&from, &event, TIMEOUT) == 0 && event == i);
+        }
+        exit(0);
+    }
+    assert(pid > 0);
+
+    unsigned int time = gettime_msec();
+    for (i = 0; i < rounds; i ++) {
+        assert(send_event_timeout(pid, i, TIMEOUT) == 0);
+    }
+    time = gettime_msec() - time;
+    assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+    return time;
+}
+
+int
+main(void) {
+    unsigned int time0 = pingpong();
+
+    // keep the timers busy with sleepers of different timeouts
+    int i, exit_code;
+    for (i = 0; i < NSLEEPERS; i ++) {
+        if ((sleepers[i] = fork()) == 0) {
+            sleep(SLEEP_TICKS + i * 7);
+            exit(0xdead);
+        }
+        assert(sleepers[i] > 0);
+    }
+    sleep(10);
+
+    unsigned int time1 = pingpong();
+
+    for (i = 0; i < NSLEEPERS; i ++) {
+        assert(kill(sleepers[i]) == 0);
+        assert(waitpid(sleepers[i], &exit_code) == 0);
+    }
+    cprintf("timerbench: %d events, %d msecs with no sleepers, %d msecs with %d sleepers.\n",
+            rounds, time0, time1, NSLEEPERS);
+    cprintf("timerbench pass.\n");
+    return 0;
+}
+
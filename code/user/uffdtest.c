@@ -0,0 +1,103 @@
+#include <ulib.h>
+#include <thread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <error.h>
+
+#define PGSIZE          4096
+
+const int npages = 16;
+
+uintptr_t base;
+int nwrites;
+char stage[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+int
+handler(void *arg) {
+    int i, pid, event;
+    for (i = 0; i < npages; i ++) {
+        assert(recv_event(&pid, &event) == 0);
+        uintptr_t addr = (uintptr_t)event & ~(PGSIZE - 1);
+        assert(addr >= base && addr < base + npages * PGSIZE);
+        if (event & UFFD_EVENT_WRITE) {
+            nwrites ++;
+        }
+        int index = (addr - base) / PGSIZE, j;
+        for (j = 0; j < PGSIZE; j ++) {
+            stage[j] = (char)(index + j);
+        }
+        assert(uffd_copy(addr, (uintptr_t)stage, PGSIZE) == 0);
+        assert(uffd_copy(addr, (uintptr_t)stage, PGSIZE) != 0);
+    }
+    return 0xbee;
+}
+
+int
+lazy_handler(void *arg) {
+    int pid, event;
+    assert(recv_event(&pid, &event) == 0);
+    return 0;
+}
+
+// the handler exits without filling the page, the waiting fault must fail
+void
+handler_exit(void) {
+    int pid, exit_code;
+    if ((pid = fork()) == 0) {
+        uintptr_t addr = 0;
+        assert(mmap(&addr, PGSIZE, MMAP_WRITE) == 0 && addr != 0);
+        thread_t tid;
+        assert(thread(lazy_handler, NULL, &tid) == 0);
+        assert(uffd_register(addr, PGSIZE, tid.pid) == 0);
+        *(volatile char *)addr = 0;
+        exit(0xbad);
+    }
+    assert(pid > 0);
+    assert(waitpid(pid, &exit_code) == 0 && exit_code == -E_KILLED);
+}
+
+int
+main(void) {
+    assert(mmap(&base, npages * PGSIZE, MMAP_WRITE) == 0 && base != 0);
+
+    thread_t tid;
+    assert(thread(handler, NULL, &tid) == 0);
+
+    assert(uffd_register(base, npages * PGSIZE, getpid()) != 0);
+    assert(uffd_register(base, npages * PGSIZE + PGSIZE, tid.pid) != 0);
+    assert(uffd_register(base, npages * PGSIZE, tid.pid) == 0);
+    assert(uffd_copy(base + 1, (uintptr_t)stage, PGSIZE) != 0);
+
+    cprintf("uffd step1 ok.\n");
+
+    char *buffer = (char *)base;
+    int i, j, exit_code;
+    for (i = 0; i < npages - 1; i ++) {
+        for (j = 0; j < PGSIZE; j ++) {
+            assert(buffer[i * PGSIZE + j] == (char)(i + j));
+        }
+    }
+    buffer[(npages - 1) * PGSIZE] = 0x5A;
+    assert(buffer[(npages - 1) * PGSIZE] == 0x5A);
+    assert(buffer[(npages - 1) * PGSIZE + 1] == (char)(npages - 1 + 1));
+
+    assert(thread_wait(&tid, &exit_code) == 0 && exit_code == 0xbee);
+    assert(nwrites == 1);
+
+    cprintf("uffd step2 ok.\n");
+
+    assert(madvise(base, PGSIZE, MADV_DONTNEED) == 0);
+    assert(uffd_unregister(base, npages * PGSIZE) == 0);
+    assert(buffer[0] == 0 && buffer[PGSIZE] == (char)1);
+
+    cprintf("uffd step3 ok.\n");
+
+    handler_exit();
+
+    cprintf("uffd step4 ok.\n");
+
+    assert(munmap(base, npages * PGSIZE) == 0);
+
+    cprintf("uffdtest pass.\n");
+    return 0;
+}
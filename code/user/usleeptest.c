@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <mboxbuf.h>
+#include <error.h>
+
+// sleeps and timeouts of usec, far shorter than a tick
+const int rounds = 20;
+const unsigned int usec = 500;
+
+// gettime_msec counts ticks, rounds short waits must end in fewer than rounds ticks
+void
+check_elapsed(const char *what, unsigned int time) {
+    time = gettime_msec() - time;
+    cprintf("usleeptest: %d %s of %d usecs in %d ticks.\n", rounds, what, usec, time);
+    assert(time < rounds / 2);
+}
+
+int
+main(void) {
+    int i;
+    unsigned int time = gettime_msec();
+    for (i = 0; i < rounds; i ++) {
+        assert(usleep(usec) == 0);
+    }
+    check_elapsed("sleeps", time);
+
+    sem_t sem_id;
+    assert((sem_id = sem_init(0)) > 0);
+    time = gettime_msec();
+    for (i = 0; i < rounds; i ++) {
+        assert(sem_wait_timeout_usec(sem_id, usec) == -E_TIMEOUT);
+    }
+    check_elapsed("semaphore timeouts", time);
+    assert(sem_free(sem_id) == 0);
+
+    int mbox_id;
+    struct mboxbuf __buf, *buf = &__buf;
+    char data[16];
+    buf->data = data, buf->size = sizeof(data);
+    assert((mbox_id = mbox_init(1)) >= 0);
+    time = gettime_msec();
+    for (i = 0; i < rounds; i ++) {
+        assert(mbox_recv_timeout_usec(mbox_id, buf, usec) == -E_TIMEOUT);
+    }
+    check_elapsed("mbox timeouts", time);
+    assert(mbox_free(mbox_id) == 0);
+
+    // the ticks still count while the cpu is idle
+    time = gettime_msec();
+    assert(sleep(10) == 0);
+    time = gettime_msec() - time;
+    assert(time >= 10 && time < 20);
+
+    cprintf("usleeptest pass.\n");
+    return 0;
+}
+